@@ -0,0 +1,241 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (c) 2024 NVIDIA CORPORATION & AFFILIATES. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <ctype.h>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <stdlib.h>
+
+#include "anc_payload.h"
+
+// RTP header and RFC 8331 payload header
+static constexpr size_t anc_headers_size = 20;
+static constexpr uint32_t anc_ssrc = 0x0eb51dbf;
+// against a typo in the frame/field index of a file
+static constexpr unsigned long anc_file_max_fields = 1 << 20;
+
+/**
+ * Appends bit fields to a byte vector, most significant bit first.
+ */
+class BitWriter
+{
+public:
+    explicit BitWriter(std::vector<uint8_t> &bytes) : m_bytes(bytes) { }
+
+    void put(uint32_t value, unsigned bits)
+    {
+        while (bits--) {
+            if (m_bits % 8 == 0) {
+                m_bytes.push_back(0);
+            }
+            m_bytes.back() |= (uint8_t)((value >> bits & 1) << (7 - m_bits % 8));
+            ++m_bits;
+        }
+    }
+    /**
+     * Pads with zero bits up to a 32-bit boundary.
+     */
+    void align32()
+    {
+        if (m_bits % 32) {
+            put(0, 32 - m_bits % 32);
+        }
+    }
+
+private:
+    std::vector<uint8_t> &m_bytes;
+    size_t m_bits = 0;
+};
+
+static uint8_t *put_be16(uint8_t *p, uint16_t value)
+{
+    p[0] = (uint8_t)(value >> 8);
+    p[1] = (uint8_t)value;
+    return p + 2;
+}
+
+static uint8_t *put_be32(uint8_t *p, uint32_t value)
+{
+    p = put_be16(p, (uint16_t)(value >> 16));
+    return put_be16(p, (uint16_t)value);
+}
+
+/**
+ * Returns the 10-bit word of an 8-bit value: b8 is its even parity, b9 the
+ * inverse of b8.
+ */
+static uint16_t anc_word(uint8_t value)
+{
+    uint8_t parity = value ^ (value >> 4);
+    parity ^= parity >> 2;
+    parity ^= parity >> 1;
+    parity &= 1;
+    return (uint16_t)(value | parity << 8 | (parity ^ 1) << 9);
+}
+
+/**
+ * Writes an ANC data packet of the RFC 8331 payload, with its checksum: the sum
+ * of the 9 low bits of the DID, SDID, data count and user data words.
+ */
+static void write_anc_packet(BitWriter &bits, const AncDataPacket &packet)
+{
+    bits.put(packet.c, 1);
+    bits.put(packet.line_number, 11);
+    bits.put(packet.horizontal_offset, 12);
+    // S and StreamNum: not a multi-stream interface
+    bits.put(0, 8);
+
+    uint16_t checksum = 0;
+    auto put_word = [&bits, &checksum](uint8_t value) {
+        const uint16_t word = anc_word(value);
+        bits.put(word, 10);
+        checksum += word;
+    };
+    put_word(packet.did);
+    put_word(packet.sdid);
+    put_word((uint8_t)packet.user_data.size());
+    for (uint8_t value : packet.user_data) {
+        put_word(value);
+    }
+    checksum &= 0x1ff;
+    bits.put(checksum | (checksum >> 8 ^ 1) << 9, 10);
+    bits.align32();
+}
+
+bool AncPacketTemplates::build(uint8_t payload_type, const std::vector<std::vector<AncDataPacket>> &fields,
+                               size_t max_packet_size)
+{
+    m_templates.clear();
+    m_field_templates.clear();
+    m_max_packet_size = 0;
+    if (fields.empty()) {
+        std::cerr << "No ANC frame/field to send" << std::endl;
+        return false;
+    }
+
+    std::map<std::vector<uint8_t>, size_t> template_indexes;
+    for (size_t i = 0; i < fields.size(); ++i) {
+        const std::vector<AncDataPacket> &packets = fields[i];
+        std::vector<uint8_t> packet(anc_headers_size);
+        BitWriter bits(packet);
+        for (const AncDataPacket &anc_packet : packets) {
+            if (anc_packet.user_data.size() > UINT8_MAX) {
+                std::cerr << "ANC data packet of frame/field " << i << " has more than 255 user data words"
+                          << std::endl;
+                return false;
+            }
+            write_anc_packet(bits, anc_packet);
+        }
+        if (packets.size() > UINT8_MAX || packet.size() > max_packet_size) {
+            std::cerr << "ANC data packets of frame/field " << i << " don't fit in an RTP packet of "
+                      << max_packet_size << " bytes" << std::endl;
+            return false;
+        }
+
+        uint8_t *p = packet.data();
+        // version 2, every packet ends its frame/field
+        p[0] = 0x80;
+        p[1] = (uint8_t)(0x80 | (payload_type & 0x7f));
+        // the sequence number and the timestamp are set by the sender
+        put_be32(p + 8, anc_ssrc);
+        // so is the extended sequence number
+        put_be16(p + 14, (uint16_t)(packet.size() - anc_headers_size));
+        p[16] = (uint8_t)packets.size();
+        // so is F, the other bits are reserved
+
+        auto it = template_indexes.find(packet);
+        if (it == template_indexes.end()) {
+            it = template_indexes.emplace(packet, m_templates.size()).first;
+            m_max_packet_size = std::max(m_max_packet_size, packet.size());
+            m_templates.push_back(std::move(packet));
+        }
+        m_field_templates.push_back(it->second);
+    }
+    return true;
+}
+
+static bool parse_number(const std::string &word, int base, unsigned long max, unsigned long &value)
+{
+    if (word.empty() || !isxdigit((unsigned char)word[0])) {
+        return false;
+    }
+    char *end;
+    value = strtoul(word.c_str(), &end, base);
+    return *end == '\0' && value <= max;
+}
+
+bool load_anc_file(const std::string &path, std::vector<std::vector<AncDataPacket>> &fields)
+{
+    std::ifstream is(path);
+    if (!is) {
+        std::cerr << "Failed to open ANC file " << path << std::endl;
+        return false;
+    }
+
+    fields.clear();
+    std::string line;
+    for (size_t line_index = 1; std::getline(is, line); ++line_index) {
+        std::istringstream line_is(line);
+        std::vector<std::string> words;
+        std::string word;
+        while (line_is >> word) {
+            words.push_back(word);
+        }
+        if (words.empty() || words[0][0] == '#') {
+            continue;
+        }
+
+        unsigned long field;
+        unsigned long line_number;
+        unsigned long did;
+        unsigned long sdid;
+        bool valid = words.size() >= 4 && words.size() - 4 <= UINT8_MAX &&
+            parse_number(words[0], 10, anc_file_max_fields - 1, field) &&
+            parse_number(words[1], 10, 0x7ff, line_number) &&
+            parse_number(words[2], 16, UINT8_MAX, did) &&
+            parse_number(words[3], 16, UINT8_MAX, sdid);
+        AncDataPacket packet;
+        for (size_t i = 4; valid && i < words.size(); ++i) {
+            unsigned long value;
+            valid = parse_number(words[i], 16, UINT8_MAX, value);
+            packet.user_data.push_back((uint8_t)value);
+        }
+        if (!valid) {
+            std::cerr << "Invalid ANC data packet at line " << line_index << " of " << path << std::endl;
+            return false;
+        }
+        packet.line_number = (uint16_t)line_number;
+        packet.did = (uint8_t)did;
+        packet.sdid = (uint8_t)sdid;
+        if (field >= fields.size()) {
+            fields.resize(field + 1);
+        }
+        fields[field].push_back(std::move(packet));
+    }
+    if (is.bad()) {
+        std::cerr << "Failed reading ANC file " << path << std::endl;
+        return false;
+    }
+    if (fields.empty()) {
+        std::cerr << "ANC file " << path << " has no ANC data packet" << std::endl;
+        return false;
+    }
+    return true;
+}
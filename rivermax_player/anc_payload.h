@@ -0,0 +1,97 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (c) 2024 NVIDIA CORPORATION & AFFILIATES. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _RIVERMAX_PLAYER_ANC_PAYLOAD_H_
+#define _RIVERMAX_PLAYER_ANC_PAYLOAD_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * ANC data packet of SMPTE ST 291-1 with 8-bit user data words, the parity bits
+ * of its 10-bit words and its checksum are computed when it is encoded.
+ */
+struct AncDataPacket
+{
+    bool c = false;                  // color difference channel
+    uint16_t line_number = 0;        // 11 bits
+    uint16_t horizontal_offset = 0;  // 12 bits
+    uint8_t did = 0;
+    uint8_t sdid = 0;
+    std::vector<uint8_t> user_data;  // up to 255 words
+};
+
+/**
+ * Reads the ANC data packets of a sequence of frames/fields from a text file,
+ * one packet per line:
+ *
+ *   <frame/field> <line> <DID> <SDID> [<user data word> ...]
+ *
+ * The frame/field index and the line number are decimal, the DID, SDID and the
+ * user data words are hexadecimal bytes, e.g. DID 61 SDID 01 for CEA-708
+ * captions or DID 60 SDID 60 for ancillary timecode. Empty lines and lines
+ * starting with '#' are skipped. The packets of a frame/field are sent in the
+ * order of the file, the sequence lasts up to the highest index and repeats.
+ *
+ * @param [in] path - file to read;
+ * @param [out] fields - ANC data packets of every frame/field of the sequence,
+ *                       none for the frames/fields not in the file.
+ *
+ * @return true on success.
+ */
+bool load_anc_file(const std::string &path, std::vector<std::vector<AncDataPacket>> &fields);
+
+/**
+ * RTP packets of an RFC 8331 (SMPTE ST 2110-40) stream built once per distinct
+ * content of a frame/field: the sender only copies the packet of a frame/field
+ * and sets its sequence number, timestamp and field bits, the other headers,
+ * the parity bits and the checksums are in the template.
+ */
+class AncPacketTemplates
+{
+public:
+    /**
+     * @param [in] payload_type - RTP payload type;
+     * @param [in] fields - ANC data packets of every frame/field of the
+     *                      sequence, at least one frame/field;
+     * @param [in] max_packet_size - size limit of an RTP packet.
+     *
+     * @return false if the packets of a frame/field don't fit in one RTP packet.
+     */
+    bool build(uint8_t payload_type, const std::vector<std::vector<AncDataPacket>> &fields,
+               size_t max_packet_size);
+    /**
+     * Returns the RTP packet of frame/field @p index of the stream.
+     */
+    const std::vector<uint8_t> &packet(uint64_t index) const
+    {
+        return m_templates[m_field_templates[index % m_field_templates.size()]];
+    }
+    size_t period() const { return m_field_templates.size(); }
+    size_t template_count() const { return m_templates.size(); }
+    size_t max_packet_size() const { return m_max_packet_size; }
+
+private:
+    std::vector<std::vector<uint8_t>> m_templates;
+    // template of every frame/field of the sequence
+    std::vector<size_t> m_field_templates;
+    size_t m_max_packet_size = 0;
+};
+
+#endif // _RIVERMAX_PLAYER_ANC_PAYLOAD_H_
@@ -0,0 +1,187 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (c) 2024 NVIDIA CORPORATION & AFFILIATES. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <math.h>
+#include <string.h>
+#include "audio_pack.h"
+
+// SIMD kernels are built with per-function target attributes, so the rest of the player
+// keeps the baseline ISA and the kernel is chosen at runtime.
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define AUDIO_PACK_X86_SIMD
+#include <immintrin.h>
+#endif
+
+// 2^31, and the largest float below it: a float sample of 1.0 or more saturates to 0x7fffff
+static constexpr float flt_scale = 2147483648.0f;
+static constexpr float flt_max = 2147483520.0f;
+
+static inline void store_s24be(uint8_t *dst, uint32_t sample)
+{
+    dst[0] = (uint8_t)(sample >> 24);
+    dst[1] = (uint8_t)(sample >> 16);
+    dst[2] = (uint8_t)(sample >> 8);
+}
+
+static inline uint32_t s16_to_s32(int16_t sample)
+{
+    return (uint32_t)(uint16_t)sample << 16;
+}
+
+static inline uint32_t flt_to_s32(float sample)
+{
+    // NaN saturates to the maximum, as with the min of the SIMD kernels
+    float scaled = sample * flt_scale;
+    scaled = scaled < flt_max ? scaled : flt_max;
+    scaled = scaled > -flt_scale ? scaled : -flt_scale;
+    return (uint32_t)(int32_t)lrintf(scaled);
+}
+
+void pack_s16_s24be_scalar(uint8_t *dst, const void *src, size_t samples)
+{
+    const int16_t *in = static_cast<const int16_t*>(src);
+    for (size_t sample = 0; sample < samples; ++sample, dst += 3) {
+        store_s24be(dst, s16_to_s32(in[sample]));
+    }
+}
+
+void pack_s32_s24be_scalar(uint8_t *dst, const void *src, size_t samples)
+{
+    const int32_t *in = static_cast<const int32_t*>(src);
+    for (size_t sample = 0; sample < samples; ++sample, dst += 3) {
+        store_s24be(dst, (uint32_t)in[sample]);
+    }
+}
+
+void pack_flt_s24be_scalar(uint8_t *dst, const void *src, size_t samples)
+{
+    const float *in = static_cast<const float*>(src);
+    for (size_t sample = 0; sample < samples; ++sample, dst += 3) {
+        store_s24be(dst, flt_to_s32(in[sample]));
+    }
+}
+
+void pack_planar_pcm_s24be(uint8_t *dst, const uint8_t *const *planes, PcmSampleFormat format, size_t channels,
+                           size_t first_sample, size_t samples)
+{
+    const size_t stride = channels * 3;
+    for (size_t channel = 0; channel < channels; ++channel) {
+        uint8_t *out = dst + channel * 3;
+        switch (format) {
+        case PcmSampleFormat::S16: {
+            const int16_t *in = reinterpret_cast<const int16_t*>(planes[channel]) + first_sample;
+            for (size_t sample = 0; sample < samples; ++sample, out += stride) {
+                store_s24be(out, s16_to_s32(in[sample]));
+            }
+            break;
+        }
+        case PcmSampleFormat::S32: {
+            const int32_t *in = reinterpret_cast<const int32_t*>(planes[channel]) + first_sample;
+            for (size_t sample = 0; sample < samples; ++sample, out += stride) {
+                store_s24be(out, (uint32_t)in[sample]);
+            }
+            break;
+        }
+        case PcmSampleFormat::FLT: {
+            const float *in = reinterpret_cast<const float*>(planes[channel]) + first_sample;
+            for (size_t sample = 0; sample < samples; ++sample, out += stride) {
+                store_s24be(out, flt_to_s32(in[sample]));
+            }
+            break;
+        }
+        }
+    }
+}
+
+#ifdef AUDIO_PACK_X86_SIMD
+
+/*
+ * The AVX2 kernels bring 8 samples to 32-bit words, a byte shuffle takes the 3 high bytes of every word in
+ * big-endian order to the low 12 bytes of each lane, and a dword permutation joins the two lanes into the
+ * 24 bytes of the 8 samples.
+ */
+
+__attribute__((target("avx2")))
+static inline void store8_s24be_avx2(uint8_t *dst, __m256i words)
+{
+    const __m256i shuffle = _mm256_setr_epi8(
+        3, 2, 1, 7, 6, 5, 11, 10, 9, 15, 14, 13, -1, -1, -1, -1,
+        3, 2, 1, 7, 6, 5, 11, 10, 9, 15, 14, 13, -1, -1, -1, -1);
+    const __m256i join = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7);
+    const __m256i packed = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(words, shuffle), join);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), _mm256_castsi256_si128(packed));
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + 16), _mm256_extracti128_si256(packed, 1));
+}
+
+__attribute__((target("avx2")))
+static void pack_s16_s24be_avx2(uint8_t *dst, const void *src, size_t samples)
+{
+    const int16_t *in = static_cast<const int16_t*>(src);
+    for (; samples >= 8; samples -= 8, in += 8, dst += 24) {
+        const __m128i s16 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in));
+        store8_s24be_avx2(dst, _mm256_slli_epi32(_mm256_cvtepi16_epi32(s16), 16));
+    }
+    pack_s16_s24be_scalar(dst, in, samples);
+}
+
+__attribute__((target("avx2")))
+static void pack_s32_s24be_avx2(uint8_t *dst, const void *src, size_t samples)
+{
+    const int32_t *in = static_cast<const int32_t*>(src);
+    for (; samples >= 8; samples -= 8, in += 8, dst += 24) {
+        store8_s24be_avx2(dst, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in)));
+    }
+    pack_s32_s24be_scalar(dst, in, samples);
+}
+
+__attribute__((target("avx2")))
+static void pack_flt_s24be_avx2(uint8_t *dst, const void *src, size_t samples)
+{
+    const float *in = static_cast<const float*>(src);
+    const __m256 scale = _mm256_set1_ps(flt_scale);
+    const __m256 max = _mm256_set1_ps(flt_max);
+    for (; samples >= 8; samples -= 8, in += 8, dst += 24) {
+        // below -2^31 the conversion gives 0x80000000, the minimum
+        const __m256 scaled = _mm256_min_ps(_mm256_mul_ps(_mm256_loadu_ps(in), scale), max);
+        store8_s24be_avx2(dst, _mm256_cvtps_epi32(scaled));
+    }
+    pack_flt_s24be_scalar(dst, in, samples);
+}
+
+#endif // AUDIO_PACK_X86_SIMD
+
+pack_pcm_s24be_func get_pack_pcm_s24be(PcmSampleFormat format, const char **kernel_name)
+{
+    struct Kernel {
+        pack_pcm_s24be_func func[3];
+        const char *name;
+    };
+    static const Kernel kernel = []() -> Kernel {
+#ifdef AUDIO_PACK_X86_SIMD
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            return { { pack_s16_s24be_avx2, pack_s32_s24be_avx2, pack_flt_s24be_avx2 }, "avx2" };
+        }
+#endif
+        return { { pack_s16_s24be_scalar, pack_s32_s24be_scalar, pack_flt_s24be_scalar }, "scalar" };
+    }();
+
+    if (kernel_name) {
+        *kernel_name = kernel.name;
+    }
+    return kernel.func[(int)format];
+}
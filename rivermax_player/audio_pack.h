@@ -0,0 +1,81 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (c) 2024 NVIDIA CORPORATION & AFFILIATES. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _RIVERMAX_PLAYER_AUDIO_PACK_H_
+#define _RIVERMAX_PLAYER_AUDIO_PACK_H_
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Formats of the decoded PCM samples the packers convert from, native endian.
+ */
+enum class PcmSampleFormat
+{
+    S16,
+    S32,
+    FLT
+};
+
+/**
+ * Converts interleaved PCM samples to 24-bit big-endian samples (L24, SMPTE
+ * ST 2110-30).
+ *
+ * The samples keep their 24 most significant bits, as the PCM_S24BE encoder of
+ * FFmpeg does after converting to 32-bit samples: 16-bit samples get a low zero
+ * byte, 32-bit samples lose their low byte, and float samples are scaled by
+ * 2^31, rounded to the nearest integer and saturated.
+ *
+ * @param [out] dst - destination, must hold @p samples * 3 bytes;
+ * @param [in] src - @p samples samples, of all the channels;
+ * @param [in] samples - number of samples to convert.
+ */
+typedef void (*pack_pcm_s24be_func)(uint8_t *dst, const void *src, size_t samples);
+
+/**
+ * Portable implementations of @ref pack_pcm_s24be_func.
+ */
+void pack_s16_s24be_scalar(uint8_t *dst, const void *src, size_t samples);
+void pack_s32_s24be_scalar(uint8_t *dst, const void *src, size_t samples);
+void pack_flt_s24be_scalar(uint8_t *dst, const void *src, size_t samples);
+
+/**
+ * Returns the fastest @ref pack_pcm_s24be_func for samples of @p format
+ * supported by the running CPU.
+ *
+ * The selection is done once, on the first call.
+ *
+ * @param [in] format - format of the samples;
+ * @param [out] kernel_name - if not null, set to a printable name of the selected kernel.
+ */
+pack_pcm_s24be_func get_pack_pcm_s24be(PcmSampleFormat format, const char **kernel_name = nullptr);
+
+/**
+ * Interleaves planar PCM samples into 24-bit big-endian samples, converted as
+ * by @ref pack_pcm_s24be_func.
+ *
+ * @param [out] dst - destination, must hold @p samples * @p channels * 3 bytes;
+ * @param [in] planes - one plane of samples per channel;
+ * @param [in] format - format of the samples;
+ * @param [in] channels - number of channels;
+ * @param [in] first_sample - first sample of the planes to convert;
+ * @param [in] samples - number of samples per channel to convert.
+ */
+void pack_planar_pcm_s24be(uint8_t *dst, const uint8_t *const *planes, PcmSampleFormat format, size_t channels,
+                           size_t first_sample, size_t samples);
+
+#endif // _RIVERMAX_PLAYER_AUDIO_PACK_H_
@@ -0,0 +1,129 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (c) 2024 NVIDIA CORPORATION & AFFILIATES. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _RIVERMAX_PLAYER_LOOP_BARRIER_H_
+#define _RIVERMAX_PLAYER_LOOP_BARRIER_H_
+
+#include <atomic>
+#include <cstdint>
+
+/**
+ * Lock-free barrier the streams of a media file meet at the end of every loop.
+ *
+ * Every stream arrives with the first alignment point (frame boundary) it can
+ * continue at, and the last one to arrive ends the loop: all the streams then
+ * continue at the latest of these points. The streams poll @ref released with
+ * the ticket returned by @ref arrive, nothing in the barrier blocks.
+ *
+ * The number of streams, the number of arrived streams and the loop number
+ * (epoch) are kept in one atomic word. The alignment points of a loop are
+ * gathered in the slot of its epoch, two slots are enough: a stream arrives for
+ * the next loop only after it read the result of the previous one, and the slot
+ * of a loop is cleared when the loop before ends, once every stream read it.
+ */
+class LoopBarrier
+{
+public:
+    LoopBarrier() = default;
+    LoopBarrier(const LoopBarrier&) = delete;
+    LoopBarrier &operator=(const LoopBarrier&) = delete;
+
+    /**
+     * Adds a stream, before the streams start.
+     */
+    void add_stream()
+    {
+        m_state.fetch_add(stream_unit);
+    }
+    /**
+     * Counts the stream at the end of its loop.
+     *
+     * @param [in] alignment_point - first alignment point the stream can continue at;
+     * @param [out] ticket - ticket to poll @ref released with.
+     *
+     * @return true if the stream was the last one and ended the loop.
+     */
+    bool arrive(uint64_t alignment_point, uint32_t &ticket)
+    {
+        uint64_t state = m_state.load(std::memory_order_acquire);
+        // the loop can't end before this stream arrived
+        ticket = epoch(state);
+        std::atomic<uint64_t> &slot = m_alignment_points[ticket & 1];
+        uint64_t latest = slot.load(std::memory_order_relaxed);
+        while (latest < alignment_point &&
+               !slot.compare_exchange_weak(latest, alignment_point, std::memory_order_relaxed)) {
+        }
+        for (;;) {
+            const bool last = arrived(state) + 1 >= streams(state);
+            if (last) {
+                // every other stream is waiting for this loop, the previous result was read
+                m_alignment_points[(ticket + 1) & 1].store(0, std::memory_order_relaxed);
+            }
+            const uint64_t next = last ? next_epoch(state) : state + 1;
+            if (m_state.compare_exchange_weak(state, next, std::memory_order_acq_rel)) {
+                return last;
+            }
+        }
+    }
+    /**
+     * @return true once the loop of @p ticket ended, @p alignment_point is then
+     *         where the streams continue.
+     */
+    bool released(uint32_t ticket, uint64_t &alignment_point) const
+    {
+        if (epoch(m_state.load(std::memory_order_acquire)) == ticket) {
+            return false;
+        }
+        alignment_point = m_alignment_points[ticket & 1].load(std::memory_order_relaxed);
+        return true;
+    }
+    /**
+     * Removes a stream that stopped, the other streams don't wait for it anymore.
+     */
+    void leave()
+    {
+        uint64_t state = m_state.load(std::memory_order_acquire);
+        for (;;) {
+            uint64_t next = state - stream_unit;
+            // the streams that arrived go on without this one
+            if (streams(next) && arrived(next) >= streams(next)) {
+                m_alignment_points[(epoch(next) + 1) & 1].store(0, std::memory_order_relaxed);
+                next = next_epoch(next);
+            }
+            if (m_state.compare_exchange_weak(state, next, std::memory_order_acq_rel)) {
+                return;
+            }
+        }
+    }
+
+private:
+    // state: epoch in the high 32 bits, streams in bits 16-31, arrived streams in bits 0-15
+    static constexpr uint64_t stream_unit = 1 << 16;
+
+    static uint32_t epoch(uint64_t state) { return (uint32_t)(state >> 32); }
+    static uint32_t streams(uint64_t state) { return (uint32_t)(state >> 16) & 0xffff; }
+    static uint32_t arrived(uint64_t state) { return (uint32_t)state & 0xffff; }
+    static uint64_t next_epoch(uint64_t state)
+    {
+        return (uint64_t)(epoch(state) + 1) << 32 | (uint64_t)streams(state) << 16;
+    }
+
+    std::atomic<uint64_t> m_state{ 0 };
+    std::atomic<uint64_t> m_alignment_points[2] = { {0}, {0} };
+};
+
+#endif // _RIVERMAX_PLAYER_LOOP_BARRIER_H_
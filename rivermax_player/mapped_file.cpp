@@ -0,0 +1,123 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (c) 2024 NVIDIA CORPORATION & AFFILIATES. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <iostream>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#include <windows.h>
+#endif
+
+#include "mapped_file.h"
+
+bool MappedFile::open(const std::string &path, bool sequential)
+{
+    unmap();
+#ifdef __linux__
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "Failed to open " << path << std::endl;
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) || !st.st_size) {
+        std::cerr << path << " is empty" << std::endl;
+        ::close(fd);
+        return false;
+    }
+    void *data = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED) {
+        std::cerr << "Failed to map " << path << std::endl;
+        return false;
+    }
+    if (sequential) {
+        madvise(data, st.st_size, MADV_SEQUENTIAL);
+    }
+    m_data = static_cast<const uint8_t*>(data);
+    m_size = st.st_size;
+#else
+    // Windows reads mapped files ahead by itself, the readers prefetch what they need next
+    (void)sequential;
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL, nullptr);
+    LARGE_INTEGER size;
+    if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &size) || !size.QuadPart) {
+        std::cerr << "Failed to open " << path << std::endl;
+        if (file != INVALID_HANDLE_VALUE) {
+            CloseHandle(file);
+        }
+        return false;
+    }
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    void *data = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    if (!data) {
+        std::cerr << "Failed to map " << path << std::endl;
+        if (mapping) {
+            CloseHandle(mapping);
+        }
+        CloseHandle(file);
+        return false;
+    }
+    m_file_handle = file;
+    m_mapping_handle = mapping;
+    m_data = static_cast<const uint8_t*>(data);
+    m_size = (size_t)size.QuadPart;
+#endif
+    return true;
+}
+
+void MappedFile::prefetch(size_t offset, size_t size) const
+{
+#ifdef __linux__
+    // madvise needs a page aligned address
+    const size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+    const size_t aligned_offset = offset / page_size * page_size;
+    madvise(const_cast<uint8_t*>(m_data + aligned_offset), size + offset - aligned_offset, MADV_WILLNEED);
+#else
+    WIN32_MEMORY_RANGE_ENTRY range;
+    range.VirtualAddress = const_cast<uint8_t*>(m_data + offset);
+    range.NumberOfBytes = size;
+    PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#endif
+}
+
+void MappedFile::unmap()
+{
+    if (m_data) {
+#ifdef __linux__
+        munmap(const_cast<uint8_t*>(m_data), m_size);
+#else
+        UnmapViewOfFile(m_data);
+        CloseHandle(m_mapping_handle);
+        CloseHandle(m_file_handle);
+        m_mapping_handle = nullptr;
+        m_file_handle = nullptr;
+#endif
+    }
+    m_data = nullptr;
+    m_size = 0;
+}
+
+MappedFile::~MappedFile()
+{
+    unmap();
+}
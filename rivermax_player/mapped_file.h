@@ -0,0 +1,65 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (c) 2024 NVIDIA CORPORATION & AFFILIATES. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _RIVERMAX_PLAYER_MAPPED_FILE_H_
+#define _RIVERMAX_PLAYER_MAPPED_FILE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * Read-only memory mapping of a whole file.
+ */
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile &operator=(const MappedFile&) = delete;
+    ~MappedFile();
+
+    /**
+     * Maps @p path, an already mapped file is unmapped first.
+     *
+     * @param [in] path - file to map;
+     * @param [in] sequential - the file is read from start to end, the kernel
+     *                          reads ahead aggressively and drops the pages
+     *                          behind sooner.
+     *
+     * @return true on success.
+     */
+    bool open(const std::string &path, bool sequential = false);
+    void unmap();
+    const uint8_t *data() const { return m_data; }
+    size_t size() const { return m_size; }
+    /**
+     * Asks the kernel to start reading @p size bytes at @p offset, if they are
+     * not in the page cache yet, so that the reader does not block on page faults.
+     */
+    void prefetch(size_t offset, size_t size) const;
+
+private:
+    const uint8_t *m_data = nullptr;
+    size_t m_size = 0;
+#ifndef __linux__
+    void *m_file_handle = nullptr;
+    void *m_mapping_handle = nullptr;
+#endif
+};
+
+#endif // _RIVERMAX_PLAYER_MAPPED_FILE_H_
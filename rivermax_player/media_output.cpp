@@ -0,0 +1,406 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (c) 2024 NVIDIA CORPORATION & AFFILIATES. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <iostream>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+#include "rt_threads.h"
+#include "media_output.h"
+#include "pcap_file.h"
+
+// HDS isn't used so the streams have only one sub block
+static constexpr size_t subblock_count = 1;
+static constexpr size_t subblock_id = subblock_count - 1;
+
+class RivermaxOutputStream : public MediaOutputStream
+{
+public:
+    bool create(const MediaOutputStreamParams &params, bool wait_for_events);
+
+    void set_chunk_packet_count(size_t packets) override
+    {
+        rmx_output_media_set_chunk_packet_count(&m_chunk_handle, packets);
+    }
+    rmx_status get_next_chunk() override
+    {
+        return rmx_output_media_get_next_chunk(&m_chunk_handle);
+    }
+    void set_pause_after_commit() override
+    {
+        rmx_output_media_set_chunk_option(&m_chunk_handle, RMX_OUTPUT_PAUSE_AFTER_COMMIT);
+    }
+    uint8_t *chunk_strides() override
+    {
+        return static_cast<uint8_t*>(rmx_output_media_get_chunk_strides(&m_chunk_handle, subblock_id));
+    }
+    uint16_t *chunk_packet_sizes() override
+    {
+        return rmx_output_media_get_chunk_packet_sizes(&m_chunk_handle, subblock_id);
+    }
+    rmx_status commit_chunk(uint64_t time_ns) override
+    {
+        return rmx_output_media_commit_chunk(&m_chunk_handle, time_ns);
+    }
+    rmx_status cancel_unsent_chunks() override
+    {
+        return rmx_output_media_cancel_unsent_chunks(&m_chunk_handle);
+    }
+    void wait_for_free_chunk() override
+    {
+        if (m_wait_for_events) {
+            m_event_mgr.request_notification(m_id);
+        }
+    }
+    rmx_status destroy() override
+    {
+        return rmx_output_media_destroy_stream(m_id);
+    }
+
+private:
+    std::vector<rmx_output_media_mem_block> m_blocks;
+    rmx_output_media_chunk_handle m_chunk_handle;
+    EventMgr m_event_mgr;
+    bool m_wait_for_events = false;
+};
+
+bool RivermaxOutputStream::create(const MediaOutputStreamParams &params, bool wait_for_events)
+{
+    m_blocks.resize(params.block_count);
+    rmx_output_media_init_mem_blocks(m_blocks.data(), m_blocks.size());
+    for (auto &block : m_blocks) {
+        rmx_output_media_set_chunk_count(&block, params.chunks_in_block);
+        rmx_output_media_set_sub_block_count(&block, subblock_count);
+        // without a layout the stream is in dynamic mode, the sizes are set for every chunk
+        if (params.packet_sizes) {
+            rmx_output_media_set_packet_layout(&block, subblock_id, params.packet_sizes);
+        }
+    }
+
+    rmx_output_media_stream_params stream_params;
+    memset(&stream_params, 0, sizeof(stream_params));
+    rmx_output_media_init(&stream_params);
+    rmx_output_media_set_sdp(&stream_params, params.sdp.c_str());
+    rmx_output_media_assign_mem_blocks(&stream_params, m_blocks.data(), m_blocks.size());
+    if (params.dscp >= 0) {
+        rmx_output_media_set_dscp(&stream_params, (uint8_t)params.dscp);
+    }
+    rmx_output_media_set_packets_per_frame(&stream_params, params.packets_in_frame);
+    rmx_output_media_set_packets_per_chunk(&stream_params, params.packets_in_chunk);
+    rmx_output_media_set_stride_size(&stream_params, subblock_id, params.stride_size);
+    rmx_output_media_set_idx_in_sdp(&stream_params, params.idx_in_sdp);
+
+    rmx_status status = rmx_output_media_create_stream(&stream_params, &m_id);
+    if (status != RMX_OK) {
+        std::cerr << "failed creating " << params.name << " output stream, got status:" << status << std::endl;
+        return false;
+    }
+
+    m_wait_for_events = wait_for_events;
+    if (m_wait_for_events && !m_event_mgr.init(m_id)) {
+        rmx_output_media_destroy_stream(m_id);
+        return false;
+    }
+    rmx_output_media_init_chunk_handle(&m_chunk_handle, m_id);
+    return true;
+}
+
+std::unique_ptr<MediaOutputStream> RivermaxOutput::create_stream(const MediaOutputStreamParams &params,
+                                                                 bool wait_for_events)
+{
+    std::unique_ptr<RivermaxOutputStream> stream(new RivermaxOutputStream);
+    if (!stream->create(params, wait_for_events)) {
+        return nullptr;
+    }
+    return std::unique_ptr<MediaOutputStream>(stream.release());
+}
+
+class NullOutputStream : public MediaOutputStream
+{
+public:
+    NullOutputStream(rmx_stream_id id, const MediaOutputStreamParams &params, bool timed,
+                     const std::function<uint64_t()> &get_time_ns, bool wait_for_events);
+
+    void set_chunk_packet_count(size_t packets) override
+    {
+        m_packet_count = std::min(packets, m_packets_in_chunk);
+    }
+    rmx_status get_next_chunk() override;
+    void set_pause_after_commit() override { }
+    uint8_t *chunk_strides() override
+    {
+        return m_strides + m_chunk * m_packets_in_chunk * m_stride_size;
+    }
+    uint16_t *chunk_packet_sizes() override
+    {
+        return m_sizes.data() + m_chunk * m_packets_in_chunk;
+    }
+    rmx_status commit_chunk(uint64_t time_ns) override;
+    rmx_status cancel_unsent_chunks() override
+    {
+        m_send_times.clear();
+        m_has_chunk = false;
+        return RMX_OK;
+    }
+    void wait_for_free_chunk() override;
+    rmx_status destroy() override;
+
+protected:
+    /**
+     * Frees the chunks whose send time passed.
+     */
+    void release_sent_chunks();
+
+    const std::string m_name;
+    const size_t m_chunk_count;
+    const size_t m_packets_in_chunk;
+    const size_t m_stride_size;
+    const bool m_timed;
+    const bool m_wait_for_events;
+    const std::function<uint64_t()> m_get_time_ns;
+    std::vector<uint8_t> m_memory;
+    uint8_t *m_strides;
+    std::vector<uint16_t> m_sizes;
+    size_t m_packet_count;
+    // chunk taken last and the next one to take
+    size_t m_chunk = 0;
+    size_t m_next_chunk = 0;
+    bool m_has_chunk = false;
+    // send times of the committed chunks in use, oldest first
+    std::deque<uint64_t> m_send_times;
+    uint64_t m_last_send_time_ns = 0;
+
+    uint64_t m_chunks = 0;
+    uint64_t m_packets = 0;
+    uint64_t m_bytes = 0;
+    uint64_t m_invalid_packets = 0;
+    uint64_t m_unordered_commits = 0;
+};
+
+NullOutputStream::NullOutputStream(rmx_stream_id id, const MediaOutputStreamParams &params, bool timed,
+                                   const std::function<uint64_t()> &get_time_ns, bool wait_for_events)
+    : m_name(params.name)
+    , m_chunk_count(params.block_count * params.chunks_in_block)
+    , m_packets_in_chunk(params.packets_in_chunk)
+    , m_stride_size(params.stride_size)
+    , m_timed(timed)
+    , m_wait_for_events(wait_for_events)
+    , m_get_time_ns(get_time_ns)
+    , m_packet_count(params.packets_in_chunk)
+{
+    m_id = id;
+    // the packetizers expect cache line aligned strides
+    constexpr size_t alignment = 64;
+    m_memory.resize(m_chunk_count * m_packets_in_chunk * m_stride_size + alignment);
+    m_strides = m_memory.data() + (alignment - (uintptr_t)m_memory.data() % alignment) % alignment;
+    m_sizes.resize(m_chunk_count * m_packets_in_chunk, 0);
+    if (params.packet_sizes) {
+        const size_t packets_in_block = params.chunks_in_block * m_packets_in_chunk;
+        for (size_t block = 0; block < params.block_count; ++block) {
+            std::copy(params.packet_sizes, params.packet_sizes + packets_in_block,
+                      m_sizes.begin() + block * packets_in_block);
+        }
+    }
+}
+
+void NullOutputStream::release_sent_chunks()
+{
+    if (m_send_times.empty()) {
+        return;
+    }
+    const uint64_t now = m_get_time_ns();
+    while (!m_send_times.empty() && m_send_times.front() <= now) {
+        m_send_times.pop_front();
+    }
+}
+
+rmx_status NullOutputStream::get_next_chunk()
+{
+    if (m_has_chunk) {
+        return RMX_OK;
+    }
+    release_sent_chunks();
+    if (m_send_times.size() >= m_chunk_count) {
+        return RMX_NO_FREE_CHUNK;
+    }
+    m_chunk = m_next_chunk;
+    m_next_chunk = (m_next_chunk + 1) % m_chunk_count;
+    m_has_chunk = true;
+    return RMX_OK;
+}
+
+rmx_status NullOutputStream::commit_chunk(uint64_t time_ns)
+{
+    if (!m_has_chunk) {
+        return RMX_INVALID_PARAM_1;
+    }
+    const uint8_t *stride = chunk_strides();
+    const uint16_t *sizes = chunk_packet_sizes();
+    for (size_t packet = 0; packet < m_packet_count; ++packet, stride += m_stride_size) {
+        // the zero sizes complete the last chunk of a frame
+        if (!sizes[packet] && m_packet_count == m_packets_in_chunk) {
+            continue;
+        }
+        // RTP version 2
+        if (!sizes[packet] || sizes[packet] > m_stride_size || (stride[0] >> 6) != 2) {
+            ++m_invalid_packets;
+            continue;
+        }
+        ++m_packets;
+        m_bytes += sizes[packet];
+    }
+    ++m_chunks;
+    m_has_chunk = false;
+    m_packet_count = m_packets_in_chunk;
+
+    if (time_ns && time_ns < m_last_send_time_ns) {
+        ++m_unordered_commits;
+    }
+    if (m_timed) {
+        // a chunk without a time is sent right after the previous one
+        m_last_send_time_ns = std::max(m_last_send_time_ns, time_ns);
+        m_send_times.push_back(m_last_send_time_ns);
+    } else if (time_ns) {
+        m_last_send_time_ns = time_ns;
+    }
+    return RMX_OK;
+}
+
+void NullOutputStream::wait_for_free_chunk()
+{
+    if (!m_wait_for_events || m_send_times.empty()) {
+        return;
+    }
+    const uint64_t now = m_get_time_ns();
+    if (m_send_times.front() > now) {
+        std::this_thread::sleep_for(std::chrono::nanoseconds{m_send_times.front() - now});
+    }
+}
+
+rmx_status NullOutputStream::destroy()
+{
+    std::cout << m_name << " output " << m_id << ": dropped " << m_chunks << " chunks, " <<
+        m_packets << " packets, " << m_bytes << " bytes, " << m_invalid_packets << " invalid packets, " <<
+        m_unordered_commits << " commits out of order" << std::endl;
+    m_send_times.clear();
+    return RMX_OK;
+}
+
+static bool check_layout(const MediaOutputStreamParams &params)
+{
+    if (!params.block_count || !params.chunks_in_block || !params.packets_in_chunk || !params.stride_size) {
+        std::cerr << "failed creating " << params.name << " output stream, empty layout" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+std::unique_ptr<MediaOutputStream> NullOutput::create_stream(const MediaOutputStreamParams &params,
+                                                             bool wait_for_events)
+{
+    if (!check_layout(params)) {
+        return nullptr;
+    }
+    return std::unique_ptr<MediaOutputStream>(new NullOutputStream(m_next_id++, params, m_timed, m_get_time_ns,
+                                                                   wait_for_events));
+}
+
+class PcapOutputStream : public NullOutputStream
+{
+public:
+    PcapOutputStream(rmx_stream_id id, const MediaOutputStreamParams &params,
+                     const std::function<uint64_t()> &get_time_ns)
+        : NullOutputStream(id, params, false, get_time_ns, false)
+        , m_packet_interval_ns(params.packet_interval_ns)
+    { }
+
+    bool open(const std::string &path, const std::string &sdp, size_t idx_in_sdp, int dscp);
+    rmx_status commit_chunk(uint64_t time_ns) override;
+    rmx_status destroy() override;
+
+private:
+    const Rational m_packet_interval_ns;
+    PcapFileWriter m_writer;
+    // commit time of the last chunk committed with a time, and the packets sent since
+    uint64_t m_frame_time_ns = 0;
+    uint64_t m_frame_packets = 0;
+};
+
+bool PcapOutputStream::open(const std::string &path, const std::string &sdp, size_t idx_in_sdp, int dscp)
+{
+    PcapStreamAddress address;
+    if (!parse_sdp_stream_address(sdp, idx_in_sdp, address)) {
+        return false;
+    }
+    address.dscp = dscp < 0 ? 0 : (uint8_t)dscp;
+    return m_writer.open(path, address);
+}
+
+rmx_status PcapOutputStream::commit_chunk(uint64_t time_ns)
+{
+    if (m_has_chunk) {
+        if (time_ns) {
+            m_frame_time_ns = time_ns;
+            m_frame_packets = 0;
+        } else if (!m_frame_time_ns) {
+            m_frame_time_ns = m_get_time_ns();
+        }
+        const uint8_t *stride = chunk_strides();
+        const uint16_t *sizes = chunk_packet_sizes();
+        for (size_t packet = 0; packet < m_packet_count; ++packet, stride += m_stride_size) {
+            if (sizes[packet] && sizes[packet] <= m_stride_size) {
+                const uint64_t packet_time_ns = (m_packet_interval_ns * m_frame_packets + m_frame_time_ns).integer();
+                m_writer.write_packet(packet_time_ns, stride, sizes[packet]);
+                ++m_frame_packets;
+            }
+        }
+    }
+    return NullOutputStream::commit_chunk(time_ns);
+}
+
+rmx_status PcapOutputStream::destroy()
+{
+    NullOutputStream::destroy();
+    if (!m_writer.close()) {
+        std::cerr << "Failed writing pcap file " << m_writer.path() << std::endl;
+    } else {
+        std::cout << m_name << " output " << m_id << ": wrote " << m_writer.packets() << " packets to " <<
+            m_writer.path() << std::endl;
+    }
+    return RMX_OK;
+}
+
+std::unique_ptr<MediaOutputStream> PcapOutput::create_stream(const MediaOutputStreamParams &params,
+                                                             bool)
+{
+    if (!check_layout(params)) {
+        return nullptr;
+    }
+    const rmx_stream_id id = m_next_id++;
+    std::unique_ptr<PcapOutputStream> stream(new PcapOutputStream(id, params, m_get_time_ns));
+    const std::string path = m_path_prefix + "_" + params.name + "_" + std::to_string(id) + ".pcap";
+    if (!stream->open(path, params.sdp, params.idx_in_sdp, params.dscp)) {
+        std::cerr << "failed creating " << params.name << " output stream " << path << std::endl;
+        return nullptr;
+    }
+    std::cout << params.name << " stream " << id << " is written to " << path << std::endl;
+    return std::unique_ptr<MediaOutputStream>(stream.release());
+}
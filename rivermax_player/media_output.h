@@ -0,0 +1,184 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (c) 2024 NVIDIA CORPORATION & AFFILIATES. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _RIVERMAX_PLAYER_MEDIA_OUTPUT_H_
+#define _RIVERMAX_PLAYER_MEDIA_OUTPUT_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+#include <rivermax_api.h>
+
+#include "rational.h"
+
+/**
+ * Layout of an output stream: its memory is made of blocks of chunks of packet
+ * strides, in one sub-block.
+ */
+struct MediaOutputStreamParams
+{
+    // kind of the stream, for the messages
+    const char *name = "";
+    std::string sdp;
+    size_t idx_in_sdp = 0;
+    size_t block_count = 1;
+    size_t chunks_in_block = 0;
+    size_t packets_in_chunk = 0;
+    size_t packets_in_frame = 0;
+    uint16_t stride_size = 0;
+    // size of every packet of a block, nullptr if the sizes are set for every chunk
+    const uint16_t *packet_sizes = nullptr;
+    // negative for the default of Rivermax
+    int dscp = -1;
+    // time between the packets of a frame on the wire (SMPTE ST 2110-21 TRS for
+    // video), 0 if they are sent back to back, for the software outputs
+    Rational packet_interval_ns;
+};
+
+/**
+ * Output stream the senders fill and commit chunks of, the calls follow the
+ * rmx_output_media chunk calls of Rivermax and return their statuses.
+ */
+class MediaOutputStream
+{
+public:
+    virtual ~MediaOutputStream() = default;
+
+    rmx_stream_id id() const { return m_id; }
+    /**
+     * Sets the number of packets of the next chunks, all the packets of a chunk by default.
+     */
+    virtual void set_chunk_packet_count(size_t packets) = 0;
+    /**
+     * Takes the next free chunk.
+     *
+     * @return RMX_NO_FREE_CHUNK if all the chunks are in use, see @ref wait_for_free_chunk.
+     */
+    virtual rmx_status get_next_chunk() = 0;
+    /**
+     * Pauses the stream after the chunk taken last is sent, until the next commit.
+     */
+    virtual void set_pause_after_commit() = 0;
+    virtual uint8_t *chunk_strides() = 0;
+    virtual uint16_t *chunk_packet_sizes() = 0;
+    /**
+     * Sends the chunk taken last at @p time_ns, Rivermax time, or right after
+     * the previous one if 0.
+     */
+    virtual rmx_status commit_chunk(uint64_t time_ns) = 0;
+    virtual rmx_status cancel_unsent_chunks() = 0;
+    /**
+     * Waits until a chunk may be free, after @ref get_next_chunk returned
+     * RMX_NO_FREE_CHUNK. Returns at once if the stream was created without
+     * waiting for events.
+     */
+    virtual void wait_for_free_chunk() = 0;
+    /**
+     * @return RMX_BUSY while chunks are being sent, the call is then repeated.
+     */
+    virtual rmx_status destroy() = 0;
+
+protected:
+    rmx_stream_id m_id = 0;
+};
+
+/**
+ * Creates the output streams of the senders.
+ */
+class MediaOutput
+{
+public:
+    virtual ~MediaOutput() = default;
+
+    /**
+     * @param [in] params - layout of the stream;
+     * @param [in] wait_for_events - @ref MediaOutputStream::wait_for_free_chunk
+     *                               waits for the completion events of the stream.
+     *
+     * @return the stream, nullptr on error.
+     */
+    virtual std::unique_ptr<MediaOutputStream> create_stream(const MediaOutputStreamParams &params,
+                                                             bool wait_for_events) = 0;
+};
+
+/**
+ * Sends the streams with Rivermax.
+ */
+class RivermaxOutput : public MediaOutput
+{
+public:
+    std::unique_ptr<MediaOutputStream> create_stream(const MediaOutputStreamParams &params,
+                                                     bool wait_for_events) override;
+};
+
+/**
+ * Sends nothing: the chunks are taken from a ring of memory, and a committed
+ * chunk is checked and dropped, to measure the throughput of the pipeline
+ * without a NIC. Every stream prints what it dropped when it is destroyed.
+ */
+class NullOutput : public MediaOutput
+{
+public:
+    /**
+     * @param [in] timed - a committed chunk is kept until its commit time, as if
+     *                     it was sent then, otherwise it is dropped at once;
+     * @param [in] get_time_ns - current Rivermax time, for @p timed.
+     */
+    NullOutput(bool timed, std::function<uint64_t()> get_time_ns) :
+        m_timed(timed), m_get_time_ns(std::move(get_time_ns)) { }
+
+    std::unique_ptr<MediaOutputStream> create_stream(const MediaOutputStreamParams &params,
+                                                     bool wait_for_events) override;
+
+private:
+    const bool m_timed;
+    const std::function<uint64_t()> m_get_time_ns;
+    std::atomic<rmx_stream_id> m_next_id{ 1 };
+};
+
+/**
+ * Writes every committed packet of a stream in a pcap file instead of sending
+ * it, with Ethernet, IPv4 and UDP headers made of the SDP of the stream. The
+ * timestamp of a packet is its commit time, the next packets of a frame follow
+ * it by @ref MediaOutputStreamParams::packet_interval_ns. The chunks are
+ * checked and dropped as by @ref NullOutput.
+ */
+class PcapOutput : public MediaOutput
+{
+public:
+    /**
+     * @param [in] path_prefix - the file of a stream is <path_prefix>_<kind>_<stream ID>.pcap;
+     * @param [in] get_time_ns - current Rivermax time, for the packets
+     *                           committed without time first.
+     */
+    PcapOutput(std::string path_prefix, std::function<uint64_t()> get_time_ns) :
+        m_path_prefix(std::move(path_prefix)), m_get_time_ns(std::move(get_time_ns)) { }
+
+    std::unique_ptr<MediaOutputStream> create_stream(const MediaOutputStreamParams &params,
+                                                     bool wait_for_events) override;
+
+private:
+    const std::string m_path_prefix;
+    const std::function<uint64_t()> m_get_time_ns;
+    std::atomic<rmx_stream_id> m_next_id{ 1 };
+};
+
+#endif // _RIVERMAX_PLAYER_MEDIA_OUTPUT_H_
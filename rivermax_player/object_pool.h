@@ -0,0 +1,237 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (c) 2024 NVIDIA CORPORATION & AFFILIATES. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _RIVERMAX_PLAYER_OBJECT_POOL_H_
+#define _RIVERMAX_PLAYER_OBJECT_POOL_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+#include <vector>
+
+/**
+ * Pool of reusable objects handed out as std::shared_ptr.
+ *
+ * The pipeline threads pass frames, packets and queue entries to each other as
+ * shared pointers. Instead of allocating a new object for every one of them, a
+ * pool keeps up to a fixed number of released objects: the handle returned by
+ * @ref acquire gives its object back to the pool when the last reference to it
+ * is dropped, from whichever thread drops it, and the next @ref acquire reuses
+ * it. The control block of the handle is stored in the pool slot as well, so
+ * reusing an object allocates nothing.
+ *
+ * Objects are created on demand. When more objects than the capacity are in use
+ * at once the extra ones are destroyed when they are released, so a pool sized
+ * from the depth of the queue it feeds holds no more memory than the queue.
+ */
+template<typename T>
+class ObjectPool
+{
+public:
+    using Create = std::function<T*()>;
+    using Recycle = std::function<void(T*)>;
+    using Destroy = std::function<void(T*)>;
+
+    /**
+     * @param [in] name - name of the pool in the allocation report printed when
+     *                    the pool is destroyed;
+     * @param [in] capacity - number of released objects kept for reuse;
+     * @param [in] create - creates a new object, returns nullptr or throws on failure;
+     * @param [in] recycle - resets an object given back to the pool, e.g. drops
+     *                       the buffers it references;
+     * @param [in] destroy - destroys an object.
+     */
+    static std::shared_ptr<ObjectPool> create(std::string name, size_t capacity, Create create,
+                                              Recycle recycle, Destroy destroy)
+    {
+        // the pool is deleted once it is dropped by its owner and all its objects are released
+        return std::shared_ptr<ObjectPool>(new ObjectPool(std::move(name), capacity, std::move(create),
+                                                          std::move(recycle), std::move(destroy)),
+                                           [](ObjectPool *pool) { pool->close(); });
+    }
+    ObjectPool(const ObjectPool&) = delete;
+    ObjectPool &operator=(const ObjectPool&) = delete;
+
+    /**
+     * Returns a released object, or a new one if there is none.
+     *
+     * @throw std::bad_alloc if a new object can't be created.
+     */
+    std::shared_ptr<T> acquire()
+    {
+        Slot *slot = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            ++m_in_use;
+            if (!m_free.empty()) {
+                slot = m_free.back();
+                m_free.pop_back();
+            }
+        }
+        if (slot) {
+            ++m_reuses;
+        } else {
+            try {
+                std::unique_ptr<Slot> new_slot(new Slot);
+                new_slot->object = m_create();
+                if (!new_slot->object) {
+                    throw std::bad_alloc();
+                }
+                slot = new_slot.release();
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(m_lock);
+                --m_in_use;
+                throw;
+            }
+            ++m_allocations;
+        }
+        return std::shared_ptr<T>(slot->object, Recycler{ this }, SlotAllocator<T>(this, slot));
+    }
+    uint64_t allocations() const { return m_allocations; }
+    uint64_t reuses() const { return m_reuses; }
+
+private:
+    struct Slot
+    {
+        T *object = nullptr;
+        // the control block of the handle, see SlotAllocator
+        alignas(std::max_align_t) unsigned char control_block[128];
+    };
+
+    // resets the object when the last reference to it is dropped
+    struct Recycler
+    {
+        void operator()(T *object) const { pool->m_recycle(object); }
+        ObjectPool *pool;
+    };
+
+    /*
+     * Places the control block of a handle in its slot. The control block is
+     * deallocated after the object was recycled and after the last weak
+     * reference is dropped, only then the slot is given back to the pool.
+     */
+    template<typename U>
+    struct SlotAllocator
+    {
+        using value_type = U;
+
+        SlotAllocator(ObjectPool *_pool, Slot *_slot) : pool(_pool), slot(_slot) { }
+        template<typename V>
+        SlotAllocator(const SlotAllocator<V> &other) : pool(other.pool), slot(other.slot) { }
+
+        U *allocate(size_t n)
+        {
+            static_assert(sizeof(U) <= sizeof(Slot::control_block), "control block doesn't fit in the pool slot");
+            static_assert(alignof(U) <= alignof(std::max_align_t), "control block is over-aligned");
+            if (n != 1) {
+                throw std::bad_alloc();
+            }
+            return reinterpret_cast<U*>(slot->control_block);
+        }
+        void deallocate(U*, size_t) { pool->release(slot); }
+        template<typename V>
+        bool operator==(const SlotAllocator<V> &other) const { return slot == other.slot; }
+        template<typename V>
+        bool operator!=(const SlotAllocator<V> &other) const { return slot != other.slot; }
+
+        ObjectPool *pool;
+        Slot *slot;
+    };
+
+    ObjectPool(std::string name, size_t capacity, Create create, Recycle recycle, Destroy destroy) :
+        m_name(std::move(name))
+        , m_capacity(capacity)
+        , m_create(std::move(create))
+        , m_recycle(std::move(recycle))
+        , m_destroy(std::move(destroy))
+        , m_start(std::chrono::steady_clock::now())
+    {
+        m_free.reserve(m_capacity);
+    }
+
+    ~ObjectPool()
+    {
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count();
+        std::cout << m_name << " pool: " << m_allocations << " allocations, " << m_reuses << " reuses ("
+                  << (seconds > 0 ? m_allocations / seconds : 0) << " allocations/s)" << std::endl;
+        for (Slot *slot : m_free) {
+            destroy(slot);
+        }
+    }
+
+    void close()
+    {
+        bool unused;
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_closed = true;
+            unused = !m_in_use;
+        }
+        if (unused) {
+            delete this;
+        }
+    }
+
+    void release(Slot *slot)
+    {
+        bool keep;
+        bool unused;
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            --m_in_use;
+            keep = !m_closed && m_free.size() < m_capacity;
+            if (keep) {
+                m_free.push_back(slot);
+            }
+            unused = m_closed && !m_in_use;
+        }
+        if (!keep) {
+            destroy(slot);
+        }
+        if (unused) {
+            delete this;
+        }
+    }
+
+    void destroy(Slot *slot)
+    {
+        m_destroy(slot->object);
+        delete slot;
+    }
+
+    const std::string m_name;
+    const size_t m_capacity;
+    const Create m_create;
+    const Recycle m_recycle;
+    const Destroy m_destroy;
+    const std::chrono::steady_clock::time_point m_start;
+    std::mutex m_lock;
+    std::vector<Slot*> m_free;
+    size_t m_in_use = 0;
+    bool m_closed = false;
+    std::atomic<uint64_t> m_allocations{ 0 };
+    std::atomic<uint64_t> m_reuses{ 0 };
+};
+
+#endif // _RIVERMAX_PLAYER_OBJECT_POOL_H_
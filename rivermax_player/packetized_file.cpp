@@ -0,0 +1,166 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (c) 2024 NVIDIA CORPORATION & AFFILIATES. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <iostream>
+#include <string.h>
+
+#include "packetized_file.h"
+
+static uint64_t align_up(uint64_t value, uint64_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+bool PacketizedFileWriter::open(const std::string &path, const PacketizedFileHeader &layout, const uint16_t *sizes)
+{
+    m_path = path;
+    m_file.open(path, std::ios::binary | std::ios::trunc);
+    if (!m_file) {
+        std::cerr << "Failed to create packetized file " << path << std::endl;
+        return false;
+    }
+
+    m_header = layout;
+    memcpy(m_header.magic, PACKETIZED_FILE_MAGIC, sizeof(m_header.magic));
+    m_header.version = PACKETIZED_FILE_VERSION;
+    m_header.header_size = sizeof(PacketizedFileHeader);
+    m_header.alignment = PACKETIZED_FILE_ALIGNMENT;
+    m_header.frame_count = 0;
+    m_header.sizes_offset = sizeof(PacketizedFileHeader);
+    m_header.index_offset = 0;
+    m_frame_offsets.clear();
+
+    // the header is rewritten by close() once the frames are known
+    m_file.write(reinterpret_cast<const char*>(&m_header), sizeof(m_header));
+    m_file.write(reinterpret_cast<const char*>(sizes), m_header.packets_in_field * sizeof(uint16_t));
+    m_offset = m_header.sizes_offset + m_header.packets_in_field * sizeof(uint16_t);
+    return pad_to_alignment();
+}
+
+bool PacketizedFileWriter::pad_to_alignment()
+{
+    static const char zeroes[PACKETIZED_FILE_ALIGNMENT] = {};
+    uint64_t padding = align_up(m_offset, m_header.alignment) - m_offset;
+    m_file.write(zeroes, padding);
+    m_offset += padding;
+    if (!m_file) {
+        std::cerr << "Failed writing packetized file " << m_path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool PacketizedFileWriter::write_frame(const uint8_t *frame)
+{
+    m_frame_offsets.push_back(m_offset);
+    m_file.write(reinterpret_cast<const char*>(frame), m_header.frame_size);
+    m_offset += m_header.frame_size;
+    return pad_to_alignment();
+}
+
+bool PacketizedFileWriter::close()
+{
+    m_header.frame_count = m_frame_offsets.size();
+    m_header.index_offset = m_offset;
+    m_file.write(reinterpret_cast<const char*>(m_frame_offsets.data()), m_frame_offsets.size() * sizeof(uint64_t));
+    m_file.seekp(0);
+    m_file.write(reinterpret_cast<const char*>(&m_header), sizeof(m_header));
+    m_file.close();
+    if (m_file.fail()) {
+        std::cerr << "Failed writing packetized file " << m_path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool PacketizedFile::probe(const std::string &path)
+{
+    char magic[sizeof(PACKETIZED_FILE_MAGIC)] = {};
+    std::ifstream is(path, std::ios::binary);
+    is.read(magic, sizeof(magic));
+    return is && !memcmp(magic, PACKETIZED_FILE_MAGIC, sizeof(magic));
+}
+
+bool PacketizedFile::open(const std::string &path)
+{
+    unmap();
+    if (!m_file.open(path)) {
+        return false;
+    }
+    if (m_file.size() < sizeof(PacketizedFileHeader)) {
+        std::cerr << "Packetized file " << path << " is truncated" << std::endl;
+        unmap();
+        return false;
+    }
+    m_data = m_file.data();
+    m_size = m_file.size();
+
+    m_header = reinterpret_cast<const PacketizedFileHeader*>(m_data);
+    const PacketizedFileHeader &header = *m_header;
+    if (memcmp(header.magic, PACKETIZED_FILE_MAGIC, sizeof(header.magic)) ||
+        header.version != PACKETIZED_FILE_VERSION || header.header_size != sizeof(PacketizedFileHeader)) {
+        std::cerr << "Unsupported packetized file " << path << std::endl;
+        unmap();
+        return false;
+    }
+    // the offsets and counts come from the file, every range is checked against
+    // the space left after its offset so that no sum can wrap around
+    bool valid = header.packets_in_field && (header.fields_in_frame == 1 || header.fields_in_frame == 2) &&
+        header.frame_count &&
+        header.frame_size == (uint64_t)header.packets_in_field * header.fields_in_frame * header.packet_stride &&
+        header.frame_size <= m_size &&
+        header.alignment && !(header.alignment & (header.alignment - 1)) &&
+        header.sizes_offset % sizeof(uint16_t) == 0 && header.sizes_offset <= m_size &&
+        header.packets_in_field <= (m_size - header.sizes_offset) / sizeof(uint16_t) &&
+        header.index_offset % sizeof(uint64_t) == 0 && header.index_offset <= m_size &&
+        header.frame_count <= (m_size - header.index_offset) / sizeof(uint64_t);
+    if (valid) {
+        m_sizes = reinterpret_cast<const uint16_t*>(m_data + header.sizes_offset);
+        m_index = reinterpret_cast<const uint64_t*>(m_data + header.index_offset);
+        valid = *std::max_element(m_sizes, m_sizes + header.packets_in_field) <= header.packet_stride;
+        for (uint64_t i = 0; valid && i < header.frame_count; ++i) {
+            valid = m_index[i] % header.alignment == 0 && m_index[i] <= m_size - header.frame_size;
+        }
+    }
+    if (!valid) {
+        std::cerr << "Packetized file " << path << " is corrupted" << std::endl;
+        unmap();
+        return false;
+    }
+    return true;
+}
+
+void PacketizedFile::prefetch(uint64_t index) const
+{
+    m_file.prefetch(m_index[index], m_header->frame_size);
+}
+
+void PacketizedFile::unmap()
+{
+    m_file.unmap();
+    m_data = nullptr;
+    m_size = 0;
+    m_header = nullptr;
+    m_sizes = nullptr;
+    m_index = nullptr;
+}
+
+PacketizedFile::~PacketizedFile()
+{
+    unmap();
+}
@@ -0,0 +1,151 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (c) 2024 NVIDIA CORPORATION & AFFILIATES. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _RIVERMAX_PLAYER_PACKETIZED_FILE_H_
+#define _RIVERMAX_PLAYER_PACKETIZED_FILE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "mapped_file.h"
+
+/*
+ * Pre-packetized video file.
+ *
+ * Holds the video of a media file exactly as the video sender writes it to the
+ * Rivermax chunks: every frame is the stride buffers of all its packets (both
+ * fields of an interlaced frame, one after the other). The layout is:
+ *
+ *   header | packet sizes of a frame/field | frames ... | frame index
+ *
+ * Every frame starts at a multiple of @ref PACKETIZED_FILE_ALIGNMENT, so that a
+ * mapped file can be copied page by page. The frame index holds the file offset
+ * of every frame. The RTP sequence numbers and timestamps stored in the packets
+ * are meaningless, the sender rewrites them at send time.
+ */
+constexpr char PACKETIZED_FILE_MAGIC[8] = { 'R', 'M', 'A', 'X', 'P', 'K', 'T', '\0' };
+constexpr uint32_t PACKETIZED_FILE_VERSION = 1;
+constexpr uint32_t PACKETIZED_FILE_ALIGNMENT = 4096;
+
+struct PacketizedFileHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    uint32_t alignment;         // alignment of the frames in the file
+    uint32_t pix_format;        // AVPixelFormat of the packetizer
+    uint16_t width;
+    uint16_t height;
+    uint32_t video_type;        // VIDEO_TYPE
+    double fps;
+    uint16_t packet_stride;     // bytes between consecutive packets
+    uint16_t max_packet_size;   // packet size limit the file was packetized with
+    uint32_t packets_in_field;  // packets of a frame/field
+    uint32_t fields_in_frame;
+    uint32_t reserved;
+    uint64_t frame_size;        // bytes of packet strides of a frame
+    uint64_t frame_count;
+    uint64_t sizes_offset;      // packets_in_field uint16_t packet sizes
+    uint64_t index_offset;      // frame_count uint64_t frame offsets
+};
+
+/**
+ * Writes a pre-packetized video file, see @ref PacketizedFileHeader.
+ */
+class PacketizedFileWriter
+{
+public:
+    /**
+     * Creates @p path and writes the stream layout of the file.
+     *
+     * @param [in] path - file to create;
+     * @param [in] layout - header of the file, the magic, version, offsets and
+     *                      frame counters are set by the writer;
+     * @param [in] sizes - @p layout.packets_in_field packet sizes.
+     *
+     * @return true on success.
+     */
+    bool open(const std::string &path, const PacketizedFileHeader &layout, const uint16_t *sizes);
+    /**
+     * Appends a frame of @ref PacketizedFileHeader::frame_size bytes.
+     */
+    bool write_frame(const uint8_t *frame);
+    /**
+     * Writes the frame index, completes the header and closes the file.
+     */
+    bool close();
+    uint64_t frame_count() const { return m_frame_offsets.size(); }
+
+private:
+    bool pad_to_alignment();
+
+    std::ofstream m_file;
+    std::string m_path;
+    PacketizedFileHeader m_header = {};
+    std::vector<uint64_t> m_frame_offsets;
+    uint64_t m_offset = 0;
+};
+
+/**
+ * Read-only memory mapping of a pre-packetized video file.
+ */
+class PacketizedFile
+{
+public:
+    PacketizedFile() = default;
+    PacketizedFile(const PacketizedFile&) = delete;
+    PacketizedFile &operator=(const PacketizedFile&) = delete;
+    ~PacketizedFile();
+
+    /**
+     * Returns true if @p path starts with the magic of a pre-packetized file.
+     */
+    static bool probe(const std::string &path);
+    /**
+     * Maps @p path and validates its header and index.
+     *
+     * @return true on success.
+     */
+    bool open(const std::string &path);
+    const PacketizedFileHeader &header() const { return *m_header; }
+    const uint16_t *packet_sizes() const { return m_sizes; }
+    uint64_t frame_count() const { return m_header->frame_count; }
+    /**
+     * Returns the packet strides of frame @p index.
+     */
+    const uint8_t *frame(uint64_t index) const { return m_data + m_index[index]; }
+    /**
+     * Asks the kernel to start reading frame @p index, if it is not in the page
+     * cache yet, so that the sender does not block on page faults.
+     */
+    void prefetch(uint64_t index) const;
+
+private:
+    void unmap();
+
+    MappedFile m_file;
+    const uint8_t *m_data = nullptr;
+    size_t m_size = 0;
+    const PacketizedFileHeader *m_header = nullptr;
+    const uint16_t *m_sizes = nullptr;
+    const uint64_t *m_index = nullptr;
+};
+
+#endif // _RIVERMAX_PLAYER_PACKETIZED_FILE_H_
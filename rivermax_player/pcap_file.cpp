@@ -0,0 +1,291 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (c) 2024 NVIDIA CORPORATION & AFFILIATES. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pcap_file.h"
+
+// pcap with nanosecond timestamps
+static constexpr uint32_t pcap_magic_ns = 0xa1b23c4d;
+static constexpr uint32_t pcap_linktype_ethernet = 1;
+static constexpr size_t pcap_record_header_size = 16;
+static constexpr size_t eth_header_size = 14;
+static constexpr size_t ipv4_header_size = 20;
+static constexpr size_t udp_header_size = 8;
+static constexpr size_t headers_size = eth_header_size + ipv4_header_size + udp_header_size;
+
+static bool parse_ipv4(const std::string &str, uint32_t &ip)
+{
+    unsigned int b[4];
+    char end;
+    if (sscanf(str.c_str(), "%u.%u.%u.%u%c", &b[0], &b[1], &b[2], &b[3], &end) != 4 ||
+        b[0] > 255 || b[1] > 255 || b[2] > 255 || b[3] > 255) {
+        return false;
+    }
+    ip = b[0] << 24 | b[1] << 16 | b[2] << 8 | b[3];
+    return true;
+}
+
+static std::vector<std::string> split_words(const std::string &line)
+{
+    std::vector<std::string> words;
+    std::istringstream is(line);
+    std::string word;
+    while (is >> word) {
+        words.push_back(word);
+    }
+    return words;
+}
+
+/**
+ * Reads the c= and a=source-filter lines of a section of an SDP.
+ */
+static void parse_sdp_connection(const std::vector<std::string> &lines, std::string &dst, std::string &ttl,
+                                 std::string &src)
+{
+    for (const auto &line : lines) {
+        std::vector<std::string> words = split_words(line);
+        if (line.compare(0, 2, "c=") == 0 && words.size() == 3) {
+            // c=IN IP4 <address>/<ttl>
+            const size_t slash = words[2].find('/');
+            dst = words[2].substr(0, slash);
+            ttl = slash == std::string::npos ? std::string() : words[2].substr(slash + 1);
+        } else if (line.compare(0, 16, "a=source-filter:") == 0 && words.size() >= 5) {
+            // a=source-filter: incl IN IP4 <destination> <source>
+            src = words.back();
+        }
+    }
+}
+
+bool parse_sdp_stream_address(const std::string &sdp, size_t idx_in_sdp, PcapStreamAddress &address)
+{
+    // the session lines, then the lines of every media section
+    std::vector<std::vector<std::string>> sections(1);
+    std::istringstream is(sdp);
+    std::string line;
+    while (std::getline(is, line)) {
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (line.compare(0, 2, "m=") == 0) {
+            sections.emplace_back();
+        }
+        sections.back().push_back(line);
+    }
+    if (idx_in_sdp + 1 >= sections.size()) {
+        std::cerr << "SDP has no media section " << idx_in_sdp << std::endl;
+        return false;
+    }
+
+    std::string dst;
+    std::string ttl;
+    std::string src;
+    parse_sdp_connection(sections[0], dst, ttl, src);
+    const std::vector<std::string> &media = sections[idx_in_sdp + 1];
+    parse_sdp_connection(media, dst, ttl, src);
+
+    // m=<media> <port>[/<number of ports>] <proto> <fmt>
+    const std::vector<std::string> media_words = split_words(media[0]);
+    const unsigned long port = media_words.size() > 1 ? strtoul(media_words[1].c_str(), nullptr, 10) : 0;
+    if (!port || port > UINT16_MAX) {
+        std::cerr << "invalid port in SDP line: " << media[0] << std::endl;
+        return false;
+    }
+    if (!parse_ipv4(dst, address.dst_ip) || !parse_ipv4(src, address.src_ip)) {
+        std::cerr << "failed finding the IPv4 addresses of SDP media section " << idx_in_sdp << std::endl;
+        return false;
+    }
+    address.dst_port = (uint16_t)port;
+    address.src_port = (uint16_t)port;
+    if (!ttl.empty()) {
+        address.ttl = (uint8_t)std::min(255ul, strtoul(ttl.c_str(), nullptr, 10));
+    }
+
+    // multicast MAC 01:00:5e + the low 23 bits of the group, locally administered unicast MAC otherwise
+    const uint8_t multicast_mac[] = { 0x01, 0x00, 0x5e, (uint8_t)(address.dst_ip >> 16 & 0x7f),
+                                      (uint8_t)(address.dst_ip >> 8), (uint8_t)address.dst_ip };
+    const uint8_t unicast_mac[] = { 0x02, 0x00, (uint8_t)(address.dst_ip >> 24), (uint8_t)(address.dst_ip >> 16),
+                                    (uint8_t)(address.dst_ip >> 8), (uint8_t)address.dst_ip };
+    const bool multicast = (address.dst_ip >> 28) == 0xe;
+    memcpy(address.dst_mac, multicast ? multicast_mac : unicast_mac, sizeof(address.dst_mac));
+    const uint8_t src_mac[] = { 0x02, 0x00, (uint8_t)(address.src_ip >> 24), (uint8_t)(address.src_ip >> 16),
+                                (uint8_t)(address.src_ip >> 8), (uint8_t)address.src_ip };
+    memcpy(address.src_mac, src_mac, sizeof(address.src_mac));
+    return true;
+}
+
+static uint8_t *put_be16(uint8_t *p, uint16_t value)
+{
+    p[0] = (uint8_t)(value >> 8);
+    p[1] = (uint8_t)value;
+    return p + 2;
+}
+
+static uint8_t *put_be32(uint8_t *p, uint32_t value)
+{
+    p = put_be16(p, (uint16_t)(value >> 16));
+    return put_be16(p, (uint16_t)value);
+}
+
+static uint16_t ipv4_checksum(const uint8_t *header)
+{
+    uint32_t sum = 0;
+    for (size_t i = 0; i < ipv4_header_size; i += 2) {
+        sum += (uint32_t)header[i] << 8 | header[i + 1];
+    }
+    while (sum >> 16) {
+        sum = (sum & 0xffff) + (sum >> 16);
+    }
+    return (uint16_t)~sum;
+}
+
+PcapFileWriter::PcapFileWriter(size_t buffer_size, size_t buffer_count)
+    : m_buffer_size(buffer_size)
+    , m_full_buffers(buffer_count - 1)
+    , m_free_buffers(buffer_count - 1)
+{
+    m_buffer.reserve(m_buffer_size);
+    for (size_t i = 0; i + 1 < buffer_count; ++i) {
+        std::vector<uint8_t> buffer;
+        buffer.reserve(m_buffer_size);
+        m_free_buffers.push(std::move(buffer));
+    }
+}
+
+PcapFileWriter::~PcapFileWriter()
+{
+    if (m_thread.joinable()) {
+        close();
+    }
+}
+
+bool PcapFileWriter::open(const std::string &path, const PcapStreamAddress &address)
+{
+    m_path = path;
+    m_address = address;
+    m_file.open(path, std::ios::binary | std::ios::trunc);
+    if (!m_file) {
+        std::cerr << "Failed to create pcap file " << path << std::endl;
+        return false;
+    }
+
+    // the readers take the byte order from the magic number
+    struct {
+        uint32_t magic;
+        uint16_t version_major;
+        uint16_t version_minor;
+        int32_t thiszone;
+        uint32_t sigfigs;
+        uint32_t snaplen;
+        uint32_t linktype;
+    } header = { pcap_magic_ns, 2, 4, 0, 0, UINT16_MAX, pcap_linktype_ethernet };
+    m_file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    if (!m_file) {
+        std::cerr << "Failed writing pcap file " << path << std::endl;
+        return false;
+    }
+    m_thread = std::thread(&PcapFileWriter::write_buffers, this);
+    return true;
+}
+
+void PcapFileWriter::write_packet(uint64_t time_ns, const uint8_t *payload, uint16_t size)
+{
+    const size_t frame_size = headers_size + size;
+    if (m_buffer.size() + pcap_record_header_size + frame_size > m_buffer_size) {
+        flush_buffer();
+    }
+    const size_t offset = m_buffer.size();
+    m_buffer.resize(offset + pcap_record_header_size + frame_size);
+    uint8_t *p = m_buffer.data() + offset;
+
+    const uint32_t record[] = { (uint32_t)(time_ns / 1000000000), (uint32_t)(time_ns % 1000000000),
+                                (uint32_t)frame_size, (uint32_t)frame_size };
+    memcpy(p, record, sizeof(record));
+    p += sizeof(record);
+
+    memcpy(p, m_address.dst_mac, sizeof(m_address.dst_mac));
+    memcpy(p + 6, m_address.src_mac, sizeof(m_address.src_mac));
+    p = put_be16(p + 12, 0x0800);
+
+    uint8_t *ip = p;
+    *p++ = 0x45;
+    *p++ = (uint8_t)(m_address.dscp << 2);
+    p = put_be16(p, (uint16_t)(ipv4_header_size + udp_header_size + size));
+    p = put_be16(p, m_ip_id++);
+    // don't fragment
+    p = put_be16(p, 0x4000);
+    *p++ = m_address.ttl;
+    *p++ = 17;  // UDP
+    p = put_be16(p, 0);
+    p = put_be32(p, m_address.src_ip);
+    p = put_be32(p, m_address.dst_ip);
+    put_be16(ip + 10, ipv4_checksum(ip));
+
+    p = put_be16(p, m_address.src_port);
+    p = put_be16(p, m_address.dst_port);
+    p = put_be16(p, (uint16_t)(udp_header_size + size));
+    // no UDP checksum, as allowed over IPv4
+    p = put_be16(p, 0);
+    memcpy(p, payload, size);
+    ++m_packets;
+}
+
+void PcapFileWriter::flush_buffer()
+{
+    if (m_buffer.empty()) {
+        return;
+    }
+    m_full_buffers.push(std::move(m_buffer));
+    if (!m_free_buffers.pop(m_buffer)) {
+        m_buffer = std::vector<uint8_t>();
+    }
+    m_buffer.clear();
+}
+
+void PcapFileWriter::write_buffers()
+{
+    std::vector<uint8_t> buffer;
+    while (m_full_buffers.pop(buffer)) {
+        // after a failure the buffers are only recycled
+        if (!m_failed) {
+            m_file.write(reinterpret_cast<const char*>(buffer.data()), buffer.size());
+            m_failed = !m_file;
+        }
+        buffer.clear();
+        m_free_buffers.push(std::move(buffer));
+    }
+}
+
+bool PcapFileWriter::close()
+{
+    if (!m_thread.joinable()) {
+        return !m_failed;
+    }
+    flush_buffer();
+    m_full_buffers.close();
+    m_thread.join();
+    m_file.close();
+    if (!m_file) {
+        m_failed = true;
+    }
+    return !m_failed;
+}
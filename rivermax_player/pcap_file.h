@@ -0,0 +1,115 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (c) 2024 NVIDIA CORPORATION & AFFILIATES. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _RIVERMAX_PLAYER_PCAP_FILE_H_
+#define _RIVERMAX_PLAYER_PCAP_FILE_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "spsc_channel.h"
+
+/**
+ * Addresses of the Ethernet, IPv4 and UDP headers of a stream.
+ */
+struct PcapStreamAddress
+{
+    uint8_t src_mac[6] = {};
+    uint8_t dst_mac[6] = {};
+    uint32_t src_ip = 0;
+    uint32_t dst_ip = 0;
+    uint16_t src_port = 0;
+    uint16_t dst_port = 0;
+    uint8_t ttl = 64;
+    uint8_t dscp = 0;
+};
+
+/**
+ * Reads the addresses of media section @p idx_in_sdp of an SDP: the port of its
+ * m= line, the destination of its c= line and the source of its
+ * a=source-filter line, the last two may be at session level. The destination
+ * MAC is the multicast MAC of the destination, the source MAC is made of the
+ * source IP.
+ *
+ * @return false if the SDP has no such section or addresses.
+ */
+bool parse_sdp_stream_address(const std::string &sdp, size_t idx_in_sdp, PcapStreamAddress &address);
+
+/**
+ * Writes the packets of a stream in a pcap file (nanosecond timestamps,
+ * Ethernet link), with synthetic Ethernet, IPv4 and UDP headers.
+ *
+ * The records are gathered in large buffers, a full buffer is written by a
+ * thread of the writer, so the caller only copies the packets. The caller
+ * waits only when all the buffers are waiting to be written.
+ */
+class PcapFileWriter
+{
+public:
+    /**
+     * @param [in] buffer_size - size of a buffer in bytes;
+     * @param [in] buffer_count - number of buffers, at least 2.
+     */
+    explicit PcapFileWriter(size_t buffer_size = 4 << 20, size_t buffer_count = 4);
+    ~PcapFileWriter();
+    PcapFileWriter(const PcapFileWriter&) = delete;
+    PcapFileWriter &operator=(const PcapFileWriter&) = delete;
+
+    /**
+     * Creates the file and starts the writer thread.
+     */
+    bool open(const std::string &path, const PcapStreamAddress &address);
+    /**
+     * Adds a UDP packet of payload @p payload.
+     *
+     * @param [in] time_ns - timestamp of the packet, in ns since the epoch.
+     */
+    void write_packet(uint64_t time_ns, const uint8_t *payload, uint16_t size);
+    /**
+     * Writes the remaining packets and closes the file.
+     *
+     * @return false if writing failed.
+     */
+    bool close();
+
+    const std::string &path() const { return m_path; }
+    uint64_t packets() const { return m_packets; }
+
+private:
+    void flush_buffer();
+    void write_buffers();
+
+    const size_t m_buffer_size;
+    std::string m_path;
+    std::ofstream m_file;
+    PcapStreamAddress m_address;
+    uint16_t m_ip_id = 0;
+    uint64_t m_packets = 0;
+    // buffer being filled, the full ones go to the writer thread and come back empty
+    std::vector<uint8_t> m_buffer;
+    SpscChannel<std::vector<uint8_t>> m_full_buffers;
+    SpscChannel<std::vector<uint8_t>> m_free_buffers;
+    std::thread m_thread;
+    std::atomic<bool> m_failed{ false };
+};
+
+#endif // _RIVERMAX_PLAYER_PCAP_FILE_H_
@@ -0,0 +1,96 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (c) 2024 NVIDIA CORPORATION & AFFILIATES. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <iomanip>
+#include <iostream>
+
+#include "queue_monitor.h"
+
+QueueMonitor::~QueueMonitor()
+{
+    stop();
+}
+
+void QueueMonitor::add(std::string name, size_t capacity, std::function<size_t()> occupancy)
+{
+    Queue queue;
+    queue.name = std::move(name);
+    queue.capacity = capacity;
+    queue.occupancy = std::move(occupancy);
+    m_queues.push_back(std::move(queue));
+}
+
+bool QueueMonitor::start(const std::string &csv_path)
+{
+    m_file.open(csv_path, std::ios::trunc);
+    if (!m_file) {
+        std::cerr << "Failed to create queue statistics file " << csv_path << std::endl;
+        return false;
+    }
+    m_file << "time_ms,queue,entries,capacity\n";
+    m_thread = std::thread(&QueueMonitor::run, this);
+    return true;
+}
+
+void QueueMonitor::stop()
+{
+    if (!m_thread.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_stop = true;
+    }
+    m_cv.notify_all();
+    m_thread.join();
+    m_file.close();
+
+    for (const Queue &queue : m_queues) {
+        if (!queue.samples) {
+            continue;
+        }
+        std::cout << queue.name << " queue: " << queue.capacity << " entries, average " << std::fixed <<
+            std::setprecision(1) << (double)queue.sum / queue.samples << ", empty " <<
+            100.0 * queue.empty / queue.samples << "%, full " << 100.0 * queue.full / queue.samples <<
+            "% of the time" << std::defaultfloat << std::endl;
+    }
+}
+
+void QueueMonitor::run()
+{
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point next = start;
+    std::unique_lock<std::mutex> lock(m_lock);
+    while (!m_stop) {
+        sample(std::chrono::steady_clock::now() - start);
+        next += m_period;
+        m_cv.wait_until(lock, next, [this] { return m_stop; });
+    }
+}
+
+void QueueMonitor::sample(std::chrono::steady_clock::duration elapsed)
+{
+    const long long time_ms = std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count();
+    for (Queue &queue : m_queues) {
+        const size_t entries = queue.occupancy();
+        ++queue.samples;
+        queue.sum += entries;
+        queue.empty += entries == 0;
+        queue.full += entries >= queue.capacity;
+        m_file << time_ms << ',' << queue.name << ',' << entries << ',' << queue.capacity << '\n';
+    }
+}
@@ -0,0 +1,95 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (c) 2024 NVIDIA CORPORATION & AFFILIATES. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _RIVERMAX_PLAYER_QUEUE_MONITOR_H_
+#define _RIVERMAX_PLAYER_QUEUE_MONITOR_H_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * Samples the occupancy of the queues between the stages of the player, to
+ * see which stage is the bottleneck: a queue that is mostly full waits for its
+ * consumer, a queue that is mostly empty waits for its producer.
+ *
+ * Every sample is written as a line of a CSV file (time in ms since the start,
+ * queue, entries, capacity), and the occupancy of every queue over the run is
+ * printed when the monitor stops.
+ */
+class QueueMonitor
+{
+public:
+    /**
+     * @param [in] period - time between the samples.
+     */
+    explicit QueueMonitor(std::chrono::milliseconds period) : m_period(period) { }
+    ~QueueMonitor();
+    QueueMonitor(const QueueMonitor&) = delete;
+    QueueMonitor &operator=(const QueueMonitor&) = delete;
+
+    /**
+     * Adds a queue, before @ref start.
+     *
+     * @param [in] name - name of the queue in the CSV file and the summary;
+     * @param [in] capacity - number of entries the queue holds;
+     * @param [in] occupancy - returns the number of entries in the queue, called
+     *                         from the thread of the monitor.
+     */
+    void add(std::string name, size_t capacity, std::function<size_t()> occupancy);
+    /**
+     * Creates the CSV file and starts sampling.
+     */
+    bool start(const std::string &csv_path);
+    /**
+     * Stops sampling and prints the summary.
+     */
+    void stop();
+
+private:
+    struct Queue
+    {
+        std::string name;
+        size_t capacity;
+        std::function<size_t()> occupancy;
+        uint64_t samples = 0;
+        uint64_t sum = 0;
+        uint64_t empty = 0;
+        uint64_t full = 0;
+    };
+
+    void run();
+    void sample(std::chrono::steady_clock::duration elapsed);
+
+    const std::chrono::milliseconds m_period;
+    std::vector<Queue> m_queues;
+    std::ofstream m_file;
+    std::mutex m_lock;
+    std::condition_variable m_cv;
+    bool m_stop = false;
+    std::thread m_thread;
+};
+
+#endif // _RIVERMAX_PLAYER_QUEUE_MONITOR_H_
@@ -0,0 +1,519 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (c) 2024 NVIDIA CORPORATION & AFFILIATES. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+#include "read_ahead_file.h"
+
+// O_DIRECT reads are aligned to that
+static constexpr size_t direct_io_alignment = 4096;
+
+/**
+ * Reads blocks of a file asynchronously for @ref ReadAheadFile, which calls it
+ * from one thread at a time.
+ */
+class ReadAheadEngine
+{
+public:
+    virtual ~ReadAheadEngine() = default;
+
+    virtual const char *name() const = 0;
+    /**
+     * Starts reading @p size bytes at @p offset of the file to @p data, the
+     * completion is reported with @p slot.
+     */
+    virtual bool submit(size_t slot, uint64_t offset, uint8_t *data, size_t size) = 0;
+    /**
+     * Waits for the next completed read.
+     *
+     * @param [out] slot - slot of the read;
+     * @param [out] result - bytes read, -errno on error.
+     */
+    virtual bool wait(size_t &slot, int64_t &result) = 0;
+};
+
+#ifdef __linux__
+
+/**
+ * Reads with an io_uring of its own, set up with the system calls directly so
+ * the player needs no liburing.
+ */
+class IoUringEngine : public ReadAheadEngine
+{
+public:
+    IoUringEngine(int fd, size_t slots) : m_file_fd(fd), m_iovecs(slots) { }
+    ~IoUringEngine() override;
+
+    /**
+     * @return false if the kernel doesn't provide io_uring.
+     */
+    bool init();
+    const char *name() const override { return "io_uring"; }
+    bool submit(size_t slot, uint64_t offset, uint8_t *data, size_t size) override;
+    bool wait(size_t &slot, int64_t &result) override;
+
+private:
+    static int enter(int ring_fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+    {
+        return (int)syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags, nullptr, 0);
+    }
+
+    const int m_file_fd;
+    int m_ring_fd = -1;
+    void *m_sq_ring = MAP_FAILED;
+    void *m_cq_ring = MAP_FAILED;
+    size_t m_sq_ring_size = 0;
+    size_t m_cq_ring_size = 0;
+    io_uring_sqe *m_sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+    size_t m_sqes_size = 0;
+    unsigned *m_sq_tail = nullptr;
+    unsigned m_sq_mask = 0;
+    unsigned *m_sq_array = nullptr;
+    unsigned *m_cq_head = nullptr;
+    unsigned *m_cq_tail = nullptr;
+    unsigned m_cq_mask = 0;
+    io_uring_cqe *m_cqes = nullptr;
+    // the kernel reads the vector of a read when it starts it
+    std::vector<iovec> m_iovecs;
+};
+
+bool IoUringEngine::init()
+{
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    m_ring_fd = (int)syscall(__NR_io_uring_setup, (unsigned)m_iovecs.size(), &params);
+    if (m_ring_fd < 0) {
+        return false;
+    }
+    m_sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    m_cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    const bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap) {
+        m_sq_ring_size = m_cq_ring_size = std::max(m_sq_ring_size, m_cq_ring_size);
+    }
+    m_sq_ring = mmap(nullptr, m_sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring_fd,
+                     IORING_OFF_SQ_RING);
+    if (m_sq_ring == MAP_FAILED) {
+        return false;
+    }
+    m_cq_ring = single_mmap ? m_sq_ring : mmap(nullptr, m_cq_ring_size, PROT_READ | PROT_WRITE,
+                                               MAP_SHARED | MAP_POPULATE, m_ring_fd, IORING_OFF_CQ_RING);
+    if (m_cq_ring == MAP_FAILED) {
+        return false;
+    }
+    m_sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    m_sqes = static_cast<io_uring_sqe*>(mmap(nullptr, m_sqes_size, PROT_READ | PROT_WRITE,
+                                             MAP_SHARED | MAP_POPULATE, m_ring_fd, IORING_OFF_SQES));
+    if (m_sqes == MAP_FAILED) {
+        return false;
+    }
+
+    uint8_t *sq = static_cast<uint8_t*>(m_sq_ring);
+    uint8_t *cq = static_cast<uint8_t*>(m_cq_ring);
+    m_sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    m_sq_mask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    m_sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    m_cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    m_cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    m_cq_mask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    m_cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+    return true;
+}
+
+IoUringEngine::~IoUringEngine()
+{
+    if (m_sqes != MAP_FAILED) {
+        munmap(m_sqes, m_sqes_size);
+    }
+    if (m_cq_ring != MAP_FAILED && m_cq_ring != m_sq_ring) {
+        munmap(m_cq_ring, m_cq_ring_size);
+    }
+    if (m_sq_ring != MAP_FAILED) {
+        munmap(m_sq_ring, m_sq_ring_size);
+    }
+    // the reads still in flight end with the ring
+    if (m_ring_fd >= 0) {
+        ::close(m_ring_fd);
+    }
+}
+
+bool IoUringEngine::submit(size_t slot, uint64_t offset, uint8_t *data, size_t size)
+{
+    // the kernel only reads the tail, it moves the head
+    const unsigned tail = *m_sq_tail;
+    const unsigned index = tail & m_sq_mask;
+    io_uring_sqe &sqe = m_sqes[index];
+    memset(&sqe, 0, sizeof(sqe));
+    m_iovecs[slot].iov_base = data;
+    m_iovecs[slot].iov_len = size;
+    // READV is older than READ, kernel 5.1
+    sqe.opcode = IORING_OP_READV;
+    sqe.fd = m_file_fd;
+    sqe.off = offset;
+    sqe.addr = (uint64_t)(uintptr_t)&m_iovecs[slot];
+    sqe.len = 1;
+    sqe.user_data = slot;
+    m_sq_array[index] = index;
+    __atomic_store_n(m_sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+    int ret;
+    do {
+        ret = enter(m_ring_fd, 1, 0, 0);
+    } while (ret < 0 && errno == EINTR);
+    return ret == 1;
+}
+
+bool IoUringEngine::wait(size_t &slot, int64_t &result)
+{
+    for (;;) {
+        const unsigned head = *m_cq_head;
+        if (head != __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE)) {
+            const io_uring_cqe &cqe = m_cqes[head & m_cq_mask];
+            slot = (size_t)cqe.user_data;
+            result = cqe.res;
+            __atomic_store_n(m_cq_head, head + 1, __ATOMIC_RELEASE);
+            return true;
+        }
+        if (enter(m_ring_fd, 0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR) {
+            return false;
+        }
+    }
+}
+
+/**
+ * Reads with pread on a thread of its own, when io_uring is not available.
+ */
+class ThreadEngine : public ReadAheadEngine
+{
+public:
+    explicit ThreadEngine(int fd) : m_fd(fd), m_thread(&ThreadEngine::run, this) { }
+    ~ThreadEngine() override
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_stop = true;
+        }
+        m_request_cv.notify_one();
+        m_thread.join();
+    }
+
+    const char *name() const override { return "read thread"; }
+    bool submit(size_t slot, uint64_t offset, uint8_t *data, size_t size) override
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_requests.push_back({ slot, offset, data, size, 0 });
+        }
+        m_request_cv.notify_one();
+        return true;
+    }
+    bool wait(size_t &slot, int64_t &result) override
+    {
+        std::unique_lock<std::mutex> lock(m_lock);
+        m_completion_cv.wait(lock, [this] { return !m_completions.empty(); });
+        slot = m_completions.front().slot;
+        result = m_completions.front().result;
+        m_completions.pop_front();
+        return true;
+    }
+
+private:
+    struct Request
+    {
+        size_t slot;
+        uint64_t offset;
+        uint8_t *data;
+        size_t size;
+        int64_t result;
+    };
+
+    void run()
+    {
+        std::unique_lock<std::mutex> lock(m_lock);
+        for (;;) {
+            m_request_cv.wait(lock, [this] { return m_stop || !m_requests.empty(); });
+            if (m_stop) {
+                return;
+            }
+            Request request = m_requests.front();
+            m_requests.pop_front();
+            lock.unlock();
+            const ssize_t ret = pread(m_fd, request.data, request.size, (off_t)request.offset);
+            request.result = ret < 0 ? -errno : ret;
+            lock.lock();
+            m_completions.push_back(request);
+            m_completion_cv.notify_one();
+        }
+    }
+
+    const int m_fd;
+    std::mutex m_lock;
+    std::condition_variable m_request_cv;
+    std::condition_variable m_completion_cv;
+    std::deque<Request> m_requests;
+    std::deque<Request> m_completions;
+    bool m_stop = false;
+    std::thread m_thread;
+};
+
+#endif // __linux__
+
+ReadAheadFile::ReadAheadFile(size_t ahead_size, size_t block_size)
+    : m_block_size(block_size)
+    , m_blocks(std::max<size_t>(2, (ahead_size + block_size - 1) / block_size))
+    , m_buffer(nullptr, free)
+{
+}
+
+ReadAheadFile::~ReadAheadFile()
+{
+    close();
+}
+
+bool ReadAheadFile::open(const std::string &path)
+{
+    close();
+    m_path = path;
+#ifdef __linux__
+    // the blocks are read ahead here, the page cache would only copy them once more
+    m_fd = ::open(path.c_str(), O_RDONLY | O_DIRECT);
+    m_direct = m_fd >= 0;
+    if (!m_direct) {
+        m_fd = ::open(path.c_str(), O_RDONLY);
+    }
+    struct stat st;
+    if (m_fd < 0 || fstat(m_fd, &st)) {
+        std::cerr << "Failed to open " << path << std::endl;
+        close();
+        return false;
+    }
+    if (!m_direct) {
+        posix_fadvise(m_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    }
+    m_size = (uint64_t)st.st_size;
+
+    if (!m_buffer) {
+        void *buffer = nullptr;
+        if (posix_memalign(&buffer, direct_io_alignment, m_blocks.size() * m_block_size)) {
+            std::cerr << "Failed to allocate the read-ahead buffer of " << path << std::endl;
+            close();
+            return false;
+        }
+        m_buffer.reset(static_cast<uint8_t*>(buffer));
+    }
+    for (size_t slot = 0; slot < m_blocks.size(); ++slot) {
+        m_blocks[slot] = Block();
+        m_blocks[slot].data = m_buffer.get() + slot * m_block_size;
+    }
+
+    std::unique_ptr<IoUringEngine> io_uring(new IoUringEngine(m_fd, m_blocks.size()));
+    if (io_uring->init()) {
+        m_engine = std::move(io_uring);
+    } else {
+        m_engine.reset(new ThreadEngine(m_fd));
+    }
+    m_position = 0;
+    m_pending = 0;
+    m_bytes_read = 0;
+    m_stalls = 0;
+    m_stall_time = m_max_stall = std::chrono::steady_clock::duration::zero();
+    m_open_time = std::chrono::steady_clock::now();
+    return true;
+#else
+    std::cerr << "Reading ahead is only supported on Linux, failed to open " << path << std::endl;
+    return false;
+#endif
+}
+
+void ReadAheadFile::close()
+{
+#ifdef __linux__
+    if (m_fd < 0) {
+        return;
+    }
+    if (m_engine) {
+        // the blocks are written until their reads complete
+        size_t slot;
+        int64_t result;
+        while (m_pending && m_engine->wait(slot, result)) {
+            --m_pending;
+        }
+        print_stats();
+        m_engine.reset();
+    }
+    ::close(m_fd);
+    m_fd = -1;
+#endif
+}
+
+int64_t ReadAheadFile::read(uint8_t *buffer, size_t size)
+{
+    if (!m_engine) {
+        return -1;
+    }
+    if (m_position >= m_size) {
+        return 0;
+    }
+    const int64_t index = (int64_t)(m_position / m_block_size);
+    // a block read since the previous calls was expected on time, the first one
+    // of a window is not
+    const bool read_ahead = block(index).index == index;
+    if (!fill_window(index)) {
+        return -1;
+    }
+    Block &current = block(index);
+    if (current.state == Block::State::PENDING) {
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        if (!wait_for(current)) {
+            return -1;
+        }
+        if (read_ahead) {
+            const std::chrono::steady_clock::duration stall = std::chrono::steady_clock::now() - start;
+            ++m_stalls;
+            m_stall_time += stall;
+            m_max_stall = std::max(m_max_stall, stall);
+        }
+    }
+    if (current.state != Block::State::READY) {
+        return -1;
+    }
+    const size_t offset = (size_t)(m_position - (uint64_t)index * m_block_size);
+    const size_t bytes = std::min(size, current.bytes - offset);
+    memcpy(buffer, current.data + offset, bytes);
+    m_position += bytes;
+    return (int64_t)bytes;
+}
+
+int64_t ReadAheadFile::seek(int64_t offset, int whence)
+{
+    const int64_t base = whence == SEEK_SET ? 0 : whence == SEEK_CUR ? (int64_t)m_position : (int64_t)m_size;
+    if (base + offset < 0) {
+        return -1;
+    }
+    m_position = (uint64_t)(base + offset);
+    return (int64_t)m_position;
+}
+
+bool ReadAheadFile::fill_window(int64_t first_index)
+{
+    const int64_t blocks_in_file = (int64_t)((m_size + m_block_size - 1) / m_block_size);
+    const int64_t end_index = std::min(first_index + (int64_t)m_blocks.size(), blocks_in_file);
+    for (int64_t index = first_index; index < end_index; ++index) {
+        Block &next = block(index);
+        if (next.index == index) {
+            continue;
+        }
+        // a block of the previous window after a seek, its buffer is in use until it is read
+        if (!wait_for(next)) {
+            return false;
+        }
+        next.index = index;
+        next.state = Block::State::PENDING;
+        next.bytes = 0;
+        next.size = (size_t)std::min<uint64_t>(m_block_size, m_size - (uint64_t)index * m_block_size);
+        if (!submit((size_t)index % m_blocks.size())) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ReadAheadFile::submit(size_t slot)
+{
+    Block &pending = m_blocks[slot];
+    // a direct read starts and ends aligned: the rest of a short read is read again from
+    // its last aligned offset, and a read of the last block goes past the end of the file,
+    // it stops there
+    pending.read_start = m_direct ? pending.bytes / direct_io_alignment * direct_io_alignment : pending.bytes;
+    const uint64_t offset = (uint64_t)pending.index * m_block_size + pending.read_start;
+    size_t size = pending.size - pending.read_start;
+    if (m_direct) {
+        size = (size + direct_io_alignment - 1) / direct_io_alignment * direct_io_alignment;
+    }
+    if (!m_engine->submit(slot, offset, pending.data + pending.read_start, size)) {
+        std::cerr << "Failed to read " << m_path << " ahead" << std::endl;
+        pending.state = Block::State::FAILED;
+        return false;
+    }
+    ++m_pending;
+    return true;
+}
+
+bool ReadAheadFile::wait_for(const Block &awaited)
+{
+    while (awaited.state == Block::State::PENDING) {
+        size_t slot;
+        int64_t result;
+        if (!m_engine->wait(slot, result)) {
+            return false;
+        }
+        --m_pending;
+        Block &completed = m_blocks[slot];
+        const size_t bytes = result > 0 ? std::min(completed.size, completed.read_start + (size_t)result) : 0;
+        if (bytes <= completed.bytes) {
+            std::cerr << "Failed to read " << m_path << " at " << (uint64_t)completed.index * m_block_size +
+                completed.read_start << ": " << (result < 0 ? strerror((int)-result) : "unexpected end of file") <<
+                std::endl;
+            completed.state = Block::State::FAILED;
+            continue;
+        }
+        m_bytes_read += bytes - completed.bytes;
+        completed.bytes = bytes;
+        if (completed.bytes < completed.size) {
+            // a short read, the rest is read again
+            if (!submit(slot)) {
+                return false;
+            }
+        } else {
+            completed.state = Block::State::READY;
+        }
+    }
+    return true;
+}
+
+void ReadAheadFile::print_stats() const
+{
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_open_time).count();
+    std::cout << m_path << ": read " << (m_bytes_read >> 20) << " MB ahead with " << m_engine->name() <<
+        (m_direct ? " and direct I/O" : "") << ", " << std::fixed << std::setprecision(1) <<
+        (seconds > 0 ? m_bytes_read / seconds / (1 << 20) : 0) << " MB/s on average, " << m_stalls << " stalls";
+    if (m_stalls) {
+        std::cout << " (" << std::chrono::duration<double, std::milli>(m_stall_time).count() << " ms, up to " <<
+            std::chrono::duration<double, std::milli>(m_max_stall).count() << " ms)";
+    }
+    std::cout << std::defaultfloat << std::endl;
+}
@@ -0,0 +1,118 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (c) 2024 NVIDIA CORPORATION & AFFILIATES. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _RIVERMAX_PLAYER_READ_AHEAD_FILE_H_
+#define _RIVERMAX_PLAYER_READ_AHEAD_FILE_H_
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+class ReadAheadEngine;
+
+/**
+ * File read sequentially through a window of large aligned blocks read ahead
+ * of the reader, so a slow read of the storage (a NAS) delays the reads ahead
+ * instead of the reader.
+ *
+ * The blocks are read with io_uring on Linux, or by a thread of the file when
+ * io_uring is not available, with O_DIRECT when the file system supports it.
+ * The reader copies from the blocks and waits only for a block that is not
+ * read yet, which is counted as a stall. A seek out of the window starts a new
+ * window at the new position.
+ *
+ * The throughput of the storage and the stalls are printed when the file is
+ * closed. Only on Linux, @ref open fails elsewhere.
+ */
+class ReadAheadFile
+{
+public:
+    /**
+     * @param [in] ahead_size - bytes read ahead of the reader, at least 2 blocks;
+     * @param [in] block_size - bytes of a read, a multiple of 4096.
+     */
+    explicit ReadAheadFile(size_t ahead_size, size_t block_size = 4 << 20);
+    ~ReadAheadFile();
+    ReadAheadFile(const ReadAheadFile&) = delete;
+    ReadAheadFile &operator=(const ReadAheadFile&) = delete;
+
+    bool open(const std::string &path);
+    /**
+     * Waits for the reads in flight, closes the file and prints its statistics.
+     */
+    void close();
+    /**
+     * Copies up to @p size bytes at the read position and moves it after them.
+     *
+     * @return the bytes copied, 0 at the end of the file, -1 on error.
+     */
+    int64_t read(uint8_t *buffer, size_t size);
+    /**
+     * Moves the read position, as lseek.
+     *
+     * @return the new position, -1 if it is before the start of the file.
+     */
+    int64_t seek(int64_t offset, int whence);
+    uint64_t size() const { return m_size; }
+    const std::string &path() const { return m_path; }
+
+private:
+    struct Block
+    {
+        enum class State { EMPTY, PENDING, READY, FAILED };
+
+        int64_t index = -1;
+        State state = State::EMPTY;
+        // bytes read, and the bytes of the block in the file
+        size_t bytes = 0;
+        size_t size = 0;
+        // where the read in flight starts in the block
+        size_t read_start = 0;
+        uint8_t *data = nullptr;
+    };
+
+    Block &block(int64_t index) { return m_blocks[(size_t)index % m_blocks.size()]; }
+    bool fill_window(int64_t first_index);
+    bool submit(size_t slot);
+    /**
+     * Handles completed reads until @p block is read.
+     */
+    bool wait_for(const Block &block);
+    void print_stats() const;
+
+    const size_t m_block_size;
+    std::vector<Block> m_blocks;
+    std::unique_ptr<uint8_t, void(*)(void*)> m_buffer;
+    std::unique_ptr<ReadAheadEngine> m_engine;
+    std::string m_path;
+    int m_fd = -1;
+    bool m_direct = false;
+    uint64_t m_size = 0;
+    uint64_t m_position = 0;
+    size_t m_pending = 0;
+
+    std::chrono::steady_clock::time_point m_open_time;
+    uint64_t m_bytes_read = 0;
+    uint64_t m_stalls = 0;
+    std::chrono::steady_clock::duration m_stall_time{};
+    std::chrono::steady_clock::duration m_max_stall{};
+};
+
+#endif // _RIVERMAX_PLAYER_READ_AHEAD_FILE_H_
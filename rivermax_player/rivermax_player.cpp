@@ -32,7 +32,14 @@
 #include <atomic>
 #include <sstream>
 #include <algorithm>
+#include <limits>
+#include <queue>
+#include <future>
+#include <cmath>
 #include "rt_threads.h"
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
 #include "readerwriterqueue/readerwriterqueue.h"
 #include "CLI/CLI.hpp"
 // ffmpeg
@@ -41,11 +48,29 @@ extern "C" {
 #include <libavformat/avformat.h>
 #include <libavutil/avutil.h>
 #include <libavutil/pixdesc.h>
+#include <libavutil/imgutils.h>
 #include <libavutil/channel_layout.h>
 #include <libswscale/swscale.h>
 #include <libswresample/swresample.h>
 }
 #include "defs.h"
+#include "video_pack.h"
+#include "video_packetizer.h"
+#include "slice_pool.h"
+#include "audio_pack.h"
+#include "anc_payload.h"
+#include "sample_ring.h"
+#include "mapped_file.h"
+#include "packetized_file.h"
+#include "rtp_header.h"
+#include "object_pool.h"
+#include "spsc_channel.h"
+#include "loop_barrier.h"
+#include "media_output.h"
+#include "queue_monitor.h"
+#include "read_ahead_file.h"
+#include "wake_up.h"
+#include "memory_allocator.h"
 
 #ifndef __linux__
 #pragma comment(lib, "avcodec.lib")
@@ -128,25 +153,50 @@ inline uint64_t align_to_rmax_time(uint64_t time)
 struct queued_data {
     enum {
         e_qdi_ok = 0,
-        e_qdi_eof
+        e_qdi_eof,
+        e_qdi_cached  // end of stream, the next iterations are played from the loop cache
     } queued_data_info = e_qdi_ok;
 
     std::shared_ptr<AVFrame> frame;
-    std::shared_ptr<AVPacket> packet;
 };
 
-using my_queue = ReaderWriterQueue<std::shared_ptr<queued_data>>;
+using media_channel = SpscChannel<std::shared_ptr<queued_data>>;
+using queued_data_pool = ObjectPool<queued_data>;
+
+// a queue between two stages holds at least that many entries
+static constexpr size_t MIN_QUEUE_ENTRIES = 3;
+// entries a stage holds besides those of its queues, as the pools of the stages expect
+static constexpr size_t QUEUE_ENTRIES_IN_USE = 2;
+
+/**
+ * Returns a pool of queue entries for the producer of a queue, see @ref ObjectPool.
+ *
+ * @param [in] name - name of the pool in its allocation report;
+ * @param [in] capacity - entries kept for reuse, the depth of the queue plus the
+ *                        entries held by its producer and consumer.
+ */
+std::shared_ptr<queued_data_pool> create_queued_data_pool(std::string name, size_t capacity)
+{
+    return queued_data_pool::create(std::move(name), capacity,
+                                    [] { return new queued_data; },
+                                    [](queued_data *entry) { *entry = queued_data(); },
+                                    [](queued_data *entry) { delete entry; });
+}
+
+struct VideoFrameCache;
+struct RawVideoFile;
 
 bool loop = false;
+// MB of a media file read ahead of its demuxer, 0 to let FFmpeg read it, see --read-ahead
+size_t read_ahead_mb = 0;
 bool disable_wait_for_event = false;
 bool disable_synchronization = false;
+// creates the output streams of the senders, Rivermax or a null sink
+std::shared_ptr<MediaOutput> media_output;
 uint16_t video_tro_default_modification;
 
-/*
- * since rivermax_player generates the ancillary data and doesn't read it from a file, we need to sleep in order
- * not to flood Rivermax
- */
-int const ancillary_wakeup_delta_ms = 10;
+// period of the lateness reports of the multiplexed senders
+int const multiplexed_sender_report_interval_s = 10;
 
 enum eMediaType_t {
     ancillary = (1 << 0),
@@ -163,6 +213,7 @@ enum affinity_index_t {
     e_video_scaler_index,
     e_video_sender_index,
     e_audio_reader_index,
+    // unused, the audio reader converts the samples, kept for the CPU list of --thread-cpu-affinity
     e_audio_encoder_index,
     e_audio_sender_index,
     // e_ancillary_reader_index,
@@ -175,47 +226,13 @@ const char* affinity_index_name_t[] {
     "Video scaler",
     "Video sender",
     "Audio reader",
-    "Audio encoder",
+    "Audio encoder (unused)",
     "Audio sender",
     // "Ancillary reader",
     // "Ancillary sender",
     "N/A"
 };
 
-struct rtp_header {
-    uint8_t cc : 4;            // CSRC count
-    uint8_t extension : 1;     // Extension bit
-    uint8_t padding : 1;       // Padding bit
-    uint8_t version : 2;       // Version, currently 2
-    uint8_t payload_type : 7;       // Payload type
-    uint8_t marker : 1;        // Marker bit
-    uint16_t sequence_number;        // sequence number
-    uint32_t timestamp;       //  timestamp
-    uint32_t ssrc;      // synchronization source (SSRC) identifier
-};
-
-struct srd_header {
-     uint16_t srd_length;  // SRD Length: 16 bits
-
-     uint8_t srd_row_number_8_to_14_7bit: 7; // srd raw number: 15 bits
-     uint8_t f: 1;  // Field identification: 1 bit
-     uint8_t srd_row_number_0_to_7_8bit; // srd raw number: 15 bits
-
-     uint8_t srd_offset_8_to_14_7bit: 7; // srd offset: 15 bits
-     uint8_t c: 1;  // Field identification: 1 bit
-     uint8_t srd_offset_0_to_7_8bit; // srd offset: 15 bits
-
-     void set_srd_row_number(uint16_t srd_raw_number) {
-         srd_row_number_0_to_7_8bit = (uint8_t)srd_raw_number;
-         srd_row_number_8_to_14_7bit = srd_raw_number>>8;
-     }
-
-     void set_srd_offset(uint16_t srd_offset) {
-         srd_offset_0_to_7_8bit = (uint8_t)srd_offset;
-         srd_offset_8_to_14_7bit = srd_offset>>8;
-     }
- };
-
 struct cst_data  // calculate stream time data
 {
     cst_data() = default;
@@ -284,17 +301,12 @@ struct VideoRmaxData: CpuAffinity
         , int _sample_rate
         , AVPixelFormat _pix_format
         , std::string &_sdp_path
-        , std::shared_ptr<my_queue> &_send_cb
-        , std::shared_ptr<std::condition_variable> &_send_cv
-        , std::shared_ptr<std::mutex> &_send_lock
-        , std::shared_ptr<std::condition_variable> &_sync_cv
-        , std::shared_ptr<std::mutex> &_sync_lock
-        , std::shared_ptr<std::condition_variable> &_eof_cv
-        , std::shared_ptr<double> &_next_frame_field_send_time_ns
-        , double _timestamp_tick
+        , std::shared_ptr<media_channel> &_send_channel
+        , std::shared_ptr<Rational> &_next_frame_field_send_time_ns
+        , const Rational &_timestamp_tick
         , uint16_t _use_max_payload_size
         , bool _allow_padding
-        , std::shared_ptr<std::atomic<int>> &_eof_stream_counter) :
+        , std::shared_ptr<LoopBarrier> &_loop_barrier) :
             CpuAffinity()
             , width(_width)
             , height(_height)
@@ -305,17 +317,12 @@ struct VideoRmaxData: CpuAffinity
             , sample_rate(_sample_rate)
             , pix_format(_pix_format)
             , sdp_path(_sdp_path)
-            , send_cb(_send_cb)
-            , send_cv(_send_cv)
-            , send_lock(_send_lock)
-            , sync_cv(_sync_cv)
-            , sync_lock(_sync_lock)
-            , eof_cv(_eof_cv)
+            , send_channel(_send_channel)
             , next_frame_field_send_time_ns(_next_frame_field_send_time_ns)
             , timestamp_tick(_timestamp_tick)
             , max_payload_size(_use_max_payload_size)
             , allow_padding(_allow_padding)
-            , eof_stream_counter(_eof_stream_counter)
+            , loop_barrier(_loop_barrier)
     { }
 
     //Video
@@ -329,23 +336,29 @@ struct VideoRmaxData: CpuAffinity
     int sample_rate = 0;
     AVPixelFormat pix_format = AV_PIX_FMT_NONE;
     std::string sdp_path;
-    std::shared_ptr<my_queue> send_cb;
-    std::shared_ptr<std::condition_variable> send_cv;
-    std::shared_ptr<std::mutex> send_lock;
-    std::shared_ptr<std::condition_variable> sync_cv;
-    std::shared_ptr<std::mutex> sync_lock;
-    std::shared_ptr<std::condition_variable> eof_cv;
-    std::shared_ptr<double> next_frame_field_send_time_ns;
-    double timestamp_tick = 0.0;
+    std::shared_ptr<media_channel> send_channel;
+    // exact times and RTP timestamps, see @ref calculate_stream_time
+    std::shared_ptr<Rational> next_frame_field_send_time_ns;
+    Rational timestamp_tick;
     uint16_t max_payload_size = 0;
     bool allow_padding = false;
-    std::shared_ptr<std::atomic<int>> eof_stream_counter;
+    // the streams of the media file meet there at the end of every loop
+    std::shared_ptr<LoopBarrier> loop_barrier;
+    // when set, the frames are sent from this file instead of @ref send_channel
+    std::shared_ptr<PacketizedFile> packetized_file;
+    // when set, the frames are read from this file instead of @ref send_channel
+    std::shared_ptr<RawVideoFile> raw_file;
+    // when set, the frames of the first loop iteration are kept for the next ones
+    std::shared_ptr<VideoFrameCache> frame_cache;
+    // threads filling the chunks together with the sender, see VideoPacketizerPool
+    size_t packetizer_threads = 0;
+    std::vector<int> packetizer_cpus;
     void notify_all_cv()
     {
-        eof_stream_counter->fetch_add(1);
-        eof_cv->notify_one();
-        send_cv->notify_all();
-        sync_cv->notify_all();
+        if (loop_barrier) {
+            loop_barrier->leave();
+        }
+        send_channel->close();
     }
 };
 
@@ -353,9 +366,7 @@ struct ScaleDataVideo
 {
     ScaleDataVideo(
         VideoRmaxData &_rmax_data
-        , std::shared_ptr<my_queue> &_conv_cb
-        , std::shared_ptr<std::condition_variable> &_conv_cv
-        , std::shared_ptr<std::mutex> &_conv_lock, int cpu) :
+        , std::shared_ptr<media_channel> &_conv_channel, int cpu) :
         rmax_data(
             _rmax_data.width
             , _rmax_data.height
@@ -366,33 +377,25 @@ struct ScaleDataVideo
             , _rmax_data.sample_rate
             , _rmax_data.pix_format
             , _rmax_data.sdp_path
-            , _rmax_data.send_cb
-            , _rmax_data.send_cv
-            , _rmax_data.send_lock
-            , _rmax_data.sync_cv
-            , _rmax_data.sync_lock
-            , _rmax_data.eof_cv
+            , _rmax_data.send_channel
             , _rmax_data.next_frame_field_send_time_ns
             , _rmax_data.timestamp_tick
             , _rmax_data.max_payload_size
             , _rmax_data.allow_padding
-            , _rmax_data.eof_stream_counter)
-        , conv_cb(_conv_cb)
-        , conv_cv(_conv_cv)
-        , conv_lock(_conv_lock)
+            , _rmax_data.loop_barrier)
+        , conv_channel(_conv_channel)
         {
             rmax_data.set_cpu(cpu);
         }
 
     VideoRmaxData rmax_data;
-    std::shared_ptr<my_queue> conv_cb;
-    std::shared_ptr<std::condition_variable> conv_cv;
-    std::shared_ptr<std::mutex> conv_lock;
+    std::shared_ptr<media_channel> conv_channel;
+    size_t scaler_threads = 0;
+    std::vector<int> scaler_cpus;
     void notify_all_cv()
     {
-        conv_cv->notify_all();
-        rmax_data.send_cv->notify_all();
-        rmax_data.sync_cv->notify_all();
+        conv_channel->close();
+        rmax_data.send_channel->close();
     }
 
 public:
@@ -411,9 +414,7 @@ struct VideoReaderData: CpuAffinity
         , AVCodecParameters *_p_codec_parameters
         , int _video_stream_index
         , std::string _file_path
-        , std::shared_ptr<my_queue> &_conv_cb
-        , std::shared_ptr<std::condition_variable> &_conv_cv
-        , std::shared_ptr<std::mutex> &_conv_lock
+        , std::shared_ptr<media_channel> &_conv_channel
         , VIDEO_TYPE _video_type
         , int cpu) :
             CpuAffinity()
@@ -422,9 +423,7 @@ struct VideoReaderData: CpuAffinity
             , p_codec_parameters(_p_codec_parameters)
             , stream_index(_video_stream_index)
             , file_path(_file_path)
-            , conv_cb(_conv_cb)
-            , conv_cv(_conv_cv)
-            , conv_lock(_conv_lock)
+            , conv_channel(_conv_channel)
             , video_type(_video_type)
     {
         set_cpu(cpu);
@@ -435,15 +434,23 @@ struct VideoReaderData: CpuAffinity
     AVCodecParameters *p_codec_parameters = nullptr;
     int stream_index = -1;
     std::string file_path;
-    std::shared_ptr<my_queue> conv_cb;
-    std::shared_ptr<std::condition_variable> conv_cv;
-    std::shared_ptr<std::mutex> conv_lock;
+    std::shared_ptr<media_channel> conv_channel;
     const char *stream_name = "video";
-    const int ffmpeg_thread_count = 5;
+    // 0 to choose from the cores, see @ref set_decoder_threads
+    int decoder_threads = 0;
+    const int max_auto_decoder_threads = 16;
+    std::vector<int> decoder_cpus;
+    size_t decoders_sharing_cpus = 1;
     VIDEO_TYPE video_type = VIDEO_TYPE::NON_VIDEO;
+    // decides at the end of the first loop iteration if it is cached, see @ref is_loop_cached
+    std::shared_ptr<VideoFrameCache> frame_cache;
+    // the reader queues the frames to the sender and copies them to frame_cache
+    bool caches_frames = false;
+    size_t queue_capacity() const { return conv_channel->capacity(); }
+    bool push(std::shared_ptr<queued_data> &&qdata) { return conv_channel->push(std::move(qdata)); }
     void notify_all_cv()
     {
-        conv_cv->notify_all();
+        conv_channel->close();
     }
 };
 
@@ -460,16 +467,11 @@ struct AudioRmaxData: CpuAffinity
         , uint64_t _ptime_usec
         , int _payload_type
         , std::string &_sdp_path
-        , std::shared_ptr<my_queue> &_send_cb
-        , std::shared_ptr<std::condition_variable> &_send_cv
-        , std::shared_ptr<std::mutex> &_send_lock
-        , std::shared_ptr<std::condition_variable> &_sync_cv
-        , std::shared_ptr<std::mutex> &_sync_lock
-        , std::shared_ptr<std::condition_variable> &_eof_cv
-        , std::shared_ptr<double> &_next_chunk_send_time_ns
-        , double _timestamp_tick
+        , std::shared_ptr<SampleRing> &_sample_ring
+        , std::shared_ptr<Rational> &_next_chunk_send_time_ns
+        , const Rational &_timestamp_tick
         , double _video_fps
-        , std::shared_ptr<std::atomic<int>> &_eof_stream_counter
+        , std::shared_ptr<LoopBarrier> &_loop_barrier
         , uint8_t _dscp) :
             CpuAffinity()
             , bit_rate(_bit_rate)
@@ -480,16 +482,11 @@ struct AudioRmaxData: CpuAffinity
             , ptime_usec(_ptime_usec)
             , payload_type(_payload_type)
             , sdp_path(_sdp_path)
-            , send_cb(_send_cb)
-            , send_cv(_send_cv)
-            , send_lock(_send_lock)
-            , sync_cv(_sync_cv)
-            , sync_lock(_sync_lock)
-            , eof_cv(_eof_cv)
+            , sample_ring(_sample_ring)
             , next_chunk_send_time_ns(_next_chunk_send_time_ns)
             , timestamp_tick(_timestamp_tick)
             , video_fps(_video_fps)
-            , eof_stream_counter(_eof_stream_counter)
+            , loop_barrier(_loop_barrier)
             , dscp(_dscp)
     { }
 
@@ -502,26 +499,224 @@ struct AudioRmaxData: CpuAffinity
     int payload_type = 0;
     AVSampleFormat format = AV_SAMPLE_FMT_NONE;
     std::string sdp_path;
-    std::shared_ptr<my_queue> send_cb;
-    std::shared_ptr<std::condition_variable> send_cv;
-    std::shared_ptr<std::mutex> send_lock;
-    std::shared_ptr<std::condition_variable> sync_cv;
-    std::shared_ptr<std::mutex> sync_lock;
-    std::shared_ptr<std::condition_variable> eof_cv;
-    std::shared_ptr<double> next_chunk_send_time_ns;
-    double timestamp_tick = 0.0;
+    // L24 samples of all the channels, written by the reader
+    std::shared_ptr<SampleRing> sample_ring;
+    // exact times and RTP timestamps, see @ref calculate_stream_time
+    std::shared_ptr<Rational> next_chunk_send_time_ns;
+    Rational timestamp_tick;
     double video_fps = 0;
-    std::shared_ptr<std::atomic<int>> eof_stream_counter;
+    // the streams of the media file meet there at the end of every loop
+    std::shared_ptr<LoopBarrier> loop_barrier;
     uint8_t dscp = 0;
     size_t bit_depth_in_bytes = 0;
+    // samples of a packet, and packets of a chunk, see @ref set_audio_packet_layout
+    size_t samples_in_packet = 0;
+    size_t packets_in_chunk = 0;
     void notify_all_cv() {
-        eof_stream_counter->fetch_add(1);
-        eof_cv->notify_one();
-        send_cv->notify_all();
-        sync_cv->notify_all();
+        if (loop_barrier) {
+            loop_barrier->leave();
+        }
+        sample_ring->close();
     }
 };
 
+/**
+ * Converts the decoded audio frames to L24 samples in the sample ring of the
+ * sender. The S16, S32 and float samples, interleaved or planar, are converted
+ * directly, the other formats and the frames of another sample rate than the
+ * stream's go through swresample first.
+ */
+class AudioSampleWriter
+{
+public:
+    /**
+     * @param [in] sample_ring - ring of the sender;
+     * @param [in] sample_rate - sample rate of the stream;
+     * @param [in] channels - number of channels of the stream and the frames.
+     */
+    AudioSampleWriter(std::shared_ptr<SampleRing> sample_ring, int sample_rate, int channels) :
+        m_ring(std::move(sample_ring)), m_sample_rate(sample_rate), m_channels((size_t)channels) { }
+    ~AudioSampleWriter() { swr_free(&m_swr); }
+    AudioSampleWriter(const AudioSampleWriter&) = delete;
+    AudioSampleWriter &operator=(const AudioSampleWriter&) = delete;
+
+    /**
+     * Writes the samples of the frame of @p qdata, or ends the loop iteration
+     * at the end of the file. Waits while the ring is full.
+     *
+     * @return false if the ring is closed or the frame can't be converted.
+     */
+    bool write(const queued_data &qdata);
+    void close() { m_ring->close(); }
+
+private:
+    bool resample(const AVFrame &frame);
+    /**
+     * Writes the samples swresample still holds and frees the resampler, at the
+     * end of the file and when the format, rate or layout of the frames changes.
+     */
+    bool drain_resampler();
+    uint8_t *resampled_buffer(int samples);
+    bool write_samples(const uint8_t *const *planes, PcmSampleFormat format, bool planar, size_t samples);
+
+    const std::shared_ptr<SampleRing> m_ring;
+    const int m_sample_rate;
+    const size_t m_channels;
+    SwrContext *m_swr = nullptr;
+    // input of the last resampler
+    AVSampleFormat m_swr_format = AV_SAMPLE_FMT_NONE;
+    int m_swr_rate = 0;
+    int64_t m_swr_layout = 0;
+    // S32 samples out of swresample, only grows
+    std::vector<int32_t> m_resampled;
+};
+
+/**
+ * Sets @p pcm_format and @p planar to the layout of @p format, returns false if
+ * the samples of @p format can't be converted directly.
+ */
+static bool pcm_sample_format(AVSampleFormat format, PcmSampleFormat &pcm_format, bool &planar)
+{
+    planar = av_sample_fmt_is_planar(format) != 0;
+    switch (format) {
+    case AV_SAMPLE_FMT_S16:
+    case AV_SAMPLE_FMT_S16P:
+        pcm_format = PcmSampleFormat::S16;
+        return true;
+    case AV_SAMPLE_FMT_S32:
+    case AV_SAMPLE_FMT_S32P:
+        pcm_format = PcmSampleFormat::S32;
+        return true;
+    case AV_SAMPLE_FMT_FLT:
+    case AV_SAMPLE_FMT_FLTP:
+        pcm_format = PcmSampleFormat::FLT;
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool AudioSampleWriter::write(const queued_data &qdata)
+{
+    if (qdata.queued_data_info != queued_data::e_qdi_ok) {
+        // the next iteration starts with a new resampler
+        return drain_resampler() && m_ring->end_iteration();
+    }
+    const AVFrame &frame = *qdata.frame;
+    PcmSampleFormat format;
+    bool planar;
+    if (frame.sample_rate != m_sample_rate || !pcm_sample_format((AVSampleFormat)frame.format, format, planar)) {
+        return resample(frame);
+    }
+    return drain_resampler() && write_samples(frame.extended_data, format, planar, (size_t)frame.nb_samples);
+}
+
+bool AudioSampleWriter::resample(const AVFrame &frame)
+{
+    const AVSampleFormat frame_format = (AVSampleFormat)frame.format;
+    const int64_t layout = frame.channel_layout ? (int64_t)frame.channel_layout :
+        av_get_default_channel_layout((int)m_channels);
+    const bool same_input = frame_format == m_swr_format && frame.sample_rate == m_swr_rate &&
+        layout == m_swr_layout;
+    if (m_swr && !same_input && !drain_resampler()) {
+        return false;
+    }
+    if (!m_swr) {
+        m_swr = swr_alloc_set_opts(nullptr, layout, AV_SAMPLE_FMT_S32, m_sample_rate,
+                                   layout, frame_format, frame.sample_rate, 0, nullptr);
+        if (!m_swr || swr_init(m_swr) < 0) {
+            std::cerr << "failed to create the audio resampler" << std::endl;
+            return false;
+        }
+        if (!same_input) {
+            std::cout << "audio samples resampled from " << av_get_sample_fmt_name(frame_format) << " " <<
+                frame.sample_rate << " Hz to " << m_sample_rate << " Hz" << std::endl;
+        }
+        m_swr_format = frame_format;
+        m_swr_rate = frame.sample_rate;
+        m_swr_layout = layout;
+    }
+    const int max_samples = swr_get_out_samples(m_swr, frame.nb_samples);
+    if (max_samples < 0) {
+        std::cerr << "failed to resample an audio frame: " << max_samples << std::endl;
+        return false;
+    }
+    uint8_t *out = resampled_buffer(max_samples);
+    const int samples = swr_convert(m_swr, &out, max_samples, const_cast<const uint8_t**>(frame.extended_data),
+                                    frame.nb_samples);
+    if (samples < 0) {
+        std::cerr << "failed to resample an audio frame: " << samples << std::endl;
+        return false;
+    }
+    return write_samples(&out, PcmSampleFormat::S32, false, (size_t)samples);
+}
+
+bool AudioSampleWriter::drain_resampler()
+{
+    if (!m_swr) {
+        return true;
+    }
+    bool ok = true;
+    for (;;) {
+        const int max_samples = swr_get_out_samples(m_swr, 0);
+        if (max_samples <= 0) {
+            break;
+        }
+        uint8_t *out = resampled_buffer(max_samples);
+        const int samples = swr_convert(m_swr, &out, max_samples, nullptr, 0);
+        if (samples < 0) {
+            std::cerr << "failed to drain the audio resampler: " << samples << std::endl;
+            ok = false;
+            break;
+        }
+        if (!samples) {
+            break;
+        }
+        if (!write_samples(&out, PcmSampleFormat::S32, false, (size_t)samples)) {
+            ok = false;
+            break;
+        }
+    }
+    swr_free(&m_swr);
+    return ok;
+}
+
+uint8_t *AudioSampleWriter::resampled_buffer(int samples)
+{
+    if (m_resampled.size() < (size_t)samples * m_channels) {
+        m_resampled.resize((size_t)samples * m_channels);
+    }
+    return reinterpret_cast<uint8_t*>(m_resampled.data());
+}
+
+bool AudioSampleWriter::write_samples(const uint8_t *const *planes, PcmSampleFormat format, bool planar,
+                                      size_t samples)
+{
+    static const pack_pcm_s24be_func pack[] = {
+        get_pack_pcm_s24be(PcmSampleFormat::S16),
+        get_pack_pcm_s24be(PcmSampleFormat::S32),
+        get_pack_pcm_s24be(PcmSampleFormat::FLT)
+    };
+    const size_t sample_size = format == PcmSampleFormat::S16 ? sizeof(int16_t) : sizeof(int32_t);
+    // the ring may wrap within the frame
+    for (size_t written = 0; written < samples;) {
+        size_t space;
+        uint8_t *dst = m_ring->wait_for_space(space);
+        if (!dst) {
+            return false;
+        }
+        const size_t count = std::min(space, samples - written);
+        if (planar) {
+            pack_planar_pcm_s24be(dst, planes, format, m_channels, written, count);
+        } else {
+            pack[(int)format](dst, planes[0] + written * m_channels * sample_size, count * m_channels);
+        }
+        m_ring->commit(count);
+        written += count;
+    }
+    return true;
+}
+
 struct AudioReaderData: CpuAffinity
 {
     AudioReaderData() = default;
@@ -531,18 +726,14 @@ struct AudioReaderData: CpuAffinity
         , AVCodecParameters *_p_codec_parameters
         , int _stream_index
         , std::string _file_path
-        , std::shared_ptr<my_queue> &_conv_cb
-        , std::shared_ptr<std::condition_variable> &_conv_cv
-        , std::shared_ptr<std::mutex> &_conv_lock) :
+        , std::shared_ptr<AudioSampleWriter> &_sample_writer) :
             CpuAffinity()
             , p_format_context(_p_format_context)
             , p_codec(_p_codec)
             , p_codec_parameters(_p_codec_parameters)
             , stream_index(_stream_index)
             , file_path(_file_path)
-            , conv_cb(_conv_cb)
-            , conv_cv(_conv_cv)
-            , conv_lock(_conv_lock)
+            , sample_writer(_sample_writer)
     { }
 
     std::shared_ptr<AVFormatContext*> p_format_context = nullptr;
@@ -550,75 +741,19 @@ struct AudioReaderData: CpuAffinity
     AVCodecParameters *p_codec_parameters = nullptr;
     int stream_index = -1;
     std::string file_path;
-    std::shared_ptr<my_queue> conv_cb;
-    std::shared_ptr<std::condition_variable> conv_cv;
-    std::shared_ptr<std::mutex> conv_lock;
+    // the decoded frames are converted to the ring of the sender right away
+    std::shared_ptr<AudioSampleWriter> sample_writer;
     const char *stream_name = "audio";
-    const int ffmpeg_thread_count = 2;
+    // 0 to choose from the cores, see @ref set_decoder_threads
+    int decoder_threads = 0;
+    const int max_auto_decoder_threads = 2;
+    std::vector<int> decoder_cpus;
+    size_t decoders_sharing_cpus = 1;
+    size_t queue_capacity() const { return 0; }
+    bool push(std::shared_ptr<queued_data> &&qdata) { return sample_writer->write(*qdata); }
     void notify_all_cv()
     {
-        conv_cv->notify_all();
-    }
-};
-
-struct AudioEncodeData
-{
-    AudioEncodeData(
-        AudioRmaxData &_rmax_data
-        , std::shared_ptr<my_queue> &_conv_cb
-        , std::shared_ptr<std::condition_variable> &_conv_cv
-        , std::shared_ptr<std::mutex> &_conv_lock
-        , const AVCodec *_p_codec
-        , AVCodecParameters *_p_codec_parameters
-        , int audio_stream_index, int cpu) :
-            rmax_data(
-                _rmax_data.bit_rate
-                , _rmax_data.sample_rate
-                , _rmax_data.channels
-                , _rmax_data.frame_size
-                , _rmax_data.channel_layout
-                , _rmax_data.ptime_usec
-                , _rmax_data.payload_type
-                , _rmax_data.sdp_path
-                , _rmax_data.send_cb
-                , _rmax_data.send_cv
-                , _rmax_data.send_lock
-                , _rmax_data.sync_cv
-                , _rmax_data.sync_lock
-                , _rmax_data.eof_cv
-                , _rmax_data.next_chunk_send_time_ns
-                , _rmax_data.timestamp_tick
-                , _rmax_data.video_fps
-                , _rmax_data.eof_stream_counter
-                , _rmax_data.dscp)
-                    , conv_cb(_conv_cb)
-                    , conv_cv(_conv_cv)
-                    , conv_lock(_conv_lock)
-                    , p_codec(_p_codec)
-                    , p_codec_parameters(_p_codec_parameters)
-                    , stream_index(audio_stream_index)
-    {
-        rmax_data.set_cpu(cpu);
-    }
-
-    AudioRmaxData rmax_data;
-    std::shared_ptr<my_queue> conv_cb;
-    std::shared_ptr<std::condition_variable> conv_cv;
-    std::shared_ptr<std::mutex> conv_lock;
-    const AVCodec *p_codec = nullptr;
-    AVCodecParameters *p_codec_parameters = nullptr;
-    int stream_index = -1;
-    void notity_all_cv()
-    {
-        conv_cv->notify_all();
-        rmax_data.send_cv->notify_all();
-        rmax_data.sync_cv->notify_all();
-    }
-
-public:
-    void set_thread_affinity()
-    {
-        rmax_data.set_thread_affinity();
+        sample_writer->close();
     }
 };
 
@@ -637,11 +772,8 @@ struct AncillaryRmaxData
         , uint16_t _video_width
         , uint16_t _video_height
         , int64_t _video_duration
-        , std::shared_ptr<double>& _next_chunk_send_time_ns
-        , std::shared_ptr<std::atomic<int>> &_eof_stream_counter
-        , std::shared_ptr<std::condition_variable> &_sync_cv
-        , std::shared_ptr<std::mutex> &_sync_lock
-        , std::shared_ptr<std::condition_variable> &_eof_cv) :
+        , std::shared_ptr<Rational>& _next_chunk_send_time_ns
+        , std::shared_ptr<LoopBarrier> &_loop_barrier) :
             video_pix_format(_video_pix_format)
             , fps(_fps)
             , video_type(_video_type)
@@ -654,10 +786,7 @@ struct AncillaryRmaxData
             , video_duration_sec(_video_duration)
             , sdp_path(_sdp_path)
             , next_chunk_send_time_ns(_next_chunk_send_time_ns)
-            , eof_stream_counter(_eof_stream_counter)
-            , sync_cv(_sync_cv)
-            , sync_lock(_sync_lock)
-            , eof_cv(_eof_cv)
+            , loop_barrier(_loop_barrier)
     { }
     AVPixelFormat video_pix_format = AV_PIX_FMT_NONE;
     double fps = 0;
@@ -670,16 +799,16 @@ struct AncillaryRmaxData
     uint16_t video_height = 0;
     int64_t video_duration_sec = 0;
     std::string sdp_path;
-    std::shared_ptr<double> next_chunk_send_time_ns;
-    std::shared_ptr<std::atomic<int>> eof_stream_counter;
-    std::shared_ptr<std::condition_variable> sync_cv;
-    std::shared_ptr<std::mutex> sync_lock;
-    std::shared_ptr<std::condition_variable> eof_cv;
+    // RTP packets of the frames/fields, built once before sending
+    std::shared_ptr<const AncPacketTemplates> packet_templates;
+    std::shared_ptr<Rational> next_chunk_send_time_ns;
+    // the streams of the media file meet there at the end of every loop
+    std::shared_ptr<LoopBarrier> loop_barrier;
     void notify_all_cv()
     {
-        eof_stream_counter->fetch_add(1);
-        eof_cv->notify_one();
-        sync_cv->notify_all();
+        if (loop_barrier) {
+            loop_barrier->leave();
+        }
     }
 };
 
@@ -711,13 +840,6 @@ struct MediaData {
 
 
 
-struct SendData
-{
-    int packet_counter;
-    int px_grp_left_in_frame_field;
-    uint16_t px_grp_left_in_line;
-};
-
 struct av_deleter
 {
     void operator()(AVCodecContext* thing)
@@ -726,47 +848,88 @@ struct av_deleter
     }
 };
 
-void calculate_stream_time(eMediaType_t stream_type, std::shared_ptr<double>& time_ns, cst_data& data, double* p_timestamp_tick)
+/**
+ * Returns the period of the alignment points of a stream: the video frame, or
+ * the audio packet time if the media file has no video.
+ */
+static Rational alignment_period_ns(const cst_data &data)
 {
-    double t_frame_ns = (double)nanoseconds{seconds{1}}.count() / data.fps;
-    uint64_t N = (uint64_t)(*time_ns/t_frame_ns + 1);
-    double first_packet_start_time_ns = N * t_frame_ns; //next alignment point calculation
+    return data.fps ?
+        Rational((uint64_t)nanoseconds{seconds{1}}.count()) / rational_approximation(data.fps) :
+        Rational((uint64_t)nanoseconds{microseconds{data.audio_ptime_usec}}.count());
+}
 
-    if (video & stream_type) {
-        int packets_in_frame = 0;
-        if (data.pix_format == AVPixelFormat::AV_PIX_FMT_YUV422P10LE) {
-            packets_in_frame = data.width == FHD_WIDTH ? HD_PACKETS_PER_FRAME_422_10B : UHD_PACKETS_PER_FRAME_422_10B;
-        } else {  // must be 8 bits
-            packets_in_frame = data.width == FHD_WIDTH ? HD_PACKETS_PER_FRAME_422_8B : UHD_PACKETS_PER_FRAME_422_8B;
+/**
+ * Sets the SMPTE ST 2110-21 gapped mode ratios of a video format.
+ *
+ * @param [in] data - format of the stream;
+ * @param [out] r_active - part of the frame time the packets are sent in;
+ * @param [out] tro_default_multiplier - default TRO, in frame times.
+ */
+static void video_gapped_mode_ratios(const cst_data &data, Rational &r_active, Rational &tro_default_multiplier)
+{
+    if (data.video_type == VIDEO_TYPE::PROGRESSIVE) {
+        r_active = Rational(1080, 1125);
+        if (data.height >= FHD_HEIGHT) { // As defined by SMPTE 2110-21 6.3.2
+            tro_default_multiplier = Rational(43, 1125);
+        } else {
+            tro_default_multiplier = Rational(28, 750);
         }
-
-        double r_active;
-        double tro_default_multiplier = 0;
-        if (data.video_type == VIDEO_TYPE::PROGRESSIVE) {
-            r_active = (1080.0 / 1125.0);
-            if (data.height >= FHD_HEIGHT) { // As defined by SMPTE 2110-21 6.3.2
-                tro_default_multiplier = (43.0 / 1125.0);
-            } else {
-                tro_default_multiplier = (28.0 / 750.0);
-            }
+    } else {
+        if (data.height >= FHD_HEIGHT) { // As defined by SMPTE 2110-21 6.3.3
+            r_active = Rational(1080, 1125);
+            tro_default_multiplier = Rational(22, 1125);
+        } else if (data.height >= 576) {
+            r_active = Rational(576, 625);
+            tro_default_multiplier = Rational(26, 625);
         } else {
-            if (data.height >= FHD_HEIGHT) { // As defined by SMPTE 2110-21 6.3.3
-                r_active = (1080.0 / 1125.0);
-                tro_default_multiplier = (22.0 / 1125.0);
-            } else if (data.height >= 576) {
-                r_active = (576.0 / 625.0);
-                tro_default_multiplier = (26.0 / 625.0);
-            } else {
-                r_active = (487.0 / 525.0);
-                tro_default_multiplier = (20.0 / 525.0);
-            }
+            r_active = Rational(487, 525);
+            tro_default_multiplier = Rational(20, 525);
         }
+    }
+}
 
-        double trs_ns = (t_frame_ns * r_active) / packets_in_frame;
-        double tro = (tro_default_multiplier * t_frame_ns) - (video_tro_default_modification * trs_ns);
-        first_packet_start_time_ns += tro;
-
+/**
+ * Returns the time from an alignment point to the first packet sent for it:
+ * the video packets start after the alignment point of their frame (SMPTE
+ * ST 2110-21), the other streams at the alignment point.
+ */
+static Rational alignment_offset_ns(eMediaType_t stream_type, const cst_data &data)
+{
+    if (!(video & stream_type)) {
+        return Rational();
     }
+    const Rational t_frame_ns = alignment_period_ns(data);
+    int packets_in_frame = 0;
+    if (data.pix_format == AVPixelFormat::AV_PIX_FMT_YUV422P10LE) {
+        packets_in_frame = data.width == FHD_WIDTH ? HD_PACKETS_PER_FRAME_422_10B : UHD_PACKETS_PER_FRAME_422_10B;
+    } else {  // must be 8 bits
+        packets_in_frame = data.width == FHD_WIDTH ? HD_PACKETS_PER_FRAME_422_8B : UHD_PACKETS_PER_FRAME_422_8B;
+    }
+
+    Rational r_active;
+    Rational tro_default_multiplier;
+    video_gapped_mode_ratios(data, r_active, tro_default_multiplier);
+    const Rational trs_ns = t_frame_ns * r_active / packets_in_frame;
+    return tro_default_multiplier * t_frame_ns - trs_ns * video_tro_default_modification;
+}
+
+/**
+ * Sets @p time_ns to the send time of the first packet of alignment point
+ * @p alignment_point, the alignment points are counted from the TAI epoch.
+ *
+ * @param [in] stream_type - kind of the stream;
+ * @param [out] time_ns - send time, TAI;
+ * @param [in] data - format of the stream;
+ * @param [in] alignment_point - index of the alignment point;
+ * @param [out] p_timestamp_tick - if not null, the RTP timestamp of @p time_ns,
+ *                                 not wrapped, its low 32 bits are sent.
+ */
+void start_stream_at(eMediaType_t stream_type, std::shared_ptr<Rational>& time_ns, const cst_data& data,
+                     uint64_t alignment_point, Rational* p_timestamp_tick)
+{
+    const Rational first_packet_start_time_ns = alignment_period_ns(data) * alignment_point +
+        alignment_offset_ns(stream_type, data);
     if (p_timestamp_tick) {
         *p_timestamp_tick = time_to_rtp_timestamp(first_packet_start_time_ns, data.sample_rate);
     }
@@ -774,6 +937,43 @@ void calculate_stream_time(eMediaType_t stream_type, std::shared_ptr<double>& ti
     *time_ns = first_packet_start_time_ns;
 }
 
+/**
+ * Returns the first alignment point a stream whose next packet would be sent at
+ * @p time_ns can continue at without a gap nor an overlap: the alignment point
+ * of the next frame when the stream ends with a whole frame.
+ */
+uint64_t next_alignment_point(eMediaType_t stream_type, const Rational &time_ns, const cst_data& data)
+{
+    const Rational offset_ns = alignment_offset_ns(stream_type, data);
+    if (time_ns <= offset_ns) {
+        return 0;
+    }
+    const Rational alignment_points = (time_ns - offset_ns) / alignment_period_ns(data);
+    return alignment_points.integer() + (alignment_points.numerator() ? 1 : 0);
+}
+
+/**
+ * Moves @p time_ns to the send time of the first packet of the next frame or
+ * field, after the alignment point of that frame (SMPTE ST 2110-21) for video.
+ *
+ * The times are kept as exact fractions of nanoseconds: the frame interval of
+ * 59.94 fps is 16683333 1/3 ns, a frame time computed as start + n * interval
+ * doesn't drift however long the stream plays, and the times are rounded down
+ * to nanoseconds only when they are given to Rivermax.
+ *
+ * @param [in] stream_type - kind of the stream;
+ * @param [in,out] time_ns - time to align, TAI;
+ * @param [in] data - format of the stream;
+ * @param [out] p_timestamp_tick - if not null, the RTP timestamp of @p time_ns,
+ *                                 not wrapped, its low 32 bits are sent.
+ */
+void calculate_stream_time(eMediaType_t stream_type, std::shared_ptr<Rational>& time_ns, cst_data& data,
+                           Rational* p_timestamp_tick)
+{
+    const uint64_t N = (*time_ns / alignment_period_ns(data)).integer() + 1;
+    start_stream_at(stream_type, time_ns, data, N, p_timestamp_tick);
+}
+
 struct RtpAudioHeaderBuilder
 {
     RtpAudioHeaderBuilder(
@@ -785,9 +985,8 @@ struct RtpAudioHeaderBuilder
         , uint16_t packet_stride_size
         , size_t samples_in_packet
         , size_t num_of_channels
-        , size_t num_of_samples_in_av_packet
         , size_t bit_depth_in_bytes
-        , double timestamp_tick) :
+        , const Rational &timestamp_tick) :
             m_payload_size(payload_size)
             , m_payload_type(payload_type)
             , m_strides_in_chunk(strides_in_chunk)
@@ -797,11 +996,20 @@ struct RtpAudioHeaderBuilder
             , m_samples_in_stride(samples_in_packet)
             , m_num_of_channels(num_of_channels)
             , m_timestamp_tick(timestamp_tick)
-            , m_num_of_samples_in_av_packet(num_of_samples_in_av_packet)
             , m_bit_depth_in_bytes(bit_depth_in_bytes)
+            , m_rtp_template(payload_type, 0x0eb51dbe) // simulated ssrc
     { }
 
-    void fill_chunk(uint8_t *buff, std::shared_ptr<AVPacket> sptr_av_packet_arr[]);
+    /**
+     * Fills the packets of a chunk with the next slices of @p ring, which
+     * holds a packet of samples per slice.
+     *
+     * @param [out] buff - strides of the chunk;
+     * @param [in] ring - samples of the stream, in L24;
+     * @param [in] packets - number of slices to take from @p ring, the packets
+     *                       after them are filled with silence.
+     */
+    void fill_chunk(uint8_t *buff, const SampleRing &ring, size_t packets);
     uint32_t m_seq_num = 0;
     const size_t m_payload_size;
     const uint8_t m_payload_type;
@@ -811,17 +1019,14 @@ struct RtpAudioHeaderBuilder
     uint16_t m_packet_stride_size;
     const size_t m_samples_in_stride;
     const size_t m_num_of_channels;
-    double m_timestamp_tick;
-    const size_t m_num_of_samples_in_av_packet;
+    Rational m_timestamp_tick;
     const size_t m_bit_depth_in_bytes;
+    const RtpHeaderTemplate m_rtp_template;
 };
 
-void RtpAudioHeaderBuilder::fill_chunk(uint8_t *buff, std::shared_ptr<AVPacket> sptr_av_packet_arr[])
+void RtpAudioHeaderBuilder::fill_chunk(uint8_t *buff, const SampleRing &ring, size_t packets)
 {
     uint8_t *pBuff_8 = buff;
-    size_t av_packet_index = 0;
-    uint8_t *src = &(sptr_av_packet_arr[av_packet_index].get())->data[0];
-    size_t num_of_samples_left_in_chunk = m_num_of_samples_in_av_packet;
 
     for (size_t m_strides_index = 0; m_strides_index < m_strides_in_chunk; ++m_strides_index, pBuff_8 += m_packet_stride_size) {
 
@@ -837,80 +1042,48 @@ void RtpAudioHeaderBuilder::fill_chunk(uint8_t *buff, std::shared_ptr<AVPacket>
          |                                         ssrc                                               |
          +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+*/
 
-        rtp_header *p_rtp_header = (rtp_header*)pBuff_8;
-        p_rtp_header->version = 2;
-        p_rtp_header->extension = 0;
-        p_rtp_header->cc = 0;
-        p_rtp_header->marker = 0;
-        p_rtp_header->payload_type = m_payload_type;
-        p_rtp_header->sequence_number = htobe16((uint16_t)m_seq_num);
+        m_rtp_template.write(pBuff_8, m_seq_num, (uint32_t)m_timestamp_tick.integer());
         ++m_seq_num;
-        p_rtp_header->timestamp = htobe32((uint32_t)m_timestamp_tick);
-        m_timestamp_tick += (double)m_samples_in_stride;
-        p_rtp_header->ssrc = 0x0eb51dbe; // simulated ssrc
-
-        uint8_t *dst = pBuff_8 + sizeof(*p_rtp_header);
+        m_timestamp_tick += m_samples_in_stride;
 
-        if (num_of_samples_left_in_chunk >= m_samples_in_stride) {
-            memcpy(dst, src, m_payload_size);
-            num_of_samples_left_in_chunk -= m_samples_in_stride;
-            src += m_payload_size;
+        uint8_t *dst = pBuff_8 + sizeof(rtp_header);
+        if (m_strides_index < packets) {
+            memcpy(dst, ring.slice(m_strides_index), m_payload_size);
         } else {
-            //Copy leftovers samples
-            size_t size_to_copy = num_of_samples_left_in_chunk * m_num_of_channels * m_bit_depth_in_bytes;
-            memcpy(dst, src, size_to_copy);
-            dst += size_to_copy;
-
-            //Copy samples from next av packet
-            ++av_packet_index;
-            src = &(sptr_av_packet_arr[av_packet_index].get())->data[0];
-            size_to_copy = (m_samples_in_stride - num_of_samples_left_in_chunk) * m_num_of_channels * m_bit_depth_in_bytes;
-            memcpy(dst, src, size_to_copy);
-            src += size_to_copy;
-            num_of_samples_left_in_chunk = (m_num_of_samples_in_av_packet - (m_samples_in_stride - num_of_samples_left_in_chunk));
+            // the end of the last iteration is padded with silence
+            memset(dst, 0, m_payload_size);
         }
     }
 }
 
+/**
+ * Fills the chunks of an ancillary stream with the RTP packet templates of its
+ * frames/fields, see @ref AncPacketTemplates.
+ */
 struct RtpAncillaryHeaderBuilder
 {
     RtpAncillaryHeaderBuilder(
-        double fps
-        , uint8_t payload_type
-        , uint16_t payload_size
-        , uint16_t did
-        , uint16_t sdid
+        std::shared_ptr<const AncPacketTemplates> packet_templates
         , size_t strides_in_chunk
         , uint16_t packet_stride_size
-        , size_t samples_in_packet
         , VIDEO_TYPE video_type) :
-            m_fps(fps)
-            , m_payload_type(payload_type)
-            , m_payload_size(payload_size)
-            , m_did(did)
-            , m_sdid(sdid)
+            m_packet_templates(std::move(packet_templates))
             , m_strides_in_chunk(strides_in_chunk)
             , m_packet_stride_size(packet_stride_size)
-            , m_samples_in_stride(samples_in_packet)
             , m_video_type(video_type)
-    {
-        if (m_video_type == VIDEO_TYPE::INTERLACE) {
-            m_field = interlace_first_field_value;
-        }
-    }
+    { }
 
-    void fill_chunk(uint8_t *buff, uint16_t *payload_sizes_ptr, double send_time_ns);
-    double m_fps = 0;
+    /**
+     * Fills the packets of frames/fields @p frame_field_index and the next ones,
+     * all sent at @p send_time_ns.
+     */
+    void fill_chunk(uint8_t *buff, uint16_t *payload_sizes_ptr, const Rational &send_time_ns,
+                    uint64_t frame_field_index);
+    const std::shared_ptr<const AncPacketTemplates> m_packet_templates;
     uint32_t m_seq_num = 0;
-    const uint8_t m_payload_type = 0;
-    const uint16_t m_payload_size = 0;
-    const uint16_t m_did = 0;
-    const uint16_t m_sdid = 0;
     const size_t m_strides_in_chunk = 0;
-    uint16_t m_packet_stride_size = 0;
-    const size_t m_samples_in_stride = 0;
-    VIDEO_TYPE m_video_type = VIDEO_TYPE::NON_VIDEO;
-    uint8_t m_field = progresive_field_value;
+    const uint16_t m_packet_stride_size = 0;
+    const VIDEO_TYPE m_video_type = VIDEO_TYPE::NON_VIDEO;
 
 private:
     const static uint8_t progresive_field_value = 0b00;
@@ -918,23 +1091,6 @@ private:
     const static uint8_t interlace_second_field_value = 0b11;
 };
 
-uint32_t number_of_set_bits(uint32_t i)
-{
-    i = i - ((i >> 1) & 0x55555555);
-    i = (i & 0x33333333) + ((i >> 2) & 0x33333333);
-    return (((i + (i >> 4)) & 0x0F0F0F0F) * 0x01010101) >> 24;
-}
-
-uint8_t get_8bit_val(uint32_t number)
-{
-    return (uint8_t)((number >> 8) & 0x1);
-}
-
-uint8_t even_parity(uint32_t number)
-{
-    return (uint8_t)(number_of_set_bits(number) & 0x1);
-}
-
 #ifdef _MSC_VER
 #define PACK( __Declaration__ ) __pragma( pack(push, 1) ) __Declaration__ __pragma( pack(pop) )
 #elif defined(__GNUC__)
@@ -951,494 +1107,744 @@ PACK(struct ancillary_rtp_header {
     uint32_t reserved_0_to_15_16bit : 16;  // reserved: 16 of 22 bits
 });
 
-PACK(struct ancillary_rtp_data_header {
-    uint32_t line_number_4_to_10_7bit : 7;  // Line_Number: 7 of 11 bits
-    uint32_t c : 1;  // C: 1 bit
-
-    uint32_t horizontal_offset_8_to_11_4bit : 4;  // Horizontal_Offset: 4 of 12 bits
-    uint32_t line_number_0_to_3_4bit : 4;  // Line_Number: 4 of 11 bits
-
-    uint32_t horizontal_offset_0_to_7_8bit : 8;  // Horizontal_Offset: 12 bits
-
-    uint32_t stream_num : 7;  // StreamNum: 7 bits
-    uint32_t s : 1; //S (Data Stream Flag): 1 bit
-
-    uint32_t did_2_to_9_8bit : 8;  // Data Identification Word DID: 8 of 10 bits
-    uint32_t sdid_4_to_9_6bit : 6; // Secondary Data Identification Word SDID: 6 of 10 bits
-    uint32_t did_0_to_1_2bit : 2;  // Data Identification Word DID: 2 of 10 bits
-
-    uint32_t data_count_6_to_7_2bit : 2;  // Data_Count: 2 of 10 bits
-    uint32_t data_count_8_1bit_even_parity : 1;
-    uint32_t data_count_9_1bit_not_8_bit : 1;
-    uint32_t sdid_0_to_3_4bit : 4; // Secondary Data Identification Word SDID: 4 of 10 bits
+void RtpAncillaryHeaderBuilder::fill_chunk(uint8_t *buff, uint16_t *payload_sizes_ptr, const Rational &send_time_ns,
+                                           uint64_t frame_field_index)
+{
+    const uint32_t timestamp = htobe32((uint32_t)time_to_rtp_timestamp(send_time_ns, 90000).integer());
 
-    uint32_t user_data_world1_8_1bit_even_parity : 1;
-    uint32_t user_data_world19_1bit_not_8_bit : 1;
-    uint32_t data_count_0_to_5_6bit : 6;  // Data_Count: 6 of 10 bits
+    for (size_t m_strides_index = 0; m_strides_index < m_strides_in_chunk; ++m_strides_index,
+            buff += m_packet_stride_size, ++frame_field_index) {
+        const std::vector<uint8_t> &packet = m_packet_templates->packet(frame_field_index);
+        memcpy(buff, packet.data(), packet.size());
+        ancillary_rtp_header* p_anc_rtp_hdr = (struct ancillary_rtp_header*)&buff[0];
+        p_anc_rtp_hdr->s_rtp_header.sequence_number = htobe16((uint16_t)m_seq_num);
+        p_anc_rtp_hdr->s_rtp_header.timestamp = timestamp;
+        if (m_video_type == VIDEO_TYPE::PROGRESSIVE) {
+            p_anc_rtp_hdr->f = progresive_field_value;
+        } else {
+            // the fields of a stream start with a first field
+            p_anc_rtp_hdr->f = (frame_field_index & 1) ? interlace_second_field_value : interlace_first_field_value;
+        }
 
-    uint32_t user_data_world1_0_to_7_9bit : 8;  // User_Data_Words: integer number of 8 of 10 bit words
+        p_anc_rtp_hdr->extended_sequence_number = htobe16((uint16_t)(m_seq_num>>16));
+        ++m_seq_num;
+        payload_sizes_ptr[m_strides_index] = (uint16_t)packet.size();
+    }
+}
 
-    uint32_t checksum_2_to_7_6bit : 6;  // checksum: integer number of 8 of 10 bit words
-    uint32_t checksum_8_to_8_1bit : 1;  // checksum: integer number of 1 of 10 bit words
-    uint32_t checksum_9_to_9_1bit_not_8_bit : 1;  // checksum: integer number of 1 of 10 bit words
+// the frames are far apart, a scaler helper sleeps at once
+static constexpr int64_t VIDEO_SCALER_SPIN_NS = 0;
+// swscale writes any band of lines of the output from the whole input frame (FFmpeg 5.0)
+#define SWS_HAS_SLICE_OUTPUT (LIBSWSCALE_VERSION_INT >= AV_VERSION_INT(6, 1, 100))
 
-    uint32_t word_align1_6bit : 6;  // word_align1: integer number of 6 of 6 bit words
-    uint32_t checksum_0_to_1_2bit : 2;  // checksum: integer number of 2 of 10 bit words
+void AVFrameDeleter(AVFrame* f)
+{
+    av_frame_free(&f);
+}
 
-    uint32_t word_align2_8bit : 8;  // word_align2: integer number of 8 of 8 bit words
+void AVSubtitleDeleter(AVSubtitle* s)
+{
+    avsubtitle_free(s);
+    delete s;
+}
 
-    inline void set_line_number(uint16_t _line_number)
+/**
+ * Decoded frames of a looped video, kept in memory after the first iteration.
+ *
+ * The thread that queues the frames to the video sender (the reader, or the
+ * scaler when the frames are converted) copies every frame of the first iteration
+ * here. If the whole clip fits, the reader ends the stream with
+ * queued_data::e_qdi_cached instead of queued_data::e_qdi_eof and stops, and the
+ * sender replays the next iterations from the cache.
+ *
+ * The frames are stored in one region allocated at setup, in huge pages when
+ * available, so the budget is charged with whole pages once and no frame is
+ * allocated while the clip plays.
+ */
+struct VideoFrameCache
+{
+    VideoFrameCache(size_t budget, AVPixelFormat pix_format, int width, int height)
+    : m_budget(budget)
+    , m_pix_format(pix_format)
+    , m_width(width)
+    , m_height(height)
+    , m_frame_size(river_align_up_pow2((size_t)av_image_get_buffer_size(pix_format, width, height,
+                                                                        frame_alignment), frame_alignment))
     {
-        line_number_0_to_3_4bit = (0x000F & _line_number);
-        line_number_4_to_10_7bit = (0x007F & (_line_number >> 4));
     }
 
-    inline void set_horizontal_offset(uint16_t _horizontal_offset)
+    /**
+     * Allocates the frames of the cache, as many as fit in the budget and at most
+     * @p max_frames.
+     *
+     * @return false if not even one frame can be stored.
+     */
+    bool allocate(uint64_t max_frames);
+    /**
+     * Returns true if a clip of @p frames frames fits in the cache and all its
+     * frames could be stored so far.
+     */
+    bool fits(uint64_t frames) const
     {
-        horizontal_offset_0_to_7_8bit = (0x00FF & _horizontal_offset);
-        horizontal_offset_8_to_11_4bit = (0x000F & (_horizontal_offset >> 8));
+        return frames <= m_capacity && !m_failed;
     }
+    /**
+     * Copies @p av_frame to the end of the cache, the cache is given up on the
+     * first frame that can't be stored.
+     *
+     * @return false if the frame doesn't fit or differs from the cached format.
+     */
+    bool add(const AVFrame *av_frame);
+    bool failed() const { return m_failed; }
+
+    size_t size() const { return m_frames.size(); }
+    const std::shared_ptr<AVFrame> &frame(size_t index) const { return m_frames[index]; }
+
+    static constexpr int frame_alignment = 64;
+    const size_t m_budget;
+    const AVPixelFormat m_pix_format;
+    const int m_width;
+    const int m_height;
+    const size_t m_frame_size;
+    size_t m_capacity = 0;
+    uint8_t *m_buffer = nullptr;
+    // set by the thread that adds the frames, read by the reader at the end of the clip
+    std::atomic<bool> m_failed{ false };
+    std::vector<std::shared_ptr<AVFrame>> m_frames;
+    std::unique_ptr<MemoryAllocator> m_allocator;
+};
 
-    inline uint16_t did_sdid_add_parity(uint16_t _val)
-    {
-        _val &= 0xff;
-        uint8_t parity = even_parity(_val);
-
-        _val |= ((!parity << 1) | parity) << 8;
-        return _val;
+bool VideoFrameCache::allocate(uint64_t max_frames)
+{
+    m_capacity = (size_t)std::min<uint64_t>(m_budget / m_frame_size, max_frames);
+    if (!m_capacity) {
+        return false;
     }
-
-    inline void set_did(uint16_t _did)
-    {
-        _did = did_sdid_add_parity(_did);
-        did_0_to_1_2bit = (0x0003 & _did);
-        did_2_to_9_8bit = (0x00FF & (_did >> 2));
+    // a single region, rounded up to a whole huge page once
+    const size_t size = m_capacity * m_frame_size;
+    m_allocator.reset(new HugePagesMemoryAllocator());
+    m_buffer = static_cast<uint8_t*>(m_allocator->allocate(size));
+    if (!m_buffer) {
+        std::cout << "Loop cache is in regular memory, not enough huge pages for " << (size >> 20) << " MB" <<
+            std::endl;
+        m_allocator.reset(new MallocMemoryAllocator());
+        m_buffer = static_cast<uint8_t*>(m_allocator->allocate(size, frame_alignment));
     }
-
-    inline uint16_t get_did()
-    {
-        return (((uint16_t)did_0_to_1_2bit)) | (((uint16_t)did_2_to_9_8bit) << 2);
+    if (!m_buffer) {
+        m_capacity = 0;
+        return false;
     }
+    m_frames.reserve(m_capacity);
+    return true;
+}
 
-    inline void set_sdid(uint16_t _sdid)
-    {
-        _sdid = did_sdid_add_parity(_sdid);
-        sdid_0_to_3_4bit = (0x000F & _sdid);
-        sdid_4_to_9_6bit = (0x003F & (_sdid >> 4));
+bool VideoFrameCache::add(const AVFrame *av_frame)
+{
+    if (m_failed || m_frames.size() == m_capacity || av_frame->format != m_pix_format ||
+        av_frame->width != m_width || av_frame->height != m_height) {
+        m_failed = true;
+        return false;
     }
 
-    inline uint16_t get_sdid()
-    {
-        return (((uint16_t)sdid_0_to_3_4bit)) | (((uint16_t)sdid_4_to_9_6bit) << 4);
+    // the cached frame only references the buffer, it is released with the allocator
+    std::shared_ptr<AVFrame> frame{ av_frame_alloc(), AVFrameDeleter };
+    if (!frame) {
+        m_failed = true;
+        return false;
     }
+    frame->format = m_pix_format;
+    frame->width = m_width;
+    frame->height = m_height;
+    av_image_fill_arrays(frame->data, frame->linesize, m_buffer + m_frames.size() * m_frame_size, m_pix_format,
+                         m_width, m_height, frame_alignment);
+    av_image_copy(frame->data, frame->linesize, const_cast<const uint8_t**>(av_frame->data), av_frame->linesize,
+                  m_pix_format, m_width, m_height);
+    m_frames.push_back(std::move(frame));
+    return true;
+}
+
+/*
+ * Frame layouts of raw video files (--raw-format). The planar and UYVY frames are
+ * laid out as FFmpeg lays them out, without line padding. v210 has no FFmpeg pixel
+ * format, its lines are padded to 128 bytes as the format defines.
+ */
+static const std::map<std::string, AVPixelFormat> RAW_VIDEO_FORMATS{
+    { "yuv422p10le", AVPixelFormat::AV_PIX_FMT_YUV422P10LE },
+    { "yuv422p",     AVPixelFormat::AV_PIX_FMT_YUV422P },
+    { "uyvy422",     AVPixelFormat::AV_PIX_FMT_UYVY422 },
+    { "v210",        AVPixelFormat::AV_PIX_FMT_NONE },
+};
 
-    inline void set_data_count(uint8_t _data_count)
+/**
+ * Uncompressed video file, read by the video sender without decoding nor scaling.
+ *
+ * The file is a sequence of frames of one of the RAW_VIDEO_FORMATS layouts, the
+ * frame geometry comes from the SDP. The file is mapped for sequential reading and
+ * the packetizer reads the frames in place.
+ */
+struct RawVideoFile
+{
+    /**
+     * Maps @p path.
+     *
+     * @param [in] path - raw video file;
+     * @param [in] format - frame layout, a key of RAW_VIDEO_FORMATS;
+     * @param [in] width - frame width;
+     * @param [in] height - frame height.
+     *
+     * @return true on success.
+     */
+    bool open(const std::string &path, const std::string &format, int width, int height);
+
+    uint64_t frame_count() const { return m_frame_count; }
+    /**
+     * Returns true if the packets of a stream send every pixel group of the
+     * frames once and within their lines, so that the packetizer only reads the
+     * mapped frames, see @ref RtpVideoHeaderBuilder::plan_valid.
+     *
+     * @param [in] video_type - scan type of the stream;
+     * @param [in] max_packet_size - video packet size limit (-b);
+     * @param [in] allow_padding - pads the last packet of a frame/field (-a).
+     */
+    bool packets_valid(VIDEO_TYPE video_type, uint16_t max_packet_size, bool allow_padding) const;
+    /**
+     * Points the planes of @p frame to frame @p index of the file.
+     */
+    void get_frame(uint64_t index, AVFrame *frame) const;
+    /**
+     * Asks the kernel to read frame @p index ahead.
+     */
+    void prefetch(uint64_t index) const
     {
-        data_count_0_to_5_6bit = (0x3F & (uint16_t)_data_count);
-        data_count_6_to_7_2bit = (0x03 & (_data_count >> 6));
-        data_count_8_1bit_even_parity = even_parity(get_data_count());
-        data_count_9_1bit_not_8_bit = !data_count_8_1bit_even_parity;
+        m_file.prefetch(index * m_frame_size, m_frame_size);
     }
 
-    inline uint16_t get_data_count()
-    {
-        return (((uint16_t)data_count_0_to_5_6bit)) | (((uint16_t)data_count_6_to_7_2bit) << 6);
+    MappedFile m_file;
+    // AV_PIX_FMT_NONE for v210
+    AVPixelFormat m_layout = AVPixelFormat::AV_PIX_FMT_NONE;
+    // pixel format with the samples of the frames, for the stream timing
+    AVPixelFormat m_pix_format = AVPixelFormat::AV_PIX_FMT_NONE;
+    const VideoPacketizerFormat *m_packetizer_format = nullptr;
+    int m_width = 0;
+    int m_height = 0;
+    int m_v210_linesize = 0;
+    size_t m_frame_size = 0;
+    uint64_t m_frame_count = 0;
+};
+
+bool RawVideoFile::open(const std::string &path, const std::string &format, int width, int height)
+{
+    auto layout = RAW_VIDEO_FORMATS.find(format);
+    if (layout == RAW_VIDEO_FORMATS.end()) {
+        std::cerr << "Unsupported raw video format " << format << std::endl;
+        return false;
+    }
+    // the frames are read in pixel groups of 2 pixels
+    if (width <= 0 || width % PX_IN_422_GRP || height <= 0) {
+        std::cerr << "Raw video frames of " << width << "x" << height << " pixels are not supported, the width "
+            "must be even" << std::endl;
+        return false;
+    }
+    m_layout = layout->second;
+    m_width = width;
+    m_height = height;
+    if (m_layout == AVPixelFormat::AV_PIX_FMT_NONE) {
+        // 48 pixels in 128 bytes
+        m_v210_linesize = (width + 47) / 48 * 128;
+        m_frame_size = (size_t)m_v210_linesize * height;
+        m_pix_format = AVPixelFormat::AV_PIX_FMT_YUV422P10LE;
+        m_packetizer_format = &v210_packetizer_format;
+    } else {
+        m_frame_size = (size_t)av_image_get_buffer_size(m_layout, width, height, 1);
+        m_pix_format = m_layout;
+        m_packetizer_format = find_video_packetizer_format(m_layout);
     }
 
-    inline uint16_t set_user_data_1_and_checksum()
-    { // SMPTE ST 291-1 Ancillary Data
-        // Set user data
-        user_data_world1_8_1bit_even_parity = even_parity(VIDEO_FORMAT); // 2 - 010    16:9 video format
-        user_data_world19_1bit_not_8_bit = !user_data_world1_8_1bit_even_parity;
-        user_data_world1_0_to_7_9bit = (uint8_t)VIDEO_FORMAT;
+    if (!m_file.open(path, true)) {
+        return false;
+    }
+    m_frame_count = m_file.size() / m_frame_size;
+    if (!m_frame_count) {
+        std::cerr << "Raw video file " << path << " is shorter than a " << width << "x" << height << " "
+            << format << " frame" << std::endl;
+        m_file.unmap();
+        return false;
+    }
+    if (m_file.size() % m_frame_size) {
+        std::cout << "Warning - Raw video file " << path << " ends with a partial frame, it is not sent" << std::endl;
+    }
+    return true;
+}
 
-        //Set checksum
-        uint16_t cs_temp = VIDEO_FORMAT + get_did() + get_sdid() + get_data_count();
-        checksum_8_to_8_1bit = get_8bit_val(cs_temp);
-        checksum_9_to_9_1bit_not_8_bit = !checksum_8_to_8_1bit;
-        checksum_0_to_1_2bit = (uint8_t)cs_temp;
-        checksum_2_to_7_6bit = 0x3F & ((uint8_t)cs_temp >> 2);
-        return 4;
+bool RawVideoFile::packets_valid(VIDEO_TYPE video_type, uint16_t max_packet_size, bool allow_padding) const
+{
+    const bool interlaced = video_type != VIDEO_TYPE::PROGRESSIVE;
+    if (interlaced && m_height % 2) {
+        return false;
     }
-});
+    const int field_height = interlaced ? m_height / 2 : m_height;
+    // according to 2110-10
+    std::vector<uint16_t> sizes = calculate_video_packet_sizes(m_width, field_height,
+        (uint16_t)(max_packet_size - IPV4_HDR_SIZE - UDP_HDR_SIZE), m_packetizer_format->pgroup_size, allow_padding);
+    const int packets = (int)sizes.size();
+    std::unique_ptr<RtpVideoHeaderBuilder> builder = m_packetizer_format->create(video_type, field_height, m_width,
+        packets, 1.0, 0, Rational(0), sizes);
+    return packets && builder->plan_valid();
+}
 
-void RtpAncillaryHeaderBuilder::fill_chunk(uint8_t *buff, uint16_t *payload_sizes_ptr, double send_time_ns)
+void RawVideoFile::get_frame(uint64_t index, AVFrame *frame) const
 {
-    for (size_t m_strides_index = 0; m_strides_index < m_strides_in_chunk; ++m_strides_index,
-            buff += m_packet_stride_size) {
-        memset(buff, 0, m_packet_stride_size);
-        ancillary_rtp_header* p_anc_rtp_hdr = (struct ancillary_rtp_header*)&buff[0];
-        //RTP header initialization
-        p_anc_rtp_hdr->s_rtp_header.version = 2;
-        p_anc_rtp_hdr->s_rtp_header.extension = 0;
-        p_anc_rtp_hdr->s_rtp_header.cc = 0;
-        p_anc_rtp_hdr->s_rtp_header.marker = 1;
-        p_anc_rtp_hdr->s_rtp_header.payload_type = m_payload_type;
-        p_anc_rtp_hdr->s_rtp_header.sequence_number = htobe16((uint16_t)m_seq_num);
-        p_anc_rtp_hdr->s_rtp_header.timestamp = htobe32((uint32_t)time_to_rtp_timestamp(send_time_ns, 90000));
-        p_anc_rtp_hdr->f = m_field;
+    uint8_t *data = const_cast<uint8_t*>(m_file.data()) + index * m_frame_size;
+    frame->format = m_layout;
+    frame->width = m_width;
+    frame->height = m_height;
+    if (m_layout == AVPixelFormat::AV_PIX_FMT_NONE) {
+        frame->data[0] = data;
+        frame->linesize[0] = m_v210_linesize;
+    } else {
+        av_image_fill_arrays(frame->data, frame->linesize, data, m_layout, m_width, m_height, 1);
+    }
+}
 
-        if (m_video_type != VIDEO_TYPE::PROGRESSIVE) {
-            m_field = (interlace_first_field_value == m_field)? interlace_second_field_value : interlace_first_field_value;
-        }
+/*
+ * how often a stream waiting for the other streams of its media file at the end
+ * of a loop checks whether they all arrived, see @ref LoopBarrier
+ */
+uint64_t const loop_sync_poll_interval_ns = 200000;
 
-        p_anc_rtp_hdr->s_rtp_header.ssrc = htobe32(0x0eb51dbf);
+/*
+ * a chunk whose send time passed by more than this when it is committed is sent
+ * immediately instead, see @ref MediaSender::commit_time
+ */
+uint64_t const late_commit_tolerance_ns = 600;
 
-        //Payload Header initialization
-        p_anc_rtp_hdr->extended_sequence_number = htobe16((uint16_t)(m_seq_num>>16));
-        ++m_seq_num;
-        p_anc_rtp_hdr->anc_count = 1;
-
-        ancillary_rtp_data_header* p_rtp_data_hdr = (struct ancillary_rtp_data_header*)&buff[20];
-        p_rtp_data_hdr->c = 0;
-        p_rtp_data_hdr->set_line_number(10);
-        p_rtp_data_hdr->set_horizontal_offset(11);
-        p_rtp_data_hdr->s = 0;
-        p_rtp_data_hdr->stream_num = 0;
-        p_rtp_data_hdr->set_did(m_did);
-        p_rtp_data_hdr->set_sdid(m_sdid);
-        p_rtp_data_hdr->set_data_count(1);
-        uint16_t length = 8 + p_rtp_data_hdr->set_user_data_1_and_checksum();
-        p_anc_rtp_hdr->length = htobe16(length);
-        payload_sizes_ptr[m_strides_index] = 20 /*RTP + ERTP headers*/ + length;
-    }
-}
-
-struct RtpVideoHeaderBuilder
-{
-    RtpVideoHeaderBuilder(int px_height, int px_width, int packets_in_frame_field, uint16_t bit_size,
-                          uint16_t px_grp_size, double fps, uint8_t payload_type, double timestamp_tick,
-                          std::vector<uint16_t> &sizes,
-                          VIDEO_TYPE video_type, AVPixelFormat pix_format)
-    : m_px_height(px_height)
-    , m_px_width(px_width)
-    , m_packets_in_frame_field(packets_in_frame_field)
-    , m_bit_depth(bit_size)
-    , m_grp_size(px_grp_size)
-    , m_px_grp_in_line(px_width / PX_IN_422_GRP)
-    , m_fps(fps)
-    , m_payload_type(payload_type)
-    , m_timestamp_tick(timestamp_tick)
-    , m_sizes(std::move(sizes))
-    , m_video_type(video_type)
-    , m_pix_format(pix_format)
-    { }
-    void set_counters() {
-        m_Y_counter = 0;
-        m_Cb_counter = 0;
-        m_Cr_counter = 0;
-        if ((m_video_type != VIDEO_TYPE::PROGRESSIVE) && (m_field)) {
-            jump_to_next_line_interlace_logic();
+/**
+ * Commit times of the chunks of a stream: a chunk committed after the time it
+ * must be sent at is late and goes out immediately.
+ */
+struct SenderStats
+{
+    uint64_t chunks = 0;
+    uint64_t late_chunks = 0;
+    uint64_t max_lateness_ns = 0;
+    // shortest time between a commit and the send time of the chunk
+    int64_t min_lead_ns = std::numeric_limits<int64_t>::max();
+    // chunks committed to be sent immediately, their send time had passed
+    uint64_t late_commits = 0;
+    // errors of the waits of the sender thread for this stream
+    WakeUpHistogram wake_ups;
+
+    void add(uint64_t send_time_ns, uint64_t commit_time_ns)
+    {
+        ++chunks;
+        const int64_t lead_ns = (int64_t)(send_time_ns - commit_time_ns);
+        min_lead_ns = std::min(min_lead_ns, lead_ns);
+        if (lead_ns < 0) {
+            ++late_chunks;
+            max_lateness_ns = std::max(max_lateness_ns, (uint64_t)-lead_ns);
         }
     }
+};
 
-    void jump_to_next_line_interlace_logic() {
-        if (m_pix_format == AVPixelFormat::AV_PIX_FMT_YUV422P ||
-            m_pix_format == AVPixelFormat::AV_PIX_FMT_YUV422P10LE) {
-            m_Cb_counter += m_px_grp_in_line;
-            m_Y_counter += m_px_grp_in_line;
-            m_Cr_counter += m_px_grp_in_line;
-            m_Y_counter += m_px_grp_in_line;
-        }
-        else if (m_pix_format == AVPixelFormat::AV_PIX_FMT_UYVY422) {
-            m_Y_counter += (m_px_grp_in_line * m_grp_size);
-        }
-        else {
-            std::cerr << "unsupported pixel format\n";
-            throw std::runtime_error("unsupported pixel format");
-        }
-    }
+/**
+ * Output media stream sending one chunk per @ref step, so that a sender
+ * thread can serve it alone (see @ref run_media_sender) or together with other
+ * streams (see @ref rivermax_multiplexed_sender).
+ */
+class MediaSender
+{
+public:
+    enum class Step {
+        RUNNING,
+        // call again at @ref retry_time_ns
+        BLOCKED,
+        DONE
+    };
+
+    /**
+     * @param [in] name - stream kind in the logs;
+     * @param [in] multiplexed - the sender thread serves other streams, @ref step
+     *                           returns Step::BLOCKED instead of waiting for a free
+     *                           chunk, for input or for the other streams at the end
+     *                           of a loop.
+     */
+    MediaSender(const char *name, bool multiplexed) : m_name(name), m_multiplexed(multiplexed) {}
+    virtual ~MediaSender() = default;
 
-    void fill_packet(uint8_t *buff, SendData &sd, AVFrame *av_frame);
-    uint32_t m_seq_num = 0;
-    int m_px_height;
-    int m_px_width;
-    int m_packets_in_frame_field;
-    uint16_t m_bit_depth;
-    uint16_t m_srd_offset = 0;
-    uint16_t m_grp_size;
-    uint16_t m_px_grp_in_line;
-    double m_fps;
-    uint8_t m_payload_type;
-    double m_timestamp_tick;
-    uint8_t *m_Y = nullptr;
-    uint8_t *m_Cb = nullptr;
-    uint8_t *m_Cr = nullptr;
-    uint32_t m_Y_counter = 0;
-    uint32_t m_Cb_counter = 0;
-    uint32_t m_Cr_counter = 0;
-    uint16_t m_curr_line = 0;
-    std::vector<uint16_t> m_sizes;
-    VIDEO_TYPE m_video_type = VIDEO_TYPE::NON_VIDEO;
-    bool m_field = false;
-    AVPixelFormat m_pix_format = AV_PIX_FMT_NONE;
-};
+    /**
+     * Creates the output stream, @ref retry_time_ns is when to start sending.
+     *
+     * @return false on error, the other threads are stopped.
+     */
+    virtual bool start() = 0;
+    /**
+     * Fills and commits the next chunk.
+     */
+    virtual Step step() = 0;
+    /**
+     * Destroys the output stream and notifies the other threads.
+     */
+    virtual void stop() = 0;
+    /**
+     * Notifies the other threads that the stream won't be sent, in place of
+     * @ref stop for a sender that was not started or failed to start.
+     */
+    virtual void abandon() = 0;
+    /**
+     * TAI time the next chunk is sent at.
+     */
+    virtual uint64_t deadline_ns() const = 0;
+    /**
+     * Packets per second, to balance the streams between sender threads.
+     */
+    virtual double packet_rate() const = 0;
+
+    const char *name() const { return m_name; }
+    rmx_stream_id stream_id() const { return m_stream_id; }
+    uint64_t retry_time_ns() const { return m_retry_time_ns; }
+    const SenderStats &stats() const { return m_stats; }
+    void print_stats() const;
+    /**
+     * Waits until @p time_ns, see @ref wake_up_at, the wake-up error is recorded
+     * in the statistics of the stream.
+     */
+    void sleep_until(uint64_t time_ns)
+    {
+        m_stats.wake_ups.add(wake_up_at(time_ns));
+    }
 
-void RtpVideoHeaderBuilder::fill_packet(uint8_t *buff, SendData &sd, AVFrame *av_frame)
-{
-    // build RTP header - 12 bytes
-    /*
-    0                   1                   2                   3
-    0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
-    +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
-    | V |P|X|  CC   |M|     PT      |            SEQ                |
-    +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
-    |                           timestamp                           |
-    +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
-    |                           ssrc                                |
-    +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+*/
-    rtp_header* p_rtp_header = (rtp_header*)buff;
-    p_rtp_header->version = 2;
-    p_rtp_header->extension = 0;
-    p_rtp_header->cc = 0;
-    p_rtp_header->timestamp = htobe32((uint32_t)m_timestamp_tick);
-    if (sd.packet_counter == m_packets_in_frame_field - 1) {
-        p_rtp_header->marker = 1;
-
-        double ticks = (90000.0 / m_fps);
-        if (m_video_type != VIDEO_TYPE::PROGRESSIVE) {
-            ticks /= 2;
-        }
-        m_timestamp_tick += ticks;
-    } else {
-        p_rtp_header->marker = 0;
-    }
-    p_rtp_header->payload_type = m_payload_type;
-    p_rtp_header->sequence_number = htobe16((uint16_t)m_seq_num);
-    p_rtp_header->ssrc = 0x0eb51dbd; // simulated ssrc
-
-    // build SRD header - 8-14 bytes
-    /*
-    0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
-    +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
-    |    Extended Sequence Number   |           SRD Length          |
-    +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
-    |F|     SRD Row Number          |C|         SRD Offset          |
-    +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+*/
-    void *buffer = ++p_rtp_header;
-    *(uint16_t *)buffer = htobe16((uint16_t )(m_seq_num >> 16));
-    ++m_seq_num;
-    srd_header *srd = reinterpret_cast<srd_header*>(reinterpret_cast<uint8_t*>(buffer) +
-        SIZE_OF_EXTENSION_SEQ);
-    int data_offset = sizeof(rtp_header) + SIZE_OF_EXTENSION_SEQ + sizeof(srd_header);
-    int payload_size = m_sizes[sd.packet_counter] - data_offset;
-    // check how many SRD we need
-    srd->set_srd_row_number(m_curr_line);
-    srd->set_srd_offset(m_srd_offset);
-    int payload_sz_with_2_srds = (payload_size - sizeof(srd_header)) / m_grp_size * m_grp_size;
-    int copy_size = payload_size;
-    if ((sd.px_grp_left_in_line < payload_size / m_grp_size) &&
-        (sd.px_grp_left_in_frame_field > sd.px_grp_left_in_line) &&
-        ((payload_sz_with_2_srds - (sd.px_grp_left_in_line * m_grp_size)) >= m_grp_size)) {
-        // this handles case when two srds are needed since line has less px then payload can contain
-        payload_size -= sizeof(srd_header);
-        payload_size = payload_size / m_grp_size * m_grp_size;
-        copy_size = payload_size;
-        uint16_t px_sizes = sd.px_grp_left_in_line * m_grp_size;
-        srd->srd_length = htobe16(px_sizes);
-        payload_size -= px_sizes;
-        sd.px_grp_left_in_frame_field -= sd.px_grp_left_in_line;
-        sd.px_grp_left_in_line = 0;
-        srd->c = 1;
-        srd->f = m_field;
-        srd++;
-        px_sizes = payload_size / m_grp_size * m_grp_size;
-        srd->srd_length = htobe16(px_sizes);
-        m_curr_line = (m_curr_line + 1) % m_px_height;
-        srd->set_srd_row_number(m_curr_line);
-        srd->set_srd_offset(0);
-        srd->c = 0;
-        srd->f = m_field;
-        sd.px_grp_left_in_frame_field -= (payload_size / m_grp_size);
-        sd.px_grp_left_in_line = m_px_grp_in_line - payload_size / m_grp_size;
-        m_srd_offset = ((m_px_grp_in_line - sd.px_grp_left_in_line) * m_grp_size *
-            BITS_IN_BYTES / m_bit_depth / PX_IN_422_GRP) % m_px_width;
-        data_offset += sizeof(srd_header);
-    } else {
-        // handle cases of one SRD
-        payload_size = payload_size / m_grp_size * m_grp_size;
-        srd->c = 0;
-        srd->f = m_field;
-        // last packet in frame/field
-        if (unlikely(sd.px_grp_left_in_frame_field <= payload_size / m_grp_size)) {
-            copy_size = sd.px_grp_left_in_frame_field * m_grp_size;
-            srd->srd_length = htobe16((uint16_t)copy_size);
-            m_curr_line = 0;
-            m_srd_offset = 0;
-            if (unlikely(sd.px_grp_left_in_frame_field < payload_size / m_grp_size)) {
-                memset(&buff[data_offset] + copy_size, 0, payload_size - copy_size);
-            }
-        } else {
-            copy_size = payload_size;
-            srd->srd_length = htobe16(payload_size);
-            sd.px_grp_left_in_line -= payload_size / m_grp_size;
-            sd.px_grp_left_in_frame_field -= payload_size / m_grp_size;
-            m_srd_offset = ((m_px_grp_in_line - sd.px_grp_left_in_line) * m_grp_size *
-                BITS_IN_BYTES / m_bit_depth / PX_IN_422_GRP) % m_px_width;
-            if (!sd.px_grp_left_in_line) {
-                m_curr_line = (m_curr_line + 1) % m_px_height;
-                sd.px_grp_left_in_line = m_px_grp_in_line;
-                m_srd_offset = 0;
-            }
+protected:
+    /**
+     * Returns the Rivermax time to commit a chunk sent at @p send_time_ns, or 0
+     * to send it immediately if that time has passed, which is counted as a
+     * late commit.
+     */
+    uint64_t commit_time(uint64_t send_time_ns)
+    {
+        if (unlikely(send_time_ns + late_commit_tolerance_ns < get_tai_time_ns())) {
+            ++m_stats.late_commits;
+            return 0;
         }
+        /*
+        * When timer handler callback is not used we have a mismatch between
+        * media_sender clock (TAI) and rivermax clock (UTC).
+        * To fix this we are calling to align_to_rmax_time function to convert
+        * @time from TAI to UTC
+        */
+        return align_to_rmax_time(send_time_ns);
     }
-    // copy data from avFrame to buffer
-    if (av_frame->format == AVPixelFormat::AV_PIX_FMT_YUV422P) {
-        int offset = data_offset;
-        while (data_offset < copy_size + offset) {
-            buff[data_offset++] = m_Cb[m_Cb_counter++];
-            buff[data_offset++] = m_Y[m_Y_counter++];
-            buff[data_offset++] = m_Cr[m_Cr_counter++];
-            buff[data_offset++] = m_Y[m_Y_counter++];
 
-            if ((m_video_type != VIDEO_TYPE::PROGRESSIVE) && !(m_Cb_counter % m_px_grp_in_line)) {
-                jump_to_next_line_interlace_logic();
-            }
+    Step blocked_until(uint64_t time_ns)
+    {
+        m_retry_time_ns = time_ns;
+        return Step::BLOCKED;
+    }
+    /**
+     * Creates the output stream of the sender on @ref media_output.
+     *
+     * @return false on error.
+     */
+    bool create_stream(const MediaOutputStreamParams &params);
+    /**
+     * Cancels the unsent chunks and destroys the output stream.
+     */
+    void destroy_stream();
+    /**
+     * Starts waiting for the other streams of the media file at the end of a
+     * loop, see @ref LoopBarrier.
+     *
+     * @param [in] barrier - barrier of the streams of the media file;
+     * @param [in] alignment_point - first alignment point the stream can
+     *                               continue at, see @ref next_alignment_point.
+     */
+    void end_loop(LoopBarrier &barrier, uint64_t alignment_point);
+    /**
+     * Polled after @ref end_loop.
+     *
+     * @param [out] alignment_point - where all the streams continue.
+     *
+     * @return true once all the streams of the media file ended the loop.
+     */
+    bool loop_synced(const LoopBarrier &barrier, uint64_t &alignment_point)
+    {
+        if (!barrier.released(m_loop_ticket, alignment_point)) {
+            return false;
         }
+        m_waiting_for_loop_sync = false;
+        return true;
     }
-    else if (av_frame->format == AVPixelFormat::AV_PIX_FMT_UYVY422) {
 
-        if (m_video_type == VIDEO_TYPE::PROGRESSIVE) {
-            memcpy(&buff[data_offset], &m_Y[m_Y_counter], copy_size);
-            m_Y_counter += copy_size;
-        } else {
-            uint32_t size_to_copy = (m_Y_counter + copy_size) % m_px_grp_in_line;
-            memcpy(&buff[data_offset], &m_Y[m_Y_counter], size_to_copy);
-            m_Y_counter += size_to_copy;
+    const char *m_name;
+    const bool m_multiplexed;
+    std::unique_ptr<MediaOutputStream> m_stream;
+    rmx_stream_id m_stream_id = 0;
+    uint64_t m_retry_time_ns = 0;
+    bool m_waiting_for_loop_sync = false;
+    uint32_t m_loop_ticket = 0;
+    SenderStats m_stats;
+};
 
-            if (!(m_Y_counter % m_px_grp_in_line) ) {
-                jump_to_next_line_interlace_logic();
-            }
+bool MediaSender::create_stream(const MediaOutputStreamParams &params)
+{
+    // a multiplexed sender polls for free chunks instead of waiting for events
+    m_stream = media_output->create_stream(params, !m_multiplexed && !disable_wait_for_event);
+    if (!m_stream) {
+        return false;
+    }
+    m_stream_id = m_stream->id();
+    std::cout << params.name << " stream created with ID " << m_stream_id << std::endl;
+    return true;
+}
 
-            if (copy_size - size_to_copy) {
-                memcpy(&buff[data_offset + size_to_copy], &m_Y[m_Y_counter], copy_size - size_to_copy);
-                m_Y_counter += (copy_size - size_to_copy);
-                if (!(m_Y_counter % m_px_grp_in_line) ) {
-                    jump_to_next_line_interlace_logic();
-                }
-            }
-        }
+void MediaSender::destroy_stream()
+{
+    rmx_status status = m_stream->cancel_unsent_chunks();
+    if (status != RMX_OK) {
+        std::cerr << "Failed to cancel unsent chunk, got status: " << status << std::endl;
     }
-    else if (av_frame->format == AVPixelFormat::AV_PIX_FMT_YUV422P10LE) {
-        int offset = data_offset;
 
-        while (data_offset < copy_size + offset) {
-            uint16_t *cb = reinterpret_cast<uint16_t*>(m_Cb);
-            uint16_t *cr = reinterpret_cast<uint16_t*>(m_Cr);
-            uint16_t *y = reinterpret_cast<uint16_t*>(m_Y);
+    do {
+        std::this_thread::sleep_for(milliseconds{300});
+        status = m_stream->destroy();
+    } while (status == RMX_BUSY);
 
-            buff[data_offset] = (cb[m_Cb_counter]) >> 2;
-            buff[data_offset + 1] = (((cb[m_Cb_counter]) << 6) & 0xc0) | (y[m_Y_counter] >> 4);
-            buff[data_offset + 2] = (((y[m_Y_counter]) << 4) & 0xf0) | ((cr[m_Cr_counter]) >> 6);
-            ++m_Y_counter;
-            buff[data_offset + 3] = (((cr[m_Cr_counter]) << 2) & 0xfc) | ((y[m_Y_counter]) >> 8);
-            buff[data_offset + 4] = ((y[m_Y_counter]) & 0xff);
-            ++m_Y_counter;
-            ++m_Cb_counter;
-            ++m_Cr_counter;
-            data_offset += 5;
+    if (status != RMX_OK) {
+        std::cerr << "Failed to destroy stream, got status: " << status << std::endl;
+    }
+    m_stream.reset();
+}
 
-            if ((m_video_type != VIDEO_TYPE::PROGRESSIVE) && !(m_Cr_counter % m_px_grp_in_line) ) {
-                jump_to_next_line_interlace_logic();
-            }
-        }
+void MediaSender::print_stats() const
+{
+    std::cout << m_name << " stream " << m_stream_id << ": " << m_stats.chunks << " chunks, " <<
+        m_stats.late_chunks << " late";
+    if (m_stats.late_chunks) {
+        std::cout << " (up to " << m_stats.max_lateness_ns / 1000 << " us)";
     }
-    else {
-        std::cerr << "unsupported pixel format\n";
-        throw std::runtime_error("unsupported pixel format");
+    if (m_stats.chunks) {
+        std::cout << ", min lead " << std::fixed << std::setprecision(3) << m_stats.min_lead_ns / 1e6 << " ms" <<
+            std::defaultfloat;
     }
+    std::cout << ", " << m_stats.late_commits << " sent immediately, ";
+    m_stats.wake_ups.print(std::cout);
+    std::cout << std::endl;
 }
 
-void AVFrameDeleter(AVFrame* f)
+void MediaSender::end_loop(LoopBarrier &barrier, uint64_t alignment_point)
 {
-    av_frame_free(&f);
+    if (barrier.arrive(alignment_point, m_loop_ticket)) {
+        std::cout << "End of loop #" << m_loop_ticket + 1 << std::endl;
+    }
+    m_waiting_for_loop_sync = true;
 }
 
-void AVPacketDeleter(AVPacket* p)
+/**
+ * Sends a stream from the calling thread until it is done.
+ */
+static void run_media_sender(MediaSender &sender)
 {
-    av_packet_unref(p);
-    delete p;
+    if (!sender.start()) {
+        return;
+    }
+    sender.sleep_until(sender.retry_time_ns());
+    std::cout << sender.name() << " sender is on!" << std::endl;
+
+    MediaSender::Step step;
+    while ((step = sender.step()) != MediaSender::Step::DONE) {
+        if (step == MediaSender::Step::BLOCKED) {
+            sender.sleep_until(sender.retry_time_ns());
+        }
+    }
+    sender.stop();
 }
 
-void AVSubtitleDeleter(AVSubtitle* s)
+class AncillarySender : public MediaSender
 {
-    avsubtitle_free(s);
-    delete s;
+public:
+    AncillarySender(AncillaryRmaxData data, bool multiplexed);
+    bool start() override;
+    Step step() override;
+    void stop() override;
+    void abandon() override { m_data.notify_all_cv(); }
+    uint64_t deadline_ns() const override;
+    double packet_rate() const override { return m_frames_fields_per_sec; }
+
+private:
+    void start_loop();
+    bool restart_after_loop_sync();
+    cst_data time_calculation_data() const
+    {
+        return cst_data(m_data.video_width, m_data.video_height, m_data.fps, m_data.video_type,
+                        m_data.video_pix_format, m_data.video_sample_rate);
+    }
+
+    // a chunk is the packet of a frame/field, sent at its time
+    static constexpr size_t strides_in_chunk = 1;
+    // the frames/fields of this time are committed ahead, in a memory block
+    static constexpr uint32_t block_time_ms = 1000;
+
+    AncillaryRmaxData m_data;
+    size_t m_packet_stride_size;
+    Rational m_video_frame_field_time_interval_ns;
+    uint32_t m_frames_fields_per_sec;
+    uint32_t m_frames_fields_per_video;
+    std::unique_ptr<RtpAncillaryHeaderBuilder> m_chunk_builder;
+    Rational m_start_send_time_ns;
+    uint32_t m_frame_field_index = 0;
+};
+
+AncillarySender::AncillarySender(AncillaryRmaxData data, bool multiplexed)
+    : MediaSender("Ancillary", multiplexed)
+    , m_data(std::move(data))
+{
+    m_packet_stride_size = river_align_up_pow2(m_data.packet_templates->max_packet_size(),
+                                               get_cache_line_size()); // align to cache line
+
+    m_video_frame_field_time_interval_ns = Rational((uint64_t)nanoseconds{seconds{1}}.count()) /
+        rational_approximation(m_data.fps);
+    m_frames_fields_per_sec = (uint32_t)m_data.fps;
+    m_frames_fields_per_video = (uint32_t)(m_data.fps * m_data.video_duration_sec);
+    if (m_data.video_type != VIDEO_TYPE::PROGRESSIVE) {
+        m_video_frame_field_time_interval_ns /= 2;
+        m_frames_fields_per_video *= 2;
+        m_frames_fields_per_sec *= 2;
+    }
 }
 
-struct SynchronizerData
+bool AncillarySender::start()
 {
-    SynchronizerData() = default;
-    SynchronizerData(
-        std::shared_ptr<std::condition_variable> &_sync_cv
-        , std::shared_ptr<std::condition_variable> &_eof_cv
-        , std::shared_ptr<std::atomic<int>> &_eof_stream_counter) :
-            sync_cv(_sync_cv)
-            , eof_cv(_eof_cv)
-            , eof_stream_counter(_eof_stream_counter)
-    { }
+    std::ifstream is(m_data.sdp_path);
+
+    // Setup ancillary stream settings, anc data uses dynamic mode and has no packet layout
+    MediaOutputStreamParams params;
+    params.name = "ancillary";
+    params.sdp.assign(std::istreambuf_iterator<char>(is), std::istreambuf_iterator<char>());
+    params.idx_in_sdp = 2;
+    params.chunks_in_block = std::max<size_t>(1, (size_t)m_frames_fields_per_sec * block_time_ms / 1000);
+    params.packets_in_chunk = strides_in_chunk;
+    params.packets_in_frame = 1;
+    params.stride_size = (uint16_t)m_packet_stride_size;
+
+    if (!create_stream(params)) {
+        run_threads = false;
+        m_data.notify_all_cv();
+        return false;
+    }
+    m_chunk_builder.reset(new RtpAncillaryHeaderBuilder(
+        m_data.packet_templates
+        , strides_in_chunk
+        , (uint16_t)m_packet_stride_size
+        , m_data.video_type
+    ));
 
-    std::shared_ptr<std::condition_variable> sync_cv;
-    std::shared_ptr<std::condition_variable> eof_cv;
-    std::shared_ptr<double> video_next_frame_field_send_time_ns;
-    std::shared_ptr<double> audio_next_chunk_send_time_ns;
-    std::shared_ptr<double> ancillary_next_chunk_send_time_ns;
-    std::shared_ptr<std::atomic<int>> eof_stream_counter;
-    int number_of_streams = 0;
+    m_retry_time_ns = m_data.next_chunk_send_time_ns->integer() - (uint64_t)nanoseconds{seconds{1}}.count();
+    start_loop();
+    return true;
+}
 
-    static void streams_synchronizer(SynchronizerData data)
-    {
-        std::mutex lck;
-        std::unique_lock<std::mutex> lock(lck);
-        uint32_t loop_counter = 0;
+void AncillarySender::start_loop()
+{
+    m_start_send_time_ns = *m_data.next_chunk_send_time_ns;
+    m_frame_field_index = 0;
+}
 
-        while (likely(!exit_app()) && run_threads) {
-            data.eof_cv->wait(lock, [&data]{return (*data.eof_stream_counter) == data.number_of_streams;});
+bool AncillarySender::restart_after_loop_sync()
+{
+    uint64_t alignment_point;
+    if (!loop_synced(*m_data.loop_barrier, alignment_point)) {
+        return false;
+    }
+    start_stream_at(eMediaType_t::ancillary, m_data.next_chunk_send_time_ns, time_calculation_data(),
+                    alignment_point, nullptr);
+    start_loop();
+    return true;
+}
 
-            double v_time_ns = 0;
-            if (data.video_next_frame_field_send_time_ns) {
-                v_time_ns = *data.video_next_frame_field_send_time_ns;
-            }
+uint64_t AncillarySender::deadline_ns() const
+{
+    return (m_start_send_time_ns + m_video_frame_field_time_interval_ns * m_frame_field_index).integer();
+}
 
-            double a_time_ns = 0;
-            if (data.audio_next_chunk_send_time_ns) {
-                a_time_ns = *data.audio_next_chunk_send_time_ns;
+MediaSender::Step AncillarySender::step()
+{
+    if (unlikely(exit_app() || !run_threads)) {
+        return Step::DONE;
+    }
+    if (m_waiting_for_loop_sync && !restart_after_loop_sync()) {
+        return blocked_until(get_tai_time_ns() + loop_sync_poll_interval_ns);
+    }
+    if (m_frame_field_index == m_frames_fields_per_video) {
+        if (!loop) {
+            return Step::DONE;
+        }
+        // the next loop starts right after the last frame or field
+        *m_data.next_chunk_send_time_ns = m_start_send_time_ns +
+            m_video_frame_field_time_interval_ns * m_frame_field_index;
+        if (!disable_synchronization) {
+            end_loop(*m_data.loop_barrier, next_alignment_point(eMediaType_t::ancillary,
+                                                                *m_data.next_chunk_send_time_ns,
+                                                                time_calculation_data()));
+            if (!restart_after_loop_sync()) {
+                return blocked_until(get_tai_time_ns() + loop_sync_poll_interval_ns);
             }
+            return Step::RUNNING;
+        }
+        start_loop();
+        return Step::RUNNING;
+    }
 
-            double time_ns = std::max<double>(v_time_ns, a_time_ns) + (double)nanoseconds{milliseconds{100}}.count();
+    *m_data.next_chunk_send_time_ns = m_start_send_time_ns + m_video_frame_field_time_interval_ns * m_frame_field_index;
 
-            if (data.video_next_frame_field_send_time_ns) {
-                *data.video_next_frame_field_send_time_ns = time_ns;
-            }
+    // Prepare next chunk to be fetched with the desired size
+    m_stream->set_chunk_packet_count(strides_in_chunk);
 
-            if (data.audio_next_chunk_send_time_ns) {
-                *data.audio_next_chunk_send_time_ns = time_ns;
-            }
+    // the frames/fields are committed as long as the memory block has free
+    // chunks, the sender is then ahead by the time of a block
+    rmx_status status;
+    do {
+        status = m_stream->get_next_chunk();
 
-            if (data.ancillary_next_chunk_send_time_ns) {
-                *data.ancillary_next_chunk_send_time_ns = time_ns;
+        if (status == RMX_NO_FREE_CHUNK) {
+            if (m_multiplexed) {
+                return blocked_until(get_tai_time_ns() + m_video_frame_field_time_interval_ns.integer() / 2);
             }
-
-            std::cout << "End of loop #" << ++loop_counter << std::endl;
-            *data.eof_stream_counter = 0;
-            data.sync_cv->notify_all();
+            m_stream->wait_for_free_chunk();
         }
-        std::cout << "The synchronizer is closing ..." << std::endl;
-    }
+        if (unlikely(status == RMX_SIGNAL)) {
+            std::cout << "Received CTRL-C, exiting..." << std::endl;
+            return Step::DONE;
+        }
+    } while (status != RMX_OK);
 
-public:
-    void add_stream()
-    {
-        number_of_streams++;
-    }
-};
+    uint16_t* payload_sizes_ptr = m_stream->chunk_packet_sizes();
+    uint8_t* payload = m_stream->chunk_strides();
+
+    m_chunk_builder->fill_chunk(payload, payload_sizes_ptr, *m_data.next_chunk_send_time_ns, m_frame_field_index);
+    do {
+        const uint64_t timeout = commit_time(m_data.next_chunk_send_time_ns->integer());
+        status = m_stream->commit_chunk(timeout);
+        if (status == RMX_HW_COMPLETION_ISSUE) {
+            std::cout << "got completion issue exiting" << std::endl;
+            return Step::DONE;
+        }
+        if (unlikely(status == RMX_SIGNAL)) {
+            return Step::DONE;
+        }
+    } while (status != RMX_OK);
+    m_stats.add(m_data.next_chunk_send_time_ns->integer(), get_tai_time_ns());
+    ++m_frame_field_index;
+    return Step::RUNNING;
+}
 
-void go_to_sleep(uint64_t next_time_to_wake_up_ns, uint64_t time_to_wake_before_ns)
+void AncillarySender::stop()
 {
-    uint64_t sleep_for_ns = next_time_to_wake_up_ns - get_tai_time_ns() - time_to_wake_before_ns;
-    if (next_time_to_wake_up_ns > (get_tai_time_ns() + time_to_wake_before_ns)) {
-        std::this_thread::sleep_for(nanoseconds(sleep_for_ns));
-    }
+    std::cout << "Done sending ancillary" << std::endl;
+    print_stats();
+
+    destroy_stream();
+
+    // Notify all other waiting threads that current thread is finished
+    m_data.notify_all_cv();
 }
 
 void rivermax_ancillary_sender(AncillaryRmaxData data)
@@ -1446,169 +1852,251 @@ void rivermax_ancillary_sender(AncillaryRmaxData data)
     if (unlikely(!run_threads)) {
         return;
     }
+    AncillarySender sender(std::move(data), false);
+    run_media_sender(sender);
+}
 
-    constexpr size_t packets_per_frame = 1;
-    const size_t num_of_chunks = 100 * (size_t)data.fps;
-    constexpr size_t samples_in_stride = 1;
-    constexpr size_t strides_in_chunk = 1;
-    const size_t payload_size = 236;
-    const size_t payload_size_with_rtp = payload_size + 20;  // ERTP header size
-    const size_t packet_stride_size = river_align_up_pow2(payload_size_with_rtp, get_cache_line_size()); // align to cache line
+/**
+ * Sets the packets of an audio stream: a packet holds @ref AudioRmaxData::ptime_usec
+ * of samples, and a chunk the packets of @p chunk_time_us, at least one. The
+ * chunk is the latency the sender adds, it waits for the samples of a whole
+ * chunk and commits them at once.
+ *
+ * @return false if the packet time is not a whole number of samples or a
+ *         packet doesn't fit in an MTU.
+ */
+static bool set_audio_packet_layout(AudioRmaxData &data, uint32_t chunk_time_us)
+{
+    const uint64_t samples_us = (uint64_t)data.sample_rate * data.ptime_usec;
+    const uint64_t us_in_second = (uint64_t)microseconds{ seconds{ 1 } }.count();
+    if (!samples_us || samples_us % us_in_second) {
+        std::cerr << "Audio packet time of " << data.ptime_usec << " us is not a whole number of samples at " <<
+            data.sample_rate << " Hz" << std::endl;
+        return false;
+    }
+    data.samples_in_packet = (size_t)(samples_us / us_in_second);
+    const size_t packet_size = RTP_HEADER_SIZE + data.samples_in_packet * data.channels * data.bit_depth_in_bytes;
+    const size_t max_packet_size = 1500 - IPV4_HDR_SIZE - UDP_HDR_SIZE;
+    if (packet_size > max_packet_size) {
+        std::cerr << "Audio packets of " << data.samples_in_packet << " samples of " << data.channels <<
+            " channels are " << packet_size << " bytes, more than the " << max_packet_size << " bytes of an MTU" <<
+            std::endl;
+        return false;
+    }
+    data.packets_in_chunk = std::max<size_t>(1, chunk_time_us / data.ptime_usec);
+    return true;
+}
 
-    constexpr size_t block_count = 1;
-    rmx_output_media_mem_block ancillary_block;
-    rmx_output_media_init_mem_blocks(&ancillary_block, block_count);
-    rmx_output_media_set_chunk_count(&ancillary_block, num_of_chunks);
+class AudioSender : public MediaSender
+{
+public:
+    AudioSender(AudioRmaxData data, bool multiplexed);
+    bool start() override;
+    Step step() override;
+    void stop() override;
+    void abandon() override { m_data.notify_all_cv(); }
+    uint64_t deadline_ns() const override { return m_data.next_chunk_send_time_ns->integer(); }
+    double packet_rate() const override { return 1e6 / m_data.ptime_usec; }
+    /**
+     * Returns the number of samples the ring of the sender of @p data holds at least.
+     */
+    static size_t min_ring_samples(const AudioRmaxData &data)
+    {
+        return MIN_QUEUE_ENTRIES * data.packets_in_chunk * data.samples_in_packet;
+    }
 
-    // Anc data uses dynamic_mode and we don't need toset packet layout
+private:
+    void start_loop();
+    bool restart_after_loop_sync();
+    cst_data time_calculation_data() const
+    {
+        return cst_data(m_data.ptime_usec, m_data.sample_rate, m_data.video_fps);
+    }
+    uint64_t retry_delay_ns() const { return m_chunk_time_ns.integer() / 2; }
 
-    // HDS isn't used so we only have one sub block
-    constexpr size_t subblock_count = 1;
-    constexpr size_t subblock_id = subblock_count-1;
-    rmx_output_media_set_sub_block_count(&ancillary_block, subblock_count);
+    // the memory of the stream holds that much audio, the sender runs that far ahead of the wire at most
+    static constexpr uint64_t block_time_us = 50000;
 
-    std::ifstream is(data.sdp_path);
-    std::string sdp_cont((std::istreambuf_iterator<char>(is)),
-        std::istreambuf_iterator<char>());
+    AudioRmaxData m_data;
+    size_t m_samples_in_stride;
+    size_t m_strides_in_chunk;
+    size_t m_samples_in_chunk;
+    size_t m_chunks_in_block;
+    uint16_t m_payload_size;
+    uint16_t m_packet_stride_size;
+    Rational m_chunk_time_ns;
+    std::vector<uint16_t> m_sizes;
+    std::unique_ptr<RtpAudioHeaderBuilder> m_chunk_builder;
+};
 
-    double video_frame_field_time_interval_ns = ((double)nanoseconds{seconds{1}}.count())/data.fps;
-    uint32_t frames_fields_per_sec = (uint32_t)data.fps;
-    uint32_t frames_fields_per_video = (uint32_t)(data.fps * data.video_duration_sec);
-    if (data.video_type != VIDEO_TYPE::PROGRESSIVE) {
-        video_frame_field_time_interval_ns /= 2;
-        frames_fields_per_video *= 2;
-        frames_fields_per_sec *= 2;
-    }
+AudioSender::AudioSender(AudioRmaxData data, bool multiplexed)
+    : MediaSender("Audio", multiplexed)
+    , m_data(std::move(data))
+{
+    const size_t bit_depth_in_bytes = m_data.bit_depth_in_bytes;  //3 -> 24-bit, 4 -> 32-bit
+    m_samples_in_stride = m_data.samples_in_packet;
+    m_strides_in_chunk = m_data.packets_in_chunk;
+    m_samples_in_chunk = m_strides_in_chunk * m_samples_in_stride;
+    const uint64_t chunk_time_us = m_strides_in_chunk * m_data.ptime_usec;
+    m_chunks_in_block = std::max<size_t>(2, (size_t)((block_time_us + chunk_time_us - 1) / chunk_time_us));
+    m_payload_size = (uint16_t)(bit_depth_in_bytes * m_data.channels * m_samples_in_stride);
+    const uint16_t payload_size_with_rtp = m_payload_size + RTP_HEADER_SIZE;
+    m_packet_stride_size = river_align_up_pow2(payload_size_with_rtp, get_cache_line_size()); // align to cache line
+    m_sizes.resize(m_strides_in_chunk * m_chunks_in_block, payload_size_with_rtp);
+    m_chunk_time_ns = Rational((uint64_t)nanoseconds{seconds{1}}.count() * m_samples_in_chunk, m_data.sample_rate);
+}
 
-    // Setup ancillary stream settings
-    rmx_output_media_stream_params stream_params;
-    memset(&stream_params, 0, sizeof(stream_params));
-    rmx_output_media_init(&stream_params);
-    rmx_output_media_set_sdp(&stream_params, sdp_cont.c_str());
-    rmx_output_media_assign_mem_blocks(&stream_params, &ancillary_block, block_count);
-    rmx_output_media_set_packets_per_frame(&stream_params, packets_per_frame);
-    rmx_output_media_set_packets_per_chunk(&stream_params, strides_in_chunk);
-    rmx_output_media_set_stride_size(&stream_params, subblock_id, packet_stride_size);
+bool AudioSender::start()
+{
+    std::ifstream is(m_data.sdp_path);
 
-    constexpr size_t media_block_index = 2;
-    rmx_output_media_set_idx_in_sdp(&stream_params, media_block_index);
+    // Setup audio stream settings
+    MediaOutputStreamParams params;
+    params.name = "audio";
+    params.sdp.assign(std::istreambuf_iterator<char>(is), std::istreambuf_iterator<char>());
+    params.idx_in_sdp = 1;
+    params.chunks_in_block = m_chunks_in_block;
+    params.packets_in_chunk = m_strides_in_chunk;
+    params.packets_in_frame = m_sizes.size();
+    params.stride_size = m_packet_stride_size;
+    params.packet_sizes = m_sizes.data();
+    params.dscp = m_data.dscp;
+    params.packet_interval_ns = (uint64_t)nanoseconds{microseconds{m_data.ptime_usec}}.count();
+
+    if (!create_stream(params)) {
+        run_threads = false;
+        m_data.notify_all_cv();
+        return false;
+    }
+    m_chunk_builder.reset(new RtpAudioHeaderBuilder(
+        m_payload_size
+        , m_data.payload_type
+        , m_strides_in_chunk
+        , m_data.sample_rate
+        , m_data.ptime_usec
+        , m_packet_stride_size
+        , m_samples_in_stride
+        , m_data.channels
+        , m_data.bit_depth_in_bytes
+        , m_data.timestamp_tick));
+
+    m_retry_time_ns = m_data.next_chunk_send_time_ns->integer() - (uint64_t)nanoseconds{seconds{1}}.count();
+    return true;
+}
 
-    rmx_stream_id stream_id;
-    rmx_status status = rmx_output_media_create_stream(&stream_params, &stream_id);
+void AudioSender::start_loop()
+{
+    m_data.sample_ring->take_end();
+}
 
-    if (status != RMX_OK) {
-        std::cerr << "failed creating ancillary output stream, got status:" << status;
-        run_threads = false;
-        data.notify_all_cv();
-        return;
+bool AudioSender::restart_after_loop_sync()
+{
+    uint64_t alignment_point;
+    if (!loop_synced(*m_data.loop_barrier, alignment_point)) {
+        return false;
     }
-    std::cout<<"ancillary stream created with ID "<<stream_id<<std::endl;
-    RtpAncillaryHeaderBuilder chunk_builder = RtpAncillaryHeaderBuilder(
-        data.fps
-        , data.payload_type
-        , payload_size
-        , data.did
-        , data.sdid
-        , strides_in_chunk
-        , (uint16_t)packet_stride_size
-        , samples_in_stride
-        , data.video_type
-    );
+    start_stream_at(audio, m_data.next_chunk_send_time_ns, time_calculation_data(), alignment_point,
+                    &m_chunk_builder->m_timestamp_tick);
+    start_loop();
+    return true;
+}
 
-    rmx_output_media_chunk_handle chunk_handle;
-    rmx_output_media_init_chunk_handle(&chunk_handle, stream_id);
+MediaSender::Step AudioSender::step()
+{
+    if (unlikely(exit_app() || !run_threads)) {
+        return Step::DONE;
+    }
+    if (m_waiting_for_loop_sync && !restart_after_loop_sync()) {
+        return blocked_until(get_tai_time_ns() + loop_sync_poll_interval_ns);
+    }
 
-    go_to_sleep((uint64_t)*data.next_chunk_send_time_ns, (uint64_t)nanoseconds{seconds{1}}.count());
+    SampleRing &ring = *m_data.sample_ring;
+    bool at_end;
+    size_t samples = ring.readable(at_end);
+    if (samples < m_samples_in_chunk && !at_end) {
+        if (ring.closed()) {
+            return Step::DONE;
+        }
+        if (m_multiplexed) {
+            return blocked_until(get_tai_time_ns() + retry_delay_ns());
+        }
+        std::cout << "Audio sender is waiting" << std::endl;
+        samples = ring.wait_for_samples(m_samples_in_chunk, at_end);
+        if (samples < m_samples_in_chunk && !at_end) {
+            return Step::DONE;
+        }
+    }
+    // the last chunk of an iteration ends it, padded with silence
+    const bool pause_after_commit = samples <= m_samples_in_chunk && at_end;
+    const size_t packets = std::min(samples, m_samples_in_chunk) / m_samples_in_stride;
 
-    std::cout << "Ancillary sender is on!" << std::endl;
+    //Build chunk
+    rmx_status status;
+    do {
+        status = m_stream->get_next_chunk();
 
-    uint8_t* payload = nullptr;
-    uint16_t* payload_sizes_ptr = nullptr;
+        if (pause_after_commit) {
+            m_stream->set_pause_after_commit();
+        }
 
-    while (likely(!exit_app()) && run_threads) {
-        double start_send_time_ns = *data.next_chunk_send_time_ns;
-        for (uint32_t frame_field_index = 0; frame_field_index < frames_fields_per_video; ++frame_field_index) {
-            *data.next_chunk_send_time_ns = start_send_time_ns + frame_field_index * video_frame_field_time_interval_ns;
-            if (0 == ((frame_field_index + 1) % frames_fields_per_sec)) {
-                // wait for ancillary time instead of sending massive chunks to rivermax
-                go_to_sleep((uint64_t)*data.next_chunk_send_time_ns, (uint64_t)nanoseconds{milliseconds{ancillary_wakeup_delta_ms}}.count());
+        if (status == RMX_NO_FREE_CHUNK) {
+            if (m_multiplexed) {
+                return blocked_until(get_tai_time_ns() + retry_delay_ns());
             }
+            m_stream->wait_for_free_chunk();
+        }
 
-            // Prepare next chunk to be fetched with the desired size
-            rmx_output_media_set_chunk_packet_count(&chunk_handle, strides_in_chunk);
-
-            do {
-                status = rmx_output_media_get_next_chunk(&chunk_handle);
+        if (unlikely(status == RMX_SIGNAL)) {
+            return Step::DONE;
+        }
+    } while (status != RMX_OK);
 
-                if (unlikely(status == RMX_SIGNAL)) {
-                    std::cout << "Received CTRL-C, exiting..." << std::endl;
-                    goto end;
-                }
-            } while (status != RMX_OK);
+    uint8_t* chunk_buffer = m_stream->chunk_strides();
+    m_chunk_builder->fill_chunk(chunk_buffer, ring, packets);
+    ring.consume(packets);
 
-            payload_sizes_ptr = rmx_output_media_get_chunk_packet_sizes(&chunk_handle, subblock_id);
-            payload = static_cast<uint8_t*>(rmx_output_media_get_chunk_strides(&chunk_handle, subblock_id));
+    do {
+        const uint64_t send_time = commit_time(m_data.next_chunk_send_time_ns->integer());
+        status = m_stream->commit_chunk(send_time);
 
-            chunk_builder.fill_chunk(payload, payload_sizes_ptr, *data.next_chunk_send_time_ns);
-            do {
-                uint64_t timeout = (uint64_t)*data.next_chunk_send_time_ns;
-                if (unlikely(timeout + 600 < get_tai_time_ns())) {
-                    timeout = 0;
-                } else {
-                    /*
-                    * When timer handler callback is not used we have a mismatch between
-                    * media_sender clock (TAI) and rivermax clock (UTC).
-                    * To fix this we are calling to align_to_rmax_time function to convert
-                    * @time from TAI to UTC
-                    */
-                    timeout = align_to_rmax_time(timeout);
-                }
-                status = rmx_output_media_commit_chunk(&chunk_handle, timeout);
-                if (status == RMX_HW_COMPLETION_ISSUE) {
-                    std::cout << "got completion issue exiting" << std::endl;
-                    goto end;
-                }
-                if (unlikely(status == RMX_SIGNAL)) {
-                    goto end;
-                }
-            } while (status != RMX_OK);
+        if (status == RMX_HW_COMPLETION_ISSUE) {
+            std::cout << "got completion issue exiting" << std::endl;
+            return Step::DONE;
         }
+        if (unlikely(status == RMX_SIGNAL)) {
+            return Step::DONE;
+        }
+    } while (status != RMX_OK);
+    m_stats.add(m_data.next_chunk_send_time_ns->integer(), get_tai_time_ns());
+    *m_data.next_chunk_send_time_ns += m_chunk_time_ns;
 
+    if (pause_after_commit) {
         if (!loop) {
-            break;
+            return Step::DONE;
         }
 
-
         if (!disable_synchronization) {
-            std::unique_lock<std::mutex> lock(*data.sync_lock);
-            data.eof_stream_counter->fetch_add(1);
-            data.eof_cv->notify_one();
-            data.sync_cv->wait(lock);
-            cst_data time_calculation_data(data.video_width, data.video_height,
-                                       data.fps, data.video_type, data.video_pix_format, data.video_sample_rate);
-            calculate_stream_time(eMediaType_t::ancillary, data.next_chunk_send_time_ns,
-                                      time_calculation_data, nullptr);
+            end_loop(*m_data.loop_barrier, next_alignment_point(audio, *m_data.next_chunk_send_time_ns,
+                                                                time_calculation_data()));
+            if (!restart_after_loop_sync()) {
+                return blocked_until(get_tai_time_ns() + loop_sync_poll_interval_ns);
+            }
+            return Step::RUNNING;
         }
+        start_loop();
     }
-end:
-    std::cout << "Done sending ancillary" << std::endl;
-
-    status = rmx_output_media_cancel_unsent_chunks(&chunk_handle);
-    if (status != RMX_OK) {
-        std::cerr << "Failed to cancel unsent chunk, got status: " << status << std::endl;
-    }
+    return Step::RUNNING;
+}
 
-    do {
-        std::this_thread::sleep_for(milliseconds{300});
-        status = rmx_output_media_destroy_stream(stream_id);
-    } while (status == RMX_BUSY);
+void AudioSender::stop()
+{
+    std::cout << "done sending audio" << std::endl;
+    print_stats();
 
-    if (status != RMX_OK) {
-        std::cerr << "Failed to destroy stream, got status: " << status << std::endl;
-    }
+    destroy_stream();
 
     // Notify all other waiting threads that current thread is finished
-    data.notify_all_cv();
+    m_data.notify_all_cv();
 }
 
 void rivermax_audio_sender(AudioRmaxData data)
@@ -1619,195 +2107,461 @@ void rivermax_audio_sender(AudioRmaxData data)
     data.set_thread_affinity();
     rt_set_thread_priority(RMAX_THREAD_PRIORITY_TIME_CRITICAL);
 
-    const size_t num_of_av_packet_in_chunk = 3;
-    const size_t bit_depth_in_bytes = data.bit_depth_in_bytes;  //3 -> 24-bit, 4 -> 32-bit
-    const size_t num_of_samples_in_av_packet = 1024;
-    const size_t num_of_chunks = 50;
-    const size_t samples_in_stride = data.sample_rate / (microseconds{ seconds{ 1 } } / microseconds{ data.ptime_usec });
-    const size_t strides_in_chunk = (num_of_samples_in_av_packet * num_of_av_packet_in_chunk) / samples_in_stride;
-    const uint16_t payload_size =
-        (uint16_t)(bit_depth_in_bytes * data.channels * samples_in_stride);
-    const uint16_t payload_size_with_rtp = payload_size + RTP_HEADER_SIZE;
-    const uint16_t packet_stride_size = river_align_up_pow2(payload_size_with_rtp, get_cache_line_size()); // align to cache line
-
-    constexpr size_t block_count = 1;
-    rmx_output_media_mem_block audio_block;
-    rmx_output_media_init_mem_blocks(&audio_block, block_count);
-    rmx_output_media_set_chunk_count(&audio_block, num_of_chunks);
-
-    // HDS isn't used so we only have one sub block
-    constexpr size_t subblock_count = 1;
-    constexpr size_t subblock_id = subblock_count - 1;
-    rmx_output_media_set_sub_block_count(&audio_block, subblock_count);
-
-    std::vector<uint16_t> sizes;
-    sizes.resize(strides_in_chunk * num_of_chunks, payload_size_with_rtp);
-    rmx_output_media_set_packet_layout(&audio_block, subblock_id, sizes.data());
-
-    std::ifstream is(data.sdp_path);
-    std::string sdp_cont((std::istreambuf_iterator<char>(is)),
-        std::istreambuf_iterator<char>());
+    AudioSender sender(std::move(data), false);
+    run_media_sender(sender);
+}
 
-    // Setup audio stream settings
-    rmx_output_media_stream_params stream_params;
-    rmx_output_media_init(&stream_params);
-    rmx_output_media_set_sdp(&stream_params, sdp_cont.c_str());
-    rmx_output_media_assign_mem_blocks(&stream_params, &audio_block, block_count);
-    rmx_output_media_set_dscp(&stream_params, data.dscp);
-    rmx_output_media_set_packets_per_frame(&stream_params, sizes.size());
-    rmx_output_media_set_packets_per_chunk(&stream_params, strides_in_chunk);
-    rmx_output_media_set_stride_size(&stream_params, subblock_id, packet_stride_size);
-
-    constexpr size_t media_block_index = 1;
-    rmx_output_media_set_idx_in_sdp(&stream_params, media_block_index);
-
-    rmx_stream_id stream_id;
-    rmx_status status = rmx_output_media_create_stream(&stream_params, &stream_id);
-    if (status != RMX_OK) {
-        std::cerr << "failed creating audio output stream, got status:" << status;
-        run_threads = false;
-        data.notify_all_cv();
-        return;
-    }
-    std::cout<<"audio stream created with ID "<<stream_id<<std::endl;
-    RtpAudioHeaderBuilder chunk_builder = RtpAudioHeaderBuilder(
-        payload_size
-        , data.payload_type
-        , strides_in_chunk
-        , data.sample_rate
-        , data.ptime_usec
-        , packet_stride_size
-        , samples_in_stride
-        , data.channels
-        , num_of_samples_in_av_packet
-        , bit_depth_in_bytes
-        , data.timestamp_tick);
-
-    EventMgr event_mgr;
-    if (!disable_wait_for_event && !event_mgr.init(stream_id)) {
-        run_threads = false;
-        data.notify_all_cv();
-        return;
+/**
+ * Returns the packetizer the video sender uses for frames of @p pix_format,
+ * frames of formats without a packetizer are converted to UYVY by the scaler.
+ */
+const VideoPacketizerFormat *video_sender_packetizer_format(AVPixelFormat pix_format)
+{
+    const VideoPacketizerFormat *packetizer_format = find_video_packetizer_format(pix_format);
+    if (!packetizer_format) {
+        packetizer_format = find_video_packetizer_format(AVPixelFormat::AV_PIX_FMT_UYVY422);
     }
+    return packetizer_format;
+}
 
-    rmx_output_media_chunk_handle chunk_handle;
-    rmx_output_media_init_chunk_handle(&chunk_handle, stream_id);
-
-    uint64_t frame_send_time_ns = (uint64_t)nanoseconds{milliseconds{(uint64_t)strides_in_chunk}}.count();
-    go_to_sleep((uint64_t)*data.next_chunk_send_time_ns, (uint64_t)nanoseconds{seconds{1}}.count());
-
-    std::cout << "Audio sender is on!" << std::endl;
+/**
+ * Returns the lines of a frame/field of the video stream.
+ */
+uint16_t video_frame_field_height(const VideoRmaxData &data)
+{
+    return data.video_type != VIDEO_TYPE::PROGRESSIVE ? data.height / 2 : data.height;
+}
 
-start:
-    bool first_loop = true;
-    uint32_t arr_index = 0;
-    const uint32_t number_of_arrs = 2;
-    std::shared_ptr<AVPacket> sptr_av_packet_arr[number_of_arrs][num_of_av_packet_in_chunk];
-    while (likely(!exit_app()) && run_threads) {
-        bool pause_after_commit = false;
-        for (size_t i = 0; i < num_of_av_packet_in_chunk; ++i) {
-            std::shared_ptr<queued_data> qdata;
-            data.send_cb->try_dequeue(qdata);
-            if (!qdata) {
-                std::cout << "Audio sender is waiting" << std::endl;
-                std::unique_lock<std::mutex> lock(*data.send_lock);
-                data.send_cv->wait(lock);
-                data.send_cb->try_dequeue(qdata);
-            }
+/**
+ * Returns the bytes between consecutive packets in the chunk memory of the video stream.
+ */
+uint16_t video_packet_stride(const VideoRmaxData &data)
+{
+    // according to 2110-10
+    const uint16_t max_payload_size = data.max_payload_size - IPV4_HDR_SIZE - UDP_HDR_SIZE;
+    // align to cache line
+    return river_align_up_pow2(max_payload_size, get_cache_line_size());
+}
 
-            data.send_cv->notify_one();
-            if (qdata->queued_data_info == queued_data::e_qdi_eof) {
-                pause_after_commit = true;
-                break;
-            }
+/**
+ * Splits a frame/field of the video stream into packets.
+ *
+ * @param [in] data - video stream;
+ * @param [in] px_group_byte_size - pixel group size of the packetizer.
+ *
+ * @return the size of every packet of a frame/field.
+ */
+std::vector<uint16_t> calculate_video_packet_sizes(const VideoRmaxData &data, uint16_t px_group_byte_size)
+{
+    // according to 2110-10
+    const uint16_t max_payload_size = data.max_payload_size - IPV4_HDR_SIZE - UDP_HDR_SIZE;
+    return calculate_video_packet_sizes(data.width, video_frame_field_height(data), max_payload_size,
+                                        px_group_byte_size, data.allow_padding);
+}
 
-            uint32_t next_arr_index = (arr_index + 1) % number_of_arrs;
-            sptr_av_packet_arr[next_arr_index][i] = qdata->packet;
-        }
+class VideoSender : public MediaSender
+{
+public:
+    VideoSender(VideoRmaxData data, bool multiplexed);
+    bool start() override;
+    Step step() override;
+    void stop() override;
+    void abandon() override { m_data.notify_all_cv(); }
+    uint64_t deadline_ns() const override
+    {
+        return (*m_data.next_frame_field_send_time_ns + m_chunk_time_interval_ns * m_chunk).integer();
+    }
+    double packet_rate() const override
+    {
+        return (double)m_packets_in_frame * m_data.fps;
+    }
 
-        if (first_loop) {
-            first_loop = false;
-            arr_index = (arr_index + 1) % number_of_arrs;
-            continue;
-        }
+private:
+    enum class FrameStatus {
+        OK,
+        END_OF_FILE,
+        BLOCKED,
+        ERROR
+    };
+
+    FrameStatus next_frame();
+    void start_loop();
+    bool restart_after_loop_sync();
+    cst_data time_calculation_data() const
+    {
+        return cst_data(m_data.width, m_data.height, m_data.fps, m_data.video_type, m_data.pix_format,
+                        m_data.sample_rate);
+    }
 
-        //Build chunk
-        do {
-            status = rmx_output_media_get_next_chunk(&chunk_handle);
+    // can be any number
+    static constexpr int strides_in_chunk = 256;
+
+    VideoRmaxData m_data;
+    int m_packets_in_frame_or_field = 0;
+    uint32_t m_chunks_num_per_frame_or_field = 0;
+    int m_packets_in_frame = 0;
+    const VideoPacketizerFormat *m_packetizer_format = nullptr;
+    uint16_t m_packet_stride = 0;
+    uint16_t m_height = 0;
+    std::vector<uint16_t> m_sizes;
+    Rational m_frame_field_time_interval_ns;
+    Rational m_chunk_time_interval_ns;
+    std::unique_ptr<RtpVideoHeaderBuilder> m_frame_field_builder;
+    std::unique_ptr<VideoPacketizerPool> m_packetizer_pool;
+
+    // frame sources
+    std::shared_ptr<PacketizedFile> m_packetized_file;
+    uint64_t m_packetized_frame_index = 0;
+    size_t m_packetized_field_size = 0;
+    std::shared_ptr<VideoFrameCache> m_frame_cache;
+    bool m_play_from_frame_cache = false;
+    size_t m_cached_frame_index = 0;
+    // raw frames are read in place, this frame only points to them
+    std::shared_ptr<RawVideoFile> m_raw_file;
+    std::shared_ptr<AVFrame> m_raw_frame;
+    uint64_t m_raw_frame_index = 0;
+
+    // position in the stream
+    std::shared_ptr<AVFrame> m_av_frame;
+    const uint8_t *m_packetized_frame = nullptr;
+    bool m_has_frame = false;
+    uint32_t m_field_in_frame = 0;
+    uint32_t m_chunk = 0;
+    int m_packet_counter = 0;
+    uint64_t m_sent_frames_or_fields = 0;
+    Rational m_start_send_time_ns;
+};
 
-            if (pause_after_commit) {
-                rmx_output_media_set_chunk_option(&chunk_handle, RMX_OUTPUT_PAUSE_AFTER_COMMIT);
-            }
+VideoSender::VideoSender(VideoRmaxData data, bool multiplexed)
+    : MediaSender("Video", multiplexed)
+    , m_data(std::move(data))
+{
+    // pre-packetized files carry the packet layout they were packetized with
+    m_packetized_file = m_data.packetized_file;
+    if (m_packetized_file) {
+        const PacketizedFileHeader &header = m_packetized_file->header();
+        m_packetizer_format = video_sender_packetizer_format((AVPixelFormat)header.pix_format);
+        m_packet_stride = header.packet_stride;
+        m_sizes.assign(m_packetized_file->packet_sizes(), m_packetized_file->packet_sizes() + header.packets_in_field);
+    } else {
+        m_packetizer_format = m_data.raw_file ? m_data.raw_file->m_packetizer_format :
+            video_sender_packetizer_format(m_data.pix_format);
+        m_packet_stride = video_packet_stride(m_data);
+        m_sizes = calculate_video_packet_sizes(m_data, m_packetizer_format->pgroup_size);
+    }
+    m_height = video_frame_field_height(m_data);
 
-            if (status == RMX_NO_FREE_CHUNK && !disable_wait_for_event) {
-                event_mgr.request_notification(stream_id);
-            }
+    m_packets_in_frame_or_field = (int)m_sizes.size();
+    m_chunks_num_per_frame_or_field = (uint32_t)std::ceil((double)m_packets_in_frame_or_field / strides_in_chunk);
+    // sizes must have zeroes at the end to complete to this size
+    m_sizes.resize(m_chunks_num_per_frame_or_field * strides_in_chunk, 0);
+
+    m_frame_field_time_interval_ns = Rational((uint64_t)nanoseconds{seconds{1}}.count()) /
+        rational_approximation(m_data.fps);
+    m_packets_in_frame = m_packets_in_frame_or_field;
+    if (m_data.video_type != VIDEO_TYPE::PROGRESSIVE) {
+        m_frame_field_time_interval_ns /= 2;
+        m_packets_in_frame *= 2;
+    }
+    m_chunk_time_interval_ns = m_frame_field_time_interval_ns / m_chunks_num_per_frame_or_field;
+    m_packetized_field_size = (size_t)m_packets_in_frame_or_field * m_packet_stride;
+    m_frame_cache = std::move(m_data.frame_cache);
+    m_raw_file = m_data.raw_file;
+}
 
-            if (unlikely(status == RMX_SIGNAL)) {
-                goto end;
-            }
-        } while (status != RMX_OK);
-
-        uint8_t* chunk_buffer = static_cast<uint8_t*>(rmx_output_media_get_chunk_strides(&chunk_handle, subblock_id));
-        chunk_builder.fill_chunk(chunk_buffer, sptr_av_packet_arr[arr_index]);
-
-        do {
-            /*
-            * When timer handler callback is not used we have a mismatch between
-            * media_sender clock (TAI) and rivermax clock (UTC).
-            * To fix this we are calling to align_to_rmax_time function to convert
-            * @time from TAI to UTC
-            */
-            const uint64_t send_time = align_to_rmax_time((uint64_t)*data.next_chunk_send_time_ns);
-            status = rmx_output_media_commit_chunk(&chunk_handle, send_time);
-
-            if (status == RMX_HW_COMPLETION_ISSUE) {
-                std::cout << "got completion issue exiting" << std::endl;
-                goto end;
-            }
-            if (unlikely(status == RMX_SIGNAL)) {
-                goto end;
-            }
-        } while (status != RMX_OK);
-        *data.next_chunk_send_time_ns += (double)frame_send_time_ns;
-        arr_index = (arr_index + 1) % number_of_arrs;
+bool VideoSender::start()
+{
+    // can be any number bigger then 1
+    int mem_block_size = (int)(m_data.fps / 2);
+    if (m_data.video_type != VIDEO_TYPE::PROGRESSIVE) {
+        mem_block_size *= 2;
+    }
 
-        if (pause_after_commit) {
+    std::ifstream is(m_data.sdp_path);
+
+    // Setup video stream settings
+    MediaOutputStreamParams params;
+    params.name = "video";
+    params.sdp.assign(std::istreambuf_iterator<char>(is), std::istreambuf_iterator<char>());
+    params.idx_in_sdp = 0;
+    params.block_count = mem_block_size;
+    params.chunks_in_block = m_chunks_num_per_frame_or_field;
+    params.packets_in_chunk = strides_in_chunk;
+    params.packets_in_frame = m_packets_in_frame;
+    params.stride_size = m_packet_stride;
+    params.packet_sizes = m_sizes.data();
+    Rational r_active;
+    Rational tro_default_multiplier;
+    video_gapped_mode_ratios(time_calculation_data(), r_active, tro_default_multiplier);
+    params.packet_interval_ns = m_frame_field_time_interval_ns * r_active / m_packets_in_frame_or_field;
+
+    if (!create_stream(params)) {
+        run_threads = false;
+        m_data.notify_all_cv();
+        return false;
+    }
+    if (m_packetized_file) {
+        std::cout << "video packetizer: " << m_packetizer_format->name <<
+            ", pre-packetized " << m_packetized_file->frame_count() << " frames" << std::endl;
+    } else {
+        std::cout << "video packetizer: " << m_packetizer_format->name << ", " <<
+            m_packetizer_format->kernel_name() << std::endl;
+    }
+    m_frame_field_builder = m_packetizer_format->create(m_data.video_type,
+                                                        m_height,
+                                                        m_data.width,
+                                                        m_packets_in_frame_or_field,
+                                                        m_data.fps,
+                                                        m_data.payload_type,
+                                                        m_data.timestamp_tick,
+                                                        m_sizes);
+    if (!m_frame_field_builder->plan_valid()) {
+        std::cerr << "Video packet sizes don't split the " << m_data.width << " pixels wide lines in SRDs" << std::endl;
+        destroy_stream();
+        run_threads = false;
+        m_data.notify_all_cv();
+        return false;
+    }
+    // pre-packetized frames are only copied, they do not need the helpers
+    if (m_data.packetizer_threads && !m_packetized_file) {
+        m_packetizer_pool.reset(new VideoPacketizerPool(*m_frame_field_builder, m_data.packetizer_threads,
+                                                        m_data.packetizer_cpus));
+        std::cout << "video packetizer threads: " << m_data.packetizer_threads + 1 << std::endl;
+    }
+
+    if (m_packetized_file) {
+        m_packetized_file->prefetch(0);
+    }
+    if (m_raw_file) {
+        m_raw_frame.reset(av_frame_alloc(), AVFrameDeleter);
+        m_raw_file->prefetch(0);
+    }
+    m_retry_time_ns = m_data.next_frame_field_send_time_ns->integer() - (uint64_t)nanoseconds{seconds{1}}.count();
+    start_loop();
+    return true;
+}
+
+void VideoSender::start_loop()
+{
+    m_sent_frames_or_fields = 0;
+    m_start_send_time_ns = *m_data.next_frame_field_send_time_ns;
+}
+
+bool VideoSender::restart_after_loop_sync()
+{
+    uint64_t alignment_point;
+    if (!loop_synced(*m_data.loop_barrier, alignment_point)) {
+        return false;
+    }
+    // when the video ends last this is its next frame, so the times and RTP timestamps go on
+    start_stream_at(video, m_data.next_frame_field_send_time_ns, time_calculation_data(), alignment_point,
+                    &m_frame_field_builder->m_timestamp_tick);
+    start_loop();
+    return true;
+}
+
+VideoSender::FrameStatus VideoSender::next_frame()
+{
+    m_av_frame.reset();
+    m_packetized_frame = nullptr;
+    if (m_packetized_file) {
+        if (m_packetized_frame_index == m_packetized_file->frame_count()) {
+            m_packetized_frame_index = 0;
+            return FrameStatus::END_OF_FILE;
+        }
+        m_packetized_frame = m_packetized_file->frame(m_packetized_frame_index++);
+        m_packetized_file->prefetch(m_packetized_frame_index % m_packetized_file->frame_count());
+        return FrameStatus::OK;
+    }
+    if (m_raw_file) {
+        if (m_raw_frame_index == m_raw_file->frame_count()) {
+            m_raw_frame_index = 0;
+            return FrameStatus::END_OF_FILE;
+        }
+        m_raw_file->get_frame(m_raw_frame_index++, m_raw_frame.get());
+        m_av_frame = m_raw_frame;
+        m_raw_file->prefetch(m_raw_frame_index % m_raw_file->frame_count());
+        return FrameStatus::OK;
+    }
+    if (m_play_from_frame_cache) {
+        if (m_cached_frame_index == m_frame_cache->size()) {
+            m_cached_frame_index = 0;
+            return FrameStatus::END_OF_FILE;
+        }
+        m_av_frame = m_frame_cache->frame(m_cached_frame_index++);
+        return FrameStatus::OK;
+    }
+
+    std::shared_ptr<queued_data> qdata;
+    if (!m_data.send_channel->try_pop(qdata)) {
+        // the scaler or the reader stopped
+        if (m_data.send_channel->closed()) {
+            return FrameStatus::ERROR;
+        }
+        if (m_multiplexed) {
+            return FrameStatus::BLOCKED;
+        }
+        std::cout << "Video sender is waiting" << std::endl;
+        if (!m_data.send_channel->pop(qdata)) {
+            return FrameStatus::ERROR;
+        }
+    }
+
+    if (qdata->queued_data_info == queued_data::e_qdi_ok) {
+        m_av_frame = qdata->frame;
+        return FrameStatus::OK;
+    }
+    if (qdata->queued_data_info == queued_data::e_qdi_cached) {
+        // the frames were added before the marker was queued
+        if (!m_frame_cache || m_frame_cache->failed()) {
+            std::cerr << "Failed to store the video frames in the loop cache" << std::endl;
+            run_threads = false;
+            return FrameStatus::ERROR;
+        }
+        std::cout << "Video is played from the loop cache: " << m_frame_cache->size() << " frames" << std::endl;
+        m_play_from_frame_cache = true;
+    } else {
+        // the clip is longer than the loop cache
+        m_frame_cache.reset();
+    }
+    return FrameStatus::END_OF_FILE;
+}
+
+MediaSender::Step VideoSender::step()
+{
+    if (unlikely(exit_app() || !run_threads)) {
+        return Step::DONE;
+    }
+    if (m_waiting_for_loop_sync && !restart_after_loop_sync()) {
+        return blocked_until(get_tai_time_ns() + loop_sync_poll_interval_ns);
+    }
+
+    if (!m_has_frame) {
+        switch (next_frame()) {
+        case FrameStatus::OK:
+            m_has_frame = true;
+            break;
+        case FrameStatus::BLOCKED:
+            return blocked_until(get_tai_time_ns() + m_chunk_time_interval_ns.integer() / 2);
+        case FrameStatus::ERROR:
+            return Step::DONE;
+        case FrameStatus::END_OF_FILE:
             if (!loop) {
-                goto end;
+                return Step::DONE;
             }
 
             if (!disable_synchronization) {
-                std::unique_lock<std::mutex> lock(*data.sync_lock);
-                data.eof_stream_counter->fetch_add(1);
-                data.eof_cv->notify_one();
-                data.sync_cv->wait(lock);
-                cst_data time_calculation_data(data.ptime_usec, data.sample_rate, data.video_fps);
-                calculate_stream_time(audio, data.next_chunk_send_time_ns, time_calculation_data, &chunk_builder.m_timestamp_tick);
+                end_loop(*m_data.loop_barrier, next_alignment_point(video, *m_data.next_frame_field_send_time_ns,
+                                                                    time_calculation_data()));
+                if (!restart_after_loop_sync()) {
+                    return blocked_until(get_tai_time_ns() + loop_sync_poll_interval_ns);
+                }
+            } else {
+                start_loop();
             }
-            goto start;
+            return Step::RUNNING;
         }
     }
 
-end:
-    std::cout << "done sending audio" << std::endl;
+    rmx_status status;
+    do {
+        status = m_stream->get_next_chunk();
 
-    status = rmx_output_media_cancel_unsent_chunks(&chunk_handle);
-    if (status != RMX_OK) {
-        std::cerr << "Failed to cancel unsent chunk, got status: " << status << std::endl;
+        if (status == RMX_NO_FREE_CHUNK) {
+            if (m_multiplexed) {
+                return blocked_until(get_tai_time_ns() + m_chunk_time_interval_ns.integer() / 2);
+            }
+            m_stream->wait_for_free_chunk();
+        }
+
+        if (unlikely(status == RMX_SIGNAL)) {
+            return Step::DONE;
+        }
+    } while (status != RMX_OK);
+
+    uint8_t* chunk_buffer = m_stream->chunk_strides();
+
+    // fill chunk
+    if (m_packetized_frame) {
+        // the strides are stored as sent, only the RTP headers change
+        const int packets = std::min(strides_in_chunk, m_packets_in_frame_or_field - m_packet_counter);
+        memcpy(chunk_buffer, m_packetized_frame + m_field_in_frame * m_packetized_field_size +
+               (size_t)m_packet_counter * m_packet_stride, (size_t)packets * m_packet_stride);
+        for (int stride = 0; stride < packets; ++stride, ++m_packet_counter) {
+            m_frame_field_builder->patch_headers(chunk_buffer, m_packet_counter);
+            chunk_buffer += m_packet_stride;
+        }
+    } else if (m_packetizer_pool) {
+        const int packets = std::min(strides_in_chunk, m_packets_in_frame_or_field - m_packet_counter);
+        uint32_t rtp_timestamp;
+        const uint32_t seq_num = m_frame_field_builder->reserve_packets(m_packet_counter, packets, rtp_timestamp);
+        m_packetizer_pool->fill_packets(chunk_buffer, m_packet_stride, m_packet_counter, packets,
+                                        m_av_frame.get(), seq_num, rtp_timestamp);
+        m_packet_counter += packets;
+    } else {
+        for (int stride = 0; stride < strides_in_chunk &&
+             m_packet_counter < m_packets_in_frame_or_field; ++stride, ++m_packet_counter) {
+            m_frame_field_builder->fill_packet(chunk_buffer, m_packet_counter, m_av_frame.get());
+            chunk_buffer += m_packet_stride;
+        }
     }
 
+    const uint64_t send_time_ns = deadline_ns();
     do {
-        std::this_thread::sleep_for(milliseconds{300});
-        status = rmx_output_media_destroy_stream(stream_id);
-    } while (status == RMX_BUSY);
+        uint64_t timeout = 0;
+        // assume gap mode!
+        if (m_chunk == 0) {
+            timeout = commit_time(m_data.next_frame_field_send_time_ns->integer());
+        }
+        if (timeout) {
+#ifdef DEBUG
+            std::cout << "calling with timeout " << timeout << " now " <<
+                get_tai_time_ns() << std::endl;
+#endif
+        }
 
-    if (status != RMX_OK) {
-        std::cerr << "Failed to destroy stream, got status: " << status << std::endl;
+        status = m_stream->commit_chunk(timeout);
+
+        if (status == RMX_HW_COMPLETION_ISSUE) {
+            std::cout << "got completion issue exiting" << std::endl;
+            return Step::DONE;
+        }
+        if (unlikely(status == RMX_SIGNAL)) {
+            return Step::DONE;
+        }
+    } while (status != RMX_OK);
+    m_stats.add(send_time_ns, get_tai_time_ns());
+
+    if (++m_chunk < m_chunks_num_per_frame_or_field && m_packet_counter < m_packets_in_frame_or_field) {
+        return Step::RUNNING;
+    }
+    // end of the frame/field
+    m_chunk = 0;
+    m_packet_counter = 0;
+    if (m_data.video_type != VIDEO_TYPE::PROGRESSIVE) {
+        m_frame_field_builder->m_field = !m_frame_field_builder->m_field;
+    }
+    ++m_sent_frames_or_fields;
+    *m_data.next_frame_field_send_time_ns = m_start_send_time_ns + m_frame_field_time_interval_ns * m_sent_frames_or_fields;
+
+    const uint32_t fields_in_frame = (m_data.video_type != VIDEO_TYPE::PROGRESSIVE ? 2 : 1);
+    if (++m_field_in_frame == fields_in_frame) {
+        m_field_in_frame = 0;
+        m_has_frame = false;
+        m_av_frame.reset();
     }
+    return Step::RUNNING;
+}
+
+void VideoSender::stop()
+{
+    std::cout << "done sending video" << std::endl;
+    print_stats();
+
+    destroy_stream();
 
     // Notify all other waiting threads that current thread is finished
-    data.notify_all_cv();
+    m_data.notify_all_cv();
 }
 
 void rivermax_video_sender(VideoRmaxData data)
@@ -1815,288 +2569,405 @@ void rivermax_video_sender(VideoRmaxData data)
     if (unlikely(!run_threads)) {
         return;
     }
-    // can be any number
-    int strides_in_chunk = 256;
-    int packets_in_frame_or_field = 0;
-    uint32_t chunks_num_per_frame_or_field;
-    uint16_t px_group_byte_size;
     data.set_thread_affinity();
     rt_set_thread_priority(RMAX_THREAD_PRIORITY_TIME_CRITICAL);
-    /*
-     * calculate packet sizes using pixel format H & W
-     * Pixel format must be either:
-     * 1. AV_PIX_FMT_YUV422P
-     * 2. AV_PIX_FMT_UYVY422
-     * 3. AV_PIX_FMT_YUV422P10LE
-     * 4. AV_PIX_FMT_UYVY422
-     * bit supported are 10 bit and 8 bit where AV_PIX_FMT_YUV422P10LE
-     * is 10 bit and the rest are 8 bit.
-     * Note: we only support 4:2:2
-     */
-    // according to 2110-10
-    const uint16_t max_packet_size = data.max_payload_size;
-    const uint16_t max_payload_size = max_packet_size - IPV4_HDR_SIZE - UDP_HDR_SIZE;
-    // align to cache line
-    const uint16_t packet_stride = river_align_up_pow2(max_payload_size, get_cache_line_size());
-    const uint16_t user_header_size = sizeof(rtp_header) + sizeof(uint16_t) + sizeof(srd_header);
-    // 10 bit
-    if (data.pix_format == AVPixelFormat::AV_PIX_FMT_YUV422P10LE) {
-        px_group_byte_size = BYTES_IN_422_10B_GRP;
-    } else {// must be 8 bits
-        px_group_byte_size = BYTES_IN_422_8B_GRP;
-    }
-    uint16_t px_groups_in_line = data.width / PX_IN_422_GRP;
-    uint16_t height = data.height;
-    if (data.video_type != VIDEO_TYPE::PROGRESSIVE) {
-        height /= 2;
-    }
-
-    int px_groups_left_in_frame_field = px_groups_in_line * height;
-
-    std::vector<uint16_t> sizes;
-    uint16_t tmp_px_groups_in_line = px_groups_in_line;
-    while (px_groups_left_in_frame_field > 0) {
-        int used_pgroups = 0;
-        uint16_t payload_size = max_payload_size - user_header_size;
-        if (tmp_px_groups_in_line <= (payload_size - sizeof(srd_header)) / px_group_byte_size) {
-            if ((int)px_groups_left_in_frame_field <
-                (int)((payload_size - sizeof(srd_header)) / px_group_byte_size)) {
-                // add padding to last packet
-                used_pgroups = px_groups_left_in_frame_field;
-                if (data.allow_padding) {
-                    payload_size = sizes[sizes.size() - 1];
-                } else {
-                    payload_size = used_pgroups * px_group_byte_size + user_header_size;
-                }
-            } else {
-                // 2 SRDs
-                payload_size -= sizeof(srd_header);
-                used_pgroups = payload_size / px_group_byte_size;
-                payload_size = (uint16_t)(used_pgroups * px_group_byte_size + user_header_size +
-                    sizeof(srd_header));
-                tmp_px_groups_in_line = px_groups_in_line - (used_pgroups - tmp_px_groups_in_line);
-            }
-        } else {
-            // 1SRDS
-            used_pgroups = payload_size / px_group_byte_size;
-            payload_size = used_pgroups * px_group_byte_size + user_header_size;
-            tmp_px_groups_in_line -= used_pgroups;
-        }
-        if (!tmp_px_groups_in_line) {
-            tmp_px_groups_in_line = px_groups_in_line;
-        }
-        px_groups_left_in_frame_field -= used_pgroups;
-        sizes.push_back((uint16_t)payload_size);
-    }
 
-    packets_in_frame_or_field = (int)sizes.size();
+    VideoSender sender(std::move(data), false);
+    run_media_sender(sender);
+}
 
-    // can be any number
-    strides_in_chunk = 256;
-    chunks_num_per_frame_or_field = (uint32_t)std::ceil((double)packets_in_frame_or_field / strides_in_chunk);
-    // sizes must have zeroes at the end to complete to this size
-    sizes.resize(chunks_num_per_frame_or_field * strides_in_chunk, 0);
+/**
+ * Output streams served by one sender thread, see @ref rivermax_multiplexed_sender.
+ */
+struct MultiplexedSenderData: CpuAffinity
+{
+    std::vector<std::shared_ptr<MediaSender>> senders;
+    double packet_rate = 0;
 
-    // can be any number bigger then 1
-    int mem_block_size = (int)(data.fps / 2);
-    double frame_field_time_interval_ns = ((double)nanoseconds{seconds{1}}.count())/data.fps;
-    int packets_in_frame = packets_in_frame_or_field;
-    if (data.video_type != VIDEO_TYPE::PROGRESSIVE) {
-        frame_field_time_interval_ns /= 2;
-        mem_block_size *= 2;
-        packets_in_frame *= 2;
+    void add(const std::shared_ptr<MediaSender> &sender)
+    {
+        senders.push_back(sender);
+        packet_rate += sender->packet_rate();
+    }
+};
+
+/**
+ * Sends several streams from one thread: the streams that can send are served
+ * one chunk at a time in the order of the send time of their next chunk, the
+ * streams waiting for a free chunk, for input or for a loop to end are retried
+ * later. The lateness of the streams is reported every
+ * @ref multiplexed_sender_report_interval_s seconds.
+ */
+void rivermax_multiplexed_sender(MultiplexedSenderData data)
+{
+    if (unlikely(!run_threads)) {
+        return;
+    }
+    data.set_thread_affinity();
+    rt_set_thread_priority(RMAX_THREAD_PRIORITY_TIME_CRITICAL);
+
+    // (send time of the next chunk or retry time, sender index), earliest first
+    typedef std::pair<uint64_t, size_t> ScheduledSender;
+    typedef std::priority_queue<ScheduledSender, std::vector<ScheduledSender>,
+                                std::greater<ScheduledSender>> SenderHeap;
+    SenderHeap ready;
+    SenderHeap blocked;
+    std::vector<bool> started(data.senders.size(), false);
+    for (size_t i = 0; i < data.senders.size(); ++i) {
+        started[i] = data.senders[i]->start();
+        if (!started[i]) {
+            // a failed start notifies the threads of its stream, the next streams are not started
+            for (size_t next = i + 1; next < data.senders.size(); ++next) {
+                data.senders[next]->abandon();
+            }
+            break;
+        }
+        blocked.emplace(data.senders[i]->retry_time_ns(), i);
     }
 
-    std::vector<rmx_output_media_mem_block> video_blocks(mem_block_size);
-    rmx_output_media_init_mem_blocks(video_blocks.data(), mem_block_size);
+    std::cout << "Multiplexed sender is on with " << data.senders.size() << " streams" << std::endl;
+    const uint64_t report_interval_ns = (uint64_t)nanoseconds{seconds{multiplexed_sender_report_interval_s}}.count();
+    uint64_t next_report_ns = get_tai_time_ns() + report_interval_ns;
+    while (likely(!exit_app()) && run_threads && (!ready.empty() || !blocked.empty())) {
+        uint64_t now = get_tai_time_ns();
+        while (!blocked.empty() && blocked.top().first <= now) {
+            const size_t index = blocked.top().second;
+            blocked.pop();
+            ready.emplace(data.senders[index]->deadline_ns(), index);
+        }
+        if (ready.empty()) {
+            data.senders[blocked.top().second]->sleep_until(blocked.top().first);
+            continue;
+        }
 
-    constexpr size_t subblock_count = 1;
-    constexpr size_t subblock_id = subblock_count - 1;
-    for (int i = 0; i < mem_block_size; i++) {
-        rmx_output_media_set_chunk_count(&video_blocks[i], chunks_num_per_frame_or_field);
+        const size_t index = ready.top().second;
+        ready.pop();
+        MediaSender &sender = *data.senders[index];
+        switch (sender.step()) {
+        case MediaSender::Step::RUNNING:
+            ready.emplace(sender.deadline_ns(), index);
+            break;
+        case MediaSender::Step::BLOCKED:
+            blocked.emplace(sender.retry_time_ns(), index);
+            break;
+        case MediaSender::Step::DONE:
+            // destroying a stream takes a while, the other streams go on until they are done too
+            break;
+        }
 
-        rmx_output_media_set_sub_block_count(&video_blocks[i], subblock_count);
-        rmx_output_media_set_packet_layout(&video_blocks[i], subblock_id, sizes.data());
+        if (now >= next_report_ns) {
+            next_report_ns = now + report_interval_ns;
+            for (size_t i = 0; i < data.senders.size(); ++i) {
+                if (started[i]) {
+                    data.senders[i]->print_stats();
+                }
+            }
+        }
     }
 
-    std::ifstream is(data.sdp_path);
-    std::string sdp_cont((std::istreambuf_iterator<char>(is)),
-        std::istreambuf_iterator<char>());
+    for (size_t i = 0; i < data.senders.size(); ++i) {
+        if (started[i]) {
+            data.senders[i]->stop();
+        }
+    }
+}
 
-    // Setup video stream settings
-    rmx_output_media_stream_params stream_params;
-    rmx_output_media_init(&stream_params);
-    rmx_output_media_set_sdp(&stream_params, sdp_cont.c_str());
-    rmx_output_media_assign_mem_blocks(&stream_params, video_blocks.data(), mem_block_size);
-    rmx_output_media_set_packets_per_frame(&stream_params, packets_in_frame);
-    rmx_output_media_set_packets_per_chunk(&stream_params, strides_in_chunk);
-    rmx_output_media_set_stride_size(&stream_params, subblock_id, packet_stride);
-
-    constexpr size_t media_block_index = 0;
-    rmx_output_media_set_idx_in_sdp(&stream_params, media_block_index);
-
-    rmx_stream_id stream_id;
-    rmx_status status = rmx_output_media_create_stream(&stream_params, &stream_id);
-    if (status != RMX_OK) {
-        std::cerr << "failed creating video output stream, got status:" << status;
-        run_threads = false;
-        data.notify_all_cv();
-        return;
+/**
+ * Spreads @p senders over @p threads multiplexed sender threads, the streams
+ * with the highest packet rates first, each one to the thread with the lowest
+ * packet rate so far.
+ *
+ * @param [in] senders - streams to send;
+ * @param [in] threads - number of sender threads;
+ * @param [in] cpus - CPU of each sender thread, can be empty;
+ * @param [out] sender_threads - the started threads are added here.
+ */
+static void start_multiplexed_senders(std::vector<std::shared_ptr<MediaSender>> senders, size_t threads,
+                                      const std::vector<int> &cpus, std::vector<std::thread> &sender_threads)
+{
+    std::stable_sort(senders.begin(), senders.end(),
+                     [](const std::shared_ptr<MediaSender> &a, const std::shared_ptr<MediaSender> &b) {
+                         return a->packet_rate() > b->packet_rate();
+                     });
+    std::vector<MultiplexedSenderData> threads_data(std::min(threads, senders.size()));
+    for (const std::shared_ptr<MediaSender> &sender : senders) {
+        std::min_element(threads_data.begin(), threads_data.end(),
+                         [](const MultiplexedSenderData &a, const MultiplexedSenderData &b) {
+                             return a.packet_rate < b.packet_rate;
+                         })->add(sender);
     }
-    std::cout<<"video stream created with ID "<<stream_id<<std::endl;
-    uint16_t bit_depth = data.pix_format == AVPixelFormat::AV_PIX_FMT_YUV422P10LE ? 10: 8;
-    RtpVideoHeaderBuilder frame_field_builder = RtpVideoHeaderBuilder(height,
-                                                                data.width,
-                                                                packets_in_frame_or_field,
-                                                                bit_depth,
-                                                                px_group_byte_size,
-                                                                data.fps,
-                                                                data.payload_type,
-                                                                data.timestamp_tick,
-                                                                sizes,
-                                                                data.video_type,
-                                                                data.pix_format);
-
-    EventMgr event_mgr;
-    if (!disable_wait_for_event && !event_mgr.init(stream_id)) {
-        run_threads = false;
-        data.notify_all_cv();
-        return;
+    for (size_t i = 0; i < threads_data.size(); ++i) {
+        std::cout << "Multiplexed sender #" << i << ": " << threads_data[i].senders.size() << " streams, " <<
+            (uint64_t)threads_data[i].packet_rate << " packets/s" << std::endl;
+        if (i < cpus.size()) {
+            threads_data[i].set_cpu(cpus[i]);
+        }
+        sender_threads.emplace_back(rivermax_multiplexed_sender, std::move(threads_data[i]));
     }
+}
 
-    rmx_output_media_chunk_handle chunk_handle;
-    rmx_output_media_init_chunk_handle(&chunk_handle, stream_id);
+/**
+ * Packetizes the frames of the video send queue the way @ref rivermax_video_sender
+ * sends them and stores the packets in a pre-packetized file, see @ref PacketizedFileHeader.
+ *
+ * @param [in] data - video stream;
+ * @param [in] path - file to create.
+ */
+void video_packetize_file(VideoRmaxData data, std::string path)
+{
+    data.set_thread_affinity();
 
-    go_to_sleep((uint64_t)*data.next_frame_field_send_time_ns, (uint64_t)nanoseconds{seconds{1}}.count());
-    std::cout << "Video sender is on!" << std::endl;
+    const VideoPacketizerFormat *packetizer_format = video_sender_packetizer_format(data.pix_format);
+    std::vector<uint16_t> sizes = calculate_video_packet_sizes(data, packetizer_format->pgroup_size);
+    const int packets_in_frame_or_field = (int)sizes.size();
+    const uint32_t fields_in_frame = data.video_type != VIDEO_TYPE::PROGRESSIVE ? 2 : 1;
+
+    PacketizedFileHeader layout = {};
+    layout.pix_format = packetizer_format->pix_format;
+    layout.width = data.width;
+    layout.height = data.height;
+    layout.video_type = data.video_type;
+    layout.fps = data.fps;
+    layout.packet_stride = video_packet_stride(data);
+    layout.max_packet_size = data.max_payload_size;
+    layout.packets_in_field = packets_in_frame_or_field;
+    layout.fields_in_frame = fields_in_frame;
+    layout.frame_size = (uint64_t)packets_in_frame_or_field * fields_in_frame * layout.packet_stride;
+
+    PacketizedFileWriter writer;
+    bool ok = writer.open(path, layout, sizes.data());
+    std::unique_ptr<RtpVideoHeaderBuilder> frame_field_builder = packetizer_format->create(data.video_type,
+                                                                                            video_frame_field_height(data),
+                                                                                            data.width,
+                                                                                            packets_in_frame_or_field,
+                                                                                            data.fps,
+                                                                                            data.payload_type,
+                                                                                            Rational(),
+                                                                                            sizes);
+    if (!frame_field_builder->plan_valid()) {
+        std::cerr << "Video packet sizes don't split the " << data.width << " pixels wide lines in SRDs" << std::endl;
+        ok = false;
+    }
+    // the stride bytes after every packet stay zero
+    std::vector<uint8_t> frame_buffer(layout.frame_size, 0);
 
-start:
-    uint64_t sent_frames_or_fields = 0;
-    double start_send_time_ns = *data.next_frame_field_send_time_ns;
-    while (likely(!exit_app()) && run_threads) {
+    while (ok && likely(!exit_app()) && run_threads) {
         std::shared_ptr<queued_data> qdata;
-        data.send_cb->try_dequeue(qdata);
-
-        if (!qdata) {
-            std::cout << "Video sender is waiting" << std::endl;
-            std::unique_lock<std::mutex> lock(*data.send_lock);
-            data.send_cv->wait(lock);
-            data.send_cb->try_dequeue(qdata);
+        if (!data.send_channel->pop(qdata) || qdata->queued_data_info == queued_data::e_qdi_eof) {
+            break;
         }
 
-        if (qdata->queued_data_info == queued_data::e_qdi_eof) {
-            if (!loop) {
-                goto end;
+        uint8_t *buffer = frame_buffer.data();
+        for (uint32_t field = 0; field < fields_in_frame; ++field) {
+            for (int packet = 0; packet < packets_in_frame_or_field; ++packet) {
+                frame_field_builder->fill_packet(buffer, packet, qdata->frame.get());
+                buffer += layout.packet_stride;
             }
-
-            if (!disable_synchronization) {
-                std::unique_lock<std::mutex> lock(*data.sync_lock);
-                data.eof_stream_counter->fetch_add(1);
-                data.eof_cv->notify_one();
-                data.sync_cv->wait(lock);
-                cst_data time_calculation_data(data.width, data.height, data.fps, data.video_type, data.pix_format, data.sample_rate);
-                calculate_stream_time(video, data.next_frame_field_send_time_ns, time_calculation_data, &frame_field_builder.m_timestamp_tick);
+            if (data.video_type != VIDEO_TYPE::PROGRESSIVE) {
+                frame_field_builder->m_field = !frame_field_builder->m_field;
             }
-            goto start;
         }
+        ok = writer.write_frame(frame_buffer.data());
+    }
 
-        std::shared_ptr<AVFrame> av_frame = qdata->frame;
-        data.send_cv->notify_one();
-
-        const uint32_t loops_per_av_fram =( data.video_type != VIDEO_TYPE::PROGRESSIVE ? 2 : 1);
-        for (uint32_t loop_per_av_fram = 0; loop_per_av_fram < loops_per_av_fram; ++loop_per_av_fram ) {
-            SendData sd{ 0, px_groups_in_line * height, px_groups_in_line };
-            frame_field_builder.m_Y = &av_frame->data[0][0];
-            frame_field_builder.m_Cb = &av_frame->data[1][0];
-            frame_field_builder.m_Cr = &av_frame->data[2][0];
-            frame_field_builder.set_counters();
-            for (uint32_t chunk = 0; chunk < chunks_num_per_frame_or_field && sd.packet_counter < packets_in_frame_or_field; ++chunk) {
-                do {
-                    status = rmx_output_media_get_next_chunk(&chunk_handle);
-
-                    if (status == RMX_NO_FREE_CHUNK && !disable_wait_for_event) {
-                        event_mgr.request_notification(stream_id);
-                    }
-
-                    if (unlikely(status == RMX_SIGNAL)) {
-                        goto end;
-                    }
-                } while (status != RMX_OK);
-
-                uint8_t* chunk_buffer = static_cast<uint8_t*>(rmx_output_media_get_chunk_strides(&chunk_handle, subblock_id));
-
-                // fill chunk
-                for (int stride = 0; stride < strides_in_chunk &&
-                     sd.packet_counter < packets_in_frame_or_field; ++stride, ++sd.packet_counter) {
-                    frame_field_builder.fill_packet(chunk_buffer, sd, av_frame.get());
-                    chunk_buffer += packet_stride;
-                }
+    if (ok && writer.close()) {
+        std::cout << "Packetized " << writer.frame_count() << " video frames to " << path << std::endl;
+    } else {
+        run_threads = false;
+    }
+    // Notify all other waiting threads that current thread is finished
+    data.notify_all_cv();
+}
 
-                do {
-                    uint64_t timeout = 0;
-                    // assume gap mode!
-                    if (chunk == 0) {
-                        timeout = (uint64_t)*data.next_frame_field_send_time_ns;
-                        // verify windows is at least 600 nanos away
-                        if (unlikely(timeout + 600 < get_tai_time_ns())) {
-                            timeout = 0;
-                        } else {
-                            /*
-                            * When timer handler callback is not used we have a mismatch between
-                            * media_sender clock (TAI) and rivermax clock (UTC).
-                            * To fix this we are calling to align_to_rmax_time function to convert
-                            * @time from TAI to UTC
-                            */
-                            timeout = align_to_rmax_time(timeout);
-                        }
-                    }
-                    if (timeout) {
-    #ifdef DEBUG
-                        std::cout << "calling with timeout " << timeout << " now " <<
-                            get_tai_time_ns() << std::endl;
-    #endif
-                    }
+/**
+ * Converts the decoded video frames to UYVY in horizontal slices, scaled
+ * together by the scaler thread and the helpers of a @ref SlicePool. 8-bit
+ * 4:2:0 frames are converted by @ref interleave_yuv420p_func, the other formats
+ * by a swscale context per slice, which reads the whole frame and writes the
+ * lines of its slice, so the chroma and the resized lines are interpolated
+ * across the slice edges. Before FFmpeg 5.0, swscale converts the lines of a
+ * slice alone, the frames that are resized or have vertically subsampled chroma
+ * are converted in one slice then.
+ */
+class VideoScaler
+{
+public:
+    /**
+     * @param [in] interlaced - the chroma of 4:2:0 frames is interpolated within each field;
+     * @param [in] threads - number of helper threads;
+     * @param [in] cpus - CPU of each helper thread, can be empty.
+     */
+    VideoScaler(bool interlaced, size_t threads, const std::vector<int> &cpus)
+        : m_interlaced(interlaced)
+        , m_interleave_yuv420p(get_interleave_yuv420p(&m_yuv420p_kernel))
+        , m_sws_contexts(threads + 1, nullptr)
+        , m_scale_slice([this](size_t slice) { scale_slice(slice); })
+        , m_pool(threads, cpus, VIDEO_SCALER_SPIN_NS)
+    {
+        std::cout << "video scaler slices: " << m_pool.slices() << ", yuv420p kernel: " << m_yuv420p_kernel <<
+            std::endl;
+    }
+    ~VideoScaler()
+    {
+        for (SwsContext *context : m_sws_contexts) {
+            sws_freeContext(context);
+        }
+    }
+    VideoScaler(const VideoScaler&) = delete;
+    VideoScaler &operator=(const VideoScaler&) = delete;
 
-                    status = rmx_output_media_commit_chunk(&chunk_handle, timeout);
+    /**
+     * Converts @p src to @p dst, a UYVY frame.
+     *
+     * @return false on error.
+     */
+    bool scale(const AVFrame *src, AVFrame *dst);
 
-                    if (status == RMX_HW_COMPLETION_ISSUE) {
-                        std::cout << "got completion issue exiting" << std::endl;
-                        goto end;
-                    }
-                    if (unlikely(status == RMX_SIGNAL)) {
-                        goto end;
-                    }
-                } while (status != RMX_OK);
-            }
+private:
+    /**
+     * First line of @p slice in the converted frame, the slices start at multiples
+     * of 16 lines so the chroma lines of a slice start with it, and with the output
+     * lines of swscale.
+     */
+    int slice_first_line(size_t slice, size_t slices) const
+    {
+        return slice == slices ? m_dst->height : (int)((size_t)m_dst->height * slice / slices) & ~15;
+    }
+    SwsContext *update_sws_context(size_t slice);
+    void scale_slice(size_t slice);
+    void convert_yuv420p_lines(int first_line, int last_line) const;
+    bool sws_scale_lines(size_t slice, int first_line, int last_line);
+
+    const bool m_interlaced;
+    const char *m_yuv420p_kernel = "";
+    const interleave_yuv420p_func m_interleave_yuv420p;
+    // of each slice, cached for the size and format of the frames
+    std::vector<SwsContext*> m_sws_contexts;
+    const AVFrame *m_src = nullptr;
+    AVFrame *m_dst = nullptr;
+    bool m_fast_path = false;
+    size_t m_slices = 1;
+    std::atomic<bool> m_failed{false};
+    const std::function<void(size_t)> m_scale_slice;
+    // stops the helpers first
+    SlicePool m_pool;
+};
 
-            if (data.video_type != VIDEO_TYPE::PROGRESSIVE) {
-                frame_field_builder.m_field = !frame_field_builder.m_field;
-            }
-            ++sent_frames_or_fields;
-            *data.next_frame_field_send_time_ns += frame_field_time_interval_ns;
+bool VideoScaler::scale(const AVFrame *src, AVFrame *dst)
+{
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get((AVPixelFormat)src->format);
+    if (!desc) {
+        return false;
+    }
+    const bool same_size = src->width == dst->width && src->height == dst->height;
+    m_src = src;
+    m_dst = dst;
+    m_fast_path = same_size && src->format == AV_PIX_FMT_YUV420P && !(src->width & 1);
+#if SWS_HAS_SLICE_OUTPUT
+    m_slices = m_pool.slices();
+    if (!m_fast_path) {
+        // the bands swscale writes start at multiples of its alignment, and so does the last one
+        const SwsContext *context = update_sws_context(0);
+        if (!context) {
+            return false;
         }
+        const unsigned int alignment = sws_receive_slice_alignment(context);
+        if (16 % alignment || dst->height % alignment) {
+            m_slices = 1;
+        }
+    }
+#else
+    // the lines of a slice can't be resized alone, the palette is not a plane, and swscale
+    // would interpolate the subsampled chroma lines of a slice without the next slice
+    m_slices = same_size && !(desc->flags & AV_PIX_FMT_FLAG_PAL) && (m_fast_path || !desc->log2_chroma_h) ?
+        m_pool.slices() : 1;
+#endif
+    m_failed.store(false, std::memory_order_relaxed);
+    m_pool.run(m_scale_slice);
+    return !m_failed.load(std::memory_order_relaxed);
+}
 
-        *data.next_frame_field_send_time_ns = (start_send_time_ns + sent_frames_or_fields * frame_field_time_interval_ns);
+void VideoScaler::scale_slice(size_t slice)
+{
+    if (slice >= m_slices) {
+        return;
     }
-end:
-    std::cout << "done sending video" << std::endl;
+    const int first_line = slice_first_line(slice, m_slices);
+    const int last_line = slice_first_line(slice + 1, m_slices);
+    if (first_line >= last_line) {
+        return;
+    }
+    if (m_fast_path) {
+        convert_yuv420p_lines(first_line, last_line);
+    } else if (!sws_scale_lines(slice, first_line, last_line)) {
+        m_failed.store(true, std::memory_order_relaxed);
+    }
+}
 
-    status = rmx_output_media_cancel_unsent_chunks(&chunk_handle);
-    if (status != RMX_OK) {
-        std::cerr << "Failed to cancel unsent chunk, got status: " << status << std::endl;
+void VideoScaler::convert_yuv420p_lines(int first_line, int last_line) const
+{
+    const int chroma_height = (m_src->height + 1) / 2;
+    const size_t pgroups = (size_t)m_src->width / 2;
+    for (int line = first_line; line < last_line; ++line) {
+        int near;
+        int far;
+        yuv420p_chroma_lines(line, chroma_height, m_interlaced, near, far);
+        const ptrdiff_t near_offset = (ptrdiff_t)near * m_src->linesize[1];
+        const ptrdiff_t far_offset = (ptrdiff_t)far * m_src->linesize[1];
+        const ptrdiff_t cr_near_offset = (ptrdiff_t)near * m_src->linesize[2];
+        const ptrdiff_t cr_far_offset = (ptrdiff_t)far * m_src->linesize[2];
+        m_interleave_yuv420p(m_dst->data[0] + (ptrdiff_t)line * m_dst->linesize[0],
+                             m_src->data[0] + (ptrdiff_t)line * m_src->linesize[0],
+                             m_src->data[1] + near_offset, m_src->data[1] + far_offset,
+                             m_src->data[2] + cr_near_offset, m_src->data[2] + cr_far_offset, pgroups);
     }
+}
 
-    do {
-        std::this_thread::sleep_for(milliseconds{300});
-        status = rmx_output_media_destroy_stream(stream_id);
-    } while (status == RMX_BUSY);
+SwsContext *VideoScaler::update_sws_context(size_t slice)
+{
+    SwsContext *&context = m_sws_contexts[slice];
+#if SWS_HAS_SLICE_OUTPUT
+    const int src_lines = m_src->height;
+    const int dst_lines = m_dst->height;
+#else
+    // the whole frame, or a slice of a frame that is not resized
+    const int src_lines = m_slices == 1 ? m_src->height :
+        slice_first_line(slice + 1, m_slices) - slice_first_line(slice, m_slices);
+    const int dst_lines = m_slices == 1 ? m_dst->height : src_lines;
+#endif
+    context = sws_getCachedContext(context, m_src->width, src_lines, (AVPixelFormat)m_src->format,
+                                   m_dst->width, dst_lines, AV_PIX_FMT_UYVY422, SWS_BILINEAR,
+                                   nullptr, nullptr, nullptr);
+    return context;
+}
 
-    if (status != RMX_OK) {
-        std::cerr << "Failed to destroy stream, got status: " << status << std::endl;
+bool VideoScaler::sws_scale_lines(size_t slice, int first_line, int last_line)
+{
+    SwsContext *context = update_sws_context(slice);
+    if (!context) {
+        return false;
     }
-
-    // Notify all other waiting threads that current thread is finished
-    data.notify_all_cv();
+#if SWS_HAS_SLICE_OUTPUT
+    // the frames are referenced by the context until sws_frame_end
+    int ret = sws_frame_start(context, m_dst, m_src);
+    if (ret >= 0) {
+        ret = sws_send_slice(context, 0, (unsigned int)m_src->height);
+    }
+    if (ret >= 0) {
+        ret = sws_receive_slice(context, (unsigned int)first_line, (unsigned int)(last_line - first_line));
+    }
+    sws_frame_end(context);
+    return ret >= 0;
+#else
+    // the sliced formats have a line of every plane per frame line, see scale
+    const uint8_t *src_data[AV_NUM_DATA_POINTERS] = {};
+    for (int plane = 0; plane < AV_NUM_DATA_POINTERS && m_src->data[plane]; ++plane) {
+        src_data[plane] = m_src->data[plane] + (ptrdiff_t)first_line * m_src->linesize[plane];
+    }
+    uint8_t *dst_data[] = { m_dst->data[0] + (ptrdiff_t)first_line * m_dst->linesize[0] };
+    const int src_lines = m_slices == 1 ? m_src->height : last_line - first_line;
+    return sws_scale(context, src_data, m_src->linesize, 0, src_lines, dst_data, m_dst->linesize) > 0;
+#endif
 }
 
 void scale_video(ScaleDataVideo scale_data)
@@ -2104,203 +2975,341 @@ void scale_video(ScaleDataVideo scale_data)
     scale_data.set_thread_affinity();
     rt_set_thread_priority(RMAX_THREAD_PRIORITY_TIME_CRITICAL);
 
-    std::unique_ptr<SwsContext, std::function<void(SwsContext*)>> swsContext{
-        sws_getContext(scale_data.rmax_data.width, scale_data.rmax_data.height,
-                       scale_data.rmax_data.pix_format, scale_data.rmax_data.width,
-                       scale_data.rmax_data.height,
-                       AV_PIX_FMT_UYVY422, SWS_BILINEAR, nullptr, nullptr, nullptr),
-                            [](SwsContext* p) { sws_freeContext(p); } };
+    VideoScaler scaler(scale_data.rmax_data.video_type != VIDEO_TYPE::PROGRESSIVE, scale_data.scaler_threads,
+                       scale_data.scaler_cpus);
+    // the scaled frames keep their buffers when they are reused, the loop cache keeps
+    // copies of them only
+    const size_t entries_in_flight = scale_data.rmax_data.send_channel->capacity() + QUEUE_ENTRIES_IN_USE;
+    const int width = (int)scale_data.rmax_data.width;
+    const int height = (int)scale_data.rmax_data.height;
+    std::shared_ptr<ObjectPool<AVFrame>> frame_pool = ObjectPool<AVFrame>::create(
+        "video scaler frame", entries_in_flight,
+        [width, height] {
+            std::unique_ptr<AVFrame, void(*)(AVFrame*)> frame{ av_frame_alloc(), AVFrameDeleter };
+            if (!frame) {
+                return (AVFrame*)nullptr;
+            }
+            frame->format = AV_PIX_FMT_UYVY422;
+            frame->width = width;
+            frame->height = height;
+            if (av_frame_get_buffer(frame.get(), 64) < 0) {
+                return (AVFrame*)nullptr;
+            }
+            return frame.release();
+        },
+        [](AVFrame*) {},
+        AVFrameDeleter);
+    std::shared_ptr<queued_data_pool> entry_pool = create_queued_data_pool("video scaler queue entry",
+                                                                           entries_in_flight);
     while (likely(!exit_app()) && run_threads) {
         // Video
         std::shared_ptr<queued_data> qdata;
-        scale_data.conv_cb->try_dequeue(qdata);
-        if (!qdata) {
-            std::unique_lock<std::mutex> lock(*scale_data.conv_lock);
-            scale_data.conv_cv->wait(lock);
-            scale_data.conv_cb->try_dequeue(qdata);
-        }
-
-        if (qdata->queued_data_info == queued_data::e_qdi_eof) {
-            if (!scale_data.rmax_data.send_cb->try_enqueue(std::move(qdata))) {
-                std::unique_lock<std::mutex> lock(*scale_data.rmax_data.send_lock);
-                scale_data.rmax_data.send_cv->wait(lock);
-                scale_data.rmax_data.send_cb->enqueue(std::move(qdata));
-            }
-            scale_data.rmax_data.send_cv->notify_all();
-            if (!loop) {
+        if (!scale_data.conv_channel->pop(qdata)) {
+            break;
+        }
+
+        if (qdata->queued_data_info != queued_data::e_qdi_ok) {
+            // nothing is left to scale once the sender plays from the loop cache
+            const bool cached = qdata->queued_data_info == queued_data::e_qdi_cached;
+            if (!scale_data.rmax_data.send_channel->push(std::move(qdata)) || !loop || cached) {
                 break;
             }
+            // the clip is longer than the loop cache
+            scale_data.rmax_data.frame_cache.reset();
             continue;
         }
 
-        scale_data.conv_cv->notify_all();
-        std::shared_ptr<queued_data> dst_qdata = std::make_shared<queued_data>();
-        if (qdata->frame->format != AVPixelFormat::AV_PIX_FMT_YUV422P &&
-            qdata->frame->format != AVPixelFormat::AV_PIX_FMT_UYVY422 &&
-            qdata->frame->format != AVPixelFormat::AV_PIX_FMT_YUV422P10LE) {
-            std::shared_ptr<AVFrame> dstframe{ av_frame_alloc(), AVFrameDeleter};
-            dstframe->format = AV_PIX_FMT_UYVY422;
-            dstframe->width = qdata->frame->width;
-            dstframe->height = qdata->frame->height;
-
-            int ret = av_frame_get_buffer(dstframe.get(), 64);
-            if (ret < 0)
-            {
-                throw std::bad_alloc();
-            }
-            ret = sws_scale(swsContext.get(), qdata->frame->data, qdata->frame->linesize, 0,
-                            qdata->frame->height, dstframe->data, dstframe->linesize);
-
-            if (ret < 0)
-            {
+        std::shared_ptr<queued_data> dst_qdata = entry_pool->acquire();
+        if (!find_video_packetizer_format((AVPixelFormat)qdata->frame->format)) {
+            std::shared_ptr<AVFrame> dstframe = frame_pool->acquire();
+            if (!scaler.scale(qdata->frame.get(), dstframe.get())) {
                 throw std::runtime_error("failed scaling frame to AV_PIX_FMT_UYVY422");
             }
-            dst_qdata->frame = dstframe;
-            if (!scale_data.rmax_data.send_cb->try_enqueue(std::move(dst_qdata))) {
-                std::unique_lock<std::mutex> lock(*scale_data.rmax_data.send_lock);
-                scale_data.rmax_data.send_cv->wait(lock);
-                scale_data.rmax_data.send_cb->enqueue(std::move(dst_qdata));
-            }
+            dst_qdata->frame = std::move(dstframe);
         } else {
             dst_qdata->frame = qdata->frame;
-            if (!scale_data.rmax_data.send_cb->try_enqueue(std::move(dst_qdata))) {
-                std::unique_lock<std::mutex> lock(*scale_data.rmax_data.send_lock);
-                scale_data.rmax_data.send_cv->wait(lock);
-                scale_data.rmax_data.send_cb->enqueue(std::move(dst_qdata));
-            }
         }
-        scale_data.rmax_data.send_cv->notify_all();
+        if (scale_data.rmax_data.frame_cache) {
+            scale_data.rmax_data.frame_cache->add(dst_qdata->frame.get());
+        }
+        if (!scale_data.rmax_data.send_channel->push(std::move(dst_qdata))) {
+            break;
+        }
     }
     // Notify all other waiting threads that current thread is finished
     scale_data.notify_all_cv();
 }
 
-void encode_audio(AudioEncodeData audio_encode_data)
+/**
+ * Returns true if all the @p frames frames of the first loop iteration are kept
+ * in the loop cache, in which case the reader ends the stream with
+ * queued_data::e_qdi_cached and stops decoding.
+ */
+bool is_loop_cached(VideoReaderData &rd, uint64_t frames)
+{
+    if (!rd.frame_cache) {
+        return false;
+    }
+    if (!rd.frame_cache->fits(frames)) {
+        std::cout << "The " << frames << " video frames don't fit in the loop cache" << std::endl;
+        rd.frame_cache.reset();
+        return false;
+    }
+    return true;
+}
+
+bool is_loop_cached(AudioReaderData &, uint64_t)
+{
+    return false;
+}
+
+/**
+ * Copies @p frame to the loop cache if the reader queues its frames to the
+ * sender, during the first loop iteration only.
+ */
+void cache_loop_frame(VideoReaderData &rd, const AVFrame *frame)
+{
+    if (rd.frame_cache && rd.caches_frames) {
+        rd.frame_cache->add(frame);
+    }
+}
+
+void cache_loop_frame(AudioReaderData &, const AVFrame *)
 {
-    audio_encode_data.set_thread_affinity();
-    rt_set_thread_priority(RMAX_THREAD_PRIORITY_TIME_CRITICAL);
+}
 
-    auto *p_audio_codec_pcm = avcodec_find_encoder(AV_CODEC_ID_PCM_S24BE);
-    if (!p_audio_codec_pcm) {
-        std::cerr << "failed find PCM_S24BE encoder";
-        return;
-    }
+// size of the AVIOContext buffer of a file read ahead, larger reads go to the file directly
+static constexpr int READ_AHEAD_IO_BUFFER_SIZE = 1 << 20;
 
-    //Process Audio
-    auto *p_audio_codec_context_pcm = avcodec_alloc_context3(p_audio_codec_pcm);
-    std::unique_ptr<AVCodecContext, av_deleter> ctx_guard(p_audio_codec_context_pcm);
-    if (!p_audio_codec_pcm) {
-        std::cerr << "failed load PCM_S24BE encoder context";
-        return;
+static int read_ahead_read_packet(void *opaque, uint8_t *buffer, int size)
+{
+    const int64_t bytes = static_cast<ReadAheadFile*>(opaque)->read(buffer, (size_t)size);
+    return bytes > 0 ? (int)bytes : bytes == 0 ? AVERROR_EOF : AVERROR(EIO);
+}
+
+static int64_t read_ahead_seek(void *opaque, int64_t offset, int whence)
+{
+    ReadAheadFile *file = static_cast<ReadAheadFile*>(opaque);
+    if (whence & AVSEEK_SIZE) {
+        return (int64_t)file->size();
     }
+    const int64_t position = file->seek(offset, whence & ~AVSEEK_FORCE);
+    return position < 0 ? AVERROR(EINVAL) : position;
+}
 
-    p_audio_codec_context_pcm->bit_rate = audio_encode_data.rmax_data.bit_rate;
-    p_audio_codec_context_pcm->sample_rate = 48000;
-    p_audio_codec_context_pcm->channel_layout = audio_encode_data.rmax_data.channel_layout;
-    p_audio_codec_context_pcm->channels = audio_encode_data.rmax_data.channels;
-    p_audio_codec_context_pcm->sample_fmt = AV_SAMPLE_FMT_S32;
+static void free_read_ahead_io(AVIOContext *io)
+{
+    delete static_cast<ReadAheadFile*>(io->opaque);
+    av_freep(&io->buffer);
+    avio_context_free(&io);
+}
 
-    if (avcodec_open2(p_audio_codec_context_pcm, p_audio_codec_pcm, nullptr) < 0) {
-        std::cerr << "failed to open audio codec through avcodec_open2";
-        return;
+/**
+ * Opens a media file as avformat_open_input, through a @ref ReadAheadFile with
+ * --read-ahead.
+ *
+ * @param [in,out] context - context to use or nullptr, freed on error as by avformat_open_input;
+ * @param [in] path - media file.
+ *
+ * @return 0 on success, a negative AVERROR otherwise.
+ */
+static int open_input(AVFormatContext *&context, const std::string &path)
+{
+    if (!read_ahead_mb) {
+        return avformat_open_input(&context, path.c_str(), nullptr, nullptr);
     }
-
-    SwrContext *swr = nullptr;
-    while (likely(!exit_app()) && run_threads) {
-        std::shared_ptr<queued_data> qdata;
-        audio_encode_data.conv_cb->try_dequeue(qdata);
-        if (!qdata) {
-            std::unique_lock<std::mutex> lock(*audio_encode_data.conv_lock);
-            audio_encode_data.conv_cv->wait(lock);
-            audio_encode_data.conv_cb->try_dequeue(qdata);
-        }
-
-        if (qdata->queued_data_info == queued_data::e_qdi_eof) {
-            if (!audio_encode_data.rmax_data.send_cb->try_enqueue(std::move(qdata))) {
-                std::unique_lock<std::mutex> lock(*audio_encode_data.rmax_data.send_lock);
-                audio_encode_data.rmax_data.send_cv->wait(lock);
-                audio_encode_data.rmax_data.send_cb->enqueue(std::move(qdata));
-            }
-            audio_encode_data.rmax_data.send_cv->notify_all();
-            if (!loop) {
-                break;
-            }
-            continue;
+    std::unique_ptr<ReadAheadFile> file(new ReadAheadFile(read_ahead_mb << 20));
+    uint8_t *buffer = static_cast<uint8_t*>(av_malloc(READ_AHEAD_IO_BUFFER_SIZE));
+    AVIOContext *io = buffer ? avio_alloc_context(buffer, READ_AHEAD_IO_BUFFER_SIZE, 0, file.get(),
+                                                  read_ahead_read_packet, nullptr, read_ahead_seek) : nullptr;
+    if (!context) {
+        context = avformat_alloc_context();
+    }
+    if (!io || !context || !file->open(path)) {
+        if (io) {
+            avio_context_free(&io);
         }
+        av_free(buffer);
+        avformat_free_context(context);
+        context = nullptr;
+        return AVERROR(EIO);
+    }
+    file.release();
+    context->pb = io;
+    const int ret = avformat_open_input(&context, path.c_str(), nullptr, nullptr);
+    if (ret < 0) {
+        free_read_ahead_io(io);
+    }
+    return ret;
+}
 
-        audio_encode_data.conv_cv->notify_all();
-
-        if (48000 != qdata->frame->sample_rate || AV_SAMPLE_FMT_S32 != qdata->frame->format) {
-            std::shared_ptr<AVFrame> new_av_frame{ av_frame_alloc(), AVFrameDeleter };
-            if (!swr) {
-                swr = swr_alloc_set_opts(nullptr,  // we're allocating a new context
-                    qdata->frame->channel_layout, // out_ch_layout
-                    AV_SAMPLE_FMT_S32,  // out_sample_fmt
-                    48000,  // out_sample_rate
-                    qdata->frame->channel_layout,  // in_ch_layout
-                    (AVSampleFormat)qdata->frame->format,  // in_sample_fmt
-                    qdata->frame->sample_rate,  // in_sample_rate
-                    0,  // log_offset
-                    nullptr);  // log_ctx
-            }
+/**
+ * Closes a media file opened by @ref open_input, as avformat_close_input.
+ */
+static void close_input(AVFormatContext **context)
+{
+    AVIOContext *io = *context && ((*context)->flags & AVFMT_FLAG_CUSTOM_IO) ? (*context)->pb : nullptr;
+    avformat_close_input(context);
+    if (io) {
+        free_read_ahead_io(io);
+    }
+}
 
-            new_av_frame->format = AVSampleFormat::AV_SAMPLE_FMT_S32;
-            new_av_frame->channel_layout = qdata->frame->channel_layout;
-            new_av_frame->sample_rate = qdata->frame->sample_rate;
-            new_av_frame->pkt_duration = qdata->frame->pkt_duration;
+/**
+ * Opens a media file again in the background while the current loop iteration
+ * is read, so the next iteration can be read as soon as the current one ends.
+ */
+class NextLoopInput
+{
+public:
+    explicit NextLoopInput(const std::string &path) : m_path(path) { }
+    NextLoopInput(const NextLoopInput&) = delete;
+    NextLoopInput &operator=(const NextLoopInput&) = delete;
+    ~NextLoopInput()
+    {
+        AVFormatContext *context = take();
+        if (context) {
+            close_input(&context);
+        }
+    }
 
-            if (swr_convert_frame(swr, new_av_frame.get(), qdata->frame.get())) {
-                std::cerr << "failed to convert audio frame with avresample_convert_frame" << std::endl;
-                return;
+    /**
+     * Starts opening the file.
+     */
+    void open()
+    {
+        const std::string path = m_path;
+        m_context = std::async(std::launch::async, [path]() {
+            AVFormatContext *context = nullptr;
+            if (open_input(context, path) != 0) {
+                std::cerr << "Error while open video file" << std::endl;
+                return (AVFormatContext*)nullptr;
             }
+            return context;
+        });
+    }
+    /**
+     * Waits until the file is open.
+     *
+     * @return the file, or nullptr if it wasn't opened or on error.
+     */
+    AVFormatContext *take()
+    {
+        return m_context.valid() ? m_context.get() : nullptr;
+    }
 
-            qdata->frame = new_av_frame;
-        }
-
-        std::shared_ptr<AVPacket> pPacket{ new AVPacket, AVPacketDeleter };
-        av_init_packet(pPacket.get());
-        pPacket->data = nullptr; // packet data will be allocated by the encoder
-        pPacket->size = 0;
+private:
+    const std::string m_path;
+    std::future<AVFormatContext*> m_context;
+};
 
-        int ret = 0;
-        while (likely(!exit_app()) && run_threads) {
-            ret = avcodec_send_frame(p_audio_codec_context_pcm, qdata->frame.get());
-            if (ret == AVERROR(EAGAIN)) {
-                while (avcodec_receive_packet(p_audio_codec_context_pcm, pPacket.get()))
-                    continue;
-            } else if (ret) {
-                std::cout << "Error while sending an audio packet to the encoder: " << ret << std::endl;;
-                return;
-            }
+/**
+ * Sets the threading of a decoder from the capabilities of its codec: frame
+ * threading when the codec has it, the fastest for long GOP codecs such as
+ * H.264 and HEVC, slice threading otherwise. External decoders such as
+ * libdav1d get the number of threads for their own threading.
+ *
+ * @param [in] context - decoder, before it is opened;
+ * @param [in] threads - number of threads, 0 for the share of the decoder of
+ *                       @p cpus, or of all the cores if empty;
+ * @param [in] max_auto_threads - at most that many threads when @p threads is 0;
+ * @param [in] cpus - CPUs of the decoder threads, can be empty;
+ * @param [in] decoders - number of decoders sharing the cores.
+ */
+static void set_decoder_threads(AVCodecContext *context, int threads, int max_auto_threads,
+                                const std::vector<int> &cpus, size_t decoders)
+{
+    if (!threads) {
+        const size_t cores = cpus.empty() ? std::thread::hardware_concurrency() : cpus.size();
+        threads = (int)std::min<size_t>(std::max<size_t>(cores / std::max<size_t>(decoders, 1), 1),
+                                        (size_t)max_auto_threads);
+    }
+    const int capabilities = context->codec ? context->codec->capabilities : 0;
+    if (threads > 1 && (capabilities & AV_CODEC_CAP_FRAME_THREADS)) {
+        context->thread_type = FF_THREAD_FRAME;
+    } else if (threads > 1 && (capabilities & AV_CODEC_CAP_SLICE_THREADS)) {
+        context->thread_type = FF_THREAD_SLICE;
+    } else if (!(capabilities & AV_CODEC_CAP_OTHER_THREADS)) {
+        // no threads, unless the wrapper of an external decoder runs its own
+        threads = 1;
+    }
+    context->thread_count = threads;
+}
 
-            break;
-        }
+// a decoder prints its frame rates that often
+static constexpr auto DECODER_REPORT_INTERVAL = seconds{10};
 
-        ret = avcodec_receive_packet(p_audio_codec_context_pcm, pPacket.get());
-        if (ret) {
-            std::cout << "Error while receiving an audio packet from the encoder: " << ret << std::endl;;
-            return;
-        }
+/**
+ * Frame rates of a decoder, over the wall clock and over the time the reader
+ * reads and decodes, without the time it waits for room in its queue. The
+ * latter is the rate the decoder would reach, to size the hosts. The rates
+ * are printed every @ref DECODER_REPORT_INTERVAL and for the whole file when
+ * the stats are destroyed.
+ */
+class DecoderStats
+{
+public:
+    explicit DecoderStats(const char *name)
+        : m_name(name)
+        , m_start(steady_clock::now())
+        , m_period_start(m_start)
+    { }
+    ~DecoderStats()
+    {
+        print("total", m_total, steady_clock::now() - m_start);
+    }
 
-        std::shared_ptr<queued_data> q_data = std::make_shared<queued_data>();
-        q_data->packet = pPacket;
-        if (!audio_encode_data.rmax_data.send_cb->try_enqueue(std::move(q_data))) {
-            std::unique_lock<std::mutex> lock(*audio_encode_data.rmax_data.send_lock);
-            audio_encode_data.rmax_data.send_cv->wait(lock);
-            audio_encode_data.rmax_data.send_cb->try_enqueue(std::move(q_data));
+    void add_frame()
+    {
+        ++m_total.frames;
+        ++m_period.frames;
+    }
+    /**
+     * The reader waits for room in its queue until @ref end_wait.
+     */
+    void begin_wait()
+    {
+        m_wait_start = steady_clock::now();
+    }
+    void end_wait()
+    {
+        const steady_clock::time_point now = steady_clock::now();
+        m_total.waiting += now - m_wait_start;
+        m_period.waiting += now - m_wait_start;
+        if (now - m_period_start >= DECODER_REPORT_INTERVAL) {
+            print("last period", m_period, now - m_period_start);
+            m_period = Counters();
+            m_period_start = now;
         }
-        audio_encode_data.rmax_data.send_cv->notify_all();
     }
 
-    if (swr) {
-        swr_free(&swr);
+private:
+    struct Counters
+    {
+        uint64_t frames = 0;
+        steady_clock::duration waiting = steady_clock::duration::zero();
+    };
+
+    void print(const char *what, const Counters &counters, steady_clock::duration elapsed) const
+    {
+        const double elapsed_s = duration<double>(elapsed).count();
+        const double decoding_s = duration<double>(elapsed - counters.waiting).count();
+        std::cout << m_name << " decoder, " << what << ": " << counters.frames << " frames in " << std::fixed <<
+            std::setprecision(1) << elapsed_s << " s, " << (elapsed_s > 0 ? counters.frames / elapsed_s : 0) <<
+            " fps, " << (decoding_s > 0 ? counters.frames / decoding_s : 0) << " fps while decoding" <<
+            std::defaultfloat << std::endl;
     }
-    // Notify all other waiting threads that current thread is finished
-    audio_encode_data.notity_all_cv();
-}
+
+    const char *m_name;
+    const steady_clock::time_point m_start;
+    steady_clock::time_point m_period_start;
+    steady_clock::time_point m_wait_start;
+    Counters m_total;
+    Counters m_period;
+};
 
 template<typename T>
-void read_stream(T rd)
+static void decode_stream(T &rd)
 {
     AVCodecContext *p_codec_context = avcodec_alloc_context3(rd.p_codec);
     std::unique_ptr<AVCodecContext, av_deleter> ctx_guard(p_codec_context);
@@ -2308,122 +3317,142 @@ void read_stream(T rd)
         std::cerr << "failed to allocated memory for " << rd.stream_name << " AVCodecContext\n";
         return;
     }
-    p_codec_context->thread_count = rd.ffmpeg_thread_count;
-    p_codec_context->active_thread_type = FF_THREAD_SLICE;
     if (avcodec_parameters_to_context(p_codec_context, rd.p_codec_parameters) < 0) {
         std::cerr << "failed to copy " << rd.stream_name << " codec params to codec context\n";
         return;
     }
-    p_codec_context->active_thread_type = FF_THREAD_SLICE;
+    set_decoder_threads(p_codec_context, rd.decoder_threads, rd.max_auto_decoder_threads, rd.decoder_cpus,
+                        rd.decoders_sharing_cpus);
+    // the decoder threads are started by avcodec_open2 and inherit the CPUs of this thread
+    if (!rd.decoder_cpus.empty()) {
+        rt_set_thread_affinity(rd.decoder_cpus);
+    }
     if (avcodec_open2(p_codec_context, rd.p_codec, nullptr) < 0) {
         std::cerr << "failed to open " << rd.stream_name << " codec through avcodec_open2\n";
         return;
     }
+    const int thread_type = p_codec_context->active_thread_type;
+    std::cout << rd.stream_name << " decoder " << rd.p_codec->name << ": " << p_codec_context->thread_count << " " <<
+        (thread_type == FF_THREAD_FRAME ? "frame" : thread_type == FF_THREAD_SLICE ? "slice" : "codec") <<
+        " threads" << std::endl;
 
     // Set reader thread affinity after initializing ffmpeg context, otherwise all
-    // @ref rd.ffmpeg_thread_count ffmpeg threads will inherit the same core as this reader thread.
-    // It will let ffmpeg threads to be set by the OS based on free available cores.
+    // the ffmpeg threads will inherit the same core as this reader thread. Without
+    // decoder CPUs, the ffmpeg threads are set by the OS based on free available cores.
     rd.set_thread_affinity();
     rt_set_thread_priority(RMAX_THREAD_PRIORITY_TIME_CRITICAL);
+    DecoderStats stats(rd.stream_name);
+
+    // the decoded frames and the queue entries are reused once the next thread drops them,
+    // the recycled frames give their buffers back to the buffer pool of the decoder
+    const size_t entries_in_flight = rd.queue_capacity() + QUEUE_ENTRIES_IN_USE;
+    std::shared_ptr<ObjectPool<AVFrame>> frame_pool = ObjectPool<AVFrame>::create(
+        std::string(rd.stream_name) + " decoder frame", entries_in_flight, av_frame_alloc, av_frame_unref,
+        AVFrameDeleter);
+    std::shared_ptr<queued_data_pool> entry_pool = create_queued_data_pool(
+        std::string(rd.stream_name) + " reader queue entry", entries_in_flight);
+    std::unique_ptr<AVPacket, std::function<void(AVPacket*)>> packet{
+                    new AVPacket,
+                    [](AVPacket* p) { av_packet_unref(p); delete p; } };
+    av_init_packet(packet.get());
+
+    // the video file is opened again for every loop iteration /* XXX */
+    NextLoopInput next_input(rd.file_path);
+    if (loop && std::is_same<T, VideoReaderData>::value) {
+        next_input.open();
+    }
 
     uint64_t frames = 0;
     while (likely(!exit_app()) && run_threads) {
-        std::unique_ptr<AVPacket, std::function<void(AVPacket*)>> packet{
-                        new AVPacket,
-                        [](AVPacket* p) { av_packet_unref(p); delete p; } };
-        std::shared_ptr<queued_data> qdata = std::make_shared<queued_data>();
-
-        av_init_packet(packet.get());
+        // the packet read by the previous iteration is done with
+        av_packet_unref(packet.get());
         int response = av_read_frame(*rd.p_format_context.get(), packet.get());
         if (AVERROR_EOF == response) {
             std::cout << "EOF while reading " << rd.stream_name << " frame (" << frames << ")." << std::endl;
-            qdata->queued_data_info = queued_data::e_qdi_eof;
-            if (!rd.conv_cb->try_enqueue(std::move(qdata))) {
-                std::unique_lock<std::mutex> lock(*rd.conv_lock);
-                rd.conv_cv->wait(lock);
-                rd.conv_cb->enqueue(std::move(qdata));
-            }
-            rd.conv_cv->notify_all();
-            if (loop) {
-                av_seek_frame(*rd.p_format_context.get(), rd.stream_index, 0, 0);
-                avcodec_flush_buffers(p_codec_context);
-                frames = 0;
-                if (std::is_same<T, VideoReaderData>::value) { /* XXX */
-                    avformat_close_input(rd.p_format_context.get());
-                    response = avformat_open_input(rd.p_format_context.get(), rd.file_path.c_str(), nullptr, nullptr);
-                    if (response != 0) {
-                        std::cerr << "Error while open video file" << std::endl;
-                    }
-                }
-                continue;
+            // the decoder gives the frames it still holds, then AVERROR_EOF
+            response = avcodec_send_packet(p_codec_context, nullptr);
+            if (response == AVERROR_EOF) {
+                // already draining
+                response = 0;
+            } else if (response < 0) {
+                std::cout << "Error while draining the " << rd.stream_name << " decoder: " << response << std::endl;
+                return;
             }
-            return;
         } else if (response < 0) {
             std::cout << "Error while reading " << rd.stream_name << " frame: " << response << std::endl;
             return;
-        }
-        if (packet->stream_index != rd.stream_index) {
-            continue;
-        }
-        // send packet to decoder
-        response = avcodec_send_packet(p_codec_context, packet.get());
-        if (response < 0) {
-            std::cout << "Error while sending a " << rd.stream_name << " packet to the decoder: " << response << std::endl;
+        } else if (packet->stream_index != rd.stream_index) {
             continue;
+        } else {
+            // send packet to decoder
+            response = avcodec_send_packet(p_codec_context, packet.get());
+            if (response < 0) {
+                std::cout << "Error while sending a " << rd.stream_name << " packet to the decoder: " << response << std::endl;
+                continue;
+            }
         }
         while (response >= 0 && run_threads) {
-            std::shared_ptr<AVFrame> pFrame{ av_frame_alloc(), AVFrameDeleter };
+            std::shared_ptr<AVFrame> pFrame = frame_pool->acquire();
             response = avcodec_receive_frame(p_codec_context, pFrame.get());
             if (response == AVERROR(EAGAIN)) {
                 continue;
             }
             if (response == AVERROR_EOF) {
-                std::cerr << "got to last " << rd.stream_name << " frame after " << frames << std::endl;
-                if (loop) {
-                    qdata->queued_data_info = queued_data::e_qdi_eof;
-                    if (!rd.conv_cb->try_enqueue(std::move(qdata))) {
-                        std::unique_lock<std::mutex> lock(*rd.conv_lock);
-                        rd.conv_cv->wait(lock);
-                        rd.conv_cb->enqueue(std::move(qdata));
-                    }
-                    rd.conv_cv->notify_all();
-                    av_seek_frame(*rd.p_format_context.get(), rd.stream_index, 0, 0);
-                    avcodec_flush_buffers(p_codec_context);
-                    frames = 0;
-                    if (std::is_same<T, VideoReaderData>::value) { /* XXX */
-                        avformat_close_input(rd.p_format_context.get());
-                        response = avformat_open_input(rd.p_format_context.get(), rd.file_path.c_str(), nullptr, nullptr);
-                        if (response != 0) {
-                            std::cerr << "Error while open video file" << std::endl;
-                        }
-                    }
-                    break;
-                } else {
-                    std::shared_ptr<queued_data> tmp_frmae;
-                    while (!rd.conv_cb->try_dequeue(tmp_frmae)) {
-                        std::unique_lock<std::mutex> lock(*rd.conv_lock);
-                        rd.conv_cv->wait(lock);
-                    }
+                const bool cached = loop && is_loop_cached(rd, frames);
+                std::shared_ptr<queued_data> qdata = entry_pool->acquire();
+                qdata->queued_data_info = cached ? queued_data::e_qdi_cached : queued_data::e_qdi_eof;
+                stats.begin_wait();
+                const bool pushed = rd.push(std::move(qdata));
+                stats.end_wait();
+                if (!pushed) {
+                    return;
+                }
+                if (!loop) {
                     std::cout << "done reading " << rd.stream_name << " file" << std::endl;
                     return;
                 }
+                if (cached) {
+                    std::cout << "done reading " << rd.stream_name << " file, next iterations are played from "
+                        "the loop cache" << std::endl;
+                    return;
+                }
+                // the next iteration is queued right behind the end of this one, so the
+                // sender goes on at the loop point without waiting for the reader
+                avcodec_flush_buffers(p_codec_context);
+                frames = 0;
+                AVFormatContext *next_context = next_input.take();
+                if (next_context) {
+                    close_input(rd.p_format_context.get());
+                    *rd.p_format_context = next_context;
+                    next_input.open();
+                } else {
+                    av_seek_frame(*rd.p_format_context.get(), rd.stream_index, 0, 0);
+                }
+                break;
             } else if (response < 0) {
                 std::cerr << "Error while receiving a " << rd.stream_name << " frame from the decoder: " << response << std::endl;
                 return;
             }
 
-            if (response >= 0) {
-                ++frames;
-                qdata->frame = pFrame;
-                if (!rd.conv_cb->try_enqueue(std::move(qdata))) {
-                    std::unique_lock<std::mutex> lock(*rd.conv_lock);
-                    rd.conv_cv->wait(lock);
-                    rd.conv_cb->enqueue(std::move(qdata));
-                }
-                rd.conv_cv->notify_all();
+            ++frames;
+            stats.add_frame();
+            cache_loop_frame(rd, pFrame.get());
+            std::shared_ptr<queued_data> qdata = entry_pool->acquire();
+            qdata->frame = std::move(pFrame);
+            stats.begin_wait();
+            const bool pushed = rd.push(std::move(qdata));
+            stats.end_wait();
+            if (!pushed) {
+                return;
             }
         }
     }
+}
+
+template<typename T>
+void read_stream(T rd)
+{
+    decode_stream(rd);
     // Notify all other waiting threads that current thread is finished
     rd.notify_all_cv();
 }
@@ -2439,7 +3468,7 @@ int get_context(const char *file_path, AVFormatContext *&p_format_context)
     }
 
     // Open the file and read its header. The codecs are not opened.
-    if (avformat_open_input(&p_format_context, file_path, nullptr, nullptr) != 0) {
+    if (open_input(p_format_context, file_path) != 0) {
         avformat_free_context(p_format_context);
         std::cerr << "ERROR could not open the file: " << file_path << std::endl;
         return -1;
@@ -2447,7 +3476,7 @@ int get_context(const char *file_path, AVFormatContext *&p_format_context)
 
     // Read Packets from the Format to get stream information
     if (avformat_find_stream_info(p_format_context, nullptr) < 0) {
-        avformat_close_input(&p_format_context);
+        close_input(&p_format_context);
         avformat_free_context(p_format_context);
         std::cerr << "ERROR could not get the stream info" << std::endl;
         return -1;
@@ -2515,7 +3544,7 @@ int video_process_file(const char *file_path, VideoRmaxData &rmax_data, VideoRea
             << "." << (p_video_format_context->duration%AV_TIME_BASE)
             << std::endl << std::endl;
     } else {
-        avformat_close_input(&p_video_format_context);
+        close_input(&p_video_format_context);
         std::cerr << "Failed finding video valid stream" << std::endl;
         return -1;
     }
@@ -2523,6 +3552,56 @@ int video_process_file(const char *file_path, VideoRmaxData &rmax_data, VideoRea
     return 0;
 }
 
+void video_process_packetized_file(const char *file_path, const PacketizedFile &packetized_file,
+                                   VideoRmaxData &rmax_data)
+{
+    const PacketizedFileHeader &header = packetized_file.header();
+
+    //Init rmax_data
+    rmax_data.width = header.width;
+    rmax_data.height = header.height;
+    rmax_data.fps = header.fps;
+    rmax_data.pix_format = (AVPixelFormat)header.pix_format;
+    rmax_data.video_type = (VIDEO_TYPE)header.video_type;
+    rmax_data.duration = (int64_t)(header.frame_count / header.fps);
+
+    std::cout << std::endl;
+    std::cout << "File information: "<< file_path << std::endl;
+    std::cout << "Video"
+        << "\n\t pre-packetized frames: " << header.frame_count
+        << "\n\t video pix format is: " << av_get_pix_fmt_name(rmax_data.pix_format)
+        << "\n\t height: " << header.height
+        << "\n\t width: " << header.width
+        << "\n\t fps: " << header.fps
+        << "\n\t " << (header.video_type == VIDEO_TYPE::PROGRESSIVE ? "progressive" : "interlaced")
+        << "\n\t packets per frame/field: " << header.packets_in_field
+        << "\n\t max packet size: " << header.max_packet_size
+        << std::endl << std::endl;
+}
+
+void video_process_raw_file(const char *file_path, const RawVideoFile &raw_file, const MediaData &media_data,
+                            VideoRmaxData &rmax_data)
+{
+    //Init rmax_data
+    rmax_data.width = raw_file.m_width;
+    rmax_data.height = raw_file.m_height;
+    rmax_data.fps = media_data.fps;
+    rmax_data.pix_format = raw_file.m_pix_format;
+    rmax_data.video_type = media_data.video_type;
+    rmax_data.duration = (int64_t)(raw_file.frame_count() / media_data.fps);
+
+    std::cout << std::endl;
+    std::cout << "File information: "<< file_path << std::endl;
+    std::cout << "Video"
+        << "\n\t raw frames: " << raw_file.frame_count()
+        << "\n\t video pix format is: " << raw_file.m_packetizer_format->name
+        << "\n\t height: " << raw_file.m_height
+        << "\n\t width: " << raw_file.m_width
+        << "\n\t fps: " << media_data.fps
+        << "\n\t " << (media_data.video_type == VIDEO_TYPE::PROGRESSIVE ? "progressive" : "interlaced")
+        << std::endl << std::endl;
+}
+
 bool audio_process_file(const char *file_path, AudioRmaxData &audio_rmax_data,
                        AudioReaderData& audio_reader_data, MediaData &media_data)
 {
@@ -2582,7 +3661,7 @@ bool audio_process_file(const char *file_path, AudioRmaxData &audio_rmax_data,
         audio_reader_data.p_codec_parameters = p_audio_codec_parameters;
         audio_reader_data.p_format_context = std::make_shared<AVFormatContext*>(std::move(p_audio_format_context));
     } else {
-        avformat_close_input(&p_audio_format_context);
+        close_input(&p_audio_format_context);
         std::cerr << "Failed finding Audio valid stream" << std::endl;
         return false;;
     }
@@ -2723,12 +3802,72 @@ static bool set_clock(rivermax_clock_types clock_handler_type, const std::vector
         std::cout << "failed set clock with status: " << status << std::endl;
         return false;
     }
+    // the PTP clock is not a kernel clock, the senders sleep against the monotonic clock then
+    wake_up_set_clock(p_get_current_time_ns, clock_handler_type != rivermax_clock_types::PTP_CLOCK);
 
     return wait_rivermax_clock_steady();
 }
 
+// default pre-roll of a queue
+static constexpr uint32_t DEFAULT_QUEUE_LATENCY_MS = 500;
+static constexpr auto QUEUE_STATS_PERIOD = milliseconds{100};
+// audio in a chunk of the audio sender, see set_audio_packet_layout
+static constexpr uint32_t DEFAULT_AUDIO_CHUNK_TIME_US = 1000;
+
+/**
+ * Number of entries of a queue holding @p latency_ms of entries produced
+ * @p rate times per second, at least @ref MIN_QUEUE_ENTRIES.
+ */
+static size_t queue_entries(uint32_t latency_ms, double rate)
+{
+    return std::max(MIN_QUEUE_ENTRIES, (size_t)std::ceil(latency_ms * rate / 1000));
+}
+
+/**
+ * Sizes the queues of decoded video frames of a stream, the queue to the
+ * scaler and the queue to the sender, from a pre-roll latency and a memory
+ * budget.
+ *
+ * @param [in] data - video stream;
+ * @param [in] scaled - the frames are scaled to UYVY before the sender queue,
+ *                      otherwise the queue to the scaler is not used;
+ * @param [in] latency_ms - pre-roll of each queue;
+ * @param [in] memory_budget - bytes of frames of the queues and their stages,
+ *                             0 for no limit;
+ * @param [out] entries - entries of each queue.
+ *
+ * @return false if the budget doesn't fit @ref MIN_QUEUE_ENTRIES frames.
+ */
+static bool size_video_queues(const VideoRmaxData &data, bool scaled, uint32_t latency_ms,
+                              uint64_t memory_budget, size_t &entries)
+{
+    const uint64_t decoded_size = (uint64_t)std::max(0, av_image_get_buffer_size(data.pix_format, data.width,
+                                                                                  data.height, 64));
+    const uint64_t scaled_size = (uint64_t)data.width * data.height * 2;
+    const uint64_t entry_size = scaled ? decoded_size + scaled_size : decoded_size;
+    entries = queue_entries(latency_ms, data.fps);
+    if (memory_budget && entry_size) {
+        const uint64_t budget_entries = memory_budget / entry_size;
+        if (budget_entries < MIN_QUEUE_ENTRIES + QUEUE_ENTRIES_IN_USE) {
+            std::cerr << "The queue memory budget of " << (memory_budget >> 20) << " MB per media file is less " <<
+                "than " << MIN_QUEUE_ENTRIES + QUEUE_ENTRIES_IN_USE << " frames of " << (entry_size >> 20) <<
+                " MB" << std::endl;
+            return false;
+        }
+        entries = std::min(entries, (size_t)budget_entries - QUEUE_ENTRIES_IN_USE);
+    }
+    std::cout << "video queues: " << entries << " frames, " << entries * 1000 / data.fps << " ms, " <<
+        ((entries + QUEUE_ENTRIES_IN_USE) * entry_size >> 20) << " MB" << std::endl;
+    return true;
+}
+
+static bool rmax_initialized = false;
+
 static void cleanup()
 {
+    if (!rmax_initialized) {
+        return;
+    }
     const rmx_status status = rmx_cleanup();
     if (status != RMX_OK) {
         std::cerr << "Failed to clean up Rivermax with status: " << status << std::endl;
@@ -2741,6 +3880,24 @@ int main(int argc, char *argv[])
 
     std::vector<std::string> sdp_files;
     std::vector<std::string> video_files;
+    std::vector<std::string> packetize_files;
+    std::vector<std::string> anc_files;
+    size_t loop_cache_mb = 0;
+    uint32_t queue_latency_ms = DEFAULT_QUEUE_LATENCY_MS;
+    size_t queue_memory_mb = 0;
+    std::string queue_stats_file;
+    uint32_t audio_chunk_time_us = DEFAULT_AUDIO_CHUNK_TIME_US;
+    std::string raw_format;
+    size_t packetizer_threads = 0;
+    std::vector<int> packetizer_cpus;
+    size_t scaler_threads = 0;
+    std::vector<int> scaler_cpus;
+    int decoder_threads = 0;
+    std::vector<int> decoder_cpus;
+    size_t sender_threads = 0;
+    std::vector<int> sender_cpus;
+    std::string output_type = "rivermax";
+    std::string pcap_prefix;
     std::vector<int> cpus;
     int rivermax_thread_affinity = CPU_NONE;
     uint16_t max_video_packet_size = 1248;
@@ -2773,7 +3930,7 @@ int main(int argc, char *argv[])
                    "                              - Second CPU: to be used for the scaling thread\n"
                    "                              - Third CPU: to be used for the Rivermax sender video thread\n"
                    "                              - Fourth CPU: to be used for the input audio reader thread\n"
-                   "                              - Fifth CPU: to be used for the encoding thread\n"
+                   "                              - Fifth CPU: unused, the audio reader converts the samples\n"
                    "                              - Sixth CPU: to be used for the Rivermax sender audio thread")
     ->delimiter(',')->check(CLI::Range(CPU_NONE, 1024))->type_size(e_num_of_affinity_index);
     app.add_option("-o,--tro-modification", multiplier,
@@ -2783,6 +3940,87 @@ int main(int argc, char *argv[])
         ->check(CLI::Range((int)rivermax_clock_types::SYSTEM_CLOCK,
                            (int)rivermax_clock_types::PTP_CLOCK));
     app.add_flag("--assert-mc_addr", assert_mc_addr, "Check that MC IP address in the range 224.0.2.0 - 239.255.255.255");
+    auto packetize_opt = app.add_option("--packetize", packetize_files,
+                   "Comma separated list of files to store the packetized video of the media files in, one per\n"
+                   "                              media file, instead of sending it. A pre-packetized file can be given\n"
+                   "                              to --media-files to send its video without decoding it")
+        ->delimiter(',')->excludes(loop_opt);
+    app.add_option("--anc-files", anc_files,
+                   "Comma separated list of files of the ANC data packets to send in the ancillary stream, one per\n"
+                   "                              media file, see the README for their format [default: a packet of\n"
+                   "                              the DID and SDID of the SDP in every frame/field]")
+        ->delimiter(',')->check(CLI::ExistingFile);
+    app.add_option("--loop-cache", loop_cache_mb,
+                   "Keep the decoded video frames of the first loop iteration in memory (huge pages when available)\n"
+                   "                              and play the next iterations without decoding, if the clip fits in\n"
+                   "                              this budget in MB per media file [default: 0, disabled]")
+        ->needs(loop_opt);
+    app.add_option("--queue-latency", queue_latency_ms,
+                   "Pre-roll in ms of every queue between the reader, scaler and sender threads, the\n"
+                   "                              queues are sized from it and the frame rate", true)
+        ->check(CLI::Range(1, 60000));
+    app.add_option("--queue-memory", queue_memory_mb,
+                   "Memory in MB of the decoded video frames of the queues of all the media files, shared evenly\n"
+                   "                              by the media files, the queues are shortened to fit [default: 0, no limit]");
+    app.add_option("--audio-chunk-time", audio_chunk_time_us,
+                   "Audio in us the audio sender commits at once, rounded down to whole packets of the packet\n"
+                   "                              time of the SDP, at least one. The audio latency of the sender", true)
+        ->check(CLI::Range(1, 1000000));
+    app.add_option("--queue-stats", queue_stats_file,
+                   "CSV file the occupancy of every queue is written to every 100 ms, the occupancy over the run\n"
+                   "                              is printed at the end");
+    app.add_option("--read-ahead", read_ahead_mb,
+                   "Read the media files ahead of their demuxers with io_uring (or a thread if io_uring is not\n"
+                   "                              available), this many MB per reader, in blocks of 4 MB with direct\n"
+                   "                              I/O, for network storage. Linux only [default: 0, disabled]")
+        ->check(CLI::Range(0, 65536));
+    app.add_option("--raw-format", raw_format,
+                   "The media files are uncompressed video frames of this format, one after the other. The frame\n"
+                   "                              size and rate are taken from the SDP files, and the frames are sent\n"
+                   "                              without reader nor scaler threads")
+        ->check(CLI::IsMember(RAW_VIDEO_FORMATS))->excludes(packetize_opt);
+    auto packetizer_threads_opt = app.add_option("--packetizer-threads", packetizer_threads,
+                   "Number of helper threads filling the video chunks together with each video sender thread, for\n"
+                   "                              high resolutions and frame rates, needs --packetizer-cpus [default: 0,\n"
+                   "                              the sender fills them]")
+        ->check(CLI::Range(0, 64))->excludes(packetize_opt);
+    app.add_option("--packetizer-cpus", packetizer_cpus,
+                   "Comma separated list of CPU for the packetizer helper threads, --packetizer-threads CPUs per\n"
+                   "                              media file, in the order of the media files")
+        ->delimiter(',')->check(CLI::Range(0, 1024))->needs(packetizer_threads_opt);
+    auto scaler_threads_opt = app.add_option("--scaler-threads", scaler_threads,
+                   "Number of helper threads converting the decoded video frames to UYVY in slices together with\n"
+                   "                              each video scaler thread [default: 0, the scaler converts them]")
+        ->check(CLI::Range(0, 64));
+    app.add_option("--scaler-cpus", scaler_cpus,
+                   "Comma separated list of CPU for the scaler helper threads, --scaler-threads CPUs per media\n"
+                   "                              file, in the order of the media files")
+        ->delimiter(',')->check(CLI::Range(0, 1024))->needs(scaler_threads_opt);
+    app.add_option("--decoder-threads", decoder_threads,
+                   "Number of threads of each video decoder, frame or slice threads as the codec supports\n"
+                   "                              [default: 0, the decoder CPUs or all the cores shared by the media files]")
+        ->check(CLI::Range(0, 64));
+    app.add_option("--decoder-cpus", decoder_cpus,
+                   "Comma separated list of CPU for the decoder threads of all the media files [default: any]")
+        ->delimiter(',')->check(CLI::Range(0, 1024));
+    auto sender_threads_opt = app.add_option("--sender-threads", sender_threads,
+                   "Send all the streams of all the media files from this number of threads, each one serving its\n"
+                   "                              streams in the order of their send times, instead of one sender\n"
+                   "                              thread per stream")
+        ->check(CLI::Range(1, 64))->excludes(packetize_opt);
+    app.add_option("--sender-cpus", sender_cpus,
+                   "Comma separated list of CPU for the --sender-threads threads, one per thread")
+        ->delimiter(',')->check(CLI::Range(0, 1024))->needs(sender_threads_opt);
+    auto output_opt = app.add_option("--output", output_type,
+                   "Where the streams are sent: rivermax, or null to drop the committed chunks after checking them\n"
+                   "                              without Rivermax nor a NIC, null-timed to also hold every chunk\n"
+                   "                              until its send time, pcap to write the packets in pcap files\n"
+                   "                              [default: rivermax]")
+        ->check(CLI::IsMember({"rivermax", "null", "null-timed", "pcap"}))->excludes(packetize_opt);
+    app.add_option("--pcap-prefix", pcap_prefix,
+                   "Path prefix of the pcap files of --output pcap, the packets of a stream are written in\n"
+                   "                              <prefix>_<video|audio|ancillary>_<stream ID>.pcap [default: rivermax_player]")
+        ->needs(output_opt);
     CLI11_PARSE(app, argc, argv);
     if (app.count("-p") > 0) {
         stream_type = 0;
@@ -2813,10 +4051,51 @@ int main(int argc, char *argv[])
         std::cout << "Error - Number of SDP files differs from number of media files" << std::endl;
         exit(EXIT_FAILURE);
     }
+    if (!packetize_files.empty()) {
+        if (packetize_files.size() != video_files.size()) {
+            std::cout << "Error - Number of packetized files differs from number of media files" << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        if (app.count("-p") > 0 && stream_type != eMediaType_t::video) {
+            std::cout << "Error - Only the video stream can be packetized" << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        stream_type = eMediaType_t::video;
+    }
+    // the helpers spin between the chunks at real-time priority, they would starve the threads of shared cores
+    if (packetizer_threads && packetizer_cpus.empty()) {
+        std::cout << "Error - Packetizer helper threads spin at real-time priority, give them dedicated cores "
+                     "with --packetizer-cpus" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    if (!packetizer_cpus.empty() && packetizer_cpus.size() != packetizer_threads * video_files.size()) {
+        std::cout << "Error - Number of packetizer CPUs differs from number of packetizer threads of all media files"
+                  << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    if (!scaler_cpus.empty() && scaler_cpus.size() != scaler_threads * video_files.size()) {
+        std::cout << "Error - Number of scaler CPUs differs from number of scaler threads of all media files"
+                  << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    if (!sender_cpus.empty() && sender_cpus.size() != sender_threads) {
+        std::cout << "Error - Number of sender CPUs differs from number of sender threads" << std::endl;
+        exit(EXIT_FAILURE);
+    }
     if ((eMediaType_t::ancillary & stream_type) && !(eMediaType_t::video & stream_type)) {
         std::cout << "Error - Ancillary stream should be sent with video stream only" << std::endl;
         exit(EXIT_FAILURE);
     }
+    if (!anc_files.empty()) {
+        if (anc_files.size() != video_files.size()) {
+            std::cout << "Error - Number of ANC files differs from number of media files" << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        if (!(eMediaType_t::ancillary & stream_type)) {
+            std::cout << "Error - ANC files are sent in the ancillary stream only" << std::endl;
+            exit(EXIT_FAILURE);
+        }
+    }
 
     if (assert_mc_addr) {
         std::ifstream is(sdp_files[0]);
@@ -2856,24 +4135,41 @@ int main(int argc, char *argv[])
         }
     }
 
-    status = rmx_enable_system_signal_handling();
-    if (status != RMX_OK) {
-        std::cerr << "Failed to enable system signal handling with code:" << status << std::endl;
-        exit(EXIT_FAILURE);
-    }
-
-    status = rmx_init();
-    if (status != RMX_OK) {
-        std::cerr << "Failed to initialize Rivermax with code:" << status << std::endl;
-        exit(EXIT_FAILURE);
-    }
+    if (output_type != "rivermax") {
+        // the software outputs need no Rivermax, the streams follow the system clock
+        p_get_current_time_ns = rivermax_player_time_handler;
+        g_tai_to_rmax_time_conversion = (uint64_t)nanoseconds{seconds{LEAP_SECONDS}}.count();
+        wake_up_set_clock(p_get_current_time_ns, true);
+        auto get_time_ns = [] { return align_to_rmax_time(get_tai_time_ns()); };
+        if (output_type == "pcap") {
+            media_output = std::make_shared<PcapOutput>(pcap_prefix.empty() ? "rivermax_player" : pcap_prefix,
+                                                        get_time_ns);
+        } else {
+            media_output = std::make_shared<NullOutput>(output_type == "null-timed", get_time_ns);
+        }
+    } else if (packetize_files.empty()) {
+        // packetizing is done offline, nothing is sent
+        status = rmx_enable_system_signal_handling();
+        if (status != RMX_OK) {
+            std::cerr << "Failed to enable system signal handling with code:" << status << std::endl;
+            exit(EXIT_FAILURE);
+        }
 
-    // Set clock
-    if (!set_clock(clock_handler_type, sdp_files)) {
-        if (!set_clock(rivermax_clock_types::SYSTEM_CLOCK, sdp_files)) {
-            cleanup();
+        status = rmx_init();
+        if (status != RMX_OK) {
+            std::cerr << "Failed to initialize Rivermax with code:" << status << std::endl;
             exit(EXIT_FAILURE);
         }
+        rmax_initialized = true;
+
+        // Set clock
+        if (!set_clock(clock_handler_type, sdp_files)) {
+            if (!set_clock(rivermax_clock_types::SYSTEM_CLOCK, sdp_files)) {
+                cleanup();
+                exit(EXIT_FAILURE);
+            }
+        }
+        media_output = std::make_shared<RivermaxOutput>();
     }
 
     static std::string media_version = std::to_string(RMX_VERSION_MAJOR) + std::string(".") +
@@ -2892,26 +4188,20 @@ int main(int argc, char *argv[])
 
     std::vector<std::thread> reader_threads;
     std::vector<std::thread> other_threads;
-    std::vector<std::shared_ptr<std::condition_variable>> cond_vars;
+    // streams of the multiplexed sender threads, see --sender-threads
+    std::vector<std::shared_ptr<MediaSender>> multiplexed_senders;
     std::vector<std::shared_ptr<AVFormatContext*>> av_format_ctx_vec;
+    // see --queue-memory and --queue-stats
+    const uint64_t queue_memory_budget = ((uint64_t)queue_memory_mb << 20) / video_files.size();
+    QueueMonitor queue_monitor(QUEUE_STATS_PERIOD);
     for (size_t i = 0; i < video_files.size(); ++i) {
         MediaData media_data;
         std::ifstream is(sdp_files[i]);
         std::string sdp((std::istreambuf_iterator<char>(is)), std::istreambuf_iterator<char>());
-        std::shared_ptr<std::condition_variable> sync_cv = std::make_shared<std::condition_variable>();
-        cond_vars.push_back(sync_cv);
-        std::shared_ptr<std::condition_variable> eof_cv = std::make_shared<std::condition_variable>();
-        cond_vars.push_back(eof_cv);
-        std::shared_ptr<std::atomic<int>> eof_stream_counter = std::make_shared<std::atomic<int>>();
-        *eof_stream_counter = 0;
-        SynchronizerData sync_data(sync_cv, eof_cv, eof_stream_counter);
-        std::shared_ptr<std::mutex> sync_lock = std::make_shared<std::mutex>();
-
-        //Video
-        VideoRmaxData video_rmax_data;
-        VideoReaderData video_reader_data;
-        if (video_process_file(video_files[i].c_str(), video_rmax_data, video_reader_data)) {
-            std::cerr << "Fail getting video info" << std::endl;
+        // all the streams are counted before the first one starts
+        std::shared_ptr<LoopBarrier> loop_barrier = std::make_shared<LoopBarrier>();
+        for (uint32_t type = stream_type; type; type &= type - 1) {
+            loop_barrier->add_stream();
         }
 
         if (!parse_video_sdp_params(sdp, media_data)) {
@@ -2920,9 +4210,64 @@ int main(int argc, char *argv[])
             exit(EXIT_FAILURE);
         }
 
+        //Video
+        VideoRmaxData video_rmax_data;
+        VideoReaderData video_reader_data;
+        std::shared_ptr<PacketizedFile> packetized_file;
+        std::shared_ptr<RawVideoFile> raw_file;
+        if (!raw_format.empty()) {
+            if (eMediaType_t::audio & stream_type) {
+                std::cerr << "Raw video file " << video_files[i] << " has no audio, "
+                    "select the streams to send with -p" << std::endl;
+                cleanup();
+                exit(EXIT_FAILURE);
+            }
+            // the raw frames have the geometry of the SDP
+            raw_file = std::make_shared<RawVideoFile>();
+            if (!raw_file->open(video_files[i], raw_format, media_data.width, media_data.height)) {
+                cleanup();
+                exit(EXIT_FAILURE);
+            }
+            if (media_data.sampling != SAMPLING_TYPE::YCBCR422 ||
+                (media_data.depth && media_data.depth != raw_file->m_packetizer_format->bit_depth)) {
+                std::cerr << "Raw video format " << raw_format << " isn't compatible with SDP parameters" << std::endl;
+                cleanup();
+                exit(EXIT_FAILURE);
+            }
+            // the packetizer reads the frames in place from the mapping
+            if (!raw_file->packets_valid(media_data.video_type, max_video_packet_size, allow_v_padding)) {
+                std::cerr << "Raw video frames of " << media_data.width << "x" << media_data.height << " can't be "
+                    "split into packets of " << max_video_packet_size << " bytes" << std::endl;
+                cleanup();
+                exit(EXIT_FAILURE);
+            }
+            video_process_raw_file(video_files[i].c_str(), *raw_file, media_data, video_rmax_data);
+        } else if (PacketizedFile::probe(video_files[i])) {
+            if (!packetize_files.empty()) {
+                std::cerr << video_files[i] << " is already packetized" << std::endl;
+                cleanup();
+                exit(EXIT_FAILURE);
+            }
+            if (eMediaType_t::audio & stream_type) {
+                std::cerr << "Pre-packetized file " << video_files[i] << " has no audio, "
+                    "select the streams to send with -p" << std::endl;
+                cleanup();
+                exit(EXIT_FAILURE);
+            }
+            packetized_file = std::make_shared<PacketizedFile>();
+            if (!packetized_file->open(video_files[i])) {
+                cleanup();
+                exit(EXIT_FAILURE);
+            }
+            video_process_packetized_file(video_files[i].c_str(), *packetized_file, video_rmax_data);
+        } else if (video_process_file(video_files[i].c_str(), video_rmax_data, video_reader_data)) {
+            std::cerr << "Fail getting video info" << std::endl;
+        }
+
         if (media_data.height != video_rmax_data.height ||
             media_data.width != video_rmax_data.width ||
-            ((uint32_t)(media_data.fps * 1000) != (uint32_t)(video_rmax_data.fps * 1000)) ) {
+            ((uint32_t)(media_data.fps * 1000) != (uint32_t)(video_rmax_data.fps * 1000)) ||
+            (packetized_file && media_data.video_type != video_rmax_data.video_type)) {
             std::cerr<< "Provided mp4 file isn't compatible with SDP parameters:" << std::endl;
             cleanup();
             exit(EXIT_FAILURE);
@@ -2932,60 +4277,75 @@ int main(int argc, char *argv[])
 
         av_format_ctx_vec.push_back(video_reader_data.p_format_context);
         int video_stream_idx = video_reader_data.stream_index;
-        if (video_stream_idx == -1) {
+        if (!packetized_file && !raw_file && video_stream_idx == -1) {
             std::cerr << "Fail finding video stream";
             cleanup();
             exit(EXIT_FAILURE);
         }
 
-        double frame_field_start_time_ns = (double)get_tai_time_ns() + (double)nanoseconds{seconds{5}}.count();
+        const Rational frame_field_start_time_ns(get_tai_time_ns() + (uint64_t)nanoseconds{seconds{5}}.count());
         if (eMediaType_t::video & stream_type) {
             //Create threads
-            std::shared_ptr<my_queue> video_conv_cb = std::make_shared<my_queue>(CB_SIZE_VIDEO);
-            std::shared_ptr<std::condition_variable> video_conv_cv = std::make_shared<std::condition_variable>();
-            cond_vars.push_back(video_conv_cv);
-            std::shared_ptr<std::mutex> video_conv_lock = std::make_shared<std::mutex>();
-
-            std::shared_ptr<my_queue> video_send_cb = std::make_shared<my_queue>(CB_SIZE_VIDEO);
-            std::shared_ptr<std::condition_variable> video_send_cv = std::make_shared<std::condition_variable>();
-            cond_vars.push_back(video_send_cv);
-            std::shared_ptr<std::mutex> video_send_lock = std::make_shared<std::mutex>();
-
-            video_reader_data.conv_cb = video_conv_cb;
-            video_reader_data.conv_cv = video_conv_cv;
-            video_reader_data.conv_lock = video_conv_lock;
+            size_t video_queue_entries = MIN_QUEUE_ENTRIES;
+            if (!packetized_file && !raw_file &&
+                !size_video_queues(video_rmax_data, !find_video_packetizer_format(video_rmax_data.pix_format),
+                                   queue_latency_ms, queue_memory_budget, video_queue_entries)) {
+                ret = EXIT_FAILURE;
+                goto exit;
+            }
+            std::shared_ptr<media_channel> video_conv_channel = std::make_shared<media_channel>(video_queue_entries);
+            std::shared_ptr<media_channel> video_send_channel = std::make_shared<media_channel>(video_queue_entries);
+            video_reader_data.conv_channel = video_conv_channel;
             video_reader_data.video_type = media_data.video_type;
 
-            sync_data.video_next_frame_field_send_time_ns = std::make_shared<double>(frame_field_start_time_ns);
-            sync_data.add_stream();
-            video_rmax_data.next_frame_field_send_time_ns = sync_data.video_next_frame_field_send_time_ns;
+            video_rmax_data.next_frame_field_send_time_ns = std::make_shared<Rational>(frame_field_start_time_ns);
             video_rmax_data.sdp_path = sdp_files[i];
-            video_rmax_data.send_cb = video_send_cb;
-            video_rmax_data.send_cv = video_send_cv;
-            video_rmax_data.send_lock = video_send_lock;
-            video_rmax_data.sync_cv = sync_cv;
-            video_rmax_data.sync_lock = sync_lock;
-            video_rmax_data.eof_cv = eof_cv;
+            video_rmax_data.send_channel = video_send_channel;
             video_rmax_data.max_payload_size = max_video_packet_size;
             video_rmax_data.allow_padding = allow_v_padding;
-            video_rmax_data.eof_stream_counter = eof_stream_counter;
-
-            bool is_scaler_needed = true;
-            if (video_rmax_data.pix_format == AVPixelFormat::AV_PIX_FMT_YUV422P ||
-                video_rmax_data.pix_format == AVPixelFormat::AV_PIX_FMT_UYVY422 ||
-                video_rmax_data.pix_format == AVPixelFormat::AV_PIX_FMT_YUV422P10LE) {
-                is_scaler_needed = false;
-                video_reader_data.conv_cb = video_send_cb;
-                video_reader_data.conv_cv = video_send_cv;
-                video_reader_data.conv_lock = video_send_lock;
-                video_send_cb = std::make_shared<my_queue>(2 * CB_SIZE_VIDEO);
-            }
+            video_rmax_data.loop_barrier = loop_barrier;
+
+            // pre-packetized and raw frames are read by the sender, there is no reader nor scaler
+            bool is_scaler_needed = false;
+            if (packetized_file) {
+                video_rmax_data.packetized_file = packetized_file;
+            } else if (raw_file) {
+                video_rmax_data.raw_file = raw_file;
+            } else {
+                is_scaler_needed = true;
+                if (find_video_packetizer_format(video_rmax_data.pix_format)) {
+                    is_scaler_needed = false;
+                    video_reader_data.conv_channel = video_send_channel;
+                }
+                if (loop_cache_mb) {
+                    // the frames the sender gets are cached, after scaling, by the thread queuing them
+                    AVPixelFormat cached_pix_format = is_scaler_needed ?
+                        AVPixelFormat::AV_PIX_FMT_UYVY422 : video_rmax_data.pix_format;
+                    video_rmax_data.frame_cache = std::make_shared<VideoFrameCache>(
+                        loop_cache_mb << 20, cached_pix_format, video_rmax_data.width, video_rmax_data.height);
+                    // the duration is in whole seconds, one more second covers the rest of the clip
+                    const uint64_t max_frames = video_rmax_data.duration > 0 ?
+                        (uint64_t)std::ceil((video_rmax_data.duration + 1) * video_rmax_data.fps) :
+                        std::numeric_limits<uint64_t>::max();
+                    if (video_rmax_data.frame_cache->allocate(max_frames)) {
+                        video_reader_data.frame_cache = video_rmax_data.frame_cache;
+                        video_reader_data.caches_frames = !is_scaler_needed;
+                    } else {
+                        std::cout << "Loop cache is disabled, no video frame can be stored in " << loop_cache_mb <<
+                            " MB" << std::endl;
+                        video_rmax_data.frame_cache.reset();
+                    }
+                }
 
-            video_reader_data.set_cpu(cpus[e_video_reader_index]);
-            reader_threads.emplace_back(read_stream<VideoReaderData>, std::move(video_reader_data));
+                video_reader_data.set_cpu(cpus[e_video_reader_index]);
+                video_reader_data.decoder_threads = decoder_threads;
+                video_reader_data.decoder_cpus = decoder_cpus;
+                video_reader_data.decoders_sharing_cpus = video_files.size();
+                reader_threads.emplace_back(read_stream<VideoReaderData>, std::move(video_reader_data));
+            }
+            // the next threads start once their input is ready
             if (is_scaler_needed) {
-                std::unique_lock<std::mutex> lock(*video_conv_lock);
-                video_conv_cv->wait(lock);
+                video_conv_channel->wait_for_item();
             }
             video_rmax_data.video_type = media_data.video_type;
             cst_data time_calculation_data(video_rmax_data.width, video_rmax_data.height,
@@ -2995,19 +4355,39 @@ int main(int argc, char *argv[])
             calculate_stream_time(video, video_rmax_data.next_frame_field_send_time_ns, time_calculation_data,
                                   &video_rmax_data.timestamp_tick);
             if (is_scaler_needed) {
-                ScaleDataVideo scale_data_video(video_rmax_data, video_conv_cb, video_conv_cv,
-                                                video_conv_lock, cpus[e_video_scaler_index]);
+                ScaleDataVideo scale_data_video(video_rmax_data, video_conv_channel, cpus[e_video_scaler_index]);
+                scale_data_video.rmax_data.frame_cache = video_rmax_data.frame_cache;
+                scale_data_video.scaler_threads = scaler_threads;
+                if (!scaler_cpus.empty()) {
+                    scale_data_video.scaler_cpus.assign(scaler_cpus.begin() + i * scaler_threads,
+                                                        scaler_cpus.begin() + (i + 1) * scaler_threads);
+                }
                 other_threads.emplace_back(scale_video, scale_data_video);
-
+                queue_monitor.add("video " + std::to_string(i) + " scaler", video_conv_channel->capacity(),
+                                  [video_conv_channel] { return video_conv_channel->size(); });
+            }
+            if (!packetized_file && !raw_file) {
+                queue_monitor.add("video " + std::to_string(i) + " sender", video_send_channel->capacity(),
+                                  [video_send_channel] { return video_send_channel->size(); });
             }
-            {
-                std::unique_lock<std::mutex> lock(*video_send_lock);
-                video_send_cv->wait(lock);
+            if (!packetized_file && !raw_file) {
+                video_send_channel->wait_for_item();
             }
 
             video_rmax_data.payload_type = media_data.payload_type;
             video_rmax_data.set_cpu(cpus[e_video_sender_index]);
-            other_threads.emplace_back(rivermax_video_sender, video_rmax_data);
+            video_rmax_data.packetizer_threads = packetizer_threads;
+            if (!packetizer_cpus.empty()) {
+                video_rmax_data.packetizer_cpus.assign(packetizer_cpus.begin() + i * packetizer_threads,
+                                                       packetizer_cpus.begin() + (i + 1) * packetizer_threads);
+            }
+            if (!packetize_files.empty()) {
+                other_threads.emplace_back(video_packetize_file, video_rmax_data, packetize_files[i]);
+            } else if (sender_threads) {
+                multiplexed_senders.push_back(std::make_shared<VideoSender>(video_rmax_data, true));
+            } else {
+                other_threads.emplace_back(rivermax_video_sender, video_rmax_data);
+            }
         }
 
         AudioRmaxData audio_rmax_data;
@@ -3027,35 +4407,16 @@ int main(int argc, char *argv[])
             }
 
             av_format_ctx_vec.push_back(audio_reader_data.p_format_context);
-            std::shared_ptr<my_queue> audio_conv_cb = std::make_shared<my_queue>(CB_SIZE_AUDIO);
-            std::shared_ptr<std::condition_variable> audio_conv_cv = std::make_shared<std::condition_variable>();
-            cond_vars.push_back(audio_conv_cv);
-            std::shared_ptr<std::mutex> audio_conv_lock = std::make_shared<std::mutex>();
-            std::shared_ptr<my_queue> audio_send_cb = std::make_shared<my_queue>(CB_SIZE_AUDIO);
-            std::shared_ptr<std::condition_variable> audio_send_cv = std::make_shared<std::condition_variable>();
-            cond_vars.push_back(audio_send_cv);
-
-            std::shared_ptr<std::mutex> audio_send_lock = std::make_shared<std::mutex>();
-            audio_reader_data.conv_cb = audio_conv_cb;
-            audio_reader_data.conv_cv = audio_conv_cv;
-            audio_reader_data.conv_lock = audio_conv_lock;
-
-            sync_data.audio_next_chunk_send_time_ns = std::make_shared<double>(frame_field_start_time_ns);
-            sync_data.add_stream();
-            audio_rmax_data.next_chunk_send_time_ns = sync_data.audio_next_chunk_send_time_ns;
+            audio_rmax_data.next_chunk_send_time_ns = std::make_shared<Rational>(frame_field_start_time_ns);
             audio_rmax_data.sdp_path = sdp_files[i];
-            audio_rmax_data.send_cb = audio_send_cb;
-            audio_rmax_data.send_cv = audio_send_cv;
-            audio_rmax_data.send_lock = audio_send_lock;
-            audio_rmax_data.sync_cv = sync_cv;
-            audio_rmax_data.sync_lock = sync_lock;
             audio_reader_data.set_cpu(cpus[e_audio_reader_index]);
+            audio_reader_data.decoder_cpus = decoder_cpus;
+            audio_reader_data.decoders_sharing_cpus = video_files.size();
             audio_rmax_data.ptime_usec = media_data.audio_ptime_us;
             audio_rmax_data.payload_type = media_data.payload_type;
             audio_rmax_data.sample_rate = media_data.sample_rate;
             audio_rmax_data.video_fps = video_rmax_data.fps;
-            audio_rmax_data.eof_stream_counter = eof_stream_counter;
-            audio_rmax_data.eof_cv = eof_cv;
+            audio_rmax_data.loop_barrier = loop_barrier;
             if (audio_rmax_data.channels != media_data.channels_num) {
                 std::cerr << "Number of channels in SDP differs from number of "
                     "channels in video file. in video file have " <<
@@ -3065,31 +4426,45 @@ int main(int argc, char *argv[])
                 ret = EXIT_FAILURE;
                 goto exit;
             }
+            if (media_data.bit_depth != 24) {
+                std::cerr << "Audio of " << media_data.bit_depth << " bits in SDP, only L24 audio is supported" <<
+                    std::endl;
+                ret = EXIT_FAILURE;
+                goto exit;
+            }
             audio_rmax_data.dscp = DSCP_MEDIA_RTP_CLASS;
             audio_rmax_data.bit_depth_in_bytes = media_data.bit_depth / BITS_IN_BYTES;
+            // the ring holds the pre-roll of the queues, and the decoded frames are converted into it
+            if (!set_audio_packet_layout(audio_rmax_data, audio_chunk_time_us)) {
+                ret = EXIT_FAILURE;
+                goto exit;
+            }
+            std::cout << "audio packets of " << audio_rmax_data.samples_in_packet << " samples, " <<
+                audio_rmax_data.packets_in_chunk << " packets per chunk" << std::endl;
+            audio_rmax_data.sample_ring = std::make_shared<SampleRing>(
+                std::max((size_t)audio_rmax_data.sample_rate * queue_latency_ms / 1000,
+                         AudioSender::min_ring_samples(audio_rmax_data)),
+                audio_rmax_data.channels * audio_rmax_data.bit_depth_in_bytes, audio_rmax_data.samples_in_packet);
+            std::shared_ptr<SampleRing> audio_sample_ring = audio_rmax_data.sample_ring;
+            queue_monitor.add("audio " + std::to_string(i) + " sender samples", audio_sample_ring->capacity(),
+                              [audio_sample_ring] { return audio_sample_ring->size(); });
+            audio_reader_data.sample_writer = std::make_shared<AudioSampleWriter>(
+                audio_sample_ring, audio_rmax_data.sample_rate, audio_rmax_data.channels);
 
             cst_data time_calculation_data(audio_rmax_data.ptime_usec,
                                            audio_rmax_data.sample_rate,
                                            video_rmax_data.fps);
             calculate_stream_time(audio, audio_rmax_data.next_chunk_send_time_ns, time_calculation_data,
                              &audio_rmax_data.timestamp_tick);
-            AudioEncodeData audio_encode_data(audio_rmax_data, audio_conv_cb, audio_conv_cv,
-                                         audio_conv_lock, audio_reader_data.p_codec,
-                                         audio_reader_data.p_codec_parameters,
-                                         audio_reader_data.stream_index,
-                                         cpus[e_audio_encoder_index]);
             reader_threads.emplace_back(read_stream<AudioReaderData>, std::move(audio_reader_data));
-            {
-                std::unique_lock<std::mutex> lock(*audio_conv_lock);
-                audio_conv_cv->wait(lock);
-            }
-            other_threads.emplace_back(encode_audio, std::move(audio_encode_data));
-            {
-                std::unique_lock<std::mutex> lock(*audio_send_lock);
-                audio_send_cv->wait(lock);
+            bool audio_at_end;
+            audio_sample_ring->wait_for_samples(1, audio_at_end);
+            if (sender_threads) {
+                multiplexed_senders.push_back(std::make_shared<AudioSender>(audio_rmax_data, true));
+            } else {
+                audio_rmax_data.set_cpu(cpus[e_audio_sender_index]);
+                other_threads.emplace_back(rivermax_audio_sender, audio_rmax_data);
             }
-            audio_rmax_data.set_cpu(cpus[e_audio_sender_index]);
-            other_threads.emplace_back(rivermax_audio_sender, audio_rmax_data);
         }
 
         if (eMediaType_t::ancillary & stream_type) {
@@ -3101,9 +4476,7 @@ int main(int argc, char *argv[])
 
             //Ancillary
             AncillaryRmaxData ancillary_rmax_data;
-            sync_data.ancillary_next_chunk_send_time_ns = std::make_shared<double>(frame_field_start_time_ns);
-            sync_data.add_stream();
-            ancillary_rmax_data.next_chunk_send_time_ns = sync_data.ancillary_next_chunk_send_time_ns;
+            ancillary_rmax_data.next_chunk_send_time_ns = std::make_shared<Rational>(frame_field_start_time_ns);
             ancillary_rmax_data.sdp_path = sdp_files[i];
             ancillary_rmax_data.fps = video_rmax_data.fps;
             ancillary_rmax_data.video_type = media_data.video_type;
@@ -3112,10 +4485,7 @@ int main(int argc, char *argv[])
             ancillary_rmax_data.video_height =video_rmax_data.height;
             ancillary_rmax_data.video_duration_sec = video_rmax_data.duration;
             ancillary_rmax_data.video_pix_format = video_rmax_data.pix_format;
-            ancillary_rmax_data.eof_stream_counter = eof_stream_counter;
-            ancillary_rmax_data.sync_cv = sync_cv;
-            ancillary_rmax_data.sync_lock = sync_lock;
-            ancillary_rmax_data.eof_cv = eof_cv;
+            ancillary_rmax_data.loop_barrier = loop_barrier;
             cst_data time_calculation_data(video_rmax_data.width, video_rmax_data.height,
                 video_rmax_data.fps, media_data.video_type, video_rmax_data.pix_format, video_rmax_data.sample_rate);
             calculate_stream_time(eMediaType_t::ancillary, ancillary_rmax_data.next_chunk_send_time_ns,
@@ -3123,18 +4493,57 @@ int main(int argc, char *argv[])
             ancillary_rmax_data.payload_type = media_data.payload_type;
             ancillary_rmax_data.did = media_data.did;
             ancillary_rmax_data.sdid = media_data.sdid;
-            other_threads.emplace_back(rivermax_ancillary_sender, ancillary_rmax_data);
-        }
-        if (loop && !disable_synchronization) {
-            other_threads.emplace_back(SynchronizerData::streams_synchronizer, sync_data);
+
+            std::vector<std::vector<AncDataPacket>> anc_fields;
+            if (!anc_files.empty()) {
+                if (!load_anc_file(anc_files[i], anc_fields)) {
+                    ret = EXIT_FAILURE;
+                    goto exit;
+                }
+            } else {
+                // the video format, 16:9, in every frame/field
+                AncDataPacket anc_packet;
+                anc_packet.line_number = 10;
+                anc_packet.horizontal_offset = 11;
+                anc_packet.did = (uint8_t)media_data.did;
+                anc_packet.sdid = (uint8_t)media_data.sdid;
+                anc_packet.user_data.push_back(VIDEO_FORMAT);
+                anc_fields.emplace_back(1, anc_packet);
+            }
+            std::shared_ptr<AncPacketTemplates> anc_templates = std::make_shared<AncPacketTemplates>();
+            if (!anc_templates->build(media_data.payload_type, anc_fields, 1500 - IPV4_HDR_SIZE - UDP_HDR_SIZE)) {
+                ret = EXIT_FAILURE;
+                goto exit;
+            }
+            std::cout << "Ancillary stream " << i << ": " << anc_templates->template_count()
+                      << " packet templates for a sequence of " << anc_templates->period() << " frames/fields"
+                      << std::endl;
+            ancillary_rmax_data.packet_templates = anc_templates;
+            if (sender_threads) {
+                multiplexed_senders.push_back(std::make_shared<AncillarySender>(ancillary_rmax_data, true));
+            } else {
+                other_threads.emplace_back(rivermax_ancillary_sender, ancillary_rmax_data);
+            }
         }
     }
+    if (!multiplexed_senders.empty()) {
+        start_multiplexed_senders(multiplexed_senders, sender_threads, sender_cpus, other_threads);
+        multiplexed_senders.clear();
+    }
+    if (!queue_stats_file.empty() && !queue_monitor.start(queue_stats_file)) {
+        ret = EXIT_FAILURE;
+    }
 
 exit:
     if (ret) {
         std::cout << "Terminating threads..." << std::endl;
         run_threads = false;
     }
+    // the streams queued for the sender threads are not sent, their reader and scaler threads wait for them
+    for (const std::shared_ptr<MediaSender> &sender : multiplexed_senders) {
+        sender->abandon();
+    }
+    multiplexed_senders.clear();
 
     for (auto &t : reader_threads) {
         t.join();
@@ -3142,16 +4551,16 @@ exit:
     for (auto &t : other_threads) {
         t.join();
     }
+    queue_monitor.stop();
 
     for (auto t : av_format_ctx_vec) {
         if (t != nullptr) {
-            avformat_close_input(t.get());
+            close_input(t.get());
         }
     }
 
     reader_threads.clear();
     other_threads.clear();
-    cond_vars.clear();
     av_format_ctx_vec.clear();
 
     cleanup();
@@ -0,0 +1,98 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (c) 2024 NVIDIA CORPORATION & AFFILIATES. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _RIVERMAX_PLAYER_RTP_HEADER_H_
+#define _RIVERMAX_PLAYER_RTP_HEADER_H_
+
+#include <cstdint>
+#include <string.h>
+
+#ifdef __linux__
+#include <endian.h>
+#else
+#include <ws2tcpip.h>
+#ifndef htobe16
+#define htobe16(x) htons(x)
+#define htobe32(x) htonl(x)
+#endif
+#endif
+
+struct rtp_header {
+    uint8_t cc : 4;            // CSRC count
+    uint8_t extension : 1;     // Extension bit
+    uint8_t padding : 1;       // Padding bit
+    uint8_t version : 2;       // Version, currently 2
+    uint8_t payload_type : 7;       // Payload type
+    uint8_t marker : 1;        // Marker bit
+    uint16_t sequence_number;        // sequence number
+    uint32_t timestamp;       //  timestamp
+    uint32_t ssrc;      // synchronization source (SSRC) identifier
+};
+
+struct srd_header {
+     uint16_t srd_length;  // SRD Length: 16 bits
+
+     uint8_t srd_row_number_8_to_14_7bit: 7; // srd raw number: 15 bits
+     uint8_t f: 1;  // Field identification: 1 bit
+     uint8_t srd_row_number_0_to_7_8bit; // srd raw number: 15 bits
+
+     uint8_t srd_offset_8_to_14_7bit: 7; // srd offset: 15 bits
+     uint8_t c: 1;  // Field identification: 1 bit
+     uint8_t srd_offset_0_to_7_8bit; // srd offset: 15 bits
+
+     void set_srd_row_number(uint16_t srd_raw_number) {
+         srd_row_number_0_to_7_8bit = (uint8_t)srd_raw_number;
+         srd_row_number_8_to_14_7bit = srd_raw_number>>8;
+     }
+
+     void set_srd_offset(uint16_t srd_offset) {
+         srd_offset_0_to_7_8bit = (uint8_t)srd_offset;
+         srd_offset_8_to_14_7bit = srd_offset>>8;
+     }
+ };
+
+/**
+ * Prebuilt beginning of the RTP packets of a stream.
+ *
+ * The constant part of the header (version, payload type, SSRC, ...) is built once,
+ * every packet copies it with a single 16-byte store and patches only the sequence
+ * number and the timestamp. Bytes 12..15 are left zero for the caller's payload header.
+ */
+struct RtpHeaderTemplate
+{
+    RtpHeaderTemplate(uint8_t payload_type, uint32_t ssrc, bool marker = false)
+    {
+        rtp_header *header = reinterpret_cast<rtp_header*>(m_bytes);
+        header->version = 2;
+        header->marker = marker;
+        header->payload_type = payload_type;
+        header->ssrc = ssrc;
+    }
+
+    rtp_header *write(uint8_t *buff, uint32_t seq_num, uint32_t timestamp) const
+    {
+        memcpy(buff, m_bytes, sizeof(m_bytes));
+        rtp_header *header = reinterpret_cast<rtp_header*>(buff);
+        header->sequence_number = htobe16((uint16_t)seq_num);
+        header->timestamp = htobe32(timestamp);
+        return header;
+    }
+
+    alignas(16) uint8_t m_bytes[16] = {};
+};
+
+#endif // _RIVERMAX_PLAYER_RTP_HEADER_H_
@@ -0,0 +1,214 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (c) 2024 NVIDIA CORPORATION & AFFILIATES. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _RIVERMAX_PLAYER_SAMPLE_RING_H_
+#define _RIVERMAX_PLAYER_SAMPLE_RING_H_
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string.h>
+#include <vector>
+
+/**
+ * Contiguous ring of audio samples between one producer and one consumer
+ * thread, a sample holds all the channels. The producer converts the decoded
+ * samples in place, the consumer copies them to the packets, so the samples
+ * need no allocation on the way.
+ *
+ * The consumer takes the samples in slices of a fixed number of samples, the
+ * payloads of the packets. The buffer holds whole slices and every loop
+ * iteration is padded with silence to whole slices, so a slice is always
+ * contiguous.
+ *
+ * The producer marks the end of every loop iteration, the consumer reads the
+ * samples of one iteration at a time and then takes the end.
+ *
+ * @ref close ends the ring: it wakes both sides, the producer gets no space
+ * from then on and the consumer reads the samples written before. Either side
+ * closes the ring when it stops, so the other one never waits for it forever.
+ */
+class SampleRing
+{
+public:
+    /**
+     * @param [in] capacity - number of samples the ring holds, rounded up to whole slices;
+     * @param [in] sample_size - size of a sample in bytes;
+     * @param [in] slice_samples - number of samples of a slice.
+     */
+    SampleRing(size_t capacity, size_t sample_size, size_t slice_samples) :
+        m_capacity((capacity + slice_samples - 1) / slice_samples * slice_samples),
+        m_sample_size(sample_size), m_slice_samples(slice_samples)
+    {
+        m_buffer.resize(m_capacity * m_sample_size);
+    }
+    SampleRing(const SampleRing&) = delete;
+    SampleRing &operator=(const SampleRing&) = delete;
+
+    /**
+     * Waits until the ring has room for a sample.
+     *
+     * @param [out] samples - number of samples that can be written at the
+     *                        returned address, up to the end of the buffer.
+     *
+     * @return where the next samples go, nullptr if the ring is closed.
+     */
+    uint8_t *wait_for_space(size_t &samples)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_space_cv.wait(lock, [this] { return m_closed || m_write - m_read < m_capacity; });
+        if (m_closed) {
+            return nullptr;
+        }
+        const size_t offset = (size_t)(m_write % m_capacity);
+        samples = std::min(m_capacity - (size_t)(m_write - m_read), m_capacity - offset);
+        return m_buffer.data() + offset * m_sample_size;
+    }
+    /**
+     * Hands the next @p samples samples written at the address returned by
+     * @ref wait_for_space to the consumer.
+     */
+    void commit(size_t samples)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_write += samples;
+        m_data_cv.notify_one();
+    }
+    /**
+     * Ends the loop iteration after the samples committed so far, padded with
+     * silence to a whole slice. Waits while the ring has no room for the padding.
+     *
+     * @return false if the ring is closed.
+     */
+    bool end_iteration()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        const size_t padding = (size_t)((m_slice_samples - m_write % m_slice_samples) % m_slice_samples);
+        m_space_cv.wait(lock, [&] { return m_closed || m_capacity - (size_t)(m_write - m_read) >= padding; });
+        if (m_closed) {
+            return false;
+        }
+        // the padding never reaches the end of the buffer, which holds whole slices
+        memset(m_buffer.data() + (size_t)(m_write % m_capacity) * m_sample_size, 0, padding * m_sample_size);
+        m_write += padding;
+        m_ends.push_back(m_write);
+        m_data_cv.notify_one();
+        return true;
+    }
+
+    /**
+     * Returns the number of samples of the current iteration that can be read.
+     *
+     * @param [out] at_end - set if the iteration ends after these samples.
+     */
+    size_t readable(bool &at_end) const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return readable_locked(at_end);
+    }
+    /**
+     * Waits until @p samples samples of the current iteration can be read,
+     * or the iteration or the ring ends before.
+     *
+     * @return the number of samples that can be read, see @ref readable.
+     */
+    size_t wait_for_samples(size_t samples, bool &at_end)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_data_cv.wait(lock, [&] { return readable_locked(at_end) >= samples || at_end || m_closed; });
+        return readable_locked(at_end);
+    }
+    /**
+     * Returns slice @p index of the readable samples, it stays valid until it is consumed.
+     */
+    const uint8_t *slice(size_t index) const
+    {
+        return m_buffer.data() + (size_t)((m_read + index * m_slice_samples) % m_capacity) * m_sample_size;
+    }
+    /**
+     * Gives the room of the next @p slices slices back to the producer, they must be readable.
+     */
+    void consume(size_t slices)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_read += slices * m_slice_samples;
+        m_space_cv.notify_one();
+    }
+    /**
+     * Goes on to the next iteration, once the samples of the current one are read.
+     */
+    void take_end()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_ends.empty() && m_ends.front() == m_read) {
+            m_ends.pop_front();
+        }
+    }
+
+    /**
+     * Closes the ring and wakes both sides, see @ref SampleRing.
+     */
+    void close()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_closed = true;
+        m_space_cv.notify_all();
+        m_data_cv.notify_all();
+    }
+    bool closed() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_closed;
+    }
+    size_t capacity() const { return m_capacity; }
+    size_t sample_size() const { return m_sample_size; }
+    size_t slice_samples() const { return m_slice_samples; }
+    /**
+     * Number of samples in the ring. Any thread may call it.
+     */
+    size_t size() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return (size_t)(m_write - m_read);
+    }
+
+private:
+    size_t readable_locked(bool &at_end) const
+    {
+        at_end = !m_ends.empty();
+        return (size_t)((at_end ? m_ends.front() : m_write) - m_read);
+    }
+
+    const size_t m_capacity;
+    const size_t m_sample_size;
+    const size_t m_slice_samples;
+    std::vector<uint8_t> m_buffer;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_space_cv;
+    std::condition_variable m_data_cv;
+    // samples written and read since the start, they never wrap, the read position is at a slice
+    uint64_t m_write = 0;
+    uint64_t m_read = 0;
+    // write positions of the ends of the iterations not taken yet
+    std::deque<uint64_t> m_ends;
+    bool m_closed = false;
+};
+
+#endif // _RIVERMAX_PLAYER_SAMPLE_RING_H_
@@ -0,0 +1,90 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (c) 2024 NVIDIA CORPORATION & AFFILIATES. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <chrono>
+
+#include "rt_threads.h"
+#include "slice_pool.h"
+
+using namespace std::chrono;
+
+SlicePool::SlicePool(size_t threads, const std::vector<int> &cpus, int64_t spin_ns)
+    : m_spin_ns(spin_ns)
+{
+    for (size_t thread = 0; thread < threads; ++thread) {
+        m_threads.emplace_back(&SlicePool::helper, this, thread + 1,
+                               thread < cpus.size() ? cpus[thread] : CPU_NONE);
+    }
+}
+
+SlicePool::~SlicePool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_stop = true;
+        ++m_generation;
+        m_cv.notify_all();
+    }
+    for (std::thread &thread : m_threads) {
+        thread.join();
+    }
+}
+
+void SlicePool::run(const std::function<void(size_t slice)> &job)
+{
+    m_job = &job;
+    m_pending.store(m_threads.size(), std::memory_order_relaxed);
+    // pairs with the helpers counting themselves as sleepers before checking the generation
+    m_generation.fetch_add(1);
+    if (m_sleepers.load()) {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_cv.notify_all();
+    }
+    job(0);
+    for (uint32_t spins = 0; m_pending.load(std::memory_order_acquire); ++spins) {
+        cpu_relax(spins);
+    }
+}
+
+void SlicePool::helper(size_t slice, int cpu)
+{
+    if (cpu != CPU_NONE) {
+        rt_set_thread_affinity(cpu);
+    }
+    rt_set_thread_priority(RMAX_THREAD_PRIORITY_TIME_CRITICAL);
+
+    uint64_t generation = 0;
+    while (true) {
+        const auto spin_end = steady_clock::now() + nanoseconds{m_spin_ns};
+        for (uint32_t spins = 0; m_generation.load(std::memory_order_acquire) == generation &&
+             steady_clock::now() < spin_end; ++spins) {
+            cpu_relax(spins);
+        }
+        if (m_generation.load(std::memory_order_acquire) == generation) {
+            std::unique_lock<std::mutex> lock(m_lock);
+            ++m_sleepers;
+            m_cv.wait(lock, [&] { return m_generation.load() != generation; });
+            --m_sleepers;
+        }
+        generation = m_generation.load(std::memory_order_acquire);
+        if (m_stop) {
+            return;
+        }
+        (*m_job)(slice);
+        m_pending.fetch_sub(1, std::memory_order_release);
+    }
+}
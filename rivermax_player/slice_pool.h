@@ -0,0 +1,87 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (c) 2024 NVIDIA CORPORATION & AFFILIATES. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _RIVERMAX_PLAYER_SLICE_POOL_H_
+#define _RIVERMAX_PLAYER_SLICE_POOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+
+/**
+ * Busy-wait step, gives the CPU away after @p spins steps in case the
+ * thread waited for shares it.
+ */
+static inline void cpu_relax(uint32_t spins)
+{
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64)
+    if (spins < 1024) {
+        _mm_pause();
+        return;
+    }
+#endif
+    (void)spins;
+    std::this_thread::yield();
+}
+
+/**
+ * Helper threads running a job split in slices together with the calling
+ * thread: the caller runs the first slice and waits for the helpers, which run
+ * one slice each. Between the jobs the helpers spin for a while, then sleep.
+ */
+class SlicePool
+{
+public:
+    /**
+     * @param [in] threads - number of helper threads;
+     * @param [in] cpus - CPU of each helper thread, can be empty;
+     * @param [in] spin_ns - time a helper spins for the next job before it sleeps.
+     */
+    SlicePool(size_t threads, const std::vector<int> &cpus, int64_t spin_ns);
+    SlicePool(const SlicePool&) = delete;
+    SlicePool &operator=(const SlicePool&) = delete;
+    ~SlicePool();
+
+    size_t slices() const { return m_threads.size() + 1; }
+    /**
+     * Calls @p job with every slice index, returns once all the slices are done.
+     */
+    void run(const std::function<void(size_t slice)> &job);
+
+private:
+    void helper(size_t slice, int cpu);
+
+    const int64_t m_spin_ns;
+    const std::function<void(size_t)> *m_job = nullptr;
+    std::atomic<uint64_t> m_generation{0};
+    std::atomic<size_t> m_pending{0};
+    std::atomic<size_t> m_sleepers{0};
+    std::atomic<bool> m_stop{false};
+    std::mutex m_lock;
+    std::condition_variable m_cv;
+    std::vector<std::thread> m_threads;
+};
+
+#endif // _RIVERMAX_PLAYER_SLICE_POOL_H_
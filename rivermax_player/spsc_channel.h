@@ -0,0 +1,149 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (c) 2024 NVIDIA CORPORATION & AFFILIATES. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _RIVERMAX_PLAYER_SPSC_CHANNEL_H_
+#define _RIVERMAX_PLAYER_SPSC_CHANNEL_H_
+
+#include <atomic>
+#include <cstddef>
+
+#include "readerwriterqueue/readerwriterqueue.h"
+
+/**
+ * Bounded blocking channel between one producer and one consumer thread.
+ *
+ * The items are kept in a lock-free ReaderWriterQueue. Two semaphores count the
+ * queued items and the free slots, a side that has to wait spins on its count
+ * for a while and then sleeps in the kernel (a futex on Linux), and it is woken
+ * by the other side's signal, so no wake-up can be lost.
+ *
+ * @ref close ends the channel: it wakes both sides, @ref push fails from then on
+ * and @ref pop fails once the items queued before are consumed. Either side
+ * closes the channel when it stops, so the other one never waits for it forever.
+ */
+template<typename T>
+class SpscChannel
+{
+public:
+    /**
+     * @param [in] capacity - number of items the channel holds.
+     */
+    explicit SpscChannel(size_t capacity) : m_queue(capacity), m_slots(capacity), m_capacity(capacity) { }
+    SpscChannel(const SpscChannel&) = delete;
+    SpscChannel &operator=(const SpscChannel&) = delete;
+
+    /**
+     * Queues @p item, waits while the channel is full.
+     *
+     * @return false if the channel is closed, @p item is left untouched.
+     */
+    bool push(T &&item)
+    {
+        m_slots.wait();
+        return enqueue(std::move(item));
+    }
+    /**
+     * Queues @p item if the channel has room for it.
+     *
+     * @return false if the channel is full or closed, @p item is left untouched.
+     */
+    bool try_push(T &&item)
+    {
+        return m_slots.tryWait() && enqueue(std::move(item));
+    }
+    /**
+     * Takes the next item, waits while the channel is empty.
+     *
+     * @return false if the channel is closed and empty.
+     */
+    bool pop(T &item)
+    {
+        m_items.wait();
+        return dequeue(item);
+    }
+    /**
+     * Takes the next item if there is one.
+     *
+     * @return false if the channel is empty.
+     */
+    bool try_pop(T &item)
+    {
+        return m_items.tryWait() && dequeue(item);
+    }
+    /**
+     * Waits until the channel holds an item or is closed, without taking it.
+     * Only the consumer may call it, or another thread before the consumer
+     * thread starts, the way main waits for the first frame.
+     *
+     * @return false if the channel is closed and empty.
+     */
+    bool wait_for_item()
+    {
+        m_items.wait();
+        const bool has_item = m_queue.peek() != nullptr;
+        m_items.signal();
+        return has_item;
+    }
+    /**
+     * Closes the channel and wakes both sides, see @ref SpscChannel.
+     */
+    void close()
+    {
+        if (!m_closed.exchange(true)) {
+            // the extra counts wake the waiters and stay for the next calls
+            m_items.signal();
+            m_slots.signal();
+        }
+    }
+    bool closed() const { return m_closed; }
+    size_t capacity() const { return m_capacity; }
+    /**
+     * Number of queued items, approximate while the other side runs. Any thread may call it.
+     */
+    size_t size() const { return m_queue.size_approx(); }
+
+private:
+    bool enqueue(T &&item)
+    {
+        if (m_closed) {
+            m_slots.signal();
+            return false;
+        }
+        // there is a free slot, the queue doesn't allocate
+        m_queue.try_enqueue(std::move(item));
+        m_items.signal();
+        return true;
+    }
+    bool dequeue(T &item)
+    {
+        if (!m_queue.try_dequeue(item)) {
+            // woken by close()
+            m_items.signal();
+            return false;
+        }
+        m_slots.signal();
+        return true;
+    }
+
+    moodycamel::ReaderWriterQueue<T> m_queue;
+    moodycamel::spsc_sema::LightweightSemaphore m_items;
+    moodycamel::spsc_sema::LightweightSemaphore m_slots;
+    const size_t m_capacity;
+    std::atomic<bool> m_closed{ false };
+};
+
+#endif // _RIVERMAX_PLAYER_SPSC_CHANNEL_H_
@@ -0,0 +1,170 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (c) 2024 NVIDIA CORPORATION & AFFILIATES. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Checks that PacketizedFile::open accepts the files of PacketizedFileWriter
+ * and rejects headers and indexes whose ranges leave the file, also when the
+ * offsets and counts are large enough for their sums to wrap around.
+ */
+
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "packetized_file.h"
+
+static constexpr uint32_t packets_in_field = 6;
+static constexpr uint16_t packet_stride = 64;
+static constexpr uint64_t frame_count = 3;
+static constexpr uint64_t max_offset = std::numeric_limits<uint64_t>::max();
+
+static int failures = 0;
+
+static void check(bool condition, const char *what)
+{
+    if (!condition) {
+        ++failures;
+        printf("FAIL %s\n", what);
+    }
+}
+
+static bool write_file(const std::string &path)
+{
+    PacketizedFileHeader layout = {};
+    layout.width = 32;
+    layout.height = 4;
+    layout.fps = 50.0;
+    layout.packet_stride = packet_stride;
+    layout.max_packet_size = packet_stride;
+    layout.packets_in_field = packets_in_field;
+    layout.fields_in_frame = 1;
+    layout.frame_size = packets_in_field * packet_stride;
+
+    std::vector<uint16_t> sizes(packets_in_field, packet_stride);
+    PacketizedFileWriter writer;
+    if (!writer.open(path, layout, sizes.data())) {
+        return false;
+    }
+    std::vector<uint8_t> frame(layout.frame_size);
+    for (uint64_t i = 0; i < frame_count; ++i) {
+        memset(frame.data(), (int)i + 1, frame.size());
+        if (!writer.write_frame(frame.data())) {
+            return false;
+        }
+    }
+    return writer.close();
+}
+
+static PacketizedFileHeader read_header(const std::string &path)
+{
+    PacketizedFileHeader header = {};
+    std::ifstream is(path, std::ios::binary);
+    is.read(reinterpret_cast<char*>(&header), sizeof(header));
+    return header;
+}
+
+static void write_at(const std::string &path, uint64_t offset, const void *data, size_t size)
+{
+    std::fstream os(path, std::ios::binary | std::ios::in | std::ios::out);
+    os.seekp((std::streamoff)offset);
+    os.write(reinterpret_cast<const char*>(data), (std::streamsize)size);
+}
+
+/**
+ * Writes a valid file, lets @p corrupt change it and returns whether it opens.
+ */
+static bool opens_after(const std::string &path, const std::function<void(const PacketizedFileHeader&)> &corrupt)
+{
+    if (!write_file(path)) {
+        printf("FAIL cannot write %s\n", path.c_str());
+        exit(EXIT_FAILURE);
+    }
+    corrupt(read_header(path));
+    PacketizedFile file;
+    return file.open(path);
+}
+
+int main()
+{
+    const std::string path = "packetized_file_test.rmax";
+
+    // a file of the writer
+    {
+        check(write_file(path), "writes the file");
+        PacketizedFile file;
+        check(file.open(path), "opens the file of the writer");
+        if (file.frame_count() == frame_count) {
+            for (uint64_t i = 0; i < frame_count; ++i) {
+                check(file.frame(i)[0] == i + 1 && file.frame(i)[file.header().frame_size - 1] == i + 1,
+                      "reads the frames");
+            }
+        } else {
+            check(false, "reads the frame count");
+        }
+    }
+
+    const auto set = [&path](size_t field_offset, uint64_t value, size_t size) {
+        return [&path, field_offset, value, size](const PacketizedFileHeader&) {
+            write_at(path, field_offset, &value, size);
+        };
+    };
+    const auto set_index = [&path](uint64_t frame, uint64_t offset) {
+        return [&path, frame, offset](const PacketizedFileHeader &header) {
+            write_at(path, header.index_offset + frame * sizeof(uint64_t), &offset, sizeof(offset));
+        };
+    };
+
+    // frame_count * 8 wraps around to 0
+    check(!opens_after(path, set(offsetof(PacketizedFileHeader, frame_count), (max_offset >> 3) + 1, 8)),
+          "rejects a frame count past the index");
+    check(!opens_after(path, set(offsetof(PacketizedFileHeader, index_offset), max_offset - 7, 8)),
+          "rejects an index offset past the file");
+    check(!opens_after(path, set(offsetof(PacketizedFileHeader, sizes_offset), max_offset - 1, 8)),
+          "rejects a sizes offset past the file");
+    check(!opens_after(path, set(offsetof(PacketizedFileHeader, packets_in_field), 0x80000000u, 4)),
+          "rejects a packet count past the file");
+    check(!opens_after(path, set(offsetof(PacketizedFileHeader, fields_in_frame), 0x80000000u, 4)),
+          "rejects a field count of neither 1 nor 2");
+    check(!opens_after(path, set(offsetof(PacketizedFileHeader, index_offset), sizeof(PacketizedFileHeader) + 4, 8)),
+          "rejects a misaligned index");
+    check(!opens_after(path, set(offsetof(PacketizedFileHeader, sizes_offset), sizeof(PacketizedFileHeader) + 1, 8)),
+          "rejects misaligned packet sizes");
+    check(!opens_after(path, set(offsetof(PacketizedFileHeader, alignment), 3000, 4)),
+          "rejects an alignment that is not a power of 2");
+    // m_index[i] + frame_size wraps around to a small offset
+    check(!opens_after(path, set_index(1, max_offset - packets_in_field * packet_stride + PACKETIZED_FILE_ALIGNMENT + 1)),
+          "rejects a frame offset that wraps around");
+    check(!opens_after(path, set_index(frame_count - 1, max_offset & ~(uint64_t)(PACKETIZED_FILE_ALIGNMENT - 1))),
+          "rejects a frame offset past the file");
+    check(!opens_after(path, set_index(0, PACKETIZED_FILE_ALIGNMENT + 8)),
+          "rejects a misaligned frame");
+    check(opens_after(path, set_index(2, PACKETIZED_FILE_ALIGNMENT)), "accepts frames at any aligned offset");
+
+    remove(path.c_str());
+    if (failures) {
+        printf("%d failures\n", failures);
+        return EXIT_FAILURE;
+    }
+    printf("all headers checked\n");
+    return EXIT_SUCCESS;
+}
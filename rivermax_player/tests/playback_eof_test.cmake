@@ -0,0 +1,73 @@
+# SPDX-FileCopyrightText: Copyright (c) 2024 NVIDIA CORPORATION & AFFILIATES. All rights reserved.
+# SPDX-License-Identifier: Apache-2.0
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+# http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+
+#------------------------------------------------------------------------------
+# Plays a short clip with --output null and checks that the player ends at the
+# end of the file, or with LOOP, that it starts the next iteration after it:
+#       $ cmake -DPLAYER=<rivermax_player> -DFFMPEG=<ffmpeg> -DWORK_DIR=<dir> [-DLOOP=ON] -P playback_eof_test.cmake
+#
+
+foreach(_var PLAYER FFMPEG WORK_DIR)
+    if (NOT ${_var})
+        message(FATAL_ERROR "${_var} is not set")
+    endif()
+endforeach()
+
+file(MAKE_DIRECTORY ${WORK_DIR})
+set(_clip ${WORK_DIR}/playback_eof_clip.mp4)
+set(_sdp ${WORK_DIR}/playback_eof_clip.sdp)
+
+# one second at 25 fps, encoded with an encoder built in every FFmpeg
+execute_process(
+    COMMAND ${FFMPEG} -y -loglevel error -f lavfi -i testsrc=size=1920x1080:rate=25 -frames:v 25
+            -pix_fmt yuv420p -c:v mpeg4 ${_clip}
+    RESULT_VARIABLE _result)
+if (NOT _result EQUAL 0)
+    message(FATAL_ERROR "cannot encode ${_clip}: ${_result}")
+endif()
+
+file(WRITE ${_sdp}
+"v=0
+s=EOF test
+t=0 0
+m=video 7000 RTP/AVP 96
+c=IN IP4 230.156.10.25/64
+a=source-filter:incl IN IP4 230.156.10.25 127.0.0.1
+a=rtpmap:96 raw/90000
+a=fmtp:96 sampling=YCbCr-4:2:2; width=1920; height=1080; exactframerate=25; depth=10; TCS=SDR; colorimetry=BT709; PM=2110GPM; SSN=ST2110-20:2017; TP=2110TPN;
+a=mediaclk:direct=0
+")
+
+if (LOOP)
+    # a looping player never ends, it is stopped once it had the time to play the clip a few times
+    execute_process(
+        COMMAND ${PLAYER} --media-files ${_clip} -s ${_sdp} -p v --output null --loop
+        TIMEOUT 10
+        OUTPUT_VARIABLE _output ERROR_VARIABLE _output
+        RESULT_VARIABLE _result)
+    if (NOT _output MATCHES "End of loop #2")
+        message(FATAL_ERROR "the loop didn't restart at the end of the file (${_result}):\n${_output}")
+    endif()
+else()
+    execute_process(
+        COMMAND ${PLAYER} --media-files ${_clip} -s ${_sdp} -p v --output null
+        TIMEOUT 30
+        OUTPUT_VARIABLE _output ERROR_VARIABLE _output
+        RESULT_VARIABLE _result)
+    if (NOT _result EQUAL 0 OR NOT _output MATCHES "done sending video")
+        message(FATAL_ERROR "the playback didn't end at the end of the file (${_result}):\n${_output}")
+    endif()
+endif()
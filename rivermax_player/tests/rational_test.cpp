@@ -0,0 +1,126 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (c) 2024 NVIDIA CORPORATION & AFFILIATES. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Plays the send times of the video sender for hours at 23.976, 29.97 and
+ * 59.94 fps, from an alignment point of today's TAI time, and checks every
+ * frame time, the packet times of a frame per minute and the RTP timestamps
+ * against a closed form on 128 bits, so they can't drift:
+ *       $ rational_test [hours]
+ */
+
+#include <cstdio>
+#include <cstdlib>
+
+#include "rational.h"
+
+static constexpr uint64_t ns_in_second = 1000000000;
+static constexpr uint64_t rtp_clock = 90000;
+// 1080p 10-bit 4:2:2, the gapped mode ratios of SMPTE ST 2110-21
+static constexpr uint64_t packets_in_frame = 4320;
+static constexpr uint64_t r_active_numerator = 1080;
+static constexpr uint64_t r_active_denominator = 1125;
+// TAI time in ns, 2024-06-01
+static constexpr uint64_t start_tai_ns = 1717200037000000000ULL;
+
+typedef unsigned __int128 uint128_t;
+
+static int failures = 0;
+
+static void check(bool condition, const char *what, double fps, uint64_t frame)
+{
+    if (!condition && ++failures <= 10) {
+        printf("FAIL %.3f fps frame %llu: %s\n", fps, (unsigned long long)frame, what);
+    }
+}
+
+/**
+ * Returns @p numerator / @p denominator, exactly.
+ */
+static Rational wide_rational(uint128_t numerator, uint64_t denominator)
+{
+    return Rational((uint64_t)(numerator / denominator), (uint64_t)(numerator % denominator), denominator);
+}
+
+/**
+ * Plays @p hours of a stream of @p rate_numerator / @p rate_denominator fps.
+ */
+static void play(uint64_t rate_numerator, uint64_t rate_denominator, uint64_t hours)
+{
+    // the frame rate as av_q2d gives it from the stream, and the intervals as VideoSender computes them
+    const double fps = (double)rate_numerator / rate_denominator;
+    const Rational rate = rational_approximation(fps);
+    check(rate == Rational(rate_numerator, rate_denominator), "approximates the frame rate", fps, 0);
+    const Rational frame_interval_ns = Rational(ns_in_second) / rate;
+    const Rational packet_interval_ns = frame_interval_ns * Rational(r_active_numerator, r_active_denominator) /
+        packets_in_frame;
+
+    // calculate_stream_time: the first alignment point after the start time
+    const uint64_t alignment_point = (Rational(start_tai_ns) / frame_interval_ns).integer() + 1;
+    const Rational start_ns = frame_interval_ns * alignment_point;
+    const uint64_t frames = hours * 3600 * rate_numerator / rate_denominator;
+    const uint64_t frames_in_minute = (60 * rate_numerator + rate_denominator - 1) / rate_denominator;
+    const uint64_t packet_denominator = rate_numerator * r_active_denominator * packets_in_frame;
+
+    Rational accumulated_ns = start_ns;
+    for (uint64_t frame = 0; frame <= frames; ++frame) {
+        // frame n is sent at (alignment_point + n) * rate_denominator / rate_numerator seconds
+        const uint128_t frame_ns_numerator = (uint128_t)(alignment_point + frame) * rate_denominator * ns_in_second;
+        const Rational frame_ns = start_ns + frame_interval_ns * frame;
+        check(frame_ns == wide_rational(frame_ns_numerator, rate_numerator), "frame time", fps, frame);
+        check(accumulated_ns == frame_ns, "accumulated frame time", fps, frame);
+        accumulated_ns += frame_interval_ns;
+
+        // time_to_rtp_timestamp, 5 ticks early
+        const Rational timestamp = frame_ns * Rational(rtp_clock, ns_in_second) - 5;
+        check(timestamp == wide_rational(frame_ns_numerator * rtp_clock / ns_in_second - 5 * rate_numerator,
+                                         rate_numerator),
+              "RTP timestamp", fps, frame);
+
+        if (frame % frames_in_minute && frame != frames) {
+            continue;
+        }
+        for (uint64_t packet = 0; packet < packets_in_frame; ++packet) {
+            const uint128_t packet_ns_numerator = frame_ns_numerator * r_active_denominator * packets_in_frame +
+                (uint128_t)packet * rate_denominator * ns_in_second * r_active_numerator;
+            const Rational packet_ns = frame_ns + packet_interval_ns * packet;
+            check(packet_ns == wide_rational(packet_ns_numerator, packet_denominator), "packet time", fps, frame);
+        }
+    }
+    const Rational end_ns = accumulated_ns - frame_interval_ns;
+    printf("%.3f fps: %llu frames in %llu h, last frame at %llu ns + %llu/%llu\n", fps,
+           (unsigned long long)frames, (unsigned long long)hours, (unsigned long long)end_ns.integer(),
+           (unsigned long long)end_ns.numerator(), (unsigned long long)end_ns.denominator());
+}
+
+int main(int argc, char **argv)
+{
+    const uint64_t hours = argc > 1 ? strtoull(argv[1], nullptr, 10) : 24;
+    try {
+        play(24000, 1001, hours);
+        play(30000, 1001, hours);
+        play(60000, 1001, hours);
+    } catch (const RationalE &e) {
+        printf("FAIL %s\n", e.what());
+        return EXIT_FAILURE;
+    }
+    if (failures) {
+        printf("%d failures\n", failures);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,189 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (c) 2024 NVIDIA CORPORATION & AFFILIATES. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Cost per packet of the RTP headers of a video stream, the way the header
+ * builder writes them from RtpHeaderTemplate and the prebuilt SRDs of the
+ * packetization plan, against setting every header field of every packet:
+ *       $ rtp_header_bench [repetitions]
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <vector>
+
+#include "rtp_header.h"
+
+// 1080p 10-bit, 1200 bytes of pgroups per packet
+static constexpr int packets_in_frame = 4320;
+static constexpr int line_pgroups = 960;
+static constexpr int packet_pgroups = 240;
+static constexpr int frames = 200;
+// packets of a chunk, rewritten for every chunk so the stride stays in the cache
+static constexpr int chunk_packets = 64;
+static constexpr size_t packet_stride = 1280;
+static constexpr uint8_t payload_type = 96;
+static constexpr uint32_t ssrc = 0x0eb51dbd;
+static constexpr size_t extension_seq_size = 2;
+
+struct srd_fields
+{
+    uint16_t length;
+    uint16_t row_number;
+    uint16_t offset;
+    bool continuation;
+};
+
+struct plan_entry
+{
+    srd_fields srd[2];
+    srd_header srd_headers[2];
+    int srd_count;
+};
+
+static std::vector<plan_entry> build_plan()
+{
+    std::vector<plan_entry> plan(packets_in_frame);
+    for (int i = 0; i < packets_in_frame; ++i) {
+        plan_entry &entry = plan[i];
+        const int first = i * packet_pgroups;
+        entry.srd_count = 1;
+        entry.srd[0] = { (uint16_t)(packet_pgroups * 5), (uint16_t)(first / line_pgroups),
+                         (uint16_t)(first % line_pgroups * 2), false };
+        memset(entry.srd_headers, 0, sizeof(entry.srd_headers));
+        for (int j = 0; j < entry.srd_count; ++j) {
+            srd_header &srd = entry.srd_headers[j];
+            srd.srd_length = htobe16(entry.srd[j].length);
+            srd.set_srd_row_number(entry.srd[j].row_number);
+            srd.set_srd_offset(entry.srd[j].offset);
+            srd.c = entry.srd[j].continuation;
+        }
+    }
+    return plan;
+}
+
+/**
+ * Every field of every header, as the builder did before the templates.
+ */
+static uint8_t *write_fields(uint8_t *buff, const plan_entry &plan, uint32_t seq_num, uint32_t timestamp,
+                             bool marker, bool field)
+{
+    rtp_header *header = reinterpret_cast<rtp_header*>(buff);
+    header->version = 2;
+    header->extension = 0;
+    header->cc = 0;
+    header->timestamp = htobe32(timestamp);
+    header->marker = marker;
+    header->payload_type = payload_type;
+    header->sequence_number = htobe16((uint16_t)seq_num);
+    header->ssrc = ssrc;
+    uint8_t *buffer = buff + sizeof(rtp_header);
+    *(uint16_t *)buffer = htobe16((uint16_t)(seq_num >> 16));
+    srd_header *srd = reinterpret_cast<srd_header*>(buffer + extension_seq_size);
+    for (int i = 0; i < plan.srd_count; ++i, ++srd) {
+        srd->srd_length = htobe16(plan.srd[i].length);
+        srd->set_srd_row_number(plan.srd[i].row_number);
+        srd->set_srd_offset(plan.srd[i].offset);
+        srd->c = plan.srd[i].continuation;
+        srd->f = field;
+    }
+    return reinterpret_cast<uint8_t*>(srd);
+}
+
+/**
+ * The template and the prebuilt SRDs, as RtpVideoHeaderBuilder::write_headers.
+ */
+static uint8_t *write_template(const RtpHeaderTemplate &rtp_template, uint8_t *buff, const plan_entry &plan,
+                               uint32_t seq_num, uint32_t timestamp, bool marker, bool field)
+{
+    rtp_header *header = rtp_template.write(buff, seq_num, timestamp);
+    if (marker) {
+        header->marker = 1;
+    }
+    uint8_t *buffer = buff + sizeof(rtp_header);
+    *(uint16_t *)buffer = htobe16((uint16_t)(seq_num >> 16));
+    srd_header *srd = reinterpret_cast<srd_header*>(buffer + extension_seq_size);
+    memcpy(srd, plan.srd_headers, sizeof(plan.srd_headers));
+    if (field) {
+        srd[0].f = 1;
+        srd[1].f = 1;
+    }
+    return reinterpret_cast<uint8_t*>(srd + plan.srd_count);
+}
+
+/**
+ * Returns the best time in ns per packet of @p repetitions runs of @p run.
+ */
+static double best_packet_time(int repetitions, const std::function<void()> &run)
+{
+    double best = 1e9;
+    for (int i = 0; i < repetitions; ++i) {
+        const auto start = std::chrono::steady_clock::now();
+        run();
+        const std::chrono::duration<double, std::nano> time = std::chrono::steady_clock::now() - start;
+        best = std::min(best, time.count() / ((double)frames * packets_in_frame));
+    }
+    return best;
+}
+
+int main(int argc, char **argv)
+{
+    const int repetitions = argc > 1 ? atoi(argv[1]) : 7;
+    const std::vector<plan_entry> plan = build_plan();
+    const RtpHeaderTemplate rtp_template(payload_type, ssrc);
+    std::vector<uint8_t> chunk(chunk_packets * packet_stride);
+    // the end of the last header is summed so the writes are not optimized out
+    volatile uintptr_t sink = 0;
+
+    const auto run = [&](bool use_template) {
+        return [&, use_template]() {
+            uint32_t seq_num = 0;
+            uintptr_t end = 0;
+            for (int frame = 0; frame < frames; ++frame) {
+                const uint32_t timestamp = (uint32_t)frame * 1501;
+                for (int i = 0; i < packets_in_frame; ++i, ++seq_num) {
+                    uint8_t *buff = &chunk[i % chunk_packets * packet_stride];
+                    const bool marker = i == packets_in_frame - 1;
+                    end += (uintptr_t)(use_template ?
+                        write_template(rtp_template, buff, plan[i], seq_num, timestamp, marker, false) :
+                        write_fields(buff, plan[i], seq_num, timestamp, marker, false));
+                }
+            }
+            sink = sink + end + chunk[sizeof(rtp_header)];
+        };
+    };
+
+    // both paths must write the same bytes
+    std::vector<uint8_t> expected(packet_stride), actual(packet_stride);
+    for (int i = 0; i < packets_in_frame; ++i) {
+        const bool marker = i == packets_in_frame - 1;
+        write_fields(expected.data(), plan[i], 0x12345 + i, 0xabcdef, marker, i & 1);
+        write_template(rtp_template, actual.data(), plan[i], 0x12345 + i, 0xabcdef, marker, i & 1);
+        if (memcmp(expected.data(), actual.data(), sizeof(rtp_header) + extension_seq_size + sizeof(srd_header))) {
+            printf("packet %d: the template headers differ\n", i);
+            return EXIT_FAILURE;
+        }
+    }
+
+    printf("video headers, 1080p 10-bit plan\n");
+    printf("  every field  %6.2f ns/packet\n", best_packet_time(repetitions, run(false)));
+    printf("  template     %6.2f ns/packet\n", best_packet_time(repetitions, run(true)));
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,187 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (c) 2024 NVIDIA CORPORATION & AFFILIATES. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Frame hand-off latency between two threads, from the push of a frame to its
+ * pop, through SpscChannel against the queue and condition variable the reader,
+ * scaler and sender used before, at several gaps between the frames:
+ *       $ spsc_channel_bench [frames per gap]
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "spsc_channel.h"
+
+// the depth of the player queues
+static constexpr size_t channel_capacity = 50;
+
+using bench_clock = std::chrono::steady_clock;
+
+struct frame_entry
+{
+    bench_clock::time_point pushed;
+    bool last;
+};
+
+/**
+ * The hand-off through SpscChannel.
+ */
+class ChannelHandOff
+{
+public:
+    ChannelHandOff() : m_channel(channel_capacity) { }
+    void push(std::shared_ptr<frame_entry> &&entry) { m_channel.push(std::move(entry)); }
+    std::shared_ptr<frame_entry> pop()
+    {
+        std::shared_ptr<frame_entry> entry;
+        m_channel.pop(entry);
+        return entry;
+    }
+    void done() { }
+
+private:
+    SpscChannel<std::shared_ptr<frame_entry>> m_channel;
+};
+
+/**
+ * The former hand-off: a ReaderWriterQueue, a waiter sleeps on the condition
+ * variable without a predicate and the other side notifies after each call.
+ * A notification sent between the failed dequeue and the wait is lost, the
+ * consumer sleeps until the next one.
+ */
+class ConditionHandOff
+{
+public:
+    ConditionHandOff() : m_queue(channel_capacity) { }
+    void push(std::shared_ptr<frame_entry> &&entry)
+    {
+        if (!m_queue.try_enqueue(std::move(entry))) {
+            std::unique_lock<std::mutex> lock(m_lock);
+            m_cv.wait(lock);
+            m_queue.enqueue(std::move(entry));
+        }
+        m_cv.notify_all();
+    }
+    std::shared_ptr<frame_entry> pop()
+    {
+        std::shared_ptr<frame_entry> entry;
+        while (!entry) {
+            m_queue.try_dequeue(entry);
+            if (!entry) {
+                std::unique_lock<std::mutex> lock(m_lock);
+                m_cv.wait(lock);
+                m_queue.try_dequeue(entry);
+            }
+        }
+        m_cv.notify_all();
+        return entry;
+    }
+    /**
+     * Keeps notifying until the consumer took the last frame, it could have
+     * missed the notification of that one and would sleep forever.
+     */
+    void done()
+    {
+        while (!m_consumed) {
+            m_cv.notify_all();
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+    void consumed() { m_consumed = true; }
+
+private:
+    moodycamel::ReaderWriterQueue<std::shared_ptr<frame_entry>> m_queue;
+    std::mutex m_lock;
+    std::condition_variable m_cv;
+    std::atomic<bool> m_consumed{ false };
+};
+
+static void consumed(ChannelHandOff&) { }
+static void consumed(ConditionHandOff &hand_off) { hand_off.consumed(); }
+
+/**
+ * Returns the latencies in us of @p frames frames pushed @p gap apart.
+ */
+template<typename HandOff>
+static std::vector<double> measure(int frames, std::chrono::microseconds gap)
+{
+    HandOff hand_off;
+    std::vector<double> latencies;
+    latencies.reserve(frames);
+    std::thread consumer([&]() {
+        for (;;) {
+            std::shared_ptr<frame_entry> entry = hand_off.pop();
+            const std::chrono::duration<double, std::micro> latency = bench_clock::now() - entry->pushed;
+            latencies.push_back(latency.count());
+            if (entry->last) {
+                break;
+            }
+        }
+        consumed(hand_off);
+    });
+    for (int i = 0; i < frames; ++i) {
+        if (gap.count()) {
+            std::this_thread::sleep_for(gap);
+        }
+        std::shared_ptr<frame_entry> entry = std::make_shared<frame_entry>();
+        entry->last = i == frames - 1;
+        entry->pushed = bench_clock::now();
+        hand_off.push(std::move(entry));
+    }
+    hand_off.done();
+    consumer.join();
+    std::sort(latencies.begin(), latencies.end());
+    return latencies;
+}
+
+static void print_latencies(const char *name, const std::vector<double> &latencies)
+{
+    const size_t count = latencies.size();
+    printf("  %-10s p50 %9.1f us  p99 %9.1f us  max %9.1f us\n", name, latencies[count / 2],
+           latencies[std::min(count - 1, count * 99 / 100)], latencies.back());
+}
+
+int main(int argc, char **argv)
+{
+    const int frames = argc > 1 ? atoi(argv[1]) : 1000;
+    if (frames < 1) {
+        printf("frames per gap must be positive\n");
+        return EXIT_FAILURE;
+    }
+    const std::chrono::microseconds gaps[] = {
+        std::chrono::microseconds(0), std::chrono::microseconds(100),
+        std::chrono::microseconds(1000), std::chrono::microseconds(20000)
+    };
+    printf("frame hand-off latency, %zu entries deep\n", channel_capacity);
+    for (const std::chrono::microseconds gap : gaps) {
+        // a 20 ms gap is one frame at 50 fps, fewer frames keep the run short
+        const int gap_frames = gap.count() >= 20000 ? std::max(1, frames / 10) : frames;
+        printf("%lld us between frames, %d frames\n", (long long)gap.count(), gap_frames);
+        print_latencies("channel", measure<ChannelHandOff>(gap_frames, gap));
+        print_latencies("condition", measure<ConditionHandOff>(gap_frames, gap));
+    }
+    return EXIT_SUCCESS;
+}
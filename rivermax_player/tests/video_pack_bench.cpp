@@ -0,0 +1,103 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (c) 2024 NVIDIA CORPORATION & AFFILIATES. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Throughput of every kernel of video_pack.h the CPU supports, in GB/s of
+ * packed pgroups, for spans of a packet that stay in the L1 cache and for
+ * the lines of whole 2160p frames that come from memory:
+ *       $ video_pack_bench [repetitions]
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <vector>
+
+#include "video_pack.h"
+
+// pgroups of a 1200 bytes 10-bit payload, about one packet
+static constexpr size_t span_pgroups = 240;
+static constexpr size_t span_count = 4096;
+static constexpr size_t frame_width = 3840;
+static constexpr size_t frame_height = 2160;
+static constexpr size_t frame_pgroups = frame_width / 2 * frame_height;
+
+/**
+ * Returns the best time in seconds of @p repetitions runs of @p run.
+ */
+static double best_time(int repetitions, const std::function<void()> &run)
+{
+    double best = 1e9;
+    for (int i = 0; i < repetitions; ++i) {
+        const auto start = std::chrono::steady_clock::now();
+        run();
+        const std::chrono::duration<double> time = std::chrono::steady_clock::now() - start;
+        best = std::min(best, time.count());
+    }
+    return best;
+}
+
+static void report(const char *function, const char *kernel, size_t pgroup_size, double span_time, double frame_time)
+{
+    printf("%-20s %-11s %8.2f GB/s %8.2f GB/s %8.3f ms\n", function, kernel,
+           span_pgroups * span_count * pgroup_size / span_time / 1e9,
+           frame_pgroups * pgroup_size / frame_time / 1e9, frame_time * 1e3);
+}
+
+template <typename Sample, typename Func, typename Kernel>
+static void bench_planar(const char *function, const std::vector<Kernel> &kernels, size_t pgroup_size,
+                         int repetitions, Func call)
+{
+    // frame planes, the spans are taken from their start
+    std::vector<Sample> y(frame_pgroups * 2, 0x100 & (Sample)~0);
+    std::vector<Sample> cb(frame_pgroups, 0x80);
+    std::vector<Sample> cr(frame_pgroups, 0x90);
+    std::vector<uint8_t> dst(frame_pgroups * pgroup_size);
+
+    for (const auto &kernel : kernels) {
+        const double span_time = best_time(repetitions, [&]() {
+            for (size_t span = 0; span < span_count; ++span) {
+                call(kernel.func, dst.data(), y.data(), cb.data(), cr.data(), span_pgroups);
+            }
+        });
+        const double frame_time = best_time(repetitions, [&]() {
+            const size_t line_pgroups = frame_width / 2;
+            for (size_t line = 0; line < frame_height; ++line) {
+                const size_t first = line * line_pgroups;
+                call(kernel.func, dst.data() + first * pgroup_size, y.data() + first * 2, cb.data() + first,
+                     cr.data() + first, line_pgroups);
+            }
+        });
+        report(function, kernel.name, pgroup_size, span_time, frame_time);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    const int repetitions = argc > 1 ? atoi(argv[1]) : 5;
+    printf("%-20s %-11s %13s %13s %11s\n", "function", "kernel", "L1 spans", "2160p frame", "frame time");
+
+    bench_planar<uint16_t>("pack_yuv422p10le", get_pack_yuv422p10le_kernels(), 5, repetitions,
+        [](pack_yuv422p10le_func func, uint8_t *dst, const uint16_t *y, const uint16_t *cb, const uint16_t *cr,
+           size_t pgroups) { func(dst, y, cb, cr, pgroups); });
+    bench_planar<uint8_t>("interleave_yuv422p", get_interleave_yuv422p_kernels(), 4, repetitions,
+        [](interleave_yuv422p_func func, uint8_t *dst, const uint8_t *y, const uint8_t *cb, const uint8_t *cr,
+           size_t pgroups) { func(dst, y, cb, cr, pgroups); });
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,276 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (c) 2024 NVIDIA CORPORATION & AFFILIATES. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Checks that every SIMD kernel of video_pack.h the CPU supports writes the
+ * same bytes as the scalar one, for all lengths up to a few vectors, at
+ * unaligned source and destination offsets, and nothing out of its
+ * destination, and the chroma lines 4:2:0 frames and fields are interpolated
+ * from.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "video_pack.h"
+
+static constexpr size_t max_pgroups = 200;
+static constexpr size_t max_offset = 7;
+static constexpr size_t guard_size = 64;
+static constexpr uint8_t guard_byte = 0xa5;
+
+static int failures = 0;
+
+static void fail(const char *function, const char *kernel, size_t pgroups, size_t offset, const char *what)
+{
+    if (failures++ < 20) {
+        printf("FAIL %s %s: %zu pgroups at offset %zu, %s\n", function, kernel, pgroups, offset, what);
+    }
+}
+
+/**
+ * Destination of a kernel with guard bytes around it.
+ */
+class GuardedBuffer
+{
+public:
+    GuardedBuffer(size_t offset, size_t size) :
+        m_bytes(guard_size + offset + size + guard_size, guard_byte), m_offset(offset), m_size(size) { }
+
+    uint8_t *data() { return m_bytes.data() + guard_size + m_offset; }
+    bool guards_intact() const
+    {
+        for (size_t i = 0; i < guard_size + m_offset; ++i) {
+            if (m_bytes[i] != guard_byte) {
+                return false;
+            }
+        }
+        for (size_t i = guard_size + m_offset + m_size; i < m_bytes.size(); ++i) {
+            if (m_bytes[i] != guard_byte) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+private:
+    std::vector<uint8_t> m_bytes;
+    size_t m_offset;
+    size_t m_size;
+};
+
+static void test_pack_yuv422p10le(std::mt19937 &random)
+{
+    // the 10-bit samples of the unaligned sources start up to max_offset samples in
+    std::vector<uint16_t> y(2 * (max_pgroups + max_offset));
+    std::vector<uint16_t> cb(max_pgroups + max_offset);
+    std::vector<uint16_t> cr(max_pgroups + max_offset);
+    for (auto *plane : { &y, &cb, &cr }) {
+        for (uint16_t &sample : *plane) {
+            sample = random() & 0x3ff;
+        }
+    }
+    // the extreme values in the first pgroups
+    y[0] = cb[0] = cr[1] = 0x3ff;
+    y[3] = cb[1] = cr[0] = 0;
+
+    for (const auto &kernel : get_pack_yuv422p10le_kernels()) {
+        for (size_t offset = 0; offset <= max_offset; ++offset) {
+            for (size_t pgroups = 0; pgroups <= max_pgroups; ++pgroups) {
+                const size_t size = pgroups * 5;
+                GuardedBuffer expected(offset, size);
+                GuardedBuffer actual(offset, size);
+                pack_yuv422p10le_scalar(expected.data(), &y[2 * offset], &cb[offset], &cr[offset], pgroups);
+                kernel.func(actual.data(), &y[2 * offset], &cb[offset], &cr[offset], pgroups);
+                if (memcmp(expected.data(), actual.data(), size)) {
+                    fail("pack_yuv422p10le", kernel.name, pgroups, offset, "differs from scalar");
+                }
+                if (!actual.guards_intact()) {
+                    fail("pack_yuv422p10le", kernel.name, pgroups, offset, "writes out of its destination");
+                }
+            }
+        }
+        printf("pack_yuv422p10le %s: checked\n", kernel.name);
+    }
+
+    // the scalar kernel against the wire layout: Cb, Y0, Cr, Y1, 10 bits each, MSB first
+    const uint16_t y_ref[] = { 0x3ff, 0x001 };
+    const uint16_t cb_ref[] = { 0x200 };
+    const uint16_t cr_ref[] = { 0x155 };
+    const uint8_t pgroup_ref[] = { 0x80, 0x3f, 0xf5, 0x54, 0x01 };
+    uint8_t pgroup[5];
+    pack_yuv422p10le_scalar(pgroup, y_ref, cb_ref, cr_ref, 1);
+    if (memcmp(pgroup, pgroup_ref, sizeof(pgroup))) {
+        fail("pack_yuv422p10le", "scalar", 1, 0, "wrong pgroup layout");
+    }
+}
+
+static void test_interleave_yuv422p(std::mt19937 &random)
+{
+    std::vector<uint8_t> y(2 * (max_pgroups + max_offset));
+    std::vector<uint8_t> cb(max_pgroups + max_offset);
+    std::vector<uint8_t> cr(max_pgroups + max_offset);
+    for (auto *plane : { &y, &cb, &cr }) {
+        for (uint8_t &sample : *plane) {
+            sample = (uint8_t)random();
+        }
+    }
+
+    for (const auto &kernel : get_interleave_yuv422p_kernels()) {
+        for (size_t offset = 0; offset <= max_offset; ++offset) {
+            for (size_t pgroups = 0; pgroups <= max_pgroups; ++pgroups) {
+                const size_t size = pgroups * 4;
+                GuardedBuffer expected(offset, size);
+                GuardedBuffer actual(offset, size);
+                interleave_yuv422p_scalar(expected.data(), &y[2 * offset], &cb[offset], &cr[offset], pgroups);
+                kernel.func(actual.data(), &y[2 * offset], &cb[offset], &cr[offset], pgroups);
+                if (memcmp(expected.data(), actual.data(), size)) {
+                    fail("interleave_yuv422p", kernel.name, pgroups, offset, "differs from scalar");
+                }
+                if (!actual.guards_intact()) {
+                    fail("interleave_yuv422p", kernel.name, pgroups, offset, "writes out of its destination");
+                }
+            }
+        }
+        printf("interleave_yuv422p %s: checked\n", kernel.name);
+    }
+
+    // the scalar kernel against the UYVY layout
+    const uint8_t y_ref[] = { 0x10, 0x20 };
+    const uint8_t cb_ref[] = { 0x80 };
+    const uint8_t cr_ref[] = { 0xf0 };
+    const uint8_t pgroup_ref[] = { 0x80, 0x10, 0xf0, 0x20 };
+    uint8_t pgroup[4];
+    interleave_yuv422p_scalar(pgroup, y_ref, cb_ref, cr_ref, 1);
+    if (memcmp(pgroup, pgroup_ref, sizeof(pgroup))) {
+        fail("interleave_yuv422p", "scalar", 1, 0, "wrong pgroup layout");
+    }
+}
+
+static void test_interleave_yuv420p(std::mt19937 &random)
+{
+    std::vector<uint8_t> y(2 * (max_pgroups + max_offset));
+    std::vector<uint8_t> cb(max_pgroups + max_offset);
+    std::vector<uint8_t> cb_far(max_pgroups + max_offset);
+    std::vector<uint8_t> cr(max_pgroups + max_offset);
+    std::vector<uint8_t> cr_far(max_pgroups + max_offset);
+    for (auto *plane : { &y, &cb, &cb_far, &cr, &cr_far }) {
+        for (uint8_t &sample : *plane) {
+            sample = (uint8_t)random();
+        }
+    }
+    // the rounding of the extreme values in the first pgroups
+    cb[0] = cr[1] = 0xff;
+    cb_far[0] = cr_far[1] = 0xff;
+    cb[1] = cr[0] = 0;
+    cb_far[1] = cr_far[0] = 0xff;
+
+    for (const auto &kernel : get_interleave_yuv420p_kernels()) {
+        for (size_t offset = 0; offset <= max_offset; ++offset) {
+            for (size_t pgroups = 0; pgroups <= max_pgroups; ++pgroups) {
+                const size_t size = pgroups * 4;
+                GuardedBuffer expected(offset, size);
+                GuardedBuffer actual(offset, size);
+                interleave_yuv420p_scalar(expected.data(), &y[2 * offset], &cb[offset], &cb_far[offset],
+                                          &cr[offset], &cr_far[offset], pgroups);
+                kernel.func(actual.data(), &y[2 * offset], &cb[offset], &cb_far[offset], &cr[offset],
+                            &cr_far[offset], pgroups);
+                if (memcmp(expected.data(), actual.data(), size)) {
+                    fail("interleave_yuv420p", kernel.name, pgroups, offset, "differs from scalar");
+                }
+                if (!actual.guards_intact()) {
+                    fail("interleave_yuv420p", kernel.name, pgroups, offset, "writes out of its destination");
+                }
+            }
+        }
+        printf("interleave_yuv420p %s: checked\n", kernel.name);
+    }
+
+    // the scalar kernel against the UYVY layout, 3/4 of the near chroma and 1/4 of the far one
+    const uint8_t y_ref[] = { 0x10, 0x20 };
+    const uint8_t cb_ref[] = { 0x80 };
+    const uint8_t cb_far_ref[] = { 0x81 };
+    const uint8_t cr_ref[] = { 0xf0 };
+    const uint8_t cr_far_ref[] = { 0x00 };
+    const uint8_t pgroup_ref[] = { 0x80, 0x10, 0xb4, 0x20 };
+    uint8_t pgroup[4];
+    interleave_yuv420p_scalar(pgroup, y_ref, cb_ref, cb_far_ref, cr_ref, cr_far_ref, 1);
+    if (memcmp(pgroup, pgroup_ref, sizeof(pgroup))) {
+        fail("interleave_yuv420p", "scalar", 1, 0, "wrong pgroup layout");
+    }
+}
+
+/**
+ * Pairs of chroma lines of the luma lines of a frame, see yuv420p_chroma_lines.
+ */
+struct ChromaPairing
+{
+    const char *name;
+    int height;
+    bool interlaced;
+    std::vector<std::pair<int, int>> lines;
+};
+
+static void test_yuv420p_chroma_lines()
+{
+    const ChromaPairing pairings[] = {
+        { "progressive", 8, false, { {0, 0}, {0, 1}, {1, 0}, {1, 2}, {2, 1}, {2, 3}, {3, 2}, {3, 3} } },
+        { "progressive odd", 5, false, { {0, 0}, {0, 1}, {1, 0}, {1, 2}, {2, 1} } },
+        // the lines of the first field, 0, 2, 4, 6, use the chroma lines 0 and 2,
+        // the lines of the second field use the chroma lines 1 and 3
+        { "interlaced", 8, true, { {0, 0}, {1, 1}, {0, 2}, {1, 3}, {2, 0}, {3, 1}, {2, 2}, {3, 3} } },
+        { "interlaced 12", 12, true,
+          { {0, 0}, {1, 1}, {0, 2}, {1, 3}, {2, 0}, {3, 1}, {2, 4}, {3, 5}, {4, 2}, {5, 3}, {4, 4}, {5, 5} } },
+        // 3 chroma lines, the second field has one
+        { "interlaced odd", 6, true, { {0, 0}, {1, 1}, {0, 2}, {1, 1}, {2, 0}, {1, 1} } },
+        // a single chroma line is shared by both fields
+        { "interlaced single", 2, true, { {0, 0}, {0, 0} } },
+        { "single line", 1, false, { {0, 0} } },
+    };
+    for (const ChromaPairing &pairing : pairings) {
+        for (int line = 0; line < pairing.height; ++line) {
+            int near = -1;
+            int far = -1;
+            yuv420p_chroma_lines(line, (pairing.height + 1) / 2, pairing.interlaced, near, far);
+            if (near != pairing.lines[line].first || far != pairing.lines[line].second) {
+                printf("FAIL yuv420p_chroma_lines %s: line %d uses chroma lines %d and %d instead of %d and %d\n",
+                       pairing.name, line, near, far, pairing.lines[line].first, pairing.lines[line].second);
+                ++failures;
+            }
+        }
+    }
+    printf("yuv420p_chroma_lines: checked\n");
+}
+
+int main()
+{
+    std::mt19937 random(2110);
+    test_pack_yuv422p10le(random);
+    test_interleave_yuv422p(random);
+    test_interleave_yuv420p(random);
+    test_yuv420p_chroma_lines();
+    if (failures) {
+        printf("%d failures\n", failures);
+        return EXIT_FAILURE;
+    }
+    printf("all kernels match\n");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,306 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (c) 2024 NVIDIA CORPORATION & AFFILIATES. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Packets per second a single core fills with the video packetizers, headers
+ * and pixel groups, for 1080p and 2160p frames of every packetizer format:
+ *       $ video_packetizer_bench [repetitions]
+ *
+ * The packets are written to the strides of a chunk, as the video sender
+ * does, the frames come from memory. Every specialized packetizer is compared
+ * with a packetizer that checks the pixel format and the scan type of every
+ * segment, as the packetizer did before it was specialized.
+ *
+ * With a CPU list, the chunks of 2160p and 4320p yuv422p10le frames are also
+ * filled by a VideoPacketizerPool, the first CPU runs the sender and the others
+ * one helper each, for 1, 2, 4 and 8 helpers as far as there are CPUs:
+ *       $ video_packetizer_bench 5 2,3,4,5,6
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "video_packetizer.h"
+
+// strides of a chunk of the video sender
+static constexpr int strides_in_chunk = 256;
+// -b 1248 and the 20 bytes IPv4 header and 8 bytes UDP header
+static constexpr uint16_t max_payload_size = 1248 - 20 - 8;
+static constexpr uint16_t packet_stride = 1280;
+static constexpr int frames = 10;
+
+/**
+ * Packetizer of any pixel format and scan type, branching on them per segment.
+ */
+struct BranchingVideoPacketizer : public RtpVideoHeaderBuilder
+{
+    BranchingVideoPacketizer(const VideoPacketizerFormat &format, int px_height, int px_width,
+                             int packets_in_frame_field, std::vector<uint16_t> &sizes)
+    : RtpVideoHeaderBuilder(px_height, px_width, packets_in_frame_field, format.bit_depth, format.pgroup_size,
+                            60.0, 96, Rational(0), sizes, VIDEO_TYPE::PROGRESSIVE)
+    {
+    }
+
+    void fill_packet(uint8_t *buff, int packet_index, const AVFrame *av_frame) override
+    {
+        const VideoPacketPlan &plan = m_plan[packet_index];
+        uint8_t *data = fill_headers(buff, packet_index);
+        for (uint8_t i = 0; i < plan.srd_count; ++i) {
+            copy_pgroups(data, av_frame, plan.srd[i]);
+            data += plan.srd[i].length;
+        }
+        if (unlikely(plan.padding_size)) {
+            memset(data, 0, plan.padding_size);
+        }
+    }
+
+    void fill_packets(uint8_t *, uint16_t, int, int, const AVFrame *, uint32_t, uint32_t) const override
+    {
+        throw std::logic_error("not benchmarked");
+    }
+
+    void copy_pgroups(uint8_t *dst, const AVFrame *av_frame, const VideoPacketPlan::SrdSegment &segment) const
+    {
+        // fields are interleaved in the frame
+        const int line_step = m_video_type != VIDEO_TYPE::PROGRESSIVE ? 2 : 1;
+        const int line = segment.src_line * line_step + m_field;
+        const int pgroups = segment.length / m_grp_size;
+
+        if (av_frame->format == AVPixelFormat::AV_PIX_FMT_YUV422P) {
+            const uint8_t *y = av_frame->data[0] + line * av_frame->linesize[0] + segment.src_pgroup * PX_IN_422_GRP;
+            const uint8_t *cb = av_frame->data[1] + line * av_frame->linesize[1] + segment.src_pgroup;
+            const uint8_t *cr = av_frame->data[2] + line * av_frame->linesize[2] + segment.src_pgroup;
+            m_interleave_yuv422p(dst, y, cb, cr, pgroups);
+        } else if (av_frame->format == AVPixelFormat::AV_PIX_FMT_UYVY422) {
+            memcpy(dst, av_frame->data[0] + line * av_frame->linesize[0] + segment.src_pgroup * m_grp_size,
+                   segment.length);
+        } else if (av_frame->format == AVPixelFormat::AV_PIX_FMT_YUV422P10LE) {
+            const uint16_t *y = reinterpret_cast<const uint16_t*>(av_frame->data[0] + line * av_frame->linesize[0]) +
+                segment.src_pgroup * PX_IN_422_GRP;
+            const uint16_t *cb = reinterpret_cast<const uint16_t*>(av_frame->data[1] + line * av_frame->linesize[1]) +
+                segment.src_pgroup;
+            const uint16_t *cr = reinterpret_cast<const uint16_t*>(av_frame->data[2] + line * av_frame->linesize[2]) +
+                segment.src_pgroup;
+            m_pack_yuv422p10le(dst, y, cb, cr, pgroups);
+        } else {
+            throw std::runtime_error("unsupported pixel format");
+        }
+    }
+
+    interleave_yuv422p_func m_interleave_yuv422p = get_interleave_yuv422p();
+    pack_yuv422p10le_func m_pack_yuv422p10le = get_pack_yuv422p10le();
+};
+
+struct BenchFrame
+{
+    int width;
+    int height;
+    const char *name;
+};
+
+/**
+ * Planes of a frame of @p format, filled with a ramp.
+ */
+struct FramePlanes
+{
+    FramePlanes(const VideoPacketizerFormat &format, int width, int height)
+    {
+        if (format.pix_format == AVPixelFormat::AV_PIX_FMT_UYVY422) {
+            add_plane(width * 2, height);
+        } else {
+            const int sample_size = format.bit_depth > 8 ? 2 : 1;
+            add_plane(width * sample_size, height);
+            add_plane(width / 2 * sample_size, height);
+            add_plane(width / 2 * sample_size, height);
+        }
+    }
+
+    void add_plane(int linesize, int height)
+    {
+        const int index = (int)m_planes.size();
+        m_planes.emplace_back((size_t)linesize * height);
+        for (size_t i = 0; i < m_planes.back().size(); ++i) {
+            // within 10 bits as little-endian 16-bit samples
+            m_planes.back()[i] = (uint8_t)(i & 1 ? i & 3 : i);
+        }
+        m_frame.data[index] = m_planes.back().data();
+        m_frame.linesize[index] = linesize;
+    }
+
+    std::vector<std::vector<uint8_t>> m_planes;
+    AVFrame m_frame = {};
+};
+
+/**
+ * Returns true if both packetizers write the same packets for @p frame.
+ */
+static bool same_packets(RtpVideoHeaderBuilder &packetizer, RtpVideoHeaderBuilder &reference, const AVFrame &frame)
+{
+    std::vector<uint8_t> packet(packet_stride), expected(packet_stride);
+    for (int i = 0; i < packetizer.m_packets_in_frame_field; ++i) {
+        packetizer.fill_packet(packet.data(), i, &frame);
+        reference.fill_packet(expected.data(), i, &frame);
+        if (memcmp(packet.data(), expected.data(), packetizer.m_sizes[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Returns the packets per second of @p repetitions runs of @p frames frames,
+ * the best run.
+ */
+static double packets_per_second(RtpVideoHeaderBuilder &packetizer, const AVFrame &frame, std::vector<uint8_t> &chunk,
+                                 int repetitions)
+{
+    double best = 1e9;
+    for (int i = 0; i < repetitions; ++i) {
+        const auto start = std::chrono::steady_clock::now();
+        for (int frame_index = 0; frame_index < frames; ++frame_index) {
+            for (int packet = 0; packet < packetizer.m_packets_in_frame_field; ++packet) {
+                packetizer.fill_packet(&chunk[packet % strides_in_chunk * packet_stride], packet, &frame);
+            }
+        }
+        const std::chrono::duration<double> time = std::chrono::steady_clock::now() - start;
+        best = std::min(best, time.count());
+    }
+    return (double)frames * packetizer.m_packets_in_frame_field / best;
+}
+
+/**
+ * Returns the best time in ms of @p repetitions runs filling a frame chunk by
+ * chunk, as the video sender does, with @p pool or by the calling thread only.
+ */
+static double frame_fill_ms(RtpVideoHeaderBuilder &packetizer, VideoPacketizerPool *pool, const AVFrame &frame,
+                            std::vector<uint8_t> &chunk, int repetitions)
+{
+    double best = 1e9;
+    for (int i = 0; i < repetitions; ++i) {
+        const auto start = std::chrono::steady_clock::now();
+        for (int frame_index = 0; frame_index < frames; ++frame_index) {
+            for (int first = 0; first < packetizer.m_packets_in_frame_field; first += strides_in_chunk) {
+                const int packets = std::min(strides_in_chunk, packetizer.m_packets_in_frame_field - first);
+                uint32_t rtp_timestamp;
+                const uint32_t seq_num = packetizer.reserve_packets(first, packets, rtp_timestamp);
+                if (pool) {
+                    pool->fill_packets(chunk.data(), packet_stride, first, packets, &frame, seq_num, rtp_timestamp);
+                } else {
+                    packetizer.fill_packets(chunk.data(), packet_stride, first, packets, &frame, seq_num,
+                                            rtp_timestamp);
+                }
+            }
+        }
+        const std::chrono::duration<double, std::milli> time = std::chrono::steady_clock::now() - start;
+        best = std::min(best, time.count() / frames);
+    }
+    return best;
+}
+
+static void bench_helpers(const std::vector<int> &cpus, std::vector<uint8_t> &chunk, int repetitions)
+{
+    const BenchFrame bench_frames[] = { { 3840, 2160, "2160p" }, { 7680, 4320, "4320p" } };
+    const VideoPacketizerFormat &format = *find_video_packetizer_format(AVPixelFormat::AV_PIX_FMT_YUV422P10LE);
+    rt_set_thread_affinity(cpus[0]);
+
+    printf("\n%-6s %-12s %8s %12s\n", "frame", "format", "helpers", "ms/frame");
+    for (const BenchFrame &bench_frame : bench_frames) {
+        std::vector<uint16_t> sizes = calculate_video_packet_sizes(bench_frame.width, bench_frame.height,
+                                                                   max_payload_size, format.pgroup_size, false);
+        const int packets = (int)sizes.size();
+        std::unique_ptr<RtpVideoHeaderBuilder> packetizer = format.create(
+            VIDEO_TYPE::PROGRESSIVE, bench_frame.height, bench_frame.width, packets, 60.0, 96, Rational(0), sizes);
+        FramePlanes planes(format, bench_frame.width, bench_frame.height);
+        printf("%-6s %-12s %8s %12.2f\n", bench_frame.name, format.name, "none",
+               frame_fill_ms(*packetizer, nullptr, planes.m_frame, chunk, repetitions));
+        for (size_t helpers : { 1, 2, 4, 8 }) {
+            if (helpers >= cpus.size()) {
+                printf("%-6s %-12s %8zu %12s\n", bench_frame.name, format.name, helpers, "no CPU");
+                continue;
+            }
+            VideoPacketizerPool pool(*packetizer, helpers,
+                                     std::vector<int>(cpus.begin() + 1, cpus.begin() + 1 + helpers));
+            printf("%-6s %-12s %8zu %12.2f\n", bench_frame.name, format.name, helpers,
+                   frame_fill_ms(*packetizer, &pool, planes.m_frame, chunk, repetitions));
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    const int repetitions = argc > 1 ? atoi(argv[1]) : 5;
+    std::vector<int> cpus;
+    if (argc > 2) {
+        std::istringstream list(argv[2]);
+        std::string cpu;
+        while (std::getline(list, cpu, ',')) {
+            cpus.push_back(atoi(cpu.c_str()));
+        }
+    }
+    const BenchFrame bench_frames[] = { { 1920, 1080, "1080p" }, { 3840, 2160, "2160p" } };
+    const VideoPacketizerFormat *formats[] = {
+        find_video_packetizer_format(AVPixelFormat::AV_PIX_FMT_YUV422P10LE),
+        find_video_packetizer_format(AVPixelFormat::AV_PIX_FMT_YUV422P),
+        find_video_packetizer_format(AVPixelFormat::AV_PIX_FMT_UYVY422),
+    };
+    std::vector<uint8_t> chunk(strides_in_chunk * packet_stride);
+
+    printf("%-6s %-12s %-11s %-11s %8s %14s %11s %10s\n", "frame", "format", "kernel", "packetizer", "packets",
+           "packets/s", "ns/packet", "frames/s");
+    for (const BenchFrame &bench_frame : bench_frames) {
+        for (const VideoPacketizerFormat *format : formats) {
+            std::vector<uint16_t> sizes = calculate_video_packet_sizes(bench_frame.width, bench_frame.height,
+                                                                       max_payload_size, format->pgroup_size, false);
+            const int packets = (int)sizes.size();
+            std::vector<uint16_t> branching_sizes = sizes;
+            std::unique_ptr<RtpVideoHeaderBuilder> packetizer = format->create(
+                VIDEO_TYPE::PROGRESSIVE, bench_frame.height, bench_frame.width, packets, 60.0, 96, Rational(0),
+                sizes);
+            BranchingVideoPacketizer branching(*format, bench_frame.height, bench_frame.width, packets,
+                                               branching_sizes);
+            if (!packetizer->plan_valid()) {
+                printf("%s %s: invalid packetization plan\n", bench_frame.name, format->name);
+                return EXIT_FAILURE;
+            }
+            FramePlanes planes(*format, bench_frame.width, bench_frame.height);
+            planes.m_frame.format = format->pix_format;
+            if (!same_packets(*packetizer, branching, planes.m_frame)) {
+                printf("%s %s: the packetizers differ\n", bench_frame.name, format->name);
+                return EXIT_FAILURE;
+            }
+            const struct {
+                const char *name;
+                RtpVideoHeaderBuilder *packetizer;
+            } runs[] = { { "branching", &branching }, { "specialized", packetizer.get() } };
+            for (const auto &run : runs) {
+                const double rate = packets_per_second(*run.packetizer, planes.m_frame, chunk, repetitions);
+                printf("%-6s %-12s %-11s %-11s %8d %14.0f %11.1f %10.1f\n", bench_frame.name, format->name,
+                       format->kernel_name(), run.name, packets, rate, 1e9 / rate, rate / packets);
+            }
+        }
+    }
+    if (!cpus.empty()) {
+        bench_helpers(cpus, chunk, repetitions);
+    }
+    return EXIT_SUCCESS;
+}
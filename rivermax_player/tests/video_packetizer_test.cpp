@@ -0,0 +1,174 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (c) 2024 NVIDIA CORPORATION & AFFILIATES. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Checks that the packet sizes and the packetization plan send every pixel
+ * group of a frame/field exactly once and within its line, for the usual
+ * frame geometries, packet sizes and every packetizer format, and that the
+ * packetizers read nothing past the frames. The frames end at the end of
+ * their allocation, as the raw video files at the end of their mapping.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "video_packetizer.h"
+
+static int failures = 0;
+
+struct Geometry
+{
+    int width;
+    int height;
+};
+
+static void fail(const char *format, const Geometry &geometry, bool interlaced, int packet_size, bool padding,
+                 const char *what)
+{
+    if (failures++ < 20) {
+        printf("FAIL %s %dx%d%c -b %d%s: %s\n", format, geometry.width, geometry.height, interlaced ? 'i' : 'p',
+               packet_size, padding ? " -a" : "", what);
+    }
+}
+
+/**
+ * Planes of a frame of @p format without line padding, each plane ends its
+ * allocation.
+ */
+struct FramePlanes
+{
+    FramePlanes(const VideoPacketizerFormat &format, int width, int height)
+    {
+        if (&format == &v210_packetizer_format) {
+            add_plane((width + 47) / 48 * 128, height);
+        } else if (format.pix_format == AVPixelFormat::AV_PIX_FMT_UYVY422) {
+            add_plane(width * 2, height);
+        } else {
+            const int sample_size = format.bit_depth > 8 ? 2 : 1;
+            add_plane(width * sample_size, height);
+            add_plane(width / 2 * sample_size, height);
+            add_plane(width / 2 * sample_size, height);
+        }
+        m_frame.format = format.pix_format;
+        m_frame.width = width;
+        m_frame.height = height;
+    }
+
+    void add_plane(int linesize, int height)
+    {
+        const int index = (int)m_planes.size();
+        m_planes.emplace_back((size_t)linesize * height);
+        m_frame.data[index] = m_planes.back().data();
+        m_frame.linesize[index] = linesize;
+    }
+
+    std::vector<std::vector<uint8_t>> m_planes;
+    AVFrame m_frame = {};
+};
+
+static void check_plan(const VideoPacketizerFormat &format, const Geometry &geometry, bool interlaced,
+                       int packet_size, bool padding)
+{
+    const int field_height = interlaced ? geometry.height / 2 : geometry.height;
+    const int pgroups_in_line = geometry.width / PX_IN_422_GRP;
+    // -b counts the IPv4 and UDP headers
+    std::vector<uint16_t> sizes = calculate_video_packet_sizes(geometry.width, field_height,
+        (uint16_t)(packet_size - 28), format.pgroup_size, padding);
+    const std::vector<uint16_t> packet_sizes = sizes;
+    const int packets = (int)sizes.size();
+    std::unique_ptr<RtpVideoHeaderBuilder> packetizer = format.create(
+        interlaced ? VIDEO_TYPE::INTERLACE : VIDEO_TYPE::PROGRESSIVE, field_height, geometry.width, packets, 50.0,
+        96, Rational(0), sizes);
+    if (!packetizer->plan_valid()) {
+        fail(format.name, geometry, interlaced, packet_size, padding, "invalid plan");
+        return;
+    }
+
+    // every pixel group once, in order, within its line
+    std::vector<uint8_t> sent((size_t)pgroups_in_line * field_height);
+    int next_pgroup = 0;
+    for (int i = 0; i < packets; ++i) {
+        const VideoPacketPlan &plan = packetizer->m_plan[i];
+        int payload = 12 + 2 + plan.srd_count * 6 + plan.padding_size;
+        for (int j = 0; j < plan.srd_count; ++j) {
+            const VideoPacketPlan::SrdSegment &segment = plan.srd[j];
+            const int pgroups = segment.length / format.pgroup_size;
+            payload += segment.length;
+            if (segment.length % format.pgroup_size || !pgroups || segment.src_line >= field_height ||
+                segment.src_pgroup + pgroups > pgroups_in_line ||
+                segment.src_line * pgroups_in_line + segment.src_pgroup != next_pgroup ||
+                segment.row_number != segment.src_line || segment.offset != segment.src_pgroup * PX_IN_422_GRP ||
+                segment.continuation != (j + 1 < plan.srd_count)) {
+                fail(format.name, geometry, interlaced, packet_size, padding, "segment out of its line");
+                return;
+            }
+            next_pgroup += pgroups;
+        }
+        if (payload != packet_sizes[i] || packet_sizes[i] > packet_size - 28) {
+            fail(format.name, geometry, interlaced, packet_size, padding, "packet size differs from the plan");
+            return;
+        }
+    }
+    if (next_pgroup != pgroups_in_line * field_height) {
+        fail(format.name, geometry, interlaced, packet_size, padding, "pixel groups not sent");
+        return;
+    }
+
+    // the last lines of the frame end their planes
+    FramePlanes planes(format, geometry.width, geometry.height);
+    std::vector<uint8_t> packet(packet_size);
+    for (int field = 0; field < (interlaced ? 2 : 1); ++field) {
+        packetizer->m_field = field != 0;
+        for (int i = 0; i < packets; ++i) {
+            packetizer->fill_packet(packet.data(), i, &planes.m_frame);
+        }
+    }
+}
+
+int main()
+{
+    const Geometry geometries[] = {
+        { 720, 486 }, { 720, 576 }, { 1280, 720 }, { 1440, 1080 }, { 1920, 1080 }, { 2048, 1080 },
+        { 2048, 1556 }, { 3840, 2160 }, { 4096, 2160 }, { 7680, 4320 }, { 642, 480 },
+    };
+    const int packet_sizes[] = { 600, 1248, 1400, 1500, 9000 };
+    std::vector<const VideoPacketizerFormat*> formats = {
+        find_video_packetizer_format(AVPixelFormat::AV_PIX_FMT_YUV422P10LE),
+        find_video_packetizer_format(AVPixelFormat::AV_PIX_FMT_YUV422P),
+        find_video_packetizer_format(AVPixelFormat::AV_PIX_FMT_UYVY422),
+        &v210_packetizer_format,
+    };
+
+    int plans = 0;
+    for (const VideoPacketizerFormat *format : formats) {
+        for (const Geometry &geometry : geometries) {
+            for (int packet_size : packet_sizes) {
+                for (int scan = 0; scan < 4; ++scan) {
+                    check_plan(*format, geometry, scan & 1, packet_size, scan & 2);
+                    ++plans;
+                }
+            }
+        }
+    }
+    if (failures) {
+        printf("%d of %d plans failed\n", failures, plans);
+        return EXIT_FAILURE;
+    }
+    printf("%d plans checked\n", plans);
+    return EXIT_SUCCESS;
+}
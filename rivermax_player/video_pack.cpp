@@ -0,0 +1,550 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (c) 2024 NVIDIA CORPORATION & AFFILIATES. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <string.h>
+#include "video_pack.h"
+
+// SIMD kernels are built with per-function target attributes, so the rest of the player
+// keeps the baseline ISA and the kernel is chosen at runtime.
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define VIDEO_PACK_X86_SIMD
+#include <immintrin.h>
+#endif
+
+void pack_yuv422p10le_scalar(uint8_t *dst, const uint16_t *y, const uint16_t *cb,
+                             const uint16_t *cr, size_t pgroups)
+{
+    for (size_t pgroup = 0; pgroup < pgroups; ++pgroup, dst += 5, y += 2, ++cb, ++cr) {
+        dst[0] = (*cb) >> 2;
+        dst[1] = (((*cb) << 6) & 0xc0) | (y[0] >> 4);
+        dst[2] = ((y[0] << 4) & 0xf0) | ((*cr) >> 6);
+        dst[3] = (((*cr) << 2) & 0xfc) | (y[1] >> 8);
+        dst[4] = (y[1] & 0xff);
+    }
+}
+
+void interleave_yuv422p_scalar(uint8_t *dst, const uint8_t *y, const uint8_t *cb,
+                               const uint8_t *cr, size_t pgroups)
+{
+    for (size_t pgroup = 0; pgroup < pgroups; ++pgroup) {
+        *dst++ = *cb++;
+        *dst++ = *y++;
+        *dst++ = *cr++;
+        *dst++ = *y++;
+    }
+}
+
+void interleave_yuv420p_scalar(uint8_t *dst, const uint8_t *y, const uint8_t *cb, const uint8_t *cb_far,
+                               const uint8_t *cr, const uint8_t *cr_far, size_t pgroups)
+{
+    for (size_t pgroup = 0; pgroup < pgroups; ++pgroup) {
+        *dst++ = (uint8_t)((3 * *cb++ + *cb_far++ + 2) >> 2);
+        *dst++ = *y++;
+        *dst++ = (uint8_t)((3 * *cr++ + *cr_far++ + 2) >> 2);
+        *dst++ = *y++;
+    }
+}
+
+void yuv420p_chroma_lines(int line, int chroma_height, bool interlaced, int &near, int &far)
+{
+    // with a single chroma line the second field has none
+    const int fields = interlaced && chroma_height > 1 ? 2 : 1;
+    const int field = line % fields;
+    const int field_line = line / fields;
+    const int field_chroma_lines = (chroma_height - field + fields - 1) / fields;
+    // 4:2:0 chroma sits between its two luma lines of the field
+    const int field_near = std::min(field_line / 2, field_chroma_lines - 1);
+    const int field_far = std::max(0, std::min(field_line & 1 ? field_near + 1 : field_near - 1,
+                                               field_chroma_lines - 1));
+    near = field_near * fields + field;
+    far = field_far * fields + field;
+}
+
+static inline uint32_t load_le32(const uint8_t *src)
+{
+    return (uint32_t)src[0] | ((uint32_t)src[1] << 8) | ((uint32_t)src[2] << 16) | ((uint32_t)src[3] << 24);
+}
+
+void repack_v210_scalar(uint8_t *dst, const uint8_t *line, size_t first_pgroup, size_t pgroups)
+{
+    const uint8_t *block = line + first_pgroup / 3 * 16;
+    size_t pgroup_in_block = first_pgroup % 3;
+    while (pgroups) {
+        uint32_t samples[12];
+        for (int word = 0; word < 4; ++word) {
+            const uint32_t value = load_le32(block + word * 4);
+            samples[word * 3] = value & 0x3ff;
+            samples[word * 3 + 1] = (value >> 10) & 0x3ff;
+            samples[word * 3 + 2] = (value >> 20) & 0x3ff;
+        }
+        for (; pgroup_in_block < 3 && pgroups; ++pgroup_in_block, --pgroups, dst += 5) {
+            const uint32_t *pgroup = samples + pgroup_in_block * 4;
+            const uint64_t bits = ((uint64_t)pgroup[0] << 30) | ((uint64_t)pgroup[1] << 20) |
+                (pgroup[2] << 10) | pgroup[3];
+            dst[0] = (uint8_t)(bits >> 32);
+            dst[1] = (uint8_t)(bits >> 24);
+            dst[2] = (uint8_t)(bits >> 16);
+            dst[3] = (uint8_t)(bits >> 8);
+            dst[4] = (uint8_t)bits;
+        }
+        pgroup_in_block = 0;
+        block += 16;
+    }
+}
+
+#ifdef VIDEO_PACK_X86_SIMD
+
+/*
+ * Both 10-bit kernels arrange every pgroup as 16-bit words [Cb, Y0, Cr, Y1] in a 64-bit lane, so that
+ * a multiply-add by (1024, 1) gives the 20-bit pairs H = Cb:Y0 and L = Cr:Y1 in the low and the
+ * high dword. (H << 20) | L is the 40-bit pgroup, its 5 low bytes are then reversed to get the
+ * big-endian wire order.
+ */
+
+__attribute__((target("avx2")))
+static inline __m256i pgroups_to_qwords_avx2(__m256i words)
+{
+    const __m256i madd = _mm256_set1_epi32((1 << 16) | (1 << 10));
+    __m256i pairs = _mm256_madd_epi16(words, madd);
+    // bits above 40 are garbage and never stored
+    return _mm256_or_si256(_mm256_slli_epi64(pairs, 20), _mm256_srli_epi64(pairs, 32));
+}
+
+__attribute__((target("avx2")))
+static inline void pack8_yuv422p10le_avx2(uint8_t *dst, const uint16_t *y, const uint16_t *cb, const uint16_t *cr)
+{
+    // 2 pgroups per 128-bit lane -> bytes 0..9 of the lane
+    const __m256i to_be = _mm256_setr_epi8(
+        4, 3, 2, 1, 0, 12, 11, 10, 9, 8, -1, -1, -1, -1, -1, -1,
+        4, 3, 2, 1, 0, 12, 11, 10, 9, 8, -1, -1, -1, -1, -1, -1);
+
+    __m256i luma = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(y));
+    __m128i blue = _mm_loadu_si128(reinterpret_cast<const __m128i*>(cb));
+    __m128i red = _mm_loadu_si128(reinterpret_cast<const __m128i*>(cr));
+    // lane 0: pgroups 0..3, lane 1: pgroups 4..7 - same split as the luma vector
+    __m256i chroma = _mm256_set_m128i(_mm_unpackhi_epi16(blue, red), _mm_unpacklo_epi16(blue, red));
+    __m256i lo = pgroups_to_qwords_avx2(_mm256_unpacklo_epi16(chroma, luma)); // pgroups 0, 1 | 4, 5
+    __m256i hi = pgroups_to_qwords_avx2(_mm256_unpackhi_epi16(chroma, luma)); // pgroups 2, 3 | 6, 7
+    lo = _mm256_shuffle_epi8(lo, to_be);
+    hi = _mm256_shuffle_epi8(hi, to_be);
+    // every store writes 6 garbage bytes past its 10 valid ones, the next store overwrites them
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), _mm256_castsi256_si128(lo));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 10), _mm256_castsi256_si128(hi));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 20), _mm256_extracti128_si256(lo, 1));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 30), _mm256_extracti128_si256(hi, 1));
+}
+
+__attribute__((target("avx2")))
+static void pack_yuv422p10le_avx2(uint8_t *dst, const uint16_t *y, const uint16_t *cb,
+                                  const uint16_t *cr, size_t pgroups)
+{
+    // keep at least 2 more pgroups (10 bytes) after every block to absorb the garbage tail
+    for (; pgroups >= 10; pgroups -= 8, dst += 40, y += 16, cb += 8, cr += 8) {
+        pack8_yuv422p10le_avx2(dst, y, cb, cr);
+    }
+    if (pgroups >= 8) {
+        uint8_t tail[48];
+        pack8_yuv422p10le_avx2(tail, y, cb, cr);
+        memcpy(dst, tail, 40);
+        pgroups -= 8;
+        dst += 40;
+        y += 16;
+        cb += 8;
+        cr += 8;
+    }
+    pack_yuv422p10le_scalar(dst, y, cb, cr, pgroups);
+}
+
+// GCC 12 reports the self-initialized _mm512_undefined_epi32() of its own headers (GCC PR 105593)
+#if !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+__attribute__((target("avx512f,avx512bw,avx512vl,avx512vbmi")))
+static void pack_yuv422p10le_avx512vbmi(uint8_t *dst, const uint16_t *y, const uint16_t *cb,
+                                        const uint16_t *cr, size_t pgroups)
+{
+    // source words: 0..15 luma, 16..23 Cb, 24..31 Cr -> [Cb, Y0, Cr, Y1] per pgroup
+    const __m512i to_words = _mm512_set_epi16(
+        15, 31, 14, 23, 13, 30, 12, 22, 11, 29, 10, 21, 9, 28, 8, 20,
+        7, 27, 6, 19, 5, 26, 4, 18, 3, 25, 2, 17, 1, 24, 0, 16);
+    const __m512i madd = _mm512_set1_epi32((1 << 16) | (1 << 10));
+    // 8 pgroups of 5 reversed bytes, compacted to the first 40 bytes
+    const __m512i to_be = _mm512_set_epi8(
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        56, 57, 58, 59, 60, 48, 49, 50, 51, 52, 40, 41, 42, 43, 44, 32, 33, 34, 35, 36,
+        24, 25, 26, 27, 28, 16, 17, 18, 19, 20, 8, 9, 10, 11, 12, 0, 1, 2, 3, 4);
+
+    while (pgroups) {
+        const size_t count = pgroups < 8 ? pgroups : 8;
+        const __mmask16 chroma_mask = static_cast<__mmask16>((1u << count) - 1);
+        const __mmask16 luma_mask = static_cast<__mmask16>((1u << (2 * count)) - 1);
+        const __mmask64 store_mask = (1ull << (5 * count)) - 1;
+
+        __m256i luma = _mm256_maskz_loadu_epi16(luma_mask, y);
+        __m128i blue = _mm_maskz_loadu_epi16(chroma_mask, cb);
+        __m128i red = _mm_maskz_loadu_epi16(chroma_mask, cr);
+        __m512i src = _mm512_inserti64x4(_mm512_castsi256_si512(luma),
+                                         _mm256_inserti128_si256(_mm256_castsi128_si256(blue), red, 1), 1);
+        __m512i pairs = _mm512_madd_epi16(_mm512_permutexvar_epi16(to_words, src), madd);
+        __m512i qwords = _mm512_or_si512(_mm512_slli_epi64(pairs, 20), _mm512_srli_epi64(pairs, 32));
+        _mm512_mask_storeu_epi8(dst, store_mask, _mm512_permutexvar_epi8(to_be, qwords));
+
+        pgroups -= count;
+        dst += 5 * count;
+        y += 2 * count;
+        cb += count;
+        cr += count;
+    }
+}
+#if !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+/*
+ * The 8-bit kernels interleave 16 pgroups per block. A span that is not a multiple of 16 ends
+ * with a block aligned to its end, overlapping the previous one: the overlapped bytes are
+ * written twice with the same values, which is cheaper than a scalar tail.
+ */
+
+__attribute__((target("sse2")))
+static inline void interleave16_yuv422p_sse2(uint8_t *dst, const uint8_t *y, const uint8_t *cb, const uint8_t *cr)
+{
+    __m128i blue = _mm_loadu_si128(reinterpret_cast<const __m128i*>(cb));
+    __m128i red = _mm_loadu_si128(reinterpret_cast<const __m128i*>(cr));
+    __m128i luma_lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(y));
+    __m128i luma_hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(y + 16));
+    __m128i chroma_lo = _mm_unpacklo_epi8(blue, red); // pgroups 0..7
+    __m128i chroma_hi = _mm_unpackhi_epi8(blue, red); // pgroups 8..15
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), _mm_unpacklo_epi8(chroma_lo, luma_lo));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 16), _mm_unpackhi_epi8(chroma_lo, luma_lo));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 32), _mm_unpacklo_epi8(chroma_hi, luma_hi));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 48), _mm_unpackhi_epi8(chroma_hi, luma_hi));
+}
+
+__attribute__((target("sse2")))
+static void interleave_yuv422p_sse2(uint8_t *dst, const uint8_t *y, const uint8_t *cb,
+                                    const uint8_t *cr, size_t pgroups)
+{
+    if (pgroups < 16) {
+        interleave_yuv422p_scalar(dst, y, cb, cr, pgroups);
+        return;
+    }
+    const size_t last = pgroups - 16;
+    for (size_t pgroup = 0; pgroup < last; pgroup += 16) {
+        interleave16_yuv422p_sse2(dst + 4 * pgroup, y + 2 * pgroup, cb + pgroup, cr + pgroup);
+    }
+    interleave16_yuv422p_sse2(dst + 4 * last, y + 2 * last, cb + last, cr + last);
+}
+
+__attribute__((target("avx2")))
+static inline void interleave16_yuv422p_avx2(uint8_t *dst, const uint8_t *y, const uint8_t *cb, const uint8_t *cr)
+{
+    // zero-extending to 16 bits places Cb/Cr pairs in the same 128-bit lanes as their luma
+    __m256i blue = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(cb)));
+    __m256i red = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(cr)));
+    __m256i chroma = _mm256_or_si256(blue, _mm256_slli_epi16(red, 8)); // pgroups 0..7 | 8..15
+    __m256i luma = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(y));
+    __m256i lo = _mm256_unpacklo_epi8(chroma, luma); // pgroups 0..3 | 8..11
+    __m256i hi = _mm256_unpackhi_epi8(chroma, luma); // pgroups 4..7 | 12..15
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), _mm256_castsi256_si128(lo));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 16), _mm256_castsi256_si128(hi));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 32), _mm256_extracti128_si256(lo, 1));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 48), _mm256_extracti128_si256(hi, 1));
+}
+
+__attribute__((target("avx2")))
+static void interleave_yuv422p_avx2(uint8_t *dst, const uint8_t *y, const uint8_t *cb,
+                                    const uint8_t *cr, size_t pgroups)
+{
+    if (pgroups < 16) {
+        interleave_yuv422p_scalar(dst, y, cb, cr, pgroups);
+        return;
+    }
+    const size_t last = pgroups - 16;
+    for (size_t pgroup = 0; pgroup < last; pgroup += 16) {
+        interleave16_yuv422p_avx2(dst + 4 * pgroup, y + 2 * pgroup, cb + pgroup, cr + pgroup);
+    }
+    interleave16_yuv422p_avx2(dst + 4 * last, y + 2 * last, cb + last, cr + last);
+}
+
+/*
+ * The 4:2:0 kernels compute the chroma of 16 pgroups in 16-bit words and then interleave them
+ * as the 4:2:2 kernels do, with the same overlapping last block.
+ */
+
+__attribute__((target("sse2")))
+static inline __m128i upsample16_chroma_sse2(const uint8_t *near, const uint8_t *far, __m128i zero, __m128i two)
+{
+    __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(near));
+    __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(far));
+    __m128i a_lo = _mm_unpacklo_epi8(a, zero);
+    __m128i a_hi = _mm_unpackhi_epi8(a, zero);
+    // 3 * a + b + 2
+    __m128i lo = _mm_add_epi16(_mm_add_epi16(_mm_slli_epi16(a_lo, 1), a_lo),
+                               _mm_add_epi16(_mm_unpacklo_epi8(b, zero), two));
+    __m128i hi = _mm_add_epi16(_mm_add_epi16(_mm_slli_epi16(a_hi, 1), a_hi),
+                               _mm_add_epi16(_mm_unpackhi_epi8(b, zero), two));
+    return _mm_packus_epi16(_mm_srli_epi16(lo, 2), _mm_srli_epi16(hi, 2));
+}
+
+__attribute__((target("sse2")))
+static inline void interleave16_yuv420p_sse2(uint8_t *dst, const uint8_t *y, const uint8_t *cb,
+                                             const uint8_t *cb_far, const uint8_t *cr, const uint8_t *cr_far)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i two = _mm_set1_epi16(2);
+    __m128i blue = upsample16_chroma_sse2(cb, cb_far, zero, two);
+    __m128i red = upsample16_chroma_sse2(cr, cr_far, zero, two);
+    __m128i luma_lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(y));
+    __m128i luma_hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(y + 16));
+    __m128i chroma_lo = _mm_unpacklo_epi8(blue, red); // pgroups 0..7
+    __m128i chroma_hi = _mm_unpackhi_epi8(blue, red); // pgroups 8..15
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), _mm_unpacklo_epi8(chroma_lo, luma_lo));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 16), _mm_unpackhi_epi8(chroma_lo, luma_lo));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 32), _mm_unpacklo_epi8(chroma_hi, luma_hi));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 48), _mm_unpackhi_epi8(chroma_hi, luma_hi));
+}
+
+__attribute__((target("sse2")))
+static void interleave_yuv420p_sse2(uint8_t *dst, const uint8_t *y, const uint8_t *cb, const uint8_t *cb_far,
+                                    const uint8_t *cr, const uint8_t *cr_far, size_t pgroups)
+{
+    if (pgroups < 16) {
+        interleave_yuv420p_scalar(dst, y, cb, cb_far, cr, cr_far, pgroups);
+        return;
+    }
+    const size_t last = pgroups - 16;
+    for (size_t pgroup = 0; pgroup < last; pgroup += 16) {
+        interleave16_yuv420p_sse2(dst + 4 * pgroup, y + 2 * pgroup, cb + pgroup, cb_far + pgroup, cr + pgroup,
+                                  cr_far + pgroup);
+    }
+    interleave16_yuv420p_sse2(dst + 4 * last, y + 2 * last, cb + last, cb_far + last, cr + last, cr_far + last);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i upsample16_chroma_avx2(const uint8_t *near, const uint8_t *far, __m256i two)
+{
+    __m256i a = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(near)));
+    __m256i b = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(far)));
+    // 3 * a + b + 2, in 16-bit words
+    __m256i sum = _mm256_add_epi16(_mm256_add_epi16(_mm256_slli_epi16(a, 1), a), _mm256_add_epi16(b, two));
+    return _mm256_srli_epi16(sum, 2);
+}
+
+__attribute__((target("avx2")))
+static inline void interleave16_yuv420p_avx2(uint8_t *dst, const uint8_t *y, const uint8_t *cb,
+                                             const uint8_t *cb_far, const uint8_t *cr, const uint8_t *cr_far,
+                                             __m256i two)
+{
+    // the chroma words are laid out as the zero-extended ones of the 4:2:2 kernel
+    __m256i blue = upsample16_chroma_avx2(cb, cb_far, two);
+    __m256i red = upsample16_chroma_avx2(cr, cr_far, two);
+    __m256i chroma = _mm256_or_si256(blue, _mm256_slli_epi16(red, 8)); // pgroups 0..7 | 8..15
+    __m256i luma = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(y));
+    __m256i lo = _mm256_unpacklo_epi8(chroma, luma); // pgroups 0..3 | 8..11
+    __m256i hi = _mm256_unpackhi_epi8(chroma, luma); // pgroups 4..7 | 12..15
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), _mm256_castsi256_si128(lo));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 16), _mm256_castsi256_si128(hi));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 32), _mm256_extracti128_si256(lo, 1));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 48), _mm256_extracti128_si256(hi, 1));
+}
+
+__attribute__((target("avx2")))
+static void interleave_yuv420p_avx2(uint8_t *dst, const uint8_t *y, const uint8_t *cb, const uint8_t *cb_far,
+                                    const uint8_t *cr, const uint8_t *cr_far, size_t pgroups)
+{
+    if (pgroups < 16) {
+        interleave_yuv420p_scalar(dst, y, cb, cb_far, cr, cr_far, pgroups);
+        return;
+    }
+    const __m256i two = _mm256_set1_epi16(2);
+    const size_t last = pgroups - 16;
+    for (size_t pgroup = 0; pgroup < last; pgroup += 16) {
+        interleave16_yuv420p_avx2(dst + 4 * pgroup, y + 2 * pgroup, cb + pgroup, cb_far + pgroup, cr + pgroup,
+                                  cr_far + pgroup, two);
+    }
+    interleave16_yuv420p_avx2(dst + 4 * last, y + 2 * last, cb + last, cb_far + last, cr + last, cr_far + last,
+                              two);
+}
+
+/*
+ * The v210 kernel gathers 2 pgroups (8 samples) per 128-bit lane: the 2 bytes holding every
+ * sample are shuffled to a 16-bit word and a multiply by 16, 4 or 1 followed by a right shift
+ * by 4 drops the bits of the neighbouring samples. Four v210 blocks give 12 pgroups, their
+ * lanes start at block offsets 0 (pgroups 0, 1), 8 (pgroups 2, 3) and 0 (pgroups 1, 2).
+ */
+
+__attribute__((target("avx2")))
+static inline __m256i v210_to_words_avx2(const uint8_t *lo, const uint8_t *hi, __m256i gather, __m256i scale)
+{
+    __m256i bytes = _mm256_inserti128_si256(
+        _mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(lo))),
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(hi)), 1);
+    __m256i words = _mm256_mullo_epi16(_mm256_shuffle_epi8(bytes, gather), scale);
+    return _mm256_and_si256(_mm256_srli_epi16(words, 4), _mm256_set1_epi16(0x3ff));
+}
+
+__attribute__((target("avx2")))
+static inline void store4_pgroups_avx2(uint8_t *dst, __m256i words)
+{
+    const __m256i to_be = _mm256_setr_epi8(
+        4, 3, 2, 1, 0, 12, 11, 10, 9, 8, -1, -1, -1, -1, -1, -1,
+        4, 3, 2, 1, 0, 12, 11, 10, 9, 8, -1, -1, -1, -1, -1, -1);
+    __m256i pgroups = _mm256_shuffle_epi8(pgroups_to_qwords_avx2(words), to_be);
+    // every store writes 6 garbage bytes past its 10 valid ones
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), _mm256_castsi256_si128(pgroups));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 10), _mm256_extracti128_si256(pgroups, 1));
+}
+
+__attribute__((target("avx2")))
+static void repack_v210_avx2(uint8_t *dst, const uint8_t *line, size_t first_pgroup, size_t pgroups)
+{
+    // lane layouts: X - pgroups 0, 1 at offset 0, Y - pgroups 2, 3 at offset 8, Z - pgroups 1, 2 at offset 0
+    const __m256i gather_xy = _mm256_setr_epi8(
+        0, 1, 1, 2, 2, 3, 4, 5, 5, 6, 6, 7, 8, 9, 9, 10,
+        2, 3, 4, 5, 5, 6, 6, 7, 8, 9, 9, 10, 10, 11, 12, 13);
+    const __m256i scale_xy = _mm256_setr_epi16(16, 4, 1, 16, 4, 1, 16, 4, 1, 16, 4, 1, 16, 4, 1, 16);
+    const __m256i gather_zx = _mm256_setr_epi8(
+        5, 6, 6, 7, 8, 9, 9, 10, 10, 11, 12, 13, 13, 14, 14, 15,
+        0, 1, 1, 2, 2, 3, 4, 5, 5, 6, 6, 7, 8, 9, 9, 10);
+    const __m256i scale_zx = _mm256_setr_epi16(4, 1, 16, 4, 1, 16, 4, 1, 16, 4, 1, 16, 4, 1, 16, 4);
+    const __m256i gather_yz = _mm256_setr_epi8(
+        2, 3, 4, 5, 5, 6, 6, 7, 8, 9, 9, 10, 10, 11, 12, 13,
+        5, 6, 6, 7, 8, 9, 9, 10, 10, 11, 12, 13, 13, 14, 14, 15);
+    const __m256i scale_yz = _mm256_setr_epi16(1, 16, 4, 1, 16, 4, 1, 16, 4, 1, 16, 4, 1, 16, 4, 1);
+
+    // the scalar kernel takes the span up to a block boundary
+    const size_t head = std::min((3 - first_pgroup % 3) % 3, pgroups);
+    repack_v210_scalar(dst, line, first_pgroup, head);
+    size_t pgroup = first_pgroup + head;
+    dst += 5 * head;
+    pgroups -= head;
+    // at least 2 pgroups are left to the scalar tail to overwrite the garbage of the last store
+    for (; pgroups >= 14; pgroups -= 12, pgroup += 12, dst += 60) {
+        const uint8_t *block = line + pgroup / 3 * 16;
+        store4_pgroups_avx2(dst, v210_to_words_avx2(block, block + 8, gather_xy, scale_xy));
+        store4_pgroups_avx2(dst + 20, v210_to_words_avx2(block + 16, block + 32, gather_zx, scale_zx));
+        store4_pgroups_avx2(dst + 40, v210_to_words_avx2(block + 40, block + 48, gather_yz, scale_yz));
+    }
+    repack_v210_scalar(dst, line, pgroup, pgroups);
+}
+
+#endif // VIDEO_PACK_X86_SIMD
+
+std::vector<VideoPackKernel<pack_yuv422p10le_func>> get_pack_yuv422p10le_kernels()
+{
+    std::vector<VideoPackKernel<pack_yuv422p10le_func>> kernels;
+#ifdef VIDEO_PACK_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") &&
+        __builtin_cpu_supports("avx512vl") && __builtin_cpu_supports("avx512vbmi")) {
+        kernels.push_back({ pack_yuv422p10le_avx512vbmi, "avx512vbmi" });
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        kernels.push_back({ pack_yuv422p10le_avx2, "avx2" });
+    }
+#endif
+    kernels.push_back({ pack_yuv422p10le_scalar, "scalar" });
+    return kernels;
+}
+
+pack_yuv422p10le_func get_pack_yuv422p10le(const char **kernel_name)
+{
+    static const VideoPackKernel<pack_yuv422p10le_func> kernel = get_pack_yuv422p10le_kernels().front();
+
+    if (kernel_name) {
+        *kernel_name = kernel.name;
+    }
+    return kernel.func;
+}
+
+std::vector<VideoPackKernel<interleave_yuv422p_func>> get_interleave_yuv422p_kernels()
+{
+    std::vector<VideoPackKernel<interleave_yuv422p_func>> kernels;
+#ifdef VIDEO_PACK_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        kernels.push_back({ interleave_yuv422p_avx2, "avx2" });
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        kernels.push_back({ interleave_yuv422p_sse2, "sse2" });
+    }
+#endif
+    kernels.push_back({ interleave_yuv422p_scalar, "scalar" });
+    return kernels;
+}
+
+interleave_yuv422p_func get_interleave_yuv422p(const char **kernel_name)
+{
+    static const VideoPackKernel<interleave_yuv422p_func> kernel = get_interleave_yuv422p_kernels().front();
+
+    if (kernel_name) {
+        *kernel_name = kernel.name;
+    }
+    return kernel.func;
+}
+
+std::vector<VideoPackKernel<interleave_yuv420p_func>> get_interleave_yuv420p_kernels()
+{
+    std::vector<VideoPackKernel<interleave_yuv420p_func>> kernels;
+#ifdef VIDEO_PACK_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        kernels.push_back({ interleave_yuv420p_avx2, "avx2" });
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        kernels.push_back({ interleave_yuv420p_sse2, "sse2" });
+    }
+#endif
+    kernels.push_back({ interleave_yuv420p_scalar, "scalar" });
+    return kernels;
+}
+
+interleave_yuv420p_func get_interleave_yuv420p(const char **kernel_name)
+{
+    static const VideoPackKernel<interleave_yuv420p_func> kernel = get_interleave_yuv420p_kernels().front();
+
+    if (kernel_name) {
+        *kernel_name = kernel.name;
+    }
+    return kernel.func;
+}
+
+std::vector<VideoPackKernel<repack_v210_func>> get_repack_v210_kernels()
+{
+    std::vector<VideoPackKernel<repack_v210_func>> kernels;
+#ifdef VIDEO_PACK_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        kernels.push_back({ repack_v210_avx2, "avx2" });
+    }
+#endif
+    kernels.push_back({ repack_v210_scalar, "scalar" });
+    return kernels;
+}
+
+repack_v210_func get_repack_v210(const char **kernel_name)
+{
+    static const VideoPackKernel<repack_v210_func> kernel = get_repack_v210_kernels().front();
+
+    if (kernel_name) {
+        *kernel_name = kernel.name;
+    }
+    return kernel.func;
+}
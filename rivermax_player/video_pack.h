@@ -0,0 +1,194 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (c) 2024 NVIDIA CORPORATION & AFFILIATES. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _RIVERMAX_PLAYER_VIDEO_PACK_H_
+#define _RIVERMAX_PLAYER_VIDEO_PACK_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * A kernel of one of the functions below and its printable name.
+ */
+template <typename Func>
+struct VideoPackKernel
+{
+    Func func;
+    const char *name;
+};
+
+/**
+ * Packs planar 4:2:2 10-bit samples into SMPTE 2110-20 pgroups.
+ *
+ * Every pgroup takes Cb, Y0, Cr, Y1 (in that order) and stores them as 5 bytes,
+ * 10 bits per sample, most significant bit first. Samples are expected to fit
+ * in 10 bits, as produced by FFmpeg for AV_PIX_FMT_YUV422P10LE.
+ *
+ * @param [out] dst - destination, must hold @p pgroups * 5 bytes;
+ * @param [in] y - 2 * @p pgroups luma samples;
+ * @param [in] cb - @p pgroups Cb samples;
+ * @param [in] cr - @p pgroups Cr samples;
+ * @param [in] pgroups - number of pgroups to pack.
+ */
+typedef void (*pack_yuv422p10le_func)(uint8_t *dst, const uint16_t *y, const uint16_t *cb,
+                                      const uint16_t *cr, size_t pgroups);
+
+/**
+ * Portable implementation of @ref pack_yuv422p10le_func.
+ */
+void pack_yuv422p10le_scalar(uint8_t *dst, const uint16_t *y, const uint16_t *cb,
+                             const uint16_t *cr, size_t pgroups);
+
+/**
+ * Returns the fastest @ref pack_yuv422p10le_func supported by the running CPU.
+ *
+ * The selection is done once, on the first call.
+ *
+ * @param [out] kernel_name - if not null, set to a printable name of the selected kernel.
+ */
+pack_yuv422p10le_func get_pack_yuv422p10le(const char **kernel_name = nullptr);
+
+/**
+ * Returns every kernel of @ref pack_yuv422p10le_func the running CPU supports, the
+ * fastest first, for the tests and the benchmarks.
+ */
+std::vector<VideoPackKernel<pack_yuv422p10le_func>> get_pack_yuv422p10le_kernels();
+
+/**
+ * Interleaves planar 4:2:2 8-bit samples into SMPTE 2110-20 pgroups.
+ *
+ * Every pgroup is Cb, Y0, Cr, Y1 (in that order), one byte per sample, which is
+ * also the UYVY layout.
+ *
+ * @param [out] dst - destination, must hold @p pgroups * 4 bytes;
+ * @param [in] y - 2 * @p pgroups luma samples;
+ * @param [in] cb - @p pgroups Cb samples;
+ * @param [in] cr - @p pgroups Cr samples;
+ * @param [in] pgroups - number of pgroups to interleave.
+ */
+typedef void (*interleave_yuv422p_func)(uint8_t *dst, const uint8_t *y, const uint8_t *cb,
+                                        const uint8_t *cr, size_t pgroups);
+
+/**
+ * Portable implementation of @ref interleave_yuv422p_func.
+ */
+void interleave_yuv422p_scalar(uint8_t *dst, const uint8_t *y, const uint8_t *cb,
+                               const uint8_t *cr, size_t pgroups);
+
+/**
+ * Returns the fastest @ref interleave_yuv422p_func supported by the running CPU.
+ *
+ * The selection is done once, on the first call.
+ *
+ * @param [out] kernel_name - if not null, set to a printable name of the selected kernel.
+ */
+interleave_yuv422p_func get_interleave_yuv422p(const char **kernel_name = nullptr);
+
+/**
+ * Returns every kernel of @ref interleave_yuv422p_func the running CPU supports, the
+ * fastest first, for the tests and the benchmarks.
+ */
+std::vector<VideoPackKernel<interleave_yuv422p_func>> get_interleave_yuv422p_kernels();
+
+/**
+ * Interleaves a line of planar 4:2:0 8-bit samples into UYVY, upsampling the
+ * chroma vertically.
+ *
+ * The chroma samples are sited between two luma lines, the chroma of a line is
+ * (3 * near + far + 2) / 4 of the nearest chroma line and the next nearest one.
+ *
+ * @param [out] dst - destination, must hold @p pgroups * 4 bytes;
+ * @param [in] y - 2 * @p pgroups luma samples;
+ * @param [in] cb, cr - @p pgroups samples of the nearest chroma line;
+ * @param [in] cb_far, cr_far - @p pgroups samples of the next nearest chroma line;
+ * @param [in] pgroups - number of pgroups to interleave.
+ */
+typedef void (*interleave_yuv420p_func)(uint8_t *dst, const uint8_t *y, const uint8_t *cb, const uint8_t *cb_far,
+                                        const uint8_t *cr, const uint8_t *cr_far, size_t pgroups);
+
+/**
+ * Portable implementation of @ref interleave_yuv420p_func.
+ */
+void interleave_yuv420p_scalar(uint8_t *dst, const uint8_t *y, const uint8_t *cb, const uint8_t *cb_far,
+                               const uint8_t *cr, const uint8_t *cr_far, size_t pgroups);
+
+/**
+ * Returns the fastest @ref interleave_yuv420p_func supported by the running CPU.
+ *
+ * The selection is done once, on the first call.
+ *
+ * @param [out] kernel_name - if not null, set to a printable name of the selected kernel.
+ */
+interleave_yuv420p_func get_interleave_yuv420p(const char **kernel_name = nullptr);
+
+/**
+ * Returns every kernel of @ref interleave_yuv420p_func the running CPU supports, the
+ * fastest first, for the tests and the benchmarks.
+ */
+std::vector<VideoPackKernel<interleave_yuv420p_func>> get_interleave_yuv420p_kernels();
+
+/**
+ * Chroma lines a luma line of a 4:2:0 frame is interpolated from, see
+ * @ref interleave_yuv420p_func. The lines of a field of interlaced video are
+ * interpolated within the field, the chroma line of a field is between its
+ * luma lines.
+ *
+ * @param [in] line - luma line;
+ * @param [in] chroma_height - number of chroma lines of the frame;
+ * @param [in] interlaced - the frame holds two fields, a single chroma line is
+ *                          shared by both;
+ * @param [out] near - nearest chroma line;
+ * @param [out] far - next nearest chroma line, @p near at the edges.
+ */
+void yuv420p_chroma_lines(int line, int chroma_height, bool interlaced, int &near, int &far);
+
+/**
+ * Repacks a span of a v210 line into SMPTE 2110-20 pgroups.
+ *
+ * v210 stores the 4:2:2 10-bit samples in pgroup order (Cb, Y0, Cr, Y1, ...),
+ * three per little-endian 32-bit word, so every 16 bytes hold 3 pgroups. Lines
+ * are padded to 48 pixels (128 bytes), so whole blocks are always readable.
+ *
+ * @param [out] dst - destination, must hold @p pgroups * 5 bytes;
+ * @param [in] line - start of the v210 line;
+ * @param [in] first_pgroup - first pgroup of the line to repack;
+ * @param [in] pgroups - number of pgroups to repack.
+ */
+typedef void (*repack_v210_func)(uint8_t *dst, const uint8_t *line, size_t first_pgroup, size_t pgroups);
+
+/**
+ * Portable implementation of @ref repack_v210_func.
+ */
+void repack_v210_scalar(uint8_t *dst, const uint8_t *line, size_t first_pgroup, size_t pgroups);
+
+/**
+ * Returns the fastest @ref repack_v210_func supported by the running CPU.
+ *
+ * The selection is done once, on the first call.
+ *
+ * @param [out] kernel_name - if not null, set to a printable name of the selected kernel.
+ */
+repack_v210_func get_repack_v210(const char **kernel_name = nullptr);
+
+/**
+ * Returns every kernel of @ref repack_v210_func the running CPU supports, the
+ * fastest first, for the tests and the benchmarks.
+ */
+std::vector<VideoPackKernel<repack_v210_func>> get_repack_v210_kernels();
+
+#endif // _RIVERMAX_PLAYER_VIDEO_PACK_H_
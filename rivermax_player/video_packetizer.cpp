@@ -0,0 +1,220 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (c) 2024 NVIDIA CORPORATION & AFFILIATES. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+
+#include "video_packetizer.h"
+
+int split_video_packet(int payload_size, int pgroup_size, int pgroups_in_line, int pgroups_left_in_line,
+                       int pgroups_left, int pgroups[2])
+{
+    const int next_line_pgroups = (payload_size - (int)sizeof(srd_header)) / pgroup_size - pgroups_left_in_line;
+    if (pgroups_left > pgroups_left_in_line && next_line_pgroups > 0) {
+        pgroups[0] = pgroups_left_in_line;
+        pgroups[1] = std::min(next_line_pgroups, std::min(pgroups_in_line, pgroups_left - pgroups_left_in_line));
+        return 2;
+    }
+    pgroups[0] = std::min(payload_size / pgroup_size, pgroups_left_in_line);
+    pgroups[1] = 0;
+    return 1;
+}
+
+std::vector<uint16_t> calculate_video_packet_sizes(int width, int height, uint16_t max_payload_size,
+                                                   uint16_t pgroup_size, bool allow_padding)
+{
+    const uint16_t user_header_size = sizeof(rtp_header) + sizeof(uint16_t) + sizeof(srd_header);
+    const int px_groups_in_line = width / PX_IN_422_GRP;
+    const int px_groups_in_frame_field = px_groups_in_line * height;
+
+    std::vector<uint16_t> sizes;
+    int px_groups_sent = 0;
+    while (px_groups_sent < px_groups_in_frame_field) {
+        const int px_groups_left = px_groups_in_frame_field - px_groups_sent;
+        int pgroups[2];
+        const int srds = split_video_packet(max_payload_size - user_header_size, pgroup_size,
+            px_groups_in_line, std::min(px_groups_in_line - px_groups_sent % px_groups_in_line, px_groups_left),
+            px_groups_left, pgroups);
+        const int used_pgroups = pgroups[0] + pgroups[1];
+        if (!used_pgroups) {
+            // a pixel group doesn't fit in a packet, the plan of the sender rejects the sizes
+            break;
+        }
+        uint16_t payload_size = (uint16_t)(user_header_size + (srds - 1) * sizeof(srd_header) +
+            used_pgroups * pgroup_size);
+        px_groups_sent += used_pgroups;
+        if (px_groups_sent == px_groups_in_frame_field && allow_padding && !sizes.empty()) {
+            // add padding to last packet
+            payload_size = std::max(payload_size, sizes.back());
+        }
+        sizes.push_back(payload_size);
+    }
+    return sizes;
+}
+
+void RtpVideoHeaderBuilder::build_packetization_plan()
+{
+    const int data_offset = sizeof(rtp_header) + SIZE_OF_EXTENSION_SEQ + sizeof(srd_header);
+    const int px_grp_in_frame_field = m_px_grp_in_line * m_px_height;
+    int src_pgroup_index = 0;
+
+    m_plan.resize(m_packets_in_frame_field);
+    for (int packet = 0; packet < m_packets_in_frame_field; ++packet) {
+        VideoPacketPlan &plan = m_plan[packet];
+        const int payload_size = m_sizes[packet] - data_offset;
+        const int px_grp_left_in_frame_field = px_grp_in_frame_field - src_pgroup_index;
+        const int px_grp_left_in_line = std::min(m_px_grp_in_line - src_pgroup_index % m_px_grp_in_line,
+                                                 px_grp_left_in_frame_field);
+        int pgroups[2];
+        plan.srd_count = (uint8_t)split_video_packet(payload_size, m_grp_size, m_px_grp_in_line, px_grp_left_in_line,
+                                                     px_grp_left_in_frame_field, pgroups);
+
+        int data_size = (plan.srd_count - 1) * (int)sizeof(srd_header);
+        for (uint8_t i = 0; i < plan.srd_count; ++i) {
+            VideoPacketPlan::SrdSegment &srd = plan.srd[i];
+            srd.src_line = (uint16_t)(src_pgroup_index / m_px_grp_in_line);
+            srd.src_pgroup = (uint16_t)(src_pgroup_index % m_px_grp_in_line);
+            srd.row_number = srd.src_line;
+            srd.offset = (uint16_t)(srd.src_pgroup * PX_IN_422_GRP);
+            srd.length = (uint16_t)(pgroups[i] * m_grp_size);
+            srd.continuation = i + 1 < plan.srd_count;
+            src_pgroup_index += pgroups[i];
+            data_size += srd.length;
+        }
+        // only the last packet of a frame/field may be padded
+        plan.padding_size = (uint16_t)std::max(payload_size - data_size, 0);
+        if (!pgroups[0] || (plan.padding_size && packet + 1 < m_packets_in_frame_field)) {
+            m_plan_valid = false;
+        }
+
+        for (uint8_t i = 0; i < plan.srd_count; ++i) {
+            srd_header *header = reinterpret_cast<srd_header*>(plan.srd_headers) + i;
+            header->srd_length = htobe16(plan.srd[i].length);
+            header->set_srd_row_number(plan.srd[i].row_number);
+            header->set_srd_offset(plan.srd[i].offset);
+            header->c = plan.srd[i].continuation;
+        }
+    }
+    if (src_pgroup_index != px_grp_in_frame_field) {
+        m_plan_valid = false;
+    }
+}
+
+uint8_t *RtpVideoHeaderBuilder::fill_headers(uint8_t *buff, int packet_index)
+{
+    uint32_t rtp_timestamp;
+    const uint32_t seq_num = reserve_packets(packet_index, 1, rtp_timestamp);
+    return write_headers(buff, packet_index, seq_num, rtp_timestamp);
+}
+
+uint32_t RtpVideoHeaderBuilder::reserve_packets(int first_packet, int packets, uint32_t &rtp_timestamp)
+{
+    if (first_packet == 0) {
+        m_rtp_timestamp = (uint32_t)m_timestamp_tick.integer();
+    }
+    if (first_packet + packets == m_packets_in_frame_field) {
+        m_timestamp_tick += m_ticks_per_frame_field;
+    }
+    rtp_timestamp = m_rtp_timestamp;
+    const uint32_t seq_num = m_seq_num;
+    m_seq_num += packets;
+    return seq_num;
+}
+
+uint8_t *RtpVideoHeaderBuilder::write_headers(uint8_t *buff, int packet_index, uint32_t seq_num,
+                                              uint32_t rtp_timestamp) const
+{
+    const VideoPacketPlan &plan = m_plan[packet_index];
+
+    // build RTP header - 12 bytes
+    /*
+    0                   1                   2                   3
+    0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
+    +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+    | V |P|X|  CC   |M|     PT      |            SEQ                |
+    +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+    |                           timestamp                           |
+    +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+    |                           ssrc                                |
+    +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+*/
+    rtp_header* p_rtp_header = m_rtp_template.write(buff, seq_num, rtp_timestamp);
+    if (packet_index == m_packets_in_frame_field - 1) {
+        p_rtp_header->marker = 1;
+    }
+
+    // build SRD header - 8-14 bytes
+    /*
+    0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
+    +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+    |    Extended Sequence Number   |           SRD Length          |
+    +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+    |F|     SRD Row Number          |C|         SRD Offset          |
+    +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+*/
+    uint8_t *buffer = buff + sizeof(rtp_header);
+    *(uint16_t *)buffer = htobe16((uint16_t )(seq_num >> 16));
+    // both SRD slots are copied, the pixel groups overwrite the second one if it is unused
+    srd_header *srd = reinterpret_cast<srd_header*>(buffer + SIZE_OF_EXTENSION_SEQ);
+    memcpy(srd, plan.srd_headers, sizeof(plan.srd_headers));
+    if (m_field) {
+        srd[0].f = 1;
+        srd[1].f = 1;
+    }
+    return reinterpret_cast<uint8_t*>(srd + plan.srd_count);
+}
+
+void RtpVideoHeaderBuilder::patch_headers(uint8_t *buff, int packet_index)
+{
+    if (packet_index == 0) {
+        m_rtp_timestamp = (uint32_t)m_timestamp_tick.integer();
+    }
+    if (packet_index == m_packets_in_frame_field - 1) {
+        m_timestamp_tick += m_ticks_per_frame_field;
+    }
+    rtp_header *p_rtp_header = reinterpret_cast<rtp_header*>(buff);
+    p_rtp_header->payload_type = m_payload_type;
+    p_rtp_header->sequence_number = htobe16((uint16_t)m_seq_num);
+    p_rtp_header->timestamp = htobe32(m_rtp_timestamp);
+    *(uint16_t *)(buff + sizeof(rtp_header)) = htobe16((uint16_t)(m_seq_num >> 16));
+    ++m_seq_num;
+}
+
+static const VideoPacketizerFormat video_packetizer_formats[] = {
+    video_packetizer_format<Yuv422p10lePgroups>(),
+    video_packetizer_format<Yuv422pPgroups>(),
+    video_packetizer_format<Uyvy422Pgroups>(),
+};
+
+// not in the registry, no decoded frame is v210
+const VideoPacketizerFormat v210_packetizer_format = video_packetizer_format<V210Pgroups>();
+
+const VideoPacketizerFormat *find_video_packetizer_format(AVPixelFormat pix_format)
+{
+    for (const VideoPacketizerFormat &format : video_packetizer_formats) {
+        if (format.pix_format == pix_format) {
+            return &format;
+        }
+    }
+    return nullptr;
+}
+
+void VideoPacketizerPool::fill_slice(size_t slice) const
+{
+    const size_t slices = m_pool.slices();
+    const int first = (int)(m_job.packets * slice / slices);
+    const int last = (int)(m_job.packets * (slice + 1) / slices);
+    m_builder.fill_packets(m_job.buff + (size_t)first * m_job.stride, m_job.stride, m_job.first_packet + first,
+                           last - first, m_job.av_frame, m_job.seq_num + first, m_job.rtp_timestamp);
+}
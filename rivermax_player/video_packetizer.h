@@ -0,0 +1,476 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (c) 2024 NVIDIA CORPORATION & AFFILIATES. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _RIVERMAX_PLAYER_VIDEO_PACKETIZER_H_
+#define _RIVERMAX_PLAYER_VIDEO_PACKETIZER_H_
+
+#include <cstdint>
+#include <memory>
+#include <string.h>
+#include <vector>
+
+extern "C" {
+#include <libavutil/frame.h>
+#include <libavutil/pixdesc.h>
+}
+
+#include "defs.h"
+#include "rational.h"
+#include "rt_threads.h"
+#include "rtp_header.h"
+#include "slice_pool.h"
+#include "video_pack.h"
+
+#ifndef unlikely
+#ifdef __GNUC__
+# define unlikely(condition) __builtin_expect(static_cast<bool>(condition), 0)
+#else
+# define unlikely(condition) (condition)
+#endif
+#endif
+
+/**
+ * Splits the pixel groups of a video packet between its SRDs. A packet ends at
+ * the end of a line at the latest, or holds the end of a line and the start of
+ * the next one in two SRDs, so that no SRD crosses a line.
+ *
+ * @param [in] payload_size - bytes of the packet after the RTP header, the
+ *                            extended sequence number and the first SRD header;
+ * @param [in] pgroup_size - bytes of a pixel group;
+ * @param [in] pgroups_in_line - pixel groups of a line;
+ * @param [in] pgroups_left_in_line - pixel groups of the current line not sent yet;
+ * @param [in] pgroups_left - pixel groups of the frame/field not sent yet;
+ * @param [out] pgroups - pixel groups of every SRD.
+ *
+ * @return the number of SRDs, 1 or 2.
+ */
+int split_video_packet(int payload_size, int pgroup_size, int pgroups_in_line, int pgroups_left_in_line,
+                       int pgroups_left, int pgroups[2]);
+
+/**
+ * Splits a frame/field into packets, see @ref split_video_packet.
+ *
+ * @param [in] width - pixels of a line;
+ * @param [in] height - lines of a frame/field;
+ * @param [in] max_payload_size - bytes of a packet after the UDP header;
+ * @param [in] pgroup_size - pixel group size of the packetizer;
+ * @param [in] allow_padding - pads the last packet to the size of the previous one.
+ *
+ * @return the size of every packet of a frame/field, after the UDP header.
+ */
+std::vector<uint16_t> calculate_video_packet_sizes(int width, int height, uint16_t max_payload_size,
+                                                   uint16_t pgroup_size, bool allow_padding);
+
+/**
+ * Layout of a single packet of a video frame/field.
+ *
+ * The layout of all frames/fields of a stream is identical, therefore it is
+ * computed once at stream setup (see @ref RtpVideoHeaderBuilder::build_packetization_plan)
+ * and the per-packet work is reduced to a table lookup and a copy.
+ */
+struct VideoPacketPlan
+{
+    struct SrdSegment
+    {
+        uint16_t row_number;  // SRD row number, line in the frame/field
+        uint16_t offset;      // SRD offset, in pixels
+        uint16_t length;      // SRD length, in bytes
+        uint8_t continuation; // SRD continuation bit
+        uint16_t src_line;    // source line in the frame/field
+        uint16_t src_pgroup;  // first source pixel group in the line
+    };
+
+    SrdSegment srd[2];
+    uint16_t padding_size = 0;  // bytes zeroed after the last pixel group
+    uint8_t srd_count = 0;
+    alignas(srd_header) uint8_t srd_headers[2 * sizeof(srd_header)] = {}; // wire format of srd, F bit is patched per field
+};
+
+/**
+ * Common part of the video packetizers: stream geometry, the packetization plan
+ * and the RTP/SRD headers. The pixel data is copied by @ref RtpVideoPacketizer,
+ * which is specialized per pixel format and scan type.
+ */
+struct RtpVideoHeaderBuilder
+{
+    RtpVideoHeaderBuilder(int px_height, int px_width, int packets_in_frame_field, uint16_t bit_size,
+                          uint16_t px_grp_size, double fps, uint8_t payload_type, const Rational &timestamp_tick,
+                          std::vector<uint16_t> &sizes,
+                          VIDEO_TYPE video_type)
+    : m_px_height(px_height)
+    , m_px_width(px_width)
+    , m_packets_in_frame_field(packets_in_frame_field)
+    , m_bit_depth(bit_size)
+    , m_grp_size(px_grp_size)
+    , m_px_grp_in_line(px_width / PX_IN_422_GRP)
+    , m_fps(fps)
+    , m_payload_type(payload_type)
+    , m_timestamp_tick(timestamp_tick)
+    , m_ticks_per_frame_field(Rational(90000) / rational_approximation(fps) / (video_type != VIDEO_TYPE::PROGRESSIVE ? 2 : 1))
+    , m_sizes(std::move(sizes))
+    , m_video_type(video_type)
+    , m_rtp_template(payload_type, 0x0eb51dbd) // simulated ssrc
+    {
+        build_packetization_plan();
+    }
+    virtual ~RtpVideoHeaderBuilder() = default;
+
+    virtual void fill_packet(uint8_t *buff, int packet_index, const AVFrame *av_frame) = 0;
+    /**
+     * Fills @p packets consecutive packets of the frame/field, starting at
+     * @p first_packet, without changing the builder state, so that several
+     * threads can fill the packets of the same frame/field.
+     *
+     * @param [out] buff - stride of the first packet;
+     * @param [in] stride - bytes between consecutive packets;
+     * @param [in] first_packet - index of the first packet in the frame/field;
+     * @param [in] packets - number of packets to fill;
+     * @param [in] av_frame - frame to packetize;
+     * @param [in] seq_num - sequence number of the first packet;
+     * @param [in] rtp_timestamp - RTP timestamp of the frame/field.
+     */
+    virtual void fill_packets(uint8_t *buff, uint16_t stride, int first_packet, int packets, const AVFrame *av_frame,
+                              uint32_t seq_num, uint32_t rtp_timestamp) const = 0;
+    /**
+     * Accounts for @p packets packets starting at @p first_packet as if they
+     * were filled one by one and returns the sequence number of the first one,
+     * see @ref fill_packets.
+     *
+     * @param [out] rtp_timestamp - RTP timestamp of the packets.
+     */
+    uint32_t reserve_packets(int first_packet, int packets, uint32_t &rtp_timestamp);
+    /**
+     * Rewrites the payload type, sequence number and timestamp of a packet
+     * copied from a pre-packetized file, the rest of the packet is kept.
+     */
+    void patch_headers(uint8_t *buff, int packet_index);
+    /**
+     * Returns false if the packet sizes don't send every pixel group of a
+     * frame/field exactly once, in lines, see @ref split_video_packet.
+     */
+    bool plan_valid() const { return m_plan_valid; }
+    uint32_t m_seq_num = 0;
+    int m_px_height;
+    int m_px_width;
+    int m_packets_in_frame_field;
+    uint16_t m_bit_depth;
+    uint16_t m_grp_size;
+    uint16_t m_px_grp_in_line;
+    double m_fps;
+    uint8_t m_payload_type;
+    Rational m_timestamp_tick;
+    Rational m_ticks_per_frame_field;
+    std::vector<uint16_t> m_sizes;
+    std::vector<VideoPacketPlan> m_plan;
+    VIDEO_TYPE m_video_type = VIDEO_TYPE::NON_VIDEO;
+    bool m_field = false;
+    const RtpHeaderTemplate m_rtp_template;
+    uint32_t m_rtp_timestamp = 0;
+
+protected:
+    /**
+     * Writes the RTP header, the extended sequence number and the SRD headers
+     * of the packet and returns the position of its first pixel group.
+     */
+    uint8_t *fill_headers(uint8_t *buff, int packet_index);
+    /**
+     * @ref fill_headers with the given sequence number and timestamp, the
+     * builder state is not changed.
+     */
+    uint8_t *write_headers(uint8_t *buff, int packet_index, uint32_t seq_num, uint32_t rtp_timestamp) const;
+
+private:
+    /**
+     * Walks the packet sizes of a frame/field once and records the SRD layout
+     * of every packet, split as by @ref split_video_packet, and the last packet
+     * padding.
+     */
+    void build_packetization_plan();
+    bool m_plan_valid = true;
+};
+
+/*
+ * Pixel group formats of the video packetizer.
+ *
+ * Each format describes its 2110-20 pgroup (size and bit depth) and copies a span
+ * of pgroups of one frame line to a packet. To send a new pixel format, add a
+ * format struct here and an entry to video_packetizer_formats.
+ */
+struct Yuv422p10lePgroups
+{
+    static constexpr AVPixelFormat pix_format = AVPixelFormat::AV_PIX_FMT_YUV422P10LE;
+    static constexpr uint16_t bit_depth = 10;
+    static constexpr uint16_t pgroup_size = BYTES_IN_422_10B_GRP;
+
+    static const char *name()
+    {
+        return av_get_pix_fmt_name(pix_format);
+    }
+
+    static const char *kernel_name()
+    {
+        const char *name;
+        get_pack_yuv422p10le(&name);
+        return name;
+    }
+
+    void copy(uint8_t *dst, const AVFrame *av_frame, int line, int first_pgroup, int pgroups) const
+    {
+        const uint16_t *y = reinterpret_cast<const uint16_t*>(av_frame->data[0] + line * av_frame->linesize[0]) +
+            first_pgroup * PX_IN_422_GRP;
+        const uint16_t *cb = reinterpret_cast<const uint16_t*>(av_frame->data[1] + line * av_frame->linesize[1]) +
+            first_pgroup;
+        const uint16_t *cr = reinterpret_cast<const uint16_t*>(av_frame->data[2] + line * av_frame->linesize[2]) +
+            first_pgroup;
+        m_pack(dst, y, cb, cr, pgroups);
+    }
+
+    pack_yuv422p10le_func m_pack = get_pack_yuv422p10le();
+};
+
+struct Yuv422pPgroups
+{
+    static constexpr AVPixelFormat pix_format = AVPixelFormat::AV_PIX_FMT_YUV422P;
+    static constexpr uint16_t bit_depth = 8;
+    static constexpr uint16_t pgroup_size = BYTES_IN_422_8B_GRP;
+
+    static const char *name()
+    {
+        return av_get_pix_fmt_name(pix_format);
+    }
+
+    static const char *kernel_name()
+    {
+        const char *name;
+        get_interleave_yuv422p(&name);
+        return name;
+    }
+
+    void copy(uint8_t *dst, const AVFrame *av_frame, int line, int first_pgroup, int pgroups) const
+    {
+        const uint8_t *y = av_frame->data[0] + line * av_frame->linesize[0] + first_pgroup * PX_IN_422_GRP;
+        const uint8_t *cb = av_frame->data[1] + line * av_frame->linesize[1] + first_pgroup;
+        const uint8_t *cr = av_frame->data[2] + line * av_frame->linesize[2] + first_pgroup;
+        m_interleave(dst, y, cb, cr, pgroups);
+    }
+
+    interleave_yuv422p_func m_interleave = get_interleave_yuv422p();
+};
+
+struct Uyvy422Pgroups
+{
+    static constexpr AVPixelFormat pix_format = AVPixelFormat::AV_PIX_FMT_UYVY422;
+    static constexpr uint16_t bit_depth = 8;
+    static constexpr uint16_t pgroup_size = BYTES_IN_422_8B_GRP;
+
+    static const char *name()
+    {
+        return av_get_pix_fmt_name(pix_format);
+    }
+
+    static const char *kernel_name()
+    {
+        return "memcpy";
+    }
+
+    void copy(uint8_t *dst, const AVFrame *av_frame, int line, int first_pgroup, int pgroups) const
+    {
+        memcpy(dst, av_frame->data[0] + line * av_frame->linesize[0] + first_pgroup * pgroup_size,
+               pgroups * pgroup_size);
+    }
+};
+
+/*
+ * FFmpeg has no pixel format for v210, its frames only come from raw video files
+ * (see RawVideoFile) with the v210 lines in data[0].
+ */
+struct V210Pgroups
+{
+    static constexpr AVPixelFormat pix_format = AVPixelFormat::AV_PIX_FMT_NONE;
+    static constexpr uint16_t bit_depth = 10;
+    static constexpr uint16_t pgroup_size = BYTES_IN_422_10B_GRP;
+
+    static const char *name()
+    {
+        return "v210";
+    }
+
+    static const char *kernel_name()
+    {
+        const char *name;
+        get_repack_v210(&name);
+        return name;
+    }
+
+    void copy(uint8_t *dst, const AVFrame *av_frame, int line, int first_pgroup, int pgroups) const
+    {
+        m_repack(dst, av_frame->data[0] + line * av_frame->linesize[0], first_pgroup, pgroups);
+    }
+
+    repack_v210_func m_repack = get_repack_v210();
+};
+
+/**
+ * Video packetizer specialized for a pixel group format and a scan type,
+ * the per-packet path has no format or scan type checks.
+ */
+template <typename PgroupFormat, bool Interlaced>
+struct RtpVideoPacketizer : public RtpVideoHeaderBuilder
+{
+    RtpVideoPacketizer(int px_height, int px_width, int packets_in_frame_field, double fps,
+                       uint8_t payload_type, const Rational &timestamp_tick, std::vector<uint16_t> &sizes)
+    : RtpVideoHeaderBuilder(px_height, px_width, packets_in_frame_field, PgroupFormat::bit_depth,
+                            PgroupFormat::pgroup_size, fps, payload_type, timestamp_tick, sizes,
+                            Interlaced ? VIDEO_TYPE::INTERLACE : VIDEO_TYPE::PROGRESSIVE)
+    {
+    }
+
+    void fill_packet(uint8_t *buff, int packet_index, const AVFrame *av_frame) override
+    {
+        fill_payload(fill_headers(buff, packet_index), packet_index, av_frame);
+    }
+
+    void fill_packets(uint8_t *buff, uint16_t stride, int first_packet, int packets, const AVFrame *av_frame,
+                      uint32_t seq_num, uint32_t rtp_timestamp) const override
+    {
+        for (int packet = 0; packet < packets; ++packet, buff += stride) {
+            const int packet_index = first_packet + packet;
+            fill_payload(write_headers(buff, packet_index, seq_num + packet, rtp_timestamp), packet_index, av_frame);
+        }
+    }
+
+    void fill_payload(uint8_t *data, int packet_index, const AVFrame *av_frame) const
+    {
+        const VideoPacketPlan &plan = m_plan[packet_index];
+
+        // copy data from avFrame to buffer
+        for (uint8_t i = 0; i < plan.srd_count; ++i) {
+            const VideoPacketPlan::SrdSegment &segment = plan.srd[i];
+            // fields are interleaved in the frame
+            const int line = Interlaced ? segment.src_line * 2 + m_field : segment.src_line;
+            m_pgroups.copy(data, av_frame, line, segment.src_pgroup, segment.length / PgroupFormat::pgroup_size);
+            data += segment.length;
+        }
+        if (unlikely(plan.padding_size)) {
+            memset(data, 0, plan.padding_size);
+        }
+    }
+
+    PgroupFormat m_pgroups;
+};
+
+/**
+ * Registry entry of a pixel format the video sender can packetize as is.
+ */
+struct VideoPacketizerFormat
+{
+    const char *name;
+    AVPixelFormat pix_format;
+    uint16_t bit_depth;
+    uint16_t pgroup_size;
+    const char *(*kernel_name)();
+    std::unique_ptr<RtpVideoHeaderBuilder> (*create)(VIDEO_TYPE video_type, int px_height, int px_width,
+                                                     int packets_in_frame_field, double fps, uint8_t payload_type,
+                                                     const Rational &timestamp_tick, std::vector<uint16_t> &sizes);
+};
+
+template <typename PgroupFormat>
+std::unique_ptr<RtpVideoHeaderBuilder> create_video_packetizer(VIDEO_TYPE video_type, int px_height, int px_width,
+                                                               int packets_in_frame_field, double fps,
+                                                               uint8_t payload_type, const Rational &timestamp_tick,
+                                                               std::vector<uint16_t> &sizes)
+{
+    if (video_type != VIDEO_TYPE::PROGRESSIVE) {
+        return std::unique_ptr<RtpVideoHeaderBuilder>(new RtpVideoPacketizer<PgroupFormat, true>(
+            px_height, px_width, packets_in_frame_field, fps, payload_type, timestamp_tick, sizes));
+    }
+    return std::unique_ptr<RtpVideoHeaderBuilder>(new RtpVideoPacketizer<PgroupFormat, false>(
+        px_height, px_width, packets_in_frame_field, fps, payload_type, timestamp_tick, sizes));
+}
+
+template <typename PgroupFormat>
+VideoPacketizerFormat video_packetizer_format()
+{
+    return { PgroupFormat::name(), PgroupFormat::pix_format, PgroupFormat::bit_depth, PgroupFormat::pgroup_size,
+             PgroupFormat::kernel_name, create_video_packetizer<PgroupFormat> };
+}
+
+// not in the registry, no decoded frame is v210
+extern const VideoPacketizerFormat v210_packetizer_format;
+
+/**
+ * Returns the registry entry of @p pix_format or nullptr if frames of this
+ * format must be converted (see scale_video) before they can be sent.
+ */
+const VideoPacketizerFormat *find_video_packetizer_format(AVPixelFormat pix_format);
+
+// a packetizer helper spins that long for the next chunk before it sleeps
+static constexpr int64_t VIDEO_PACKETIZER_SPIN_NS = 200000;
+
+/**
+ * Helper threads filling the packets of a video chunk together with the video
+ * sender: the chunk is split in one slice per thread, the sender fills the
+ * first slice and waits for the helpers before it commits the chunk, so the
+ * chunks are still committed in order by the sender only.
+ */
+class VideoPacketizerPool
+{
+public:
+    /**
+     * @param [in] builder - packetizer of the stream, must outlive the pool;
+     * @param [in] threads - number of helper threads;
+     * @param [in] cpus - CPU of each helper thread, can be empty.
+     */
+    VideoPacketizerPool(const RtpVideoHeaderBuilder &builder, size_t threads, const std::vector<int> &cpus)
+        : m_builder(builder)
+        , m_fill_slice([this](size_t slice) { fill_slice(slice); })
+        , m_pool(threads, cpus, VIDEO_PACKETIZER_SPIN_NS)
+    { }
+
+    /**
+     * Same as @ref RtpVideoHeaderBuilder::fill_packets, returns once all the
+     * packets are filled.
+     */
+    void fill_packets(uint8_t *buff, uint16_t stride, int first_packet, int packets, const AVFrame *av_frame,
+                      uint32_t seq_num, uint32_t rtp_timestamp)
+    {
+        m_job = { buff, stride, first_packet, packets, av_frame, seq_num, rtp_timestamp };
+        m_pool.run(m_fill_slice);
+    }
+
+private:
+    struct Job
+    {
+        uint8_t *buff;
+        uint16_t stride;
+        int first_packet;
+        int packets;
+        const AVFrame *av_frame;
+        uint32_t seq_num;
+        uint32_t rtp_timestamp;
+    };
+
+    void fill_slice(size_t slice) const;
+
+    const RtpVideoHeaderBuilder &m_builder;
+    Job m_job = {};
+    const std::function<void(size_t)> m_fill_slice;
+    // stops the helpers first
+    SlicePool m_pool;
+};
+
+#endif // _RIVERMAX_PLAYER_VIDEO_PACKETIZER_H_
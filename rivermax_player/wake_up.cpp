@@ -0,0 +1,223 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (c) 2024 NVIDIA CORPORATION & AFFILIATES. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+
+#ifdef __linux__
+#include <sys/prctl.h>
+#include <time.h>
+#endif
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64)
+#define WAKE_UP_TSC
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#include <x86intrin.h>
+#endif
+#endif
+
+#include "wake_up.h"
+
+using namespace std::chrono;
+
+// bounds of the spin window, the part of a wait spent spinning instead of sleeping
+static const int64_t min_spin_ns = 20000;
+static const int64_t max_spin_ns = 250000;
+// the spin window is the kernel wake-up latency plus this margin
+static const int64_t spin_margin_ns = 10000;
+
+static uint64_t (*g_get_time_ns)(void*) = nullptr;
+static bool g_realtime = false;
+static bool g_use_tsc = false;
+static double g_ticks_per_ns = 1.0;
+
+static int64_t steady_ns()
+{
+    return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+static inline uint64_t spin_ticks()
+{
+#ifdef WAKE_UP_TSC
+    if (g_use_tsc) {
+        return __rdtsc();
+    }
+#endif
+    return (uint64_t)steady_ns();
+}
+
+static inline void spin_pause()
+{
+#ifdef WAKE_UP_TSC
+    _mm_pause();
+#endif
+}
+
+#ifdef WAKE_UP_TSC
+static bool has_invariant_tsc()
+{
+    unsigned int regs[4] = {};
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0x80000000);
+    if ((unsigned int)info[0] < 0x80000007) {
+        return false;
+    }
+    __cpuid(info, 0x80000007);
+    regs[3] = (unsigned int)info[3];
+#else
+    if (__get_cpuid_max(0x80000000, nullptr) < 0x80000007 ||
+        !__get_cpuid(0x80000007, &regs[0], &regs[1], &regs[2], &regs[3])) {
+        return false;
+    }
+#endif
+    // CPUID.80000007H:EDX[8], the TSC runs at a constant rate in all states
+    return regs[3] & (1 << 8);
+}
+#endif
+
+static void calibrate_spin_clock()
+{
+#ifdef WAKE_UP_TSC
+    if (!has_invariant_tsc()) {
+        std::cout << "Wake-up spin clock: no invariant TSC, using the steady clock" << std::endl;
+        return;
+    }
+    const int64_t start_ns = steady_ns();
+    const uint64_t start_ticks = __rdtsc();
+    std::this_thread::sleep_for(milliseconds{20});
+    const int64_t end_ns = steady_ns();
+    const uint64_t end_ticks = __rdtsc();
+    g_ticks_per_ns = (double)(end_ticks - start_ticks) / (end_ns - start_ns);
+    g_use_tsc = g_ticks_per_ns > 0;
+    std::cout << "Wake-up spin clock: TSC at " << std::fixed << std::setprecision(3) << g_ticks_per_ns <<
+        " GHz" << std::defaultfloat << std::endl;
+#endif
+}
+
+void wake_up_set_clock(uint64_t (*get_time_ns)(void*), bool realtime)
+{
+    static bool calibrated = false;
+    if (!calibrated) {
+        calibrate_spin_clock();
+        calibrated = true;
+    }
+    g_get_time_ns = get_time_ns;
+    g_realtime = realtime;
+}
+
+/**
+ * Sleeps @p sleep_ns in the kernel, from @p now_ns of the wake-up clock.
+ */
+static void kernel_sleep(uint64_t now_ns, int64_t sleep_ns)
+{
+#ifdef __linux__
+    // the wake-up clock is read against the kernel clock each time, it may drift from it
+    const clockid_t clock = g_realtime ? CLOCK_REALTIME : CLOCK_MONOTONIC;
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    const int64_t offset_ns = (int64_t)(now_ns - g_get_time_ns(nullptr));
+    int64_t target_ns = ts.tv_sec * 1000000000LL + ts.tv_nsec + sleep_ns + offset_ns;
+    ts.tv_sec = target_ns / 1000000000LL;
+    ts.tv_nsec = target_ns % 1000000000LL;
+    while (clock_nanosleep(clock, TIMER_ABSTIME, &ts, nullptr) == EINTR) {
+    }
+#else
+    (void)now_ns;
+    std::this_thread::sleep_for(nanoseconds{sleep_ns});
+#endif
+}
+
+int64_t wake_up_at(uint64_t time_ns)
+{
+    static thread_local int64_t spin_ns = 100000;
+#ifdef __linux__
+    static thread_local bool slack_set = false;
+    if (!slack_set) {
+        // the kernel may delay the timers of the thread by its timer slack, 50 us by default
+        prctl(PR_SET_TIMERSLACK, 1UL, 0UL, 0UL, 0UL);
+        slack_set = true;
+    }
+#endif
+
+    uint64_t now_ns = g_get_time_ns(nullptr);
+    int64_t remaining_ns = (int64_t)(time_ns - now_ns);
+    while (remaining_ns > spin_ns) {
+        const int64_t sleep_ns = remaining_ns - spin_ns;
+        kernel_sleep(now_ns, sleep_ns);
+        now_ns = g_get_time_ns(nullptr);
+        remaining_ns = (int64_t)(time_ns - now_ns);
+        // grow the window at once when the kernel is late, shrink it slowly
+        const int64_t latency_ns = spin_ns - remaining_ns;
+        const int64_t window_ns = std::max(min_spin_ns, std::min(max_spin_ns, latency_ns + spin_margin_ns));
+        spin_ns = window_ns > spin_ns ? window_ns : spin_ns - (spin_ns - window_ns) / 16;
+    }
+    if (remaining_ns > 0) {
+        const uint64_t end_ticks = spin_ticks() + (uint64_t)(remaining_ns * g_ticks_per_ns);
+        while (spin_ticks() < end_ticks) {
+            spin_pause();
+        }
+    }
+    return (int64_t)(g_get_time_ns(nullptr) - time_ns);
+}
+
+void WakeUpHistogram::add(int64_t error_ns)
+{
+    ++m_wake_ups;
+    if (error_ns < 0) {
+        ++m_early;
+        error_ns = 0;
+    }
+    int bucket = 0;
+    for (uint64_t error = (uint64_t)error_ns; error && bucket < buckets - 1; error >>= 1) {
+        ++bucket;
+    }
+    ++m_counts[bucket];
+    m_max_error_ns = std::max(m_max_error_ns, (uint64_t)error_ns);
+}
+
+uint64_t WakeUpHistogram::percentile_ns(double fraction) const
+{
+    const uint64_t rank = (uint64_t)(fraction * m_wake_ups);
+    uint64_t count = 0;
+    for (int bucket = 0; bucket < buckets; ++bucket) {
+        count += m_counts[bucket];
+        if (count > rank || count == m_wake_ups) {
+            return bucket ? std::min(m_max_error_ns, ((uint64_t)1 << bucket) - 1) : 0;
+        }
+    }
+    return m_max_error_ns;
+}
+
+void WakeUpHistogram::print(std::ostream &os) const
+{
+    os << m_wake_ups << " wake-ups";
+    if (!m_wake_ups) {
+        return;
+    }
+    os << ", error p50 <= " << std::fixed << std::setprecision(1) << percentile_ns(0.5) / 1e3 << " us, p99 <= " <<
+        percentile_ns(0.99) / 1e3 << " us, max " << m_max_error_ns / 1e3 << " us" << std::defaultfloat;
+    if (m_early) {
+        os << ", " << m_early << " early";
+    }
+}
@@ -0,0 +1,74 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (c) 2024 NVIDIA CORPORATION & AFFILIATES. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _RIVERMAX_PLAYER_WAKE_UP_H_
+#define _RIVERMAX_PLAYER_WAKE_UP_H_
+
+#include <cstdint>
+#include <ostream>
+
+/**
+ * Histogram of the wake-up errors of a stream: how long after the time it
+ * asked for its sender thread resumed.
+ */
+class WakeUpHistogram
+{
+public:
+    void add(int64_t error_ns);
+    uint64_t wake_ups() const { return m_wake_ups; }
+    /**
+     * Upper bound of the error of the fraction @p fraction of the wake-ups, the
+     * wake-ups before their time count as on time.
+     */
+    uint64_t percentile_ns(double fraction) const;
+    /**
+     * Prints the median, 99th percentile and maximal error and the early wake-ups.
+     */
+    void print(std::ostream &os) const;
+
+private:
+    // bucket i > 0 counts the errors in [2^(i-1), 2^i) ns, bucket 0 the wake-ups on time
+    static constexpr int buckets = 40;
+    uint64_t m_counts[buckets] = {};
+    uint64_t m_wake_ups = 0;
+    uint64_t m_early = 0;
+    uint64_t m_max_error_ns = 0;
+};
+
+/**
+ * Sets the clock the wake-up times are given in and calibrates the spin clock,
+ * must be called before the sender threads start.
+ *
+ * @param [in] get_time_ns - current time of the clock;
+ * @param [in] realtime - the clock is the system real-time clock at a constant
+ *                        offset, the kernel sleeps against it directly, the
+ *                        monotonic clock is used otherwise.
+ */
+void wake_up_set_clock(uint64_t (*get_time_ns)(void*), bool realtime);
+
+/**
+ * Waits until @p time_ns: sleeps in the kernel with an absolute timeout until
+ * shortly before it, then spins on the TSC for the rest. The spin window of the
+ * calling thread follows the kernel wake-up latency it sees.
+ *
+ * @param [in] time_ns - time to wake up at, of the clock set by @ref wake_up_set_clock.
+ *
+ * @return the wake-up error: the time the call returned at minus @p time_ns.
+ */
+int64_t wake_up_at(uint64_t time_ns);
+
+#endif // _RIVERMAX_PLAYER_WAKE_UP_H_
@@ -30,18 +30,25 @@ public:
     RationalE(const std::string& what): std::runtime_error(what) {}
 };
 
+/**
+ * Non-negative rational number: an integer part and a reduced proper fraction.
+ *
+ * All the operations are exact, the intermediate products are computed on 128
+ * bits, and throw RationalE when the result doesn't fit. The class is a literal
+ * type, so the media timings built from it can be constant expressions.
+ */
 class Rational {
 public:
-    Rational();
-    Rational(uint64_t integer, uint64_t numerator, uint64_t denominator);
-    explicit Rational(uint64_t integer);
-    Rational(uint64_t numerator, uint64_t denominator);
-    Rational(const Rational& num);
+    constexpr Rational() : m_integer(0), m_numerator(0), m_denominator(1) {}
+    constexpr Rational(uint64_t integer, uint64_t numerator, uint64_t denominator)
+        : Rational(integer, numerator, denominator, gcd(numerator, checked_denominator(numerator, denominator)))
+    {
+    }
+    constexpr explicit Rational(uint64_t integer) : m_integer(integer), m_numerator(0), m_denominator(1) {}
+    constexpr Rational(uint64_t numerator, uint64_t denominator) : Rational(0, numerator, denominator) {}
 
     friend std::ostream& operator<<(std::ostream& os, const Rational& num);
 
-    Rational& operator=(const Rational& num);
-
     template <typename T, typename = typename std::enable_if<std::is_integral<T>::value>::type>
     Rational& operator=(T n)
     {
@@ -52,30 +59,64 @@ public:
         return *this;
     }
 
-    Rational operator+(const Rational& num) const;
-    Rational operator-(const Rational& num) const;
-    Rational operator*(const Rational& num) const;
-    Rational operator/(const Rational& num) const;
+    constexpr Rational operator+(const Rational& num) const
+    {
+        return add(*this, num, lcd(m_denominator, num.m_denominator));
+    }
+
+    constexpr Rational operator-(const Rational& num) const
+    {
+        return subtract(*this, num, lcd(m_denominator, num.m_denominator));
+    }
 
-    Rational& operator+=(const Rational& num);
-    Rational& operator-=(const Rational& num);
-    Rational& operator*=(const Rational& num);
-    Rational& operator/=(const Rational& num);
+    /*
+     * (i1 + n1/d1) * (i2 + n2/d2) = i1*i2 + i1*n2/d2 + i2*n1/d1 + n1*n2/(d1*d2)
+     */
+    constexpr Rational operator*(const Rational& num) const
+    {
+        return Rational(checked_mul(m_integer, num.m_integer)) + num.fraction() * m_integer +
+            fraction() * num.m_integer + multiply_fractions(*this, num);
+    }
+
+    constexpr Rational operator/(const Rational& num) const
+    {
+        return *this * num.reciprocal();
+    }
+
+    Rational& operator+=(const Rational& num)
+    {
+        return *this = *this + num;
+    }
+
+    Rational& operator-=(const Rational& num)
+    {
+        return *this = *this - num;
+    }
+
+    Rational& operator*=(const Rational& num)
+    {
+        return *this = *this * num;
+    }
+
+    Rational& operator/=(const Rational& num)
+    {
+        return *this = *this / num;
+    }
 
     template <typename T, typename = typename std::enable_if<std::is_integral<T>::value>::type>
-    Rational operator+(T n) const
+    constexpr Rational operator+(T n) const
     {
-        return *this + Rational(n);
+        return Rational(checked_add(m_integer, n), m_numerator, m_denominator, 1);
     }
 
     template <typename T, typename = typename std::enable_if<std::is_integral<T>::value>::type>
     Rational& operator+=(T n)
     {
-        return *this += Rational(n);
+        return *this = *this + n;
     }
 
     template <typename T, typename = typename std::enable_if<std::is_integral<T>::value>::type>
-    Rational operator-(T n) const
+    constexpr Rational operator-(T n) const
     {
         return *this - Rational(n);
     }
@@ -83,23 +124,27 @@ public:
     template <typename T, typename = typename std::enable_if<std::is_integral<T>::value>::type>
     Rational& operator-=(T n)
     {
-        return *this -= Rational(n);
+        return *this = *this - n;
     }
 
+    /*
+     * (i + n/d) * k = i*k + floor(n*k/d) + (n*k mod d)/d
+     */
     template <typename T, typename = typename std::enable_if<std::is_integral<T>::value>::type>
-    Rational operator*(T n) const
+    constexpr Rational operator*(T n) const
     {
-        return *this * Rational(n);
+        return Rational(checked_add(checked_mul(m_integer, n), mul_div(m_numerator, n, m_denominator)),
+                        mul_mod(m_numerator, n, m_denominator), m_denominator);
     }
 
     template <typename T, typename = typename std::enable_if<std::is_integral<T>::value>::type>
     Rational& operator*=(T n)
     {
-        return *this *= Rational(n);
+        return *this = *this * n;
     }
 
     template <typename T, typename = typename std::enable_if<std::is_integral<T>::value>::type>
-    Rational operator/(T n) const
+    constexpr Rational operator/(T n) const
     {
         return *this / Rational(n);
     }
@@ -107,172 +152,347 @@ public:
     template <typename T, typename = typename std::enable_if<std::is_integral<T>::value>::type>
     Rational& operator/=(const T n)
     {
-        return *this /= Rational(n);
+        return *this = *this / n;
     }
 
-    bool operator==(const Rational& num) const;
-    bool operator!=(const Rational& num) const;
-    bool operator<(const Rational& num) const;
+    constexpr bool operator==(const Rational& num) const
+    {
+        return m_integer == num.m_integer && m_numerator == num.m_numerator && m_denominator == num.m_denominator;
+    }
+
+    constexpr bool operator!=(const Rational& num) const
+    {
+        return !(*this == num);
+    }
+
+    constexpr bool operator<(const Rational& num) const
+    {
+        return m_integer != num.m_integer ? m_integer < num.m_integer :
+            wide_less(m_numerator, num.m_denominator, num.m_numerator, m_denominator);
+    }
 
-    bool operator>(const Rational& num) const
+    constexpr bool operator>(const Rational& num) const
     {
         return (num < *this);
     }
 
-    bool operator<=(const Rational& num) const
+    constexpr bool operator<=(const Rational& num) const
     {
         return !(num < *this);
     }
 
-    bool operator>=(const Rational& num) const
+    constexpr bool operator>=(const Rational& num) const
     {
         return (num <= *this);
     }
 
     template <typename T, typename = typename std::enable_if<std::is_integral<T>::value>::type>
-    bool operator==(T n) const
+    constexpr bool operator==(T n) const
     {
         return this->m_integer == n && !this->m_numerator;
     }
 
     template <typename T, typename = typename std::enable_if<std::is_integral<T>::value>::type>
-    bool operator!=(T n) const
+    constexpr bool operator!=(T n) const
     {
         return !(*this == n);
     }
 
     template <typename T, typename = typename std::enable_if<std::is_integral<T>::value>::type>
-    bool operator<(T n) const
+    constexpr bool operator<(T n) const
     {
         return (this->m_integer < n);
     }
 
     template <typename T, typename = typename std::enable_if<std::is_integral<T>::value>::type>
-    bool operator<=(T n) const
+    constexpr bool operator<=(T n) const
     {
-        if (n < this->m_integer)
-            return false;
-
-        return (this->m_integer < n || !this->m_numerator);
+        return !(n < this->m_integer) && (this->m_integer < n || !this->m_numerator);
     }
 
     template <typename T, typename = typename std::enable_if<std::is_integral<T>::value>::type>
-    bool operator>(T n) const
+    constexpr bool operator>(T n) const
     {
-        if (this->m_integer < n)
-            return false;
-
-        return this->m_integer > n || this->m_numerator;
+        return !(this->m_integer < n) && (this->m_integer > n || this->m_numerator);
     }
 
     template <typename T, typename = typename std::enable_if<std::is_integral<T>::value>::type>
-    bool operator>=(T n) const
+    constexpr bool operator>=(T n) const
     {
         return (this->m_integer >= n);
     }
 
-    uint64_t integer() const
+    /**
+     * Integer part, the number rounded down.
+     */
+    constexpr uint64_t integer() const
     {
         return m_integer;
     }
 
-    uint64_t numerator() const
+    constexpr uint64_t numerator() const
     {
         return m_numerator;
     }
 
-    uint64_t denominator() const
+    constexpr uint64_t denominator() const
     {
         return m_denominator;
     }
 
-    explicit operator bool() const
+    /**
+     * The number rounded to the nearest integer, halves up.
+     */
+    constexpr uint64_t round() const
+    {
+        return m_integer + (m_numerator >= m_denominator - m_numerator ? 1 : 0);
+    }
+
+    constexpr explicit operator bool() const
     {
         return m_integer || m_numerator;
     }
 
+    /**
+     * floor(a * b / c), with a 128-bit intermediate product.
+     *
+     * @throw RationalE if the result doesn't fit in 64 bits.
+     */
+    static constexpr uint64_t mul_div(uint64_t a, uint64_t b, uint64_t c)
+    {
+        return mul_high(a, b) < c ? divide_wide(mul_high(a, b), a * b, c) :
+            throw RationalE{"Rational: overflow in " + std::to_string(a) + " * " + std::to_string(b) + " / " +
+                            std::to_string(c)};
+    }
+
+    /**
+     * (a * b) mod c, with a 128-bit intermediate product.
+     */
+    static constexpr uint64_t mul_mod(uint64_t a, uint64_t b, uint64_t c)
+    {
+        // the remainder is below c, the low 64 bits of the difference are exact
+        return a * b - mul_div(a, b, c) * c;
+    }
+
 private:
-    static uint64_t gcd(uint64_t i1, uint64_t i2);
-    static uint64_t lcd(uint64_t i1, uint64_t i2);
-    static uint64_t reduce_two(uint64_t& i1, uint64_t& i2);
-    static void reduce(uint64_t& i1, uint64_t& i2);
-
-    void init(uint64_t integer, uint64_t numerator, uint64_t denominator);
-    void init();
-    Rational mul_div(const Rational& num1, const Rational& num2, bool is_multiply) const;
-    Rational& mul_div_assign(const Rational& num1, const Rational& num2, bool is_multiply);
-    Rational add_sub(const Rational& num1, const Rational& num2, bool is_add) const;
-    Rational& add_sub_assign(const Rational& num, bool is_add);
+    /*
+     * @p divisor is gcd(@p numerator, @p denominator), the fraction is reduced by it
+     */
+    constexpr Rational(uint64_t integer, uint64_t numerator, uint64_t denominator, uint64_t divisor)
+        : m_integer(checked_add(integer, numerator / denominator))
+        , m_numerator(numerator % denominator / divisor)
+        , m_denominator(denominator / divisor)
+    {
+    }
+
+    constexpr Rational fraction() const
+    {
+        return Rational(0, m_numerator, m_denominator, 1);
+    }
+
+    constexpr Rational reciprocal() const
+    {
+        return Rational(0, m_denominator, checked_add(checked_mul(m_integer, m_denominator), m_numerator));
+    }
+
+    static constexpr uint64_t checked_denominator(uint64_t numerator, uint64_t denominator)
+    {
+        return denominator ? denominator :
+            throw RationalE{"Rational: denominator cannot be zero: " + std::to_string(numerator) + " / 0"};
+    }
+
+    /*
+     * Calculates Greatest common divisor
+     * https://en.wikipedia.org/wiki/Greatest_common_divisor
+     */
+    static constexpr uint64_t gcd(uint64_t a, uint64_t b)
+    {
+        return b ? gcd(b, a % b) : a;
+    }
+
+    /*
+     * Calculates Lowest common denominator
+     * https://en.wikipedia.org/wiki/Lowest_common_denominator
+     */
+    static constexpr uint64_t lcd(uint64_t d1, uint64_t d2)
+    {
+        return checked_mul(d1 / gcd(d1, d2), d2);
+    }
+
+    static constexpr uint64_t checked_add(uint64_t a, uint64_t b)
+    {
+        return a + b >= a ? a + b :
+            throw RationalE{"Rational: overflow in " + std::to_string(a) + " + " + std::to_string(b)};
+    }
+
+    static constexpr uint64_t checked_mul(uint64_t a, uint64_t b)
+    {
+        return !mul_high(a, b) ? a * b :
+            throw RationalE{"Rational: overflow in " + std::to_string(a) + " * " + std::to_string(b)};
+    }
+
+    // high 64 bits of the 128-bit product a * b
+#if defined(__SIZEOF_INT128__)
+    static constexpr uint64_t mul_high(uint64_t a, uint64_t b)
+    {
+        return (uint64_t)(((unsigned __int128)a * b) >> 64);
+    }
+
+    // (high * 2^64 + low) / divisor, the quotient fits in 64 bits
+    static constexpr uint64_t divide_wide(uint64_t high, uint64_t low, uint64_t divisor)
+    {
+        return (uint64_t)((((unsigned __int128)high << 64) | low) / divisor);
+    }
+#else
+    static constexpr uint64_t mul_high(uint64_t a, uint64_t b)
+    {
+        return mul_high_parts(a >> 32, a & 0xffffffff, b >> 32, b & 0xffffffff);
+    }
+
+    static constexpr uint64_t mul_high_parts(uint64_t a_high, uint64_t a_low, uint64_t b_high, uint64_t b_low)
+    {
+        return a_high * b_high + ((a_high * b_low) >> 32) + ((a_low * b_high) >> 32) +
+            ((((a_low * b_low) >> 32) + ((a_high * b_low) & 0xffffffff) + ((a_low * b_high) & 0xffffffff)) >> 32);
+    }
+
+    static constexpr uint64_t divide_wide(uint64_t high, uint64_t low, uint64_t divisor)
+    {
+        return divide_wide_bits(high, low, divisor, 0, 64);
+    }
+
+    // long division, one bit of the low half per step, the remainder is below the divisor
+    static constexpr uint64_t divide_wide_bits(uint64_t remainder, uint64_t low, uint64_t divisor,
+                                               uint64_t quotient, int bits)
+    {
+        return !bits ? quotient :
+            (remainder >> 63) || ((remainder << 1) | (low >> 63)) >= divisor ?
+                divide_wide_bits(((remainder << 1) | (low >> 63)) - divisor, low << 1, divisor,
+                                 (quotient << 1) | 1, bits - 1) :
+                divide_wide_bits((remainder << 1) | (low >> 63), low << 1, divisor, quotient << 1, bits - 1);
+    }
+#endif
+
+    // a / b < c / d
+    static constexpr bool wide_less(uint64_t a, uint64_t d, uint64_t c, uint64_t b)
+    {
+        return mul_high(a, d) != mul_high(c, b) ? mul_high(a, d) < mul_high(c, b) : a * d < c * b;
+    }
+
+    static constexpr Rational add(const Rational& num1, const Rational& num2, uint64_t denominator)
+    {
+        return Rational(checked_add(num1.m_integer, num2.m_integer),
+                        checked_add(num1.m_numerator * (denominator / num1.m_denominator),
+                                    num2.m_numerator * (denominator / num2.m_denominator)),
+                        denominator);
+    }
+
+    static constexpr Rational subtract(const Rational& num1, const Rational& num2, uint64_t denominator)
+    {
+        return num1 < num2 ?
+            throw RationalE{"Rational: negative rationals are not supported: attempted operation " +
+                            to_string(num1) + " - " + to_string(num2)} :
+            subtract_numerators(num1.m_integer - num2.m_integer,
+                                num1.m_numerator * (denominator / num1.m_denominator),
+                                num2.m_numerator * (denominator / num2.m_denominator), denominator);
+    }
+
+    static constexpr Rational subtract_numerators(uint64_t integer, uint64_t numerator1, uint64_t numerator2,
+                                                  uint64_t denominator)
+    {
+        // when the fraction of the subtrahend is larger, 1 is borrowed from the integer part
+        return numerator1 >= numerator2 ? Rational(integer, numerator1 - numerator2, denominator) :
+            Rational(integer - 1, numerator1 + (denominator - numerator2), denominator);
+    }
+
+    static constexpr Rational multiply_fractions(const Rational& num1, const Rational& num2)
+    {
+        return multiply_reduced(num1.m_numerator, num1.m_denominator, num2.m_numerator, num2.m_denominator,
+                                gcd(num1.m_numerator, num2.m_denominator), gcd(num2.m_numerator, num1.m_denominator));
+    }
+
+    static constexpr Rational multiply_reduced(uint64_t n1, uint64_t d1, uint64_t n2, uint64_t d2,
+                                               uint64_t gcd12, uint64_t gcd21)
+    {
+        // the product of the numerators is below the product of the denominators
+        return Rational(n1 / gcd12 * (n2 / gcd21), checked_mul(d1 / gcd21, d2 / gcd12));
+    }
+
+    static std::string to_string(const Rational& num);
 
     uint64_t m_integer;
     uint64_t m_numerator;
     uint64_t m_denominator;
 };
 
-template <typename T> inline T rational_cast(const Rational& a)
+/**
+ * Returns the fraction closest to @p value with a denominator up to
+ * @p max_denominator, e.g. 60000/1001 for a frame rate of 59.94.
+ *
+ * @throw RationalE if @p value is negative or too large.
+ */
+Rational rational_approximation(double value, uint64_t max_denominator = 1000000);
+
+template <typename T> constexpr T rational_cast(const Rational& a)
 {
-    T ret = static_cast<T>(a.numerator());
-    ret /= static_cast<T>(a.denominator());
-    ret += static_cast<T>(a.integer());
-    return ret;
+    return static_cast<T>(a.numerator()) / static_cast<T>(a.denominator()) + static_cast<T>(a.integer());
 }
 
 template <typename T, typename = typename std::enable_if<std::is_integral<T>::value>::type>
-Rational operator+(T a, const Rational& b)
+constexpr Rational operator+(T a, const Rational& b)
 {
     return b + a;
 }
 
 template <typename T, typename = typename std::enable_if<std::is_integral<T>::value>::type>
-Rational operator-(T a, const Rational& b)
+constexpr Rational operator-(T a, const Rational& b)
 {
     return Rational(a) - b;
 }
 
 template <typename T, typename = typename std::enable_if<std::is_integral<T>::value>::type>
-Rational operator*(T a, const Rational& b)
+constexpr Rational operator*(T a, const Rational& b)
 {
     return b * a;
 }
 
 template <typename T, typename = typename std::enable_if<std::is_integral<T>::value>::type>
-Rational operator/(T a, const Rational& b)
+constexpr Rational operator/(T a, const Rational& b)
 {
     return Rational(a) / b;
 }
 
 template <typename T, typename = typename std::enable_if<std::is_integral<T>::value>::type>
-bool operator<(T a, const Rational& b)
+constexpr bool operator<(T a, const Rational& b)
 {
     return b > a;
 }
 
 template <typename T, typename = typename std::enable_if<std::is_integral<T>::value>::type>
-bool operator<=(T a, const Rational& b)
+constexpr bool operator<=(T a, const Rational& b)
 {
     return b >= a;
 }
 
 template <typename T, typename = typename std::enable_if<std::is_integral<T>::value>::type>
-bool operator>(T a, const Rational& b)
+constexpr bool operator>(T a, const Rational& b)
 {
     return b < a;
 }
 
 template <typename T, typename = typename std::enable_if<std::is_integral<T>::value>::type>
-bool operator>=(T a, const Rational& b)
+constexpr bool operator>=(T a, const Rational& b)
 {
     return b <= a;
 }
 
 template <typename T, typename = typename std::enable_if<std::is_integral<T>::value>::type>
-bool operator==(T a, const Rational& b)
+constexpr bool operator==(T a, const Rational& b)
 {
     return b == a;
 }
 
 template <typename T, typename = typename std::enable_if<std::is_integral<T>::value>::type>
-bool operator!=(T a, const Rational& b)
+constexpr bool operator!=(T a, const Rational& b)
 {
     return b != a;
 }
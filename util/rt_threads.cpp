@@ -598,6 +598,14 @@ double time_to_rtp_timestamp(double time_ns, int sample_rate)
     return timestamp;
 }
 
+Rational time_to_rtp_timestamp(const Rational &time_ns, int sample_rate)
+{
+    Rational timestamp = time_ns * Rational((uint64_t)sample_rate,
+                                            (uint64_t)std::chrono::nanoseconds{ std::chrono::seconds{1} }.count());
+    // same margin as above
+    return timestamp - 5;
+}
+
 uint32_t convert_ip_str_to_int(const std::string& ipv4str)
 {
     struct sockaddr_in sa;
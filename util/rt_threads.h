@@ -626,6 +626,11 @@ inline uint64_t get_time_ns(void)
 }
 
 double time_to_rtp_timestamp(double time_ns, int sample_rate);
+/**
+ * Exact version of @ref time_to_rtp_timestamp: the timestamp isn't wrapped,
+ * its integer part modulo 2^32 is the RTP timestamp.
+ */
+Rational time_to_rtp_timestamp(const Rational &time_ns, int sample_rate);
 
 uint32_t convert_ip_str_to_int(const std::string& ipv4str);
 